@@ -0,0 +1,53 @@
+#ifndef EcalBadChannelMask_h
+#define EcalBadChannelMask_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "DataFormats/EcalDetId/interface/EBDetId.h"
+#include "DataFormats/EcalDetId/interface/EEDetId.h"
+#include "CondFormats/EcalObjects/interface/EcalChannelStatus.h"
+#include "CalibCode/CalibTools/interface/EcalNeighbourTable.h"
+
+class TH2F;
+
+// One byte of flags per EB and EE xtal, indexed by EB hashed index or
+// EE hashed index + EBDetId::kSizeForDenseIndexing (as EcalGeometryTable).
+// It merges the channel status from the DB, the external dead xtal map and
+// the xtals having a dead one in their 3x3 window (itself included), so the clustering checks
+// a whole window by OR-ing the flags of its xtals.
+class EcalBadChannelMask
+{
+    public:
+        static const uint32_t kSizeEB = EBDetId::kSizeForDenseIndexing;
+        static const uint32_t kSizeEE = EEDetId::kSizeForDenseIndexing;
+
+        enum Flag {
+            kChannelStatus   = 1, // status code > 0 in EcalChannelStatus
+            kDeadMap         = 2, // flagged in the external dead xtal map
+            kNeighbourOfDead = 4  // its 3x3 window contains a dead xtal (kChannelStatus or kDeadMap)
+        };
+
+        EcalBadChannelMask() : flags_(kSizeEB + kSizeEE, 0), hasChannelStatus_(false) {}
+
+        void setChannelStatus(const EcalChannelStatus& channelStatus);
+        // maps of ix,iy (EE) or iphi,ieta (EB) with 1 for dead xtals, as the rms_EB, rms_EEm, rms_EEp histograms
+        void setDeadMap(const TH2F* ebMap, const TH2F* eemMap, const TH2F* eepMap);
+        // to be called again after setChannelStatus or setDeadMap
+        void setNeighbours(const EcalNeighbourTable<EBDetId>& ebWindow, const EcalNeighbourTable<EEDetId>& eeWindow);
+
+        bool hasChannelStatus() const { return hasChannelStatus_; }
+
+        uint8_t eb(uint32_t hash) const { return flags_[hash]; }
+        uint8_t ee(uint32_t hash) const { return flags_[kSizeEB + hash]; }
+        // by combined EB+EE index
+        uint8_t flags(uint32_t index) const { return flags_[index]; }
+
+    private:
+        void clear(uint8_t flag);
+
+        std::vector<uint8_t> flags_;
+        bool hasChannelStatus_;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef EcalClusterGrid_h
+#define EcalClusterGrid_h
+
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+
+#include "TMath.h"
+#include "DataFormats/CaloRecHit/interface/CaloCluster.h"
+
+// Per-event eta-phi grid of the clusters, used to find pi0/eta photon pairs
+// without testing all the N^2/2 combinations.
+// Cluster quantities are kept as structure of arrays, indexed like the input vector.
+// Cells are at least as large as the pair DeltaR cut, so two clusters closer than
+// that are always in the same or in adjacent cells (phi wraps around).
+// Clusters beyond |eta| = etaMax go into the first/last eta row.
+class EcalClusterGrid
+{
+    public:
+        EcalClusterGrid(float minCellSize = 0.45, float etaMax = 3.5);
+
+        void fill(const std::vector<reco::CaloCluster>& clusters);
+
+        unsigned int size() const { return eta_.size(); }
+        double eta(unsigned int i) const { return eta_[i]; }
+        double phi(unsigned int i) const { return phi_[i]; }
+        double energy(unsigned int i) const { return energy_[i]; }
+        double pt(unsigned int i) const { return pt_[i]; }
+
+        // indices j > i of the clusters in the cell of i and in the adjacent ones, in increasing order
+        void pairCandidates(unsigned int i, std::vector<unsigned int>& candidates) const;
+
+        // smallest DeltaR between (eta,phi) and the clusters other than skip1 and skip2,
+        // 999 if there is none. Cells are visited in growing squares until no closer cluster can be left.
+        // With selections, only the clusters having one of the bits are considered (here and in etaBandPtSum)
+        float nearestDeltaR(float eta, float phi, unsigned int skip1, unsigned int skip2,
+                            const std::vector<uint8_t>* selections = 0, uint8_t bits = 0) const;
+
+        // index of the cluster closest to (eta,phi) among those not flagged in used, with DeltaR < maxDR
+        // (lowest index on ties, as a linear scan with a strict <), -1 if there is none
+        int nearestUnused(float eta, float phi, double maxDR, const std::vector<bool>& used) const;
+
+        // scalar sum of the pt of the clusters other than skip1 and skip2 with |Deta| <= maxDeta,
+        // DeltaR <= maxDR and pt >= ptMin around (eta,phi), added in increasing cluster index (HLT eta-band isolation)
+        float etaBandPtSum(float eta, float phi, float maxDeta, float maxDR, float ptMin, unsigned int skip1, unsigned int skip2,
+                           const std::vector<uint8_t>* selections = 0, uint8_t bits = 0) const;
+
+        // same arithmetic as FillEpsilonPlot::DeltaPhi and FillEpsilonPlot::GetDeltaR
+        static float deltaPhi(float phi1, float phi2)
+        {
+            float diff = phi2 - phi1;
+            while (diff > TMath::Pi()) diff -= 2.*TMath::Pi();
+            while (diff <= -TMath::Pi()) diff += 2.*TMath::Pi();
+            return diff;
+        }
+        static float deltaR(float eta1, float eta2, float phi1, float phi2)
+        {
+            return std::sqrt( (eta1-eta2)*(eta1-eta2) + deltaPhi(phi1, phi2)*deltaPhi(phi1, phi2) );
+        }
+
+    private:
+        int etaCell(double eta) const;
+        int phiCell(double phi) const;
+        // cells of the (2k+1)x(2k+1) square around (ie0,ip0), each phi cell only once
+        void cellsAround(int ie0, int ip0, int k, std::vector<int>& cells) const;
+
+        float etaMax_;
+        int nEta_;
+        int nPhi_;
+        double etaCellSize_;
+        double phiCellSize_;
+
+        std::vector<double> eta_, phi_, energy_, pt_;
+        std::vector<int> cell_;             // cell of each cluster
+        std::vector<unsigned int> cellStart_; // clusters of cell c are cellItems_[cellStart_[c]..cellStart_[c+1]]
+        std::vector<unsigned int> cellItems_; // cluster indices, increasing within each cell
+        std::vector<unsigned int> cellNext_;
+        mutable std::vector<int> cellBuffer_;
+        mutable std::vector<unsigned int> indexBuffer_;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef EcalEventStore_h
+#define EcalEventStore_h
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "CalibCode/CalibTools/interface/EcalHitRecord.h"
+
+class TFile;
+class TTree;
+class TChain;
+class TBranch;
+
+// What FillEpsilonPlot reads from an event, besides the rechits
+struct EcalEventStoreHeader
+{
+    EcalEventStoreHeader() : run(0), lumi(0), event(0), bx(0), ebHLT(true), eeHLT(true) {}
+
+    uint32_t run;
+    uint32_t lumi;
+    uint64_t event;
+    int32_t bx;
+    bool ebHLT;
+    bool eeHLT;
+    std::vector<uint16_t> l1Seeds; // bits of the stream L1 seeds that fired
+};
+
+// Columnar dump of the EB, EE and ES rechits of the selected events, in one
+// TTree with a variable length array per quantity (hashed index, energy, time, flags),
+// so each column is compressed in its own baskets and can be read alone.
+// Files are written with LZ4, which decompresses at close to disk speed.
+class EcalEventStoreWriter
+{
+    public:
+        EcalEventStoreWriter() : file_(0), tree_(0) {}
+        ~EcalEventStoreWriter() { close(); }
+
+        void open(const std::string& fileName);
+        bool isOpen() const { return file_ != 0; }
+        void fill(const EcalEventStoreHeader& header, const std::vector<EcalHitRecord>& eb,
+                  const std::vector<EcalHitRecord>& ee, const std::vector<EcalHitRecord>& es);
+        void close();
+
+    private:
+        struct Columns
+        {
+            uint32_t n;
+            std::vector<uint32_t> hash;
+            std::vector<float> energy;
+            std::vector<float> time;
+            std::vector<uint32_t> flags;
+            TBranch* branches[4];
+        };
+        void book(Columns& columns, const char* prefix);
+        void copy(Columns& columns, const std::vector<EcalHitRecord>& records);
+
+        TFile* file_;
+        TTree* tree_;
+        EcalEventStoreHeader header_;
+        uint32_t nL1_;
+        std::vector<uint16_t> l1Seeds_;
+        TBranch* l1Branch_;
+        Columns eb_, ee_, es_;
+};
+
+// Reads one or more stores in sequence. The ES columns are not read if readES is false.
+class EcalEventStoreReader
+{
+    public:
+        static const uint32_t kMaxL1Seeds = 512;
+
+        EcalEventStoreReader(const std::vector<std::string>& fileNames, bool readES = true);
+        ~EcalEventStoreReader();
+
+        int64_t entries() const;
+        void read(int64_t entry);
+
+        const EcalEventStoreHeader& header() const { return header_; }
+        const std::vector<EcalHitRecord>& eb() const { return eb_.records; }
+        const std::vector<EcalHitRecord>& ee() const { return ee_.records; }
+        const std::vector<EcalHitRecord>& es() const { return es_.records; }
+
+    private:
+        struct Columns
+        {
+            uint32_t n;
+            std::vector<uint32_t> hash;
+            std::vector<float> energy;
+            std::vector<float> time;
+            std::vector<uint32_t> flags;
+            std::vector<EcalHitRecord> records;
+        };
+        void attach(Columns& columns, const char* prefix, uint32_t maxHits);
+        void toRecords(Columns& columns);
+
+        TChain* chain_;
+        bool readES_;
+        EcalEventStoreHeader header_;
+        uint32_t run_, lumi_;
+        unsigned long long event_;
+        int32_t bx_;
+        bool ebHLT_, eeHLT_;
+        uint32_t nL1_;
+        uint16_t l1Seeds_[kMaxL1Seeds];
+        Columns eb_, ee_, es_;
+};
+
+#endif
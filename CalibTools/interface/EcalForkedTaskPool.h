@@ -0,0 +1,38 @@
+#ifndef EcalForkedTaskPool_h
+#define EcalForkedTaskPool_h
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Runs task(i) for i in [begin, end) in nWorkers forked processes: worker w takes the indices
+// begin+w, begin+w+nWorkers, ... and sends the result of each (bytes filled by the task) through
+// its pipe. read(i), called with increasing i, returns the result of task i while the workers
+// go on with the following ones. Each worker has its own copy of the process (fit models,
+// gDirectory, canvases): it is for code that cannot run in threads, such as RooFit fits.
+// The pool must be made while the process runs a single thread.
+class EcalForkedTaskPool
+{
+    public:
+        typedef std::function<void(int, std::string&)> Task;
+
+        EcalForkedTaskPool(int begin, int end, unsigned int nWorkers, const Task& task);
+        // stops the workers still running
+        ~EcalForkedTaskPool();
+
+        // result of task i, throws if the task or its worker failed
+        void read(int i, std::string& result);
+
+    private:
+        static void runWorker(int fd, int first, int end, int step, const Task& task);
+        void stop();
+
+        int begin_;
+        int end_;
+        std::vector<pid_t> pids_;
+        std::vector<int> fds_;        // read end of the pipe of each worker
+        std::vector<int> nextIndex_;  // next task to read from each worker
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef EcalGeometryTable_h
+#define EcalGeometryTable_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "DataFormats/GeometryVector/interface/GlobalPoint.h"
+#include "DataFormats/DetId/interface/DetId.h"
+#include "DataFormats/EcalDetId/interface/EBDetId.h"
+#include "DataFormats/EcalDetId/interface/EEDetId.h"
+
+class ECALGeometry;
+class CaloGeometry;
+
+// Flat per-crystal geometry (structure of arrays) for EB and EE.
+// Index is the EB hashed index, or EE hashed index + EBDetId::kSizeForDenseIndexing.
+// Positions follow ECALGeometry::getPosition and TruncatedPyramid::getPosition:
+// front face center + depth * unit axis.
+class EcalGeometryTable
+{
+    public:
+        static const uint32_t kSizeEB = EBDetId::kSizeForDenseIndexing;
+        static const uint32_t kSizeEE = EEDetId::kSizeForDenseIndexing;
+        static const uint32_t kSize = kSizeEB + kSizeEE;
+
+        EcalGeometryTable() : isFilled_(false) {}
+
+        void fill(const ECALGeometry* geom);
+        void fill(const CaloGeometry* geom);
+        bool isFilled() const { return isFilled_; }
+
+        static uint32_t index(const EBDetId& id) { return id.hashedIndex(); }
+        static uint32_t index(const EEDetId& id) { return kSizeEB + id.hashedIndex(); }
+        static uint32_t index(const DetId& id) {
+            return id.subdetId() == EcalBarrel ? index(EBDetId(id)) : index(EEDetId(id));
+        }
+
+        // distance of the front face from the origin
+        float frontDistance(uint32_t i) const { return front_[i]; }
+        // sin(theta) of the front face center, used for Et thresholds
+        float sinTheta(uint32_t i) const { return sinTheta_[i]; }
+
+        GlobalPoint position(uint32_t i, float depth = 0.) const {
+            return GlobalPoint(posX_[i] + depth*axisX_[i], posY_[i] + depth*axisY_[i], posZ_[i] + depth*axisZ_[i]);
+        }
+
+    private:
+        void resize();
+        void set(uint32_t i, const GlobalPoint& pos, const GlobalVector& axis);
+
+        bool isFilled_;
+        std::vector<float> posX_, posY_, posZ_;
+        std::vector<float> axisX_, axisY_, axisZ_;
+        std::vector<float> front_;
+        std::vector<float> sinTheta_;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef EcalHitRecord_h
+#define EcalHitRecord_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "DataFormats/EcalRecHit/interface/EcalRecHitCollections.h"
+
+// What the pi0 clustering uses of an EcalRecHit, without the framework:
+// hashed index of its EBDetId, EEDetId or ESDetId, energy, time and flag bits.
+struct EcalHitRecord
+{
+    uint32_t hash;
+    float energy;
+    float time;
+    uint32_t flags;
+};
+
+// records of a rechit collection, in the order of the collection
+template<class DetIdType>
+void fillHitRecords(const EcalRecHitCollection& recHits, std::vector<EcalHitRecord>& records)
+{
+    records.resize(recHits.size());
+    std::vector<EcalHitRecord>::iterator rec = records.begin();
+    for(EcalRecHitCollection::const_iterator it = recHits.begin(); it != recHits.end(); ++it, ++rec) {
+        rec->hash = DetIdType(it->id()).hashedIndex();
+        rec->energy = it->energy();
+        rec->time = it->time();
+        rec->flags = it->flagsBits();
+    }
+}
+
+#endif
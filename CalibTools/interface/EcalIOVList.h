@@ -0,0 +1,45 @@
+#ifndef EcalIOVList_h
+#define EcalIOVList_h
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Intervals of validity given by the run and lumi section where each of them starts:
+// an IOV lasts until the next one starts, the last one until the end of the data.
+// Lumi sections before the first boundary belong to no IOV.
+// The lookup is a binary search on the sorted boundaries, skipped while the lumi section
+// stays inside the IOV found last (consecutive events mostly share their lumi section).
+class EcalIOVList
+{
+    public:
+        EcalIOVList() : cachedIOV_(-1), cachedBegin_(1), cachedEnd_(0) {}
+
+        // boundaries as "run" (from its first lumi section) or "run:lumi", in any order
+        void configure(const std::vector<std::string>& boundaries);
+
+        size_t size() const { return starts_.size(); }
+
+        // index of the IOV of the lumi section, -1 if before the first boundary
+        int find(uint32_t run, uint32_t lumi)
+        {
+            const uint64_t key = (uint64_t(run) << 32) | lumi;
+            if(key >= cachedBegin_ && key < cachedEnd_) return cachedIOV_;
+            return lookup(key);
+        }
+
+        uint32_t firstRun(size_t iov) const { return starts_[iov] >> 32; }
+        uint32_t firstLumi(size_t iov) const { return starts_[iov] & 0xffffffff; }
+        // "run:lumi" where the IOV starts
+        std::string label(size_t iov) const;
+
+    private:
+        int lookup(uint64_t key);
+
+        std::vector<uint64_t> starts_;   // run << 32 | lumi, sorted
+        int cachedIOV_;
+        uint64_t cachedBegin_;           // [cachedBegin_, cachedEnd_) belongs to cachedIOV_
+        uint64_t cachedEnd_;
+};
+
+#endif
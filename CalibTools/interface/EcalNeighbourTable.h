@@ -0,0 +1,100 @@
+#ifndef EcalNeighbourTable_h
+#define EcalNeighbourTable_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "Geometry/CaloTopology/interface/CaloTopology.h"
+#include "DataFormats/EcalDetId/interface/EBDetId.h"
+#include "DataFormats/EcalDetId/interface/EEDetId.h"
+#include "CalibCode/CalibTools/interface/GlobalFunctions.h"
+
+// distance in xtals between the seed and another xtal of its window,
+// as used for the S4/S9 quadrants (seed - xtal)
+inline void windowOffset(const EBDetId& seed, const EBDetId& id, int& dx, int& dy)
+{
+    int seed_ieta = seed.ieta(), seed_iphi = seed.iphi();
+    int ieta = id.ieta(), iphi = id.iphi();
+    convxtalid(seed_iphi, seed_ieta);
+    convxtalid(iphi, ieta);
+    dx = diff_neta_s(seed_ieta, ieta);
+    dy = diff_nphi_s(seed_iphi, iphi);
+}
+
+inline void windowOffset(const EEDetId& seed, const EEDetId& id, int& dx, int& dy)
+{
+    dx = seed.ix() - id.ix();
+    dy = seed.iy() - id.iy();
+}
+
+// NxN window of every EB or EE xtal, indexed by hashed index.
+// Each window has N*N slots filled in the order of CaloTopology::getWindow
+// and padded with kNoXtal at the end (eta edges of EB, border of EE).
+// The offset of each xtal with respect to the central one is stored too,
+// so phi wrap-around and EE edges cost nothing when the table is used.
+template<class DetIdType>
+class EcalNeighbourTable
+{
+    public:
+        static const uint32_t kNoXtal = 0xFFFFFFFF;
+        static const int kMaxSlots = 25; // up to 5x5
+
+        EcalNeighbourTable() : size_(0), nSlots_(0) {}
+
+        void fill(const CaloTopology* topology, int windowSize)
+        {
+            if(windowSize*windowSize > kMaxSlots)
+                throw cms::Exception("EcalNeighbourTable") << "window size " << windowSize << " not supported\n";
+            size_ = windowSize;
+            nSlots_ = windowSize*windowSize;
+            const uint32_t nXtals = DetIdType::kSizeForDenseIndexing;
+            hashes_.assign(nXtals*nSlots_, kNoXtal);
+            dx_.assign(nXtals*nSlots_, 0);
+            dy_.assign(nXtals*nSlots_, 0);
+
+            for(uint32_t h=0; h<nXtals; ++h) {
+                DetIdType seed = DetIdType::unhashIndex(h);
+                std::vector<DetId> window = topology->getWindow(seed, windowSize, windowSize);
+                if((int)window.size() > nSlots_)
+                    throw cms::Exception("EcalNeighbourTable") << "window larger than " << nSlots_ << " xtals\n";
+                for(unsigned int k=0; k<window.size(); ++k) {
+                    DetIdType id(window[k]);
+                    int dx, dy;
+                    windowOffset(seed, id, dx, dy);
+                    hashes_[h*nSlots_+k] = id.hashedIndex();
+                    dx_[h*nSlots_+k] = dx;
+                    dy_[h*nSlots_+k] = dy;
+                }
+            }
+        }
+
+        int windowSize() const { return size_; }
+        int slots() const { return nSlots_; }
+
+        // first slot of the window around xtal with hashed index h
+        const uint32_t* window(uint32_t h) const { return &hashes_[h*nSlots_]; }
+        const int8_t* dx(uint32_t h) const { return &dx_[h*nSlots_]; }
+        const int8_t* dy(uint32_t h) const { return &dy_[h*nSlots_]; }
+
+        // number of xtals shared by the windows around h1 and h2
+        int overlap(uint32_t h1, uint32_t h2) const
+        {
+            const uint32_t* w1 = window(h1);
+            const uint32_t* w2 = window(h2);
+            int n = 0;
+            for(int i=0; i<nSlots_ && w2[i]!=kNoXtal; ++i)
+                for(int j=0; j<nSlots_ && w1[j]!=kNoXtal; ++j)
+                    if(w1[j]==w2[i]) { ++n; break; }
+            return n;
+        }
+
+    private:
+        int size_;
+        int nSlots_;
+        std::vector<uint32_t> hashes_;
+        std::vector<int8_t> dx_;
+        std::vector<int8_t> dy_;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef EcalPi0CandidateReplay_h
+#define EcalPi0CandidateReplay_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "DataFormats/Math/interface/Point3D.h"
+#include "CalibCode/CalibTools/interface/EcalPi0CandidateStore.h"
+#include "CalibCode/CalibTools/interface/EcalPi0Clustering.h"
+#include "CalibCode/CalibTools/interface/EcalPi0PairSelection.h"
+#include "CalibCode/CalibTools/interface/EcalRegionalCalibration.h"
+#include "CalibCode/CalibTools/interface/EcalRegionHistogram.h"
+
+// Reprocesses a candidate store with a new IC map: the 3x3 energies are recalibrated,
+// then positions, photon cuts, pair kinematics and pair cuts are recomputed as in
+// FillEpsilonPlot and the accepted pairs fill the region histograms.
+// Work is done one block at a time, each step over flat arrays: xtal energies,
+// photons, then pairs. The pair cuts are those of EcalMesonSelection, as in EcalPi0PairSelection.
+// Differences with a full pass: the windows and used xtals are those of the iteration
+// that wrote the store, a photon can only be lost (not gained) by the new cuts, the
+// isolation sums keep the pt of the neighbours at that iteration, and neither the
+// containment corrections nor the eta-ring/SM expansion of the fills are applied.
+class EcalPi0CandidateReplay
+{
+    public:
+        EcalPi0CandidateReplay() : geometry_(0), ebWindow_(0), eeWindow_(0), useMassInsteadOfEpsilon_(false), nRead_(0), nAccepted_(0) {}
+
+        // the tables are not copied and must stay alive
+        void setTables(const EcalGeometryTable* geometry, const EcalNeighbourTable<EBDetId>* ebWindow, const EcalNeighbourTable<EEDetId>* eeWindow)
+        {
+            geometry_ = geometry;
+            ebWindow_ = ebWindow;
+            eeWindow_ = eeWindow;
+        }
+        void setParameters(const EcalPi0ClusteringParameters& eb, const EcalPi0ClusteringParameters& ee,
+                           const EcalMesonSelection& selection, bool useMassInsteadOfEpsilon)
+        {
+            eb_ = eb;
+            ee_ = ee;
+            selection_ = selection;
+            useMassInsteadOfEpsilon_ = useMassInsteadOfEpsilon;
+        }
+        // intercalibration of every xtal by EcalGeometryTable index, uncalibrated energies if map is null
+        void setCalibration(EcalCalibMapBase* map);
+
+        // ebHistogram and eeHistogram may be null, weights from calibration
+        void run(const EcalPi0CandidateBlock& block, EcalRegionalCalibrationBase& calibration,
+                 EcalRegionHistogram* ebHistogram, EcalRegionHistogram* eeHistogram);
+
+        uint64_t nRead() const { return nRead_; }
+        uint64_t nAccepted() const { return nAccepted_; }
+
+    private:
+        template<class DetIdType>
+        void computePhoton(const EcalPi0CandidateBlock& block, uint32_t p, const EcalNeighbourTable<DetIdType>* window,
+                           const EcalPi0ClusteringParameters& par);
+
+        const EcalGeometryTable* geometry_;
+        const EcalNeighbourTable<EBDetId>* ebWindow_;
+        const EcalNeighbourTable<EEDetId>* eeWindow_;
+        EcalPi0ClusteringParameters eb_, ee_;
+        EcalMesonSelection selection_;
+        bool useMassInsteadOfEpsilon_;
+        std::vector<float> ic_;
+
+        // per xtal and per photon of the current block
+        std::vector<float> calibrated_;
+        std::vector<float> energy_;
+        std::vector<math::XYZPoint> position_;
+        std::vector<bool> passes_;
+
+        uint64_t nRead_;
+        uint64_t nAccepted_;
+};
+
+#endif
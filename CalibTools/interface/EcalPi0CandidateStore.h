@@ -0,0 +1,101 @@
+#ifndef EcalPi0CandidateStore_h
+#define EcalPi0CandidateStore_h
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class TFile;
+class TTree;
+class TChain;
+
+// A photon of a preselected pair, as found by the 3x3 clustering
+struct EcalPi0CandidatePhoton
+{
+    static const uint32_t kMaxXtals = 9;
+
+    uint32_t seed;               // hashed index
+    uint32_t nXtal;
+    uint32_t hash[kMaxXtals];
+    float energy[kMaxXtals];     // uncalibrated
+    float es1, es2;              // ES energy (MIPs) of the two planes, -999 if not matched (always for EB)
+    float esX, esY, esZ;         // position from the ES clusters, when matched
+};
+
+// A photon pair passing the DeltaR and uncorrected mass preselection of computeEpsilon
+struct EcalPi0Candidate
+{
+    uint32_t run;
+    uint32_t lumi;
+    uint64_t event;
+    bool ebHLT;
+    bool eeHLT;
+    bool isEB;
+    float nextClu;               // DeltaR of the closest other cluster
+    float isoPtSum;              // HLT eta-band isolation, not yet divided by the pair pt
+    EcalPi0CandidatePhoton g1, g2;
+};
+
+// Candidates of many events in columns, photons and xtals flattened:
+// photon 2k and 2k+1 belong to candidate k, the xtals of photon p are [firstXtal[p], firstXtal[p]+nXtal[p]).
+struct EcalPi0CandidateBlock
+{
+    void clear();
+    size_t size() const { return isEB.size(); }
+    void push_back(const EcalPi0Candidate& candidate);
+
+    // per candidate
+    std::vector<uint32_t> run, lumi;
+    std::vector<uint64_t> event;
+    std::vector<bool> ebHLT, eeHLT, isEB;
+    std::vector<float> nextClu, isoPtSum;
+    // per photon
+    std::vector<uint32_t> seed;
+    std::vector<uint32_t> firstXtal, nXtal;
+    std::vector<float> es1, es2, esX, esY, esZ;
+    // per xtal
+    std::vector<uint32_t> hash;
+    std::vector<float> energy;
+};
+
+// One TTree entry per candidate, written with LZ4 like EcalEventStoreWriter
+class EcalPi0CandidateStoreWriter
+{
+    public:
+        EcalPi0CandidateStoreWriter() : file_(0), tree_(0) {}
+        ~EcalPi0CandidateStoreWriter() { close(); }
+
+        void open(const std::string& fileName);
+        bool isOpen() const { return file_ != 0; }
+        void fill(const EcalPi0Candidate& candidate);
+        void close();
+
+    private:
+        void book(EcalPi0CandidatePhoton& photon, const char* prefix);
+
+        TFile* file_;
+        TTree* tree_;
+        EcalPi0Candidate candidate_;
+};
+
+class EcalPi0CandidateStoreReader
+{
+    public:
+        EcalPi0CandidateStoreReader(const std::vector<std::string>& fileNames);
+        ~EcalPi0CandidateStoreReader();
+
+        int64_t entries() const;
+        // next maxCandidates candidates (less at the end), false when all were read
+        bool readBlock(EcalPi0CandidateBlock& block, size_t maxCandidates);
+        void rewind() { next_ = 0; }
+
+    private:
+        void attach(EcalPi0CandidatePhoton& photon, const char* prefix);
+
+        TChain* chain_;
+        int64_t next_;
+        EcalPi0Candidate candidate_;
+        unsigned long long event_;
+};
+
+#endif
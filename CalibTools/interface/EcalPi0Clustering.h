@@ -0,0 +1,312 @@
+#ifndef EcalPi0Clustering_h
+#define EcalPi0Clustering_h
+
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdint.h>
+
+#include "DataFormats/Math/interface/Point3D.h"
+#include "CalibCode/CalibTools/interface/EcalHitRecord.h"
+#include "CalibCode/CalibTools/interface/EcalRecHitCompare.h"
+#include "CalibCode/CalibTools/interface/EcalNeighbourTable.h"
+#include "CalibCode/CalibTools/interface/EcalGeometryTable.h"
+#include "CalibCode/CalibTools/interface/EcalBadChannelMask.h"
+#include "CalibCode/CalibTools/interface/EcalCalibMap.h"
+#include "CalibCode/CalibTools/interface/PosCalcParams.h"
+
+// seed thresholds and single photon cuts of the 3x3 clustering
+struct EcalPi0ClusteringParameters
+{
+    EcalPi0ClusteringParameters() :
+        seedEnergy(0.), useSeedEt(false), seedEt(0.), etaBoundary(0.),
+        s4s9Low(0.), s4s9High(0.), nXtalLow(0.), nXtalHigh(0.), ptLow(0.), ptHigh(0.),
+        removeSeedsCloseToDead(false), deadXtalFlags(0), T0(0.) {}
+
+    double seedEnergy;
+    bool useSeedEt;            // seed threshold on E*sin(theta) of the xtal instead of E
+    double seedEt;
+    double etaBoundary;        // |eta| of the cluster below which the low cuts apply
+    double s4s9Low, s4s9High;
+    double nXtalLow, nXtalHigh;
+    double ptLow, ptHigh;
+    bool removeSeedsCloseToDead;
+    uint8_t deadXtalFlags;     // EcalBadChannelMask flags rejecting a window
+    float T0;                  // shower depth parameter (barrel or endcap)
+    PosCalcParams position;
+};
+
+struct EcalPi0Cluster
+{
+    float energy;              // calibrated 3x3 energy
+    math::XYZPoint position;
+    uint32_t seed;             // hashed index
+    float seedEnergy;          // uncalibrated
+    unsigned int nXtal;
+    float s4s9;
+    unsigned int firstHit;     // its 3x3 xtals are hits()[firstHit, firstHit+nHits)
+    unsigned int nHits;
+    uint8_t selections;        // bit s set if built with the parameters s
+};
+
+// The 3x3 clustering of FillEpsilonPlot for EB (EBDetId) or EE (EEDetId), without the framework:
+// it runs on EcalHitRecord arrays with the precomputed windows, geometry, bad channel mask
+// and intercalibration of every xtal. Seeds are taken in decreasing energy, each xtal
+// goes into one cluster at most.
+// With several parameter sets (one per meson selection), each set clusters the event as if
+// it were alone and the clusters are the union of those, a cluster built identically by
+// several sets being kept once: the clusters of set s are those with bit s, in their own order.
+template<class DetIdType>
+class EcalPi0Clustering
+{
+    public:
+        static const uint32_t kSize = DetIdType::kSizeForDenseIndexing;
+        static const int32_t kNoHit = -1;
+
+        EcalPi0Clustering() :
+            window_(0), geometry_(0), mask_(0),
+            slot_(kSize, kNoHit), used_(kSize, false) {}
+
+        // the tables are not copied and must stay alive
+        void setTables(const EcalNeighbourTable<DetIdType>* window, const EcalGeometryTable* geometry, const EcalBadChannelMask* mask)
+        {
+            window_ = window;
+            geometry_ = geometry;
+            mask_ = mask;
+        }
+
+        void setParameters(const EcalPi0ClusteringParameters& parameters) { par_.assign(1, parameters); }
+        // one set per selection, at most 8; the seed thresholds are those of the first set
+        void setParameters(const std::vector<EcalPi0ClusteringParameters>& parameters) { par_ = parameters; }
+
+        // intercalibration of every xtal, uncalibrated energies if map is null (E/Etrue)
+        void setCalibration(EcalCalibMapBase* map)
+        {
+            ic_.clear();
+            if(!map) return;
+            ic_.resize(kSize);
+            for(uint32_t h=0; h<kSize; ++h) ic_[h] = map->coeff(DetIdType::unhashIndex(h));
+        }
+        void setCalibration(const std::vector<float>& ic) { ic_ = ic; }
+
+        // clusters of one event, hits in the order of the rechit collection
+        void run(const EcalHitRecord* hits, uint32_t nHits);
+
+        const std::vector<EcalPi0Cluster>& clusters() const { return clusters_; }
+        // (hashed index, calibrated energy) of the xtals of all the clusters
+        const std::vector<std::pair<uint32_t,float> >& hits() const { return hits_; }
+        unsigned int nSeeds() const { return seeds_.size(); }
+        // position in the input of the last run of the hit of a xtal, kNoHit if it had none
+        int32_t hitIndex(uint32_t hash) const { return slot_[hash]; }
+
+    private:
+        // index in EcalGeometryTable and EcalBadChannelMask
+        static uint32_t denseIndex(uint32_t hash) { return DetIdType::Subdet == EcalEndcap ? EcalGeometryTable::kSizeEB + hash : hash; }
+        // clusters of the parameters s, with the seeds of the event
+        void makeClusters(const EcalHitRecord* hits, size_t s);
+        // index of a cluster of an earlier parameter set equal to the last one, -1 if there is none
+        int sameCluster(const EcalPi0Cluster& cluster) const;
+
+        const EcalNeighbourTable<DetIdType>* window_;
+        const EcalGeometryTable* geometry_;
+        const EcalBadChannelMask* mask_;
+        std::vector<EcalPi0ClusteringParameters> par_;
+        std::vector<float> ic_;
+
+        // per event
+        std::vector<int32_t> slot_;  // position in the input of the hit of each xtal
+        std::vector<bool> used_;
+        std::vector<uint32_t> filled_;
+        std::vector<EcalSeedCandidate> seeds_;
+        std::vector<EcalPi0Cluster> clusters_;
+        std::vector<std::pair<uint32_t,float> > hits_;
+        std::vector<int32_t> seedCluster_;  // with several parameter sets: last cluster of each seed
+        std::vector<int32_t> previousOfSeed_; // by cluster, the one before with the same seed
+};
+
+template<class DetIdType>
+void EcalPi0Clustering<DetIdType>::run(const EcalHitRecord* hits, uint32_t nHits)
+{
+    for(std::vector<uint32_t>::const_iterator it = filled_.begin(); it != filled_.end(); ++it) {
+        slot_[*it] = kNoHit;
+        used_[*it] = false;
+        if(!seedCluster_.empty()) seedCluster_[*it] = -1;
+    }
+    filled_.clear();
+    seeds_.clear();
+    clusters_.clear();
+    hits_.clear();
+    previousOfSeed_.clear();
+    if(par_.size() > 1 && seedCluster_.empty()) seedCluster_.assign(kSize, -1);
+
+    // sort by energy and find the seeds
+    const EcalPi0ClusteringParameters& par = par_[0];
+    for(uint32_t i=0; i<nHits; ++i) {
+        slot_[hits[i].hash] = i;
+        filled_.push_back(hits[i].hash);
+        if(par.useSeedEt) {
+            if(hits[i].energy*geometry_->sinTheta(denseIndex(hits[i].hash)) > par.seedEt)
+                seeds_.push_back(EcalSeedCandidate(hits[i].energy, hits[i].hash));
+        } else {
+            if(hits[i].energy > par.seedEnergy)
+                seeds_.push_back(EcalSeedCandidate(hits[i].energy, hits[i].hash));
+        }
+    }
+    std::sort(seeds_.begin(), seeds_.end(), ecalSeedCandidateLess());
+
+    for(size_t s=0; s<par_.size(); ++s) {
+        if(s > 0) {
+            for(std::vector<uint32_t>::const_iterator it = filled_.begin(); it != filled_.end(); ++it) used_[*it] = false;
+        }
+        makeClusters(hits, s);
+    }
+}
+
+template<class DetIdType>
+int EcalPi0Clustering<DetIdType>::sameCluster(const EcalPi0Cluster& cluster) const
+{
+    for(int32_t c = seedCluster_[cluster.seed]; c >= 0; c = previousOfSeed_[c]) {
+        const EcalPi0Cluster& other = clusters_[c];
+        if(other.energy != cluster.energy || other.position != cluster.position || other.nXtal != cluster.nXtal
+           || other.s4s9 != cluster.s4s9 || other.nHits != cluster.nHits) continue;
+        if(std::equal(hits_.begin() + cluster.firstHit, hits_.begin() + cluster.firstHit + cluster.nHits, hits_.begin() + other.firstHit))
+            return c;
+    }
+    return -1;
+}
+
+template<class DetIdType>
+void EcalPi0Clustering<DetIdType>::makeClusters(const EcalHitRecord* hits, size_t s)
+{
+    const EcalPi0ClusteringParameters& par = par_[s];
+
+    // loop over seeds and make clusters
+    for(std::vector<EcalSeedCandidate>::const_iterator itseed = seeds_.begin(); itseed != seeds_.end(); ++itseed)
+    {
+        const uint32_t seed = itseed->second;
+        // check if seed already in use. If so go to next seed
+        if(used_[seed]) continue;
+        if(par.removeSeedsCloseToDead && (mask_->flags(denseIndex(seed)) & EcalBadChannelMask::kNeighbourOfDead)) continue;
+
+        // 3x3 matrix of xtals (precomputed, padded with kNoXtal)
+        const uint32_t* clus_v = window_->window(seed);
+        const int8_t* clus_dx = window_->dx(seed);
+        const int8_t* clus_dy = window_->dy(seed);
+
+        // xtals actually used after removing those already used, with their distance from the seed
+        uint32_t inWindow[EcalNeighbourTable<DetIdType>::kMaxSlots];
+        int inWindowDx[EcalNeighbourTable<DetIdType>::kMaxSlots];
+        int inWindowDy[EcalNeighbourTable<DetIdType>::kMaxSlots];
+        unsigned int nInWindow = 0;
+
+        float simple_energy = 0.;
+        float posTotalEnergy = 0.; // only positive energies for the position
+        uint8_t windowFlags = 0;
+
+        for(int i_clus=0; i_clus<window_->slots() && clus_v[i_clus]!=EcalNeighbourTable<DetIdType>::kNoXtal; i_clus++)
+        {
+            if(used_[clus_v[i_clus]]) continue;
+            if(slot_[clus_v[i_clus]] == kNoHit) continue; // no rechit
+
+            const float energy = hits[slot_[clus_v[i_clus]]].energy;
+            inWindow[nInWindow] = clus_v[i_clus];
+            inWindowDx[nInWindow] = clus_dx[i_clus];
+            inWindowDy[nInWindow] = clus_dy[i_clus];
+            nInWindow++;
+            windowFlags |= mask_->flags(denseIndex(clus_v[i_clus]));
+
+            simple_energy += energy;
+            if(energy>0.) posTotalEnergy += energy;
+        }
+
+        if(simple_energy <= 0) continue;
+
+        // skip the cluster if one of its xtals is dead
+        if(windowFlags & par.deadXtalFlags) continue;
+
+        float s4s9_tmp[4] = {0., 0., 0., 0.};
+        float e3x3 = 0.;
+        unsigned int firstHit = hits_.size();
+
+        // weighted average of the xtal positions at the shower depth
+        float xclu = 0., yclu = 0., zclu = 0.;
+        float total_weight = 0.;
+        float maxDepth = par.position.param_X0_ * ( par.T0 + std::log( posTotalEnergy ) );
+        float maxToFront = geometry_->frontDistance( denseIndex(seed) );
+
+        for(unsigned int j=0; j<nInWindow; j++)
+        {
+            float en = hits[slot_[inWindow[j]]].energy;
+            if(!ic_.empty()) en *= ic_[inWindow[j]];
+
+            int dx = inWindowDx[j];
+            int dy = inWindowDy[j];
+            if(std::abs(dx)<=1 && std::abs(dy)<=1)
+            {
+                e3x3 += en;
+                if(dx <= 0 && dy <=0){ s4s9_tmp[0] += en; }
+                if(dx >= 0 && dy <=0){ s4s9_tmp[1] += en; }
+                if(dx <= 0 && dy >=0){ s4s9_tmp[2] += en; }
+                if(dx >= 0 && dy >=0){ s4s9_tmp[3] += en; }
+                hits_.push_back(std::make_pair(inWindow[j], en));
+            }
+
+            if(en>0.)
+            {
+                float weight = std::max( float(0.), par.position.param_W0_ + std::log(en/posTotalEnergy) );
+                uint32_t igeo = denseIndex(inWindow[j]);
+                float pos_geo = geometry_->frontDistance(igeo);
+                float depth = maxDepth + maxToFront - pos_geo;
+                GlobalPoint posThis = geometry_->position(igeo, depth);
+                xclu += weight*posThis.x();
+                yclu += weight*posThis.y();
+                zclu += weight*posThis.z();
+                total_weight += weight;
+            }
+        }
+
+        float e2x2 = *std::max_element(s4s9_tmp, s4s9_tmp+4);
+        float s4s9 = e2x2/e3x3;
+        float inv_total_weight = 1./total_weight;
+        math::XYZPoint clusPos( xclu * inv_total_weight, yclu * inv_total_weight, zclu * inv_total_weight );
+
+        // single photon cuts
+        bool low = std::fabs( clusPos.eta() ) < par.etaBoundary;
+        if( s4s9 < (low ? par.s4s9Low : par.s4s9High) || nInWindow < (low ? par.nXtalLow : par.nXtalHigh) ) {
+            hits_.resize(firstHit);
+            continue;
+        }
+        float ptClus = e3x3*std::sin(clusPos.Theta());
+        if( ptClus < (low ? par.ptLow : par.ptHigh) ) {
+            hits_.resize(firstHit);
+            continue;
+        }
+
+        for(unsigned int j=0; j<nInWindow; j++) used_[inWindow[j]] = true;
+
+        EcalPi0Cluster cluster;
+        cluster.energy = e3x3;
+        cluster.position = clusPos;
+        cluster.seed = seed;
+        cluster.seedEnergy = itseed->first;
+        cluster.nXtal = nInWindow;
+        cluster.s4s9 = s4s9;
+        cluster.firstHit = firstHit;
+        cluster.nHits = hits_.size() - firstHit;
+        cluster.selections = 1 << s;
+        if(par_.size() > 1) {
+            int same = s > 0 ? sameCluster(cluster) : -1;
+            if(same >= 0) {
+                clusters_[same].selections |= cluster.selections;
+                hits_.resize(firstHit);
+                continue;
+            }
+            previousOfSeed_.push_back(seedCluster_[seed]);
+            seedCluster_[seed] = clusters_.size();
+        }
+        clusters_.push_back(cluster);
+    }
+}
+
+#endif
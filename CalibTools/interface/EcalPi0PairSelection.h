@@ -0,0 +1,121 @@
+#ifndef EcalPi0PairSelection_h
+#define EcalPi0PairSelection_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "DataFormats/Math/interface/Point3D.h"
+#include "DataFormats/Math/interface/Vector3D.h"
+#include "DataFormats/CaloRecHit/interface/CaloCluster.h"
+#include "CalibCode/CalibTools/interface/EcalClusterGrid.h"
+#include "CalibCode/CalibTools/interface/EcalStageProfiler.h"
+
+// pi0 or eta selection of the pairs, cuts by eta region (0 EB |eta|<1, 1 EB, 2 EE |eta|<1.8, 3 EE).
+// The mass windows and the isolation cone are fixed by isPi0, the cut vectors are left empty
+struct EcalMesonSelection
+{
+    explicit EcalMesonSelection(bool isPi0 = true);
+
+    bool isPi0;
+    float massLowNoCorr, massHighNoCorr;  // before the containment corrections
+    float massLow, massHigh;
+    float hltIsoDR, hltIsoDEta;          // eta-band isolation cone
+    double referenceMass;                // for epsilon
+    std::vector<double> pi0PtCut, gPtCut, S4S9Cut, isoCut, hltIsoCut;
+    std::vector<int> nXtal1Cut, nXtal2Cut;
+
+    // pair cuts of region r, nXtal of the more and of the less energetic photon
+    bool inWindowNoCorr(float massNoCorr) const { return massNoCorr >= massLowNoCorr && massNoCorr <= massHighNoCorr; }
+    bool passesKinematics(int r, float mass, float pt, int nXtalMore, int nXtalLess) const
+    {
+        return !(mass < massLow || mass > massHigh || pt < pi0PtCut[r] || nXtalMore < nXtal1Cut[r] || nXtalLess < nXtal2Cut[r]);
+    }
+    // the DeltaR to the closest other cluster is only cut on if isoCut > 0
+    bool appliesIsoCut(int r) const { return isoCut[r] > 0.0; }
+    bool passesIsolation(int r, float nextClu) const { return !(appliesIsoCut(r) && nextClu < isoCut[r]); }
+    bool passesHLTIsolation(int r, float hltIso) const { return !(hltIso > hltIsoCut[r]); }
+};
+
+// photon pair being selected, clusters i < j of the input vector
+struct EcalPi0Pair
+{
+    size_t i, j;
+    unsigned int inWindow;        // bit s set if the uncorrected mass is in the window of selection s
+    float g1eta, g1phi, g2eta, g2phi;
+    float deltaR;                 // between the two clusters
+    // uncorrected photons and pair
+    math::XYZVector g1, g2;
+    float massNoCorr, ptNoCorr, etaNoCorr, phiNoCorr;
+    // after the containment corrections, the uncorrected ones if there are none
+    math::XYZVector g1Corr, g2Corr;
+    float mass, pt, eta, phi;
+    // set for each selection
+    int etaRegion;                // index of the cuts
+    int streamRegion;             // as etaRegion, 4 for EE |eta|>2
+    int nXtal1, nXtal2;           // of clusters i and j
+    float nextClu;                // DeltaR of the closest other cluster, 999 if the cut is not applied
+    float hltIso;                 // eta-band isolation over the pair pt
+};
+
+// The pair search and the pair cuts of FillEpsilonPlot::computeEpsilon, shared with the replay tools.
+// Pairs are searched among the clusters of adjacent eta-phi grid cells, with DeltaR < 0.4, then
+// each selection applies its mass window, pt, nXtal, isolation and HLT isolation cuts.
+// What is done with the pairs is left to the Hooks, called in the order of the original loop.
+class EcalPi0PairSelection
+{
+    public:
+        class Hooks
+        {
+            public:
+                virtual ~Hooks() {}
+                // pair in at least one uncorrected mass window
+                virtual void preselected(const EcalPi0Pair& pair) {}
+                // sets g1Corr, g2Corr, mass, pt, eta, phi if containment corrections are used
+                virtual void correct(EcalPi0Pair& pair) {}
+                // pair passing the corrected mass window, pt and nXtal cuts of selection s, before the isolation
+                virtual void passedKinematics(const EcalPi0Pair& pair, size_t s) {}
+                // pair passing all the cuts of selection s
+                virtual void selected(const EcalPi0Pair& pair, size_t s) = 0;
+        };
+
+        EcalPi0PairSelection() : selections_(0), nTested_(0), nSkipped_(0) {}
+
+        // not copied, must stay alive
+        void setSelections(const std::vector<EcalMesonSelection>* selections) { selections_ = selections; }
+
+        // nXtal by cluster; with photonSelections, a pair is tried by selection s only if bit s
+        // is set for both clusters, and only the clusters with bit s enter its isolation
+        void run(const std::vector<reco::CaloCluster>& clusters, const std::vector<int>& nXtal,
+                 const std::vector<uint8_t>* photonSelections, bool isEB, Hooks& hooks, EcalStageProfiler& profiler);
+
+        // grid of the clusters of the last run, for the isolation of the hooks
+        const EcalClusterGrid& grid() const { return grid_; }
+        // index of the cuts of a pair, EB pairs beyond |eta| = 1.479 keep region 0
+        static int etaRegion(float absEta, bool isEB) { return isEB ? (absEta >= 1.0 && absEta < 1.479 ? 1 : 0) : (absEta < 1.8 ? 2 : 3); }
+        // pt threshold of the clusters in the HLT isolation
+        static float ptMinForIso(bool isEB) { return isEB ? 1.0 : 0.5; }
+
+        // photons with the cluster energies along their positions, and mass, pt, eta, phi of the pair
+        static void pairProperties(const math::XYZPoint& position1, float energy1,
+                                   const math::XYZPoint& position2, float energy2,
+                                   math::XYZVector& photon1, math::XYZVector& photon2,
+                                   float& mass, float& pt, float& eta, float& phi);
+
+        // pairs tested and pairs skipped by the grid, over all the runs
+        unsigned long long nTested() const { return nTested_; }
+        unsigned long long nSkipped() const { return nSkipped_; }
+        void addCounts(const EcalPi0PairSelection& other)
+        {
+            nTested_ += other.nTested_;
+            nSkipped_ += other.nSkipped_;
+        }
+
+    private:
+        const std::vector<EcalMesonSelection>* selections_;
+        EcalClusterGrid grid_;
+        std::vector<unsigned int> candidates_;
+        unsigned long long nTested_;
+        unsigned long long nSkipped_;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef EcalPreshowerClosestStripGrid_h
+#define EcalPreshowerClosestStripGrid_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "DataFormats/DetId/interface/DetId.h"
+#include "DataFormats/GeometryVector/interface/GlobalPoint.h"
+
+class EcalPreshowerGeometry;
+class ESDetId;
+
+// Lookup grid for EcalPreshowerGeometry::getClosestCellInPlane, one per plane and z side.
+// The point is projected on the plane along the line from the origin, as done by the
+// exact search, and falls in a cell of the grid. The strips at the four corners of a
+// cell are computed with the exact search the first time the cell is used. The cell is
+// given to a strip only if the four corners agree and the strip is also the nearest one
+// among all the sensors around it: the regions of the nearest strip are convex, and the
+// exact search (which only looks at the sensors next to the one of the point) cannot
+// miss it anywhere in the cell, even if the cell crosses a sensor edge. Otherwise (or
+// near the cell edges, or outside the ES) the exact search is called.
+// fill() checks that the exact search really depends only on the projected point;
+// if it does not, the grid is disabled and every call goes to the exact search.
+// About 12 MB per instance (one per stream): 4 bytes per cell of the four grids and the strip positions.
+class EcalPreshowerClosestStripGrid
+{
+    public:
+        EcalPreshowerClosestStripGrid() : esGeometry_(0), isFilled_(false), isEnabled_(false) {}
+
+        void fill(const EcalPreshowerGeometry* esGeometry);
+        bool isFilled() const { return isFilled_; }
+        bool isEnabled() const { return isEnabled_; }
+        void disable() { isEnabled_ = false; }
+
+        DetId getClosestCellInPlane(const GlobalPoint& point, int plane);
+
+        // compare the grid with the exact search on nPoints points per plane and side,
+        // returns the number of points where they disagree
+        int validate(int nPoints);
+
+    private:
+        static const uint32_t kNotComputed = 0xFFFFFFFF;
+        static const uint32_t kMixed = 0xFFFFFFFE;
+
+        struct PlaneGrid {
+            float zRef;              // z of the plane, sign included
+            float xMin, yMin;
+            float dx, dy;            // cell size
+            int nx, ny;
+            std::vector<uint32_t> cells; // strip rawId, kMixed or kNotComputed
+        };
+
+        PlaneGrid& planeGrid(int plane, bool zPositive) { return grids_[plane-1][zPositive ? 1 : 0]; }
+        uint32_t cell(PlaneGrid& grid, int plane, int ix, int iy);
+        bool isNearestStrip(const ESDetId& strip, float x, float y) const;
+        bool isProjective();
+
+        const EcalPreshowerGeometry* esGeometry_;
+        bool isFilled_;
+        bool isEnabled_;
+        PlaneGrid grids_[2][2];
+        std::vector<float> stripX_;  // strip centers by ESDetId hashed index
+        std::vector<float> stripY_;
+        float sensorSpacing_;        // smallest distance between the same strip of two neighbouring sensors
+};
+
+#endif
@@ -1,6 +1,11 @@
 #ifndef EcalRecHitCompare_H
 #define EcalRecHitCompare_H
 
+#include <utility>
+#include <functional>
+#include <stdint.h>
+#include "DataFormats/EcalRecHit/interface/EcalRecHit.h"
+
 class ecalRecHitPtrLess : public std::binary_function<EcalRecHit*, EcalRecHit*, bool>
 {
 public:
@@ -19,5 +24,17 @@ public:
   }
 };
 
+// (energy, hashed index) of a seed candidate
+typedef std::pair<float,uint32_t> EcalSeedCandidate;
+
+// same ordering as ecalRecHitLess, on energy only
+class ecalSeedCandidateLess
+{
+public:
+  bool operator()(const EcalSeedCandidate& x, const EcalSeedCandidate& y) const
+  {
+    return (x.first > y.first);
+  }
+};
 
 #endif
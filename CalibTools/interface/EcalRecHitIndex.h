@@ -0,0 +1,60 @@
+#ifndef EcalRecHitIndex_h
+#define EcalRecHitIndex_h
+
+#include <vector>
+#include <stdint.h>
+
+#include "DataFormats/EcalRecHit/interface/EcalRecHitCollections.h"
+
+// Dense per-event lookup of rechits by hashed index (EBDetId or EEDetId).
+// Each slot holds a pointer to the rechit of the current event and a flag
+// telling whether the crystal was already used by a cluster.
+// Only the slots filled in the previous event are cleared, so the reset
+// costs O(hits) and not O(crystals).
+template<class DetIdType>
+class EcalRecHitIndex
+{
+    public:
+        EcalRecHitIndex() :
+            hits_(DetIdType::kSizeForDenseIndexing, (const EcalRecHit*)0),
+            used_(DetIdType::kSizeForDenseIndexing, false) {}
+
+        void fill(const EcalRecHitCollection& recHits)
+        {
+            clear();
+            filled_.reserve(recHits.size());
+            for(EcalRecHitCollection::const_iterator it = recHits.begin(); it != recHits.end(); ++it) {
+                uint32_t hash = DetIdType(it->id()).hashedIndex();
+                hits_[hash] = &(*it);
+                filled_.push_back(hash);
+            }
+        }
+
+        void clear()
+        {
+            for(std::vector<uint32_t>::const_iterator it = filled_.begin(); it != filled_.end(); ++it) {
+                hits_[*it] = 0;
+                used_[*it] = false;
+            }
+            filled_.clear();
+        }
+
+        // null if there is no rechit for this crystal in the event
+        const EcalRecHit* find(uint32_t hash) const { return hits_[hash]; }
+        const EcalRecHit* find(const DetIdType& id) const { return hits_[id.hashedIndex()]; }
+
+        // only crystals with a rechit can be flagged as used
+        bool isUsed(uint32_t hash) const { return used_[hash]; }
+        bool isUsed(const DetIdType& id) const { return used_[id.hashedIndex()]; }
+        void setUsed(uint32_t hash) { used_[hash] = true; }
+        void setUsed(const DetIdType& id) { used_[id.hashedIndex()] = true; }
+
+        uint32_t size() const { return hits_.size(); }
+
+    private:
+        std::vector<const EcalRecHit*> hits_;
+        std::vector<bool> used_;
+        std::vector<uint32_t> filled_; // hashes set in the current event
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef EcalRegionHistogram_h
+#define EcalRegionHistogram_h
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+class TH2F;
+
+// Mass (or epsilon, E/Etrue) distributions of all the calibration regions.
+// Bin contents are kept in one contiguous array with the same layout as a
+// TH2F with nBins fixed-width bins on x and one bin per region on y
+// (under/overflow included), so fill() is a plain index computation and the
+// TH2F read by FitEpsilonPlot is only built when the histogram is written.
+// Contents are floats and the sum of squared weights doubles, as in TH2F,
+// and the fill statistics are accumulated like TH2::Fill does.
+class EcalRegionHistogram
+{
+    public:
+        EcalRegionHistogram(const char *name, const char *title, int nBins, double xMin, double xMax, int nRegions, bool useSumw2 = true);
+
+        void fill(double x, int region, double w)
+        {
+            int binx;
+            if (x < xMin_) binx = 0;
+            else if (!(x < xMax_)) binx = nBins_ + 1;
+            else binx = 1 + int(nBins_*(x - xMin_)/(xMax_ - xMin_));
+            int biny = region < 0 ? 0 : (region >= nRegions_ ? nRegions_ + 1 : region + 1);
+
+            size_t bin = binx + size_t(nBins_ + 2)*biny;
+            sumw_[bin] += float(w);
+            if (useSumw2_) sumw2_[bin] += w*w;
+            ++entries_;
+
+            if (binx == 0 || binx > nBins_ || biny == 0 || biny > nRegions_) return;
+            double y = region;
+            stats_[0] += w;
+            stats_[1] += w*w;
+            stats_[2] += w*x;
+            stats_[3] += w*x*x;
+            stats_[4] += w*y;
+            stats_[5] += w*y*y;
+            stats_[6] += w*x*y;
+        }
+
+        // adds the contents of a histogram with the same binning
+        void add(const EcalRegionHistogram& other);
+        void reset();
+
+        void setAxisTitles(const char *xTitle, const char *yTitle) { xTitle_ = xTitle; yTitle_ = yTitle; }
+
+        // new TH2F (not attached to any directory) with the contents of this histogram
+        TH2F* toTH2F() const;
+
+        const std::string& name() const { return name_; }
+        const std::string& title() const { return title_; }
+        const std::string& xTitle() const { return xTitle_; }
+        const std::string& yTitle() const { return yTitle_; }
+        int nBins() const { return nBins_; }
+        double xMin() const { return xMin_; }
+        double xMax() const { return xMax_; }
+        int nRegions() const { return nRegions_; }
+        bool useSumw2() const { return useSumw2_; }
+        double entries() const { return entries_; }
+        size_t memoryBytes() const { return sumw_.size()*sizeof(float) + sumw2_.size()*sizeof(double); }
+
+    private:
+        std::string name_;
+        std::string title_;
+        std::string xTitle_;
+        std::string yTitle_;
+        int nBins_;
+        double xMin_;
+        double xMax_;
+        int nRegions_;
+        bool useSumw2_;
+
+        std::vector<float> sumw_;   // (nBins+2)*(nRegions+2), global bin = binx + (nBins+2)*biny
+        std::vector<double> sumw2_;
+        double entries_;
+        double stats_[7];           // as TH1::GetStats/PutStats for a TH2
+};
+
+#endif
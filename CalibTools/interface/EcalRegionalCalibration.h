@@ -2,6 +2,8 @@
 #define EcalRegionalCalibration_H
 
 #include <vector>
+#include <map>
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
@@ -26,6 +28,8 @@ class RegionWeight {
 
 typedef std::vector<RegionWeight> RegionWeightVector;
 
+inline bool lessRegion(const RegionWeight& a, const RegionWeight& b) { return a.iRegion < b.iRegion; }
+
 typedef std::pair<DetId, float> EnergyFraction;
 typedef std::vector< EnergyFraction > EnergyFractionVector;
 
@@ -33,6 +37,12 @@ typedef std::vector< EnergyFraction > EnergyFractionVector;
 class EcalRegionalCalibrationBase{
     public:
         virtual RegionWeightVector getWeights(const reco::CaloCluster* clus, int subDetId ) const =0;
+        /// region of the xtal in this granularity
+        virtual uint32_t iRegion(const DetId& id, bool isEB) const =0;
+        /// weights of the cluster in several granularities from one pass over its xtals:
+        /// weights[g] as getWeights of calibrations[g], the vectors are reused between calls
+        static void getWeights(const std::vector<EcalRegionalCalibrationBase*>& calibrations,
+                               const reco::CaloCluster* clus, int subDetId, std::vector<RegionWeightVector>& weights);
         //EcalCalibMap<Type>* getCalibMap() =0;
         virtual  EcalCalibMapBase* getCalibMap() =0;
         virtual std::string printType() =0;
@@ -47,6 +57,7 @@ template<class Type> class EcalRegionalCalibration : public EcalRegionalCalibrat
         ~EcalRegionalCalibration(){}
 
         RegionWeightVector getWeights(const reco::CaloCluster* clus, int subDetId ) const;
+        uint32_t iRegion(const DetId& id, bool isEB) const { return isEB ? Type::iRegion(id) : Type::iRegionEE(id); }
 
         //EcalCalibMap<Type>* getCalibMap() { 
         EcalCalibMapBase* getCalibMap() { 
@@ -136,5 +147,52 @@ RegionWeightVector EcalRegionalCalibration<Type>::getWeights(const reco::CaloClu
 }
 
 
+//================================================================================================
+inline void EcalRegionalCalibrationBase::getWeights(const std::vector<EcalRegionalCalibrationBase*>& calibrations,
+                                                    const reco::CaloCluster* clus, int subDetId, std::vector<RegionWeightVector>& weights) {
+//================================================================================================
+    bool isEB = true;
+
+    if( subDetId == EcalBarrel ) { isEB = true; }
+    else if( subDetId == EcalEndcap ) { isEB = false; }
+    else throw cms::Exception("EcalRegionalCalibration::getWeights") << "Subdetector Id not recognized\n";
+
+    weights.resize(calibrations.size());
+    for(size_t g = 0; g < weights.size(); ++g) weights[g].clear();
+
+    // a cluster has a few xtals: the energy of each region is summed in place in the weight
+    // vector (linear search) instead of a map, as many granularities as needed per xtal
+    const EnergyFractionVector& enHits = clus->hitsAndFractions();
+    for(EnergyFractionVector::const_iterator it = enHits.begin(); it != enHits.end(); ++it) {
+        float energy = it->second;
+        if(energy==0.) continue;
+        for(size_t g = 0; g < calibrations.size(); ++g) {
+            uint32_t iR = calibrations[g]->iRegion( it->first, isEB );
+            RegionWeightVector& w = weights[g];
+            RegionWeightVector::iterator r = w.begin();
+            while(r != w.end() && r->iRegion != iR) ++r;
+            if(r != w.end()) r->value += energy;
+            else {
+                RegionWeight rw;
+                rw.iRegion = iR;
+                rw.value = energy;
+                w.push_back( rw );
+            }
+        }
+    }
+
+    for(size_t g = 0; g < weights.size(); ++g) {
+        // same order as getWeights, increasing region
+        std::sort(weights[g].begin(), weights[g].end(), lessRegion);
+        for(RegionWeightVector::iterator r = weights[g].begin(); r != weights[g].end(); ++r) {
+            // only positive weights
+            r->value = (r->value<0.) ? 0. : r->value/clus->energy();
+            // no w>1. weight!
+            r->value = (r->value>1.) ? 1. : r->value;
+        }
+    }
+}
+
+
 
 #endif
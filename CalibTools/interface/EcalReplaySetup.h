@@ -0,0 +1,51 @@
+#ifndef EcalReplaySetup_h
+#define EcalReplaySetup_h
+
+#include <string>
+#include <map>
+#include <stdint.h>
+
+#include "Geometry/CaloTopology/interface/CaloTopology.h"
+#include "CalibCode/CalibTools/interface/EcalGeometryTable.h"
+#include "CalibCode/CalibTools/interface/EcalNeighbourTable.h"
+#include "CalibCode/CalibTools/interface/EcalBadChannelMask.h"
+#include "CalibCode/CalibTools/interface/PosCalcParams.h"
+#include "CalibCode/CalibTools/interface/EcalPi0Clustering.h"
+#include "CalibCode/CalibTools/interface/EcalPi0PairSelection.h"
+
+// The tables FillEpsilonPlot builds at construction, for the standalone replay programs:
+// external geometry (also registered in GeometryService), 3x3 windows from the hardcoded
+// topologies and a bad channel mask with the dead xtal map only (no channel status from the DB).
+class EcalReplaySetup
+{
+    public:
+        EcalReplaySetup(const std::string& geometryFile, const std::string& deadMapFile = "");
+
+        const EcalGeometryTable& geometry() const { return geomTable_; }
+        const EcalNeighbourTable<EBDetId>& ebWindow3x3() const { return ebWindow3x3_; }
+        const EcalNeighbourTable<EEDetId>& eeWindow3x3() const { return eeWindow3x3_; }
+        const EcalBadChannelMask& badChannels() const { return badChannels_; }
+        // flags of badChannels() rejecting a cluster
+        uint8_t deadXtalFlags() const { return deadXtalFlags_; }
+
+        // shower depth parameters of FillEpsilonPlot
+        static PosCalcParams positionParameters();
+
+        // cuts of submit/parameters.py by FillEpsilonPlot parameter name (S4S9_EB_low, ...): those of the
+        // pi0 calibration, or the etaSelection ones for the eta; the seed thresholds are the same for both
+        static std::map<std::string,double> defaultCuts(bool isPi0);
+        // clustering of one subdetector and pair selection of FillEpsilonPlot from such cuts,
+        // the mass windows and the reference mass are those of EcalMesonSelection(isPi0)
+        static EcalPi0ClusteringParameters clusteringParameters(const std::map<std::string,double>& cuts, bool isEB, const PosCalcParams& pc);
+        static EcalMesonSelection mesonSelection(const std::map<std::string,double>& cuts, bool isPi0);
+
+    private:
+        CaloTopology ebTopology_, eeTopology_;
+        EcalGeometryTable geomTable_;
+        EcalNeighbourTable<EBDetId> ebWindow3x3_;
+        EcalNeighbourTable<EEDetId> eeWindow3x3_;
+        EcalBadChannelMask badChannels_;
+        uint8_t deadXtalFlags_;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef EcalSparseRegionHistogram_h
+#define EcalSparseRegionHistogram_h
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+class TH2F;
+
+// Same content and TH2F output as EcalRegionHistogram, but the bins of a region are only
+// allocated when the region is first filled: memory grows with the regions actually
+// filled, which is what many histograms with few events each (one per IOV) need.
+// Filled rows are appended to one array, rows_ gives where each region starts.
+class EcalSparseRegionHistogram
+{
+    public:
+        EcalSparseRegionHistogram(const char *name, const char *title, int nBins, double xMin, double xMax, int nRegions, bool useSumw2 = true);
+
+        void fill(double x, int region, double w)
+        {
+            int binx;
+            if (x < xMin_) binx = 0;
+            else if (!(x < xMax_)) binx = nBins_ + 1;
+            else binx = 1 + int(nBins_*(x - xMin_)/(xMax_ - xMin_));
+            int biny = region < 0 ? 0 : (region >= nRegions_ ? nRegions_ + 1 : region + 1);
+
+            size_t bin = rowOffset(biny) + binx;
+            sumw_[bin] += float(w);
+            if (useSumw2_) sumw2_[bin] += w*w;
+            ++entries_;
+
+            if (binx == 0 || binx > nBins_ || biny == 0 || biny > nRegions_) return;
+            double y = region;
+            stats_[0] += w;
+            stats_[1] += w*w;
+            stats_[2] += w*x;
+            stats_[3] += w*x*x;
+            stats_[4] += w*y;
+            stats_[5] += w*y*y;
+            stats_[6] += w*x*y;
+        }
+
+        // adds the contents of a histogram with the same binning
+        void add(const EcalSparseRegionHistogram& other);
+
+        void setAxisTitles(const char *xTitle, const char *yTitle) { xTitle_ = xTitle; yTitle_ = yTitle; }
+
+        // new TH2F (not attached to any directory) with the contents of this histogram, empty regions included
+        TH2F* toTH2F() const;
+
+        const std::string& name() const { return name_; }
+        int nRegions() const { return nRegions_; }
+        int nFilledRegions() const { return nRows_; }
+        double entries() const { return entries_; }
+        size_t memoryBytes() const { return rows_.size()*sizeof(uint32_t) + sumw_.capacity()*sizeof(float) + sumw2_.capacity()*sizeof(double); }
+
+    private:
+        static const uint32_t kNoRow = 0xffffffff;
+
+        size_t rowOffset(int biny)
+        {
+            uint32_t& row = rows_[biny];
+            if (row == kNoRow) {
+                row = nRows_++;
+                sumw_.resize(sumw_.size() + nBins_ + 2, 0.);
+                if (useSumw2_) sumw2_.resize(sumw2_.size() + nBins_ + 2, 0.);
+            }
+            return size_t(row)*(nBins_ + 2);
+        }
+
+        std::string name_;
+        std::string title_;
+        std::string xTitle_;
+        std::string yTitle_;
+        int nBins_;
+        double xMin_;
+        double xMax_;
+        int nRegions_;
+        bool useSumw2_;
+
+        std::vector<uint32_t> rows_;  // row of each biny (under/overflow included) in sumw_, kNoRow if never filled
+        uint32_t nRows_;
+        std::vector<float> sumw_;     // nRows_*(nBins+2)
+        std::vector<double> sumw2_;
+        double entries_;
+        double stats_[7];
+};
+
+#endif
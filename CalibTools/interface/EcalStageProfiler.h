@@ -0,0 +1,99 @@
+#ifndef EcalStageProfiler_h
+#define EcalStageProfiler_h
+
+#include <string>
+#include <stdint.h>
+#include <chrono>
+
+class TH1D;
+
+// Wall time and counters of the stages of the fill job, one instance per stream.
+// When disabled every call reduces to a test of a bool, so it can stay in the event loop.
+// Stage times are inclusive: EE clustering contains the ES matching, the pair search
+// contains isolation, region weights and histogram fill.
+class EcalStageProfiler
+{
+    public:
+        enum Stage {
+            kTriggerFilter,  // JSON, HLT and L1 selection
+            kMCTruth,
+            kEBClustering,
+            kEEClustering,
+            kESMatching,
+            kPairSearch,
+            kIsolation,
+            kRegionWeights,
+            kHistogramFill,
+            kHistogramMerge, // end of job: sum of the stream histograms
+            kHistogramWrite, // end of job: region histograms to TH2F, written
+            nStages
+        };
+
+        enum Counter {
+            kEvents,
+            kSeeds,
+            kClusters,
+            kPairsTested,
+            kPairsAccepted, // pairs passing all the selections
+            kFills,         // region weights filled in the epsilon histograms
+            nCounters
+        };
+
+        // times the stage from construction to the end of the scope
+        class Scope
+        {
+            public:
+                Scope(EcalStageProfiler& profiler, Stage stage) : profiler_(profiler), stage_(stage)
+                {
+                    if(profiler_.enabled_) start_ = std::chrono::steady_clock::now();
+                }
+                ~Scope()
+                {
+                    if(profiler_.enabled_) profiler_.add(stage_, std::chrono::steady_clock::now() - start_);
+                }
+
+            private:
+                EcalStageProfiler& profiler_;
+                Stage stage_;
+                std::chrono::steady_clock::time_point start_;
+        };
+
+        EcalStageProfiler(bool enabled = false);
+
+        void setEnabled(bool enabled) { enabled_ = enabled; }
+        bool enabled() const { return enabled_; }
+
+        void count(Counter counter, uint64_t n = 1) { if(enabled_) counters_[counter] += n; }
+
+        void merge(const EcalStageProfiler& other);
+
+        double seconds(Stage stage) const { return nanoseconds_[stage]*1.e-9; }
+        uint64_t calls(Stage stage) const { return calls_[stage]; }
+        uint64_t counter(Counter counter) const { return counters_[counter]; }
+
+        static const char* stageName(Stage stage);
+        static const char* counterName(Counter counter);
+
+        // new histograms with one labelled bin per stage or counter, owned by the caller
+        TH1D* timeHistogram(const char* name) const;
+        TH1D* callsHistogram(const char* name) const;
+        TH1D* counterHistogram(const char* name) const;
+
+        void print() const;
+        // nStreams is only reported, times are summed over the merged streams
+        void writeJSON(const std::string& fileName, unsigned int nStreams) const;
+
+    private:
+        void add(Stage stage, std::chrono::steady_clock::duration elapsed)
+        {
+            nanoseconds_[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            calls_[stage]++;
+        }
+
+        bool enabled_;
+        uint64_t nanoseconds_[nStages];
+        uint64_t calls_[nStages];
+        uint64_t counters_[nCounters];
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef EcalStatReplicas_h
+#define EcalStatReplicas_h
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Event weights of the statistical replicas filled next to the nominal epsilon histograms.
+// "evenOdd": 2 replicas, the even events in replica 0 and the odd ones in replica 1 (as SystOrNot 1 and 2).
+// "bootstrap": n replicas, each event with a Poisson(1) weight per replica.
+// The weights depend only on run, event number and replica, so the jobs and streams
+// of an iteration agree on them and the replicas can be hadd-ed like the nominal histograms.
+class EcalStatReplicas
+{
+    public:
+        enum Mode { kNone, kEvenOdd, kBootstrap };
+
+        EcalStatReplicas() : mode_(kNone) {}
+
+        // mode is "", "evenOdd" or "bootstrap", nBootstrap is only used by the latter
+        void configure(const std::string& mode, unsigned int nBootstrap);
+
+        Mode mode() const { return mode_; }
+        unsigned int size() const { return weights_.size(); }
+
+        void setEvent(uint32_t run, uint64_t event);
+        float weight(unsigned int replica) const { return weights_[replica]; }
+
+    private:
+        Mode mode_;
+        std::vector<float> weights_;
+};
+
+#endif
@@ -1,32 +1,30 @@
 #ifndef PreshowerTools_H
 #define PreshowerTools_H
 
-#include <set>
-#include <map>
 #include <vector>
-#include "Geometry/CaloTopology/interface/CaloTopology.h"
+#include <stdint.h>
+#include "Geometry/CaloTopology/interface/CaloSubdetectorTopology.h"
 #include "DataFormats/EcalDetId/interface/ESDetId.h"
-#include "RecoCaloTools/Navigation/interface/EcalPreshowerNavigator.h"
 #include "DataFormats/EcalRecHit/interface/EcalRecHitCollections.h"
 #include "DataFormats/GeometryVector/interface/GlobalPoint.h"
-#include "DataFormats/Common/interface/Handle.h"
-#include "DataFormats/EcalRecHit/interface/EcalRecHitCollections.h"
 #include "Geometry/CaloGeometry/interface/CaloGeometry.h"
 //#include "Geometry/CaloGeometry/interface/CaloSubdetectorGeometry.h"
 //#include "Analysis/Modules/interface/PreshowerCluster.h"
 #include "DataFormats/EgammaReco/interface/PreshowerCluster.h"
-
-//using namespace reco;
-
-typedef std::map<DetId, EcalRecHit> RecHitsMap;
-typedef std::set<DetId> HitsID;
+#include "CalibCode/CalibTools/interface/EcalRecHitIndex.h"
 
 using namespace reco;
 
+// Preshower clustering around the strip closest to an EE cluster.
+// The object is built once per job: the one-step neighbours of every strip
+// are taken from the topology and stored by hashed index, so the roads are
+// walked on tables instead of with EcalPreshowerNavigator.
+// setEvent() must be called once per event before makeOnePreshowerCluster().
 class PreshowerTools{
     public:
-      //PreshowerTools(CaloSubdetectorGeometry* extGeom, CaloSubdetectorTopology* topology_p,  edm::Handle< ESRecHitCollection > & esHandle); 
-      PreshowerTools(const CaloGeometry* extGeom, CaloSubdetectorTopology* topology_p,  edm::Handle< ESRecHitCollection > & esHandle); 
+      PreshowerTools(const CaloSubdetectorTopology* topology_p);
+
+      void setEvent(const CaloGeometry* extGeom, const ESRecHitCollection& esRecHits);
       PreshowerCluster makeOnePreshowerCluster(int stripwindow, ESDetId *strip);
 
       /// preshower calibration constants
@@ -36,21 +34,30 @@ class PreshowerTools{
       static const double calib_planeY_;
       static const int clusterwindowsize_;
 
+      static const uint32_t kNoStrip = 0xFFFFFFFF;
 
     private:
+      enum Direction { kNorth = 0, kSouth, kEast, kWest, kNDirections };
+
       const CaloGeometry* geom_;
-      CaloSubdetectorTopology *estopology_;
 
-      std::vector<ESDetId> esroad_2d;
+      // hashed index of the neighbour of each strip in each direction, kNoStrip if none
+      std::vector<uint32_t> neighbours_[kNDirections];
+
+      // ES rechits of the current event by hashed index
+      EcalRecHitIndex<ESDetId> rechits_;
 
-      // The set of used DetID's for a given event used in the preshower clustering algo:
-      HitsID  used_strips;
+      std::vector<uint32_t> esroad_2d;
 
-      // creates the map of rechits used in the preshower clustering algo
-      RecHitsMap  rechits_map;
+      // strips used by the cluster being built, reset at each makeOnePreshowerCluster()
+      std::vector<bool> used_strips;
+      std::vector<uint32_t> used_list;
 
-      void findESRoad(int stripwindow, ESDetId strip, EcalPreshowerNavigator theESNav, int plane);
-      bool goodStrip(RecHitsMap::iterator candidate_it);
+      uint32_t next(uint32_t hash, Direction dir) const { return hash == kNoStrip ? kNoStrip : neighbours_[dir][hash]; }
+      void findESRoad(int stripwindow, uint32_t strip, int plane);
+      bool goodStrip(uint32_t hash) const;
+      void setUsed(uint32_t hash);
+      void clearUsed();
 };
 
 #endif
@@ -0,0 +1,57 @@
+#include "CalibCode/CalibTools/interface/EcalBadChannelMask.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "TH2F.h"
+
+void EcalBadChannelMask::clear(uint8_t flag)
+{
+    for(std::vector<uint8_t>::iterator it = flags_.begin(); it != flags_.end(); ++it) *it &= ~flag;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalBadChannelMask::setChannelStatus(const EcalChannelStatus& channelStatus)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    clear(kChannelStatus);
+    for(uint32_t h=0; h<kSizeEB; ++h)
+        if( int(channelStatus[EBDetId::unhashIndex(h).rawId()].getStatusCode()) > 0 ) flags_[h] |= kChannelStatus;
+    for(uint32_t h=0; h<kSizeEE; ++h)
+        if( int(channelStatus[EEDetId::unhashIndex(h).rawId()].getStatusCode()) > 0 ) flags_[kSizeEB + h] |= kChannelStatus;
+    hasChannelStatus_ = true;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalBadChannelMask::setDeadMap(const TH2F* ebMap, const TH2F* eemMap, const TH2F* eepMap)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if(!ebMap || !eemMap || !eepMap) throw cms::Exception("EcalBadChannelMask") << "missing histogram in the dead xtal map\n";
+    clear(kDeadMap);
+    for(uint32_t h=0; h<kSizeEB; ++h) {
+        EBDetId id = EBDetId::unhashIndex(h);
+        if( ebMap->GetBinContent( id.iphi()+1, id.ieta()+86 ) == 1 ) flags_[h] |= kDeadMap;
+    }
+    for(uint32_t h=0; h<kSizeEE; ++h) {
+        EEDetId id = EEDetId::unhashIndex(h);
+        const TH2F* map = id.zside() == -1 ? eemMap : eepMap;
+        if( map->GetBinContent( id.ix()+1, id.iy()+1 ) == 1 ) flags_[kSizeEB + h] |= kDeadMap;
+    }
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalBadChannelMask::setNeighbours(const EcalNeighbourTable<EBDetId>& ebWindow, const EcalNeighbourTable<EEDetId>& eeWindow)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    const uint8_t dead = kChannelStatus | kDeadMap;
+    clear(kNeighbourOfDead);
+    for(uint32_t h=0; h<kSizeEB; ++h) {
+        const uint32_t* w = ebWindow.window(h);
+        for(int k=0; k<ebWindow.slots() && w[k]!=EcalNeighbourTable<EBDetId>::kNoXtal; ++k)
+            if( flags_[w[k]] & dead ) { flags_[h] |= kNeighbourOfDead; break; }
+    }
+    for(uint32_t h=0; h<kSizeEE; ++h) {
+        const uint32_t* w = eeWindow.window(h);
+        for(int k=0; k<eeWindow.slots() && w[k]!=EcalNeighbourTable<EEDetId>::kNoXtal; ++k)
+            if( flags_[kSizeEB + w[k]] & dead ) { flags_[kSizeEB + h] |= kNeighbourOfDead; break; }
+    }
+}
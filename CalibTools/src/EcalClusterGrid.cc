@@ -0,0 +1,171 @@
+#include "CalibCode/CalibTools/interface/EcalClusterGrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+EcalClusterGrid::EcalClusterGrid(float minCellSize, float etaMax) :
+  etaMax_(etaMax)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    nEta_ = std::max(1, int(2.*etaMax/minCellSize));
+    nPhi_ = std::max(1, int(2.*TMath::Pi()/minCellSize));
+    etaCellSize_ = 2.*etaMax/nEta_;
+    phiCellSize_ = 2.*TMath::Pi()/nPhi_;
+    cellStart_.assign(nEta_*nPhi_+1, 0);
+}
+
+int EcalClusterGrid::etaCell(double eta) const
+{
+    int ie = int(std::floor((eta + etaMax_)/etaCellSize_));
+    return std::min(std::max(ie, 0), nEta_-1);
+}
+
+int EcalClusterGrid::phiCell(double phi) const
+{
+    int ip = int(std::floor((phi + TMath::Pi())/phiCellSize_));
+    return std::min(std::max(ip, 0), nPhi_-1);
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalClusterGrid::fill(const std::vector<reco::CaloCluster>& clusters)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    unsigned int n = clusters.size();
+    eta_.resize(n); phi_.resize(n); energy_.resize(n); pt_.resize(n);
+    cell_.resize(n);
+    cellItems_.resize(n);
+    std::fill(cellStart_.begin(), cellStart_.end(), 0);
+
+    for(unsigned int i=0; i<n; ++i) {
+        eta_[i] = clusters[i].eta();
+        phi_[i] = clusters[i].phi();
+        energy_[i] = clusters[i].energy();
+        pt_[i] = clusters[i].energy()*sin(clusters[i].position().Theta());
+        cell_[i] = etaCell(eta_[i])*nPhi_ + phiCell(phi_[i]);
+        cellStart_[cell_[i]+1]++;
+    }
+    // counting sort, keeps the cluster order inside each cell
+    for(unsigned int c=1; c<cellStart_.size(); ++c) cellStart_[c] += cellStart_[c-1];
+    cellNext_.assign(cellStart_.begin(), cellStart_.end()-1);
+    for(unsigned int i=0; i<n; ++i) cellItems_[cellNext_[cell_[i]]++] = i;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalClusterGrid::pairCandidates(unsigned int i, std::vector<unsigned int>& candidates) const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    candidates.clear();
+    int ie0 = cell_[i] / nPhi_;
+    int ip0 = cell_[i] % nPhi_;
+    int nPhiSteps = std::min(3, nPhi_); // avoid visiting the same phi cell twice
+
+    for(int ie = std::max(ie0-1, 0); ie <= std::min(ie0+1, nEta_-1); ++ie) {
+        for(int k = 0; k < nPhiSteps; ++k) {
+            int ip = (ip0 - 1 + k + nPhi_) % nPhi_;
+            int c = ie*nPhi_ + ip;
+            for(unsigned int it = cellStart_[c]; it < cellStart_[c+1]; ++it) {
+                if(cellItems_[it] > i) candidates.push_back(cellItems_[it]);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+}
+
+void EcalClusterGrid::cellsAround(int ie0, int ip0, int k, std::vector<int>& cells) const
+{
+    cells.clear();
+    int nPhiSteps = std::min(2*k+1, nPhi_);
+    for(int ie = std::max(ie0-k, 0); ie <= std::min(ie0+k, nEta_-1); ++ie) {
+        for(int step = 0; step < nPhiSteps; ++step) {
+            int ip = ((ip0 - k + step) % nPhi_ + nPhi_) % nPhi_;
+            cells.push_back(ie*nPhi_ + ip);
+        }
+    }
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+float EcalClusterGrid::nearestDeltaR(float eta, float phi, unsigned int skip1, unsigned int skip2,
+                                     const std::vector<uint8_t>* selections, uint8_t bits) const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    int ie0 = etaCell(eta);
+    int ip0 = phiCell(phi);
+    double minCellSize = std::min(etaCellSize_, phiCellSize_);
+
+    for(int k = 1; ; ++k) {
+        float best = 999.;
+        cellsAround(ie0, ip0, k, cellBuffer_);
+        for(std::vector<int>::const_iterator c = cellBuffer_.begin(); c != cellBuffer_.end(); ++c) {
+            for(unsigned int it = cellStart_[*c]; it < cellStart_[*c+1]; ++it) {
+                unsigned int j = cellItems_[it];
+                if(j == skip1 || j == skip2) continue;
+                if(selections && !((*selections)[j] & bits)) continue;
+                float dR = deltaR(eta_[j], eta, phi_[j], phi);
+                if(dR < best) best = dR;
+            }
+        }
+        // clusters outside the square are farther than k cells in eta or phi
+        // (small margin for the float arithmetic of deltaR)
+        bool allCells = ie0-k <= 0 && ie0+k >= nEta_-1 && 2*k+1 >= nPhi_;
+        if(allCells || best < k*minCellSize*(1.-1.e-4)) return best;
+    }
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+int EcalClusterGrid::nearestUnused(float eta, float phi, double maxDR, const std::vector<bool>& used) const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    int k = int(maxDR / std::min(etaCellSize_, phiCellSize_)) + 1;
+    cellsAround(etaCell(eta), phiCell(phi), k, cellBuffer_);
+
+    int best = -1;
+    float bestDR = 0.;
+    for(std::vector<int>::const_iterator c = cellBuffer_.begin(); c != cellBuffer_.end(); ++c) {
+        for(unsigned int it = cellStart_[*c]; it < cellStart_[*c+1]; ++it) {
+            unsigned int j = cellItems_[it];
+            if(used[j]) continue;
+            float dR = deltaR(eta_[j], eta, phi_[j], phi);
+            if(dR >= maxDR) continue;
+            // cells are not visited in cluster order
+            if(best < 0 || dR < bestDR || (dR == bestDR && int(j) < best)) {
+                best = j;
+                bestDR = dR;
+            }
+        }
+    }
+    return best;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+float EcalClusterGrid::etaBandPtSum(float eta, float phi, float maxDeta, float maxDR, float ptMin, unsigned int skip1, unsigned int skip2,
+                                    const std::vector<uint8_t>* selections, uint8_t bits) const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    int k = int(maxDR / std::min(etaCellSize_, phiCellSize_)) + 1;
+    cellsAround(etaCell(eta), phiCell(phi), k, cellBuffer_);
+
+    indexBuffer_.clear();
+    for(std::vector<int>::const_iterator c = cellBuffer_.begin(); c != cellBuffer_.end(); ++c) {
+        for(unsigned int it = cellStart_[*c]; it < cellStart_[*c+1]; ++it) {
+            unsigned int j = cellItems_[it];
+            if(j == skip1 || j == skip2) continue;
+            if(selections && !((*selections)[j] & bits)) continue;
+            indexBuffer_.push_back(j);
+        }
+    }
+    // the float sum depends on the order
+    std::sort(indexBuffer_.begin(), indexBuffer_.end());
+
+    float sum = 0.0;
+    for(std::vector<unsigned int>::const_iterator it = indexBuffer_.begin(); it != indexBuffer_.end(); ++it) {
+        unsigned int j = *it;
+        double deta = fabs(eta_[j] - eta);
+        if (deta > maxDeta) continue;
+        double dR = deltaR(eta_[j], eta, phi_[j], phi);
+        if (dR > maxDR) continue;
+        if (pt_[j] < ptMin) continue;
+        sum += pt_[j];
+    }
+    return sum;
+}
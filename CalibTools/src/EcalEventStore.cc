@@ -0,0 +1,189 @@
+#include "CalibCode/CalibTools/interface/EcalEventStore.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "DataFormats/EcalDetId/interface/EBDetId.h"
+#include "DataFormats/EcalDetId/interface/EEDetId.h"
+#include "DataFormats/EcalDetId/interface/ESDetId.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TChain.h"
+#include "TBranch.h"
+
+static const char* const treeName = "ecalEventStore";
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalEventStoreWriter::open(const std::string& fileName)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    close();
+    // compression 404: LZ4, level 4
+    file_ = TFile::Open(fileName.c_str(), "RECREATE", "ECAL rechit store", 404);
+    if(!file_ || !file_->IsOpen()) throw cms::Exception("EcalEventStore") << "cannot create the rechit store " << fileName << "\n";
+
+    tree_ = new TTree(treeName, "EB, EE and ES rechits of the selected events");
+    tree_->SetDirectory(file_);
+    tree_->Branch("run",   &header_.run,   "run/i");
+    tree_->Branch("lumi",  &header_.lumi,  "lumi/i");
+    tree_->Branch("event", &header_.event, "event/l");
+    tree_->Branch("bx",    &header_.bx,    "bx/I");
+    tree_->Branch("ebHLT", &header_.ebHLT, "ebHLT/O");
+    tree_->Branch("eeHLT", &header_.eeHLT, "eeHLT/O");
+    tree_->Branch("nL1",   &nL1_,          "nL1/i");
+    l1Seeds_.resize(1);
+    l1Branch_ = tree_->Branch("l1Seeds", &l1Seeds_[0], "l1Seeds[nL1]/s");
+    book(eb_, "eb");
+    book(ee_, "ee");
+    book(es_, "es");
+}
+
+void EcalEventStoreWriter::book(Columns& columns, const char* prefix)
+{
+    const std::string p(prefix);
+    const std::string n = "n" + p;
+    columns.hash.resize(1);
+    columns.energy.resize(1);
+    columns.time.resize(1);
+    columns.flags.resize(1);
+    tree_->Branch(n.c_str(), &columns.n, (n + "/i").c_str());
+    columns.branches[0] = tree_->Branch((p + "Hash").c_str(),   &columns.hash[0],   (p + "Hash[" + n + "]/i").c_str());
+    columns.branches[1] = tree_->Branch((p + "Energy").c_str(), &columns.energy[0], (p + "Energy[" + n + "]/F").c_str());
+    columns.branches[2] = tree_->Branch((p + "Time").c_str(),   &columns.time[0],   (p + "Time[" + n + "]/F").c_str());
+    columns.branches[3] = tree_->Branch((p + "Flags").c_str(),  &columns.flags[0],  (p + "Flags[" + n + "]/i").c_str());
+}
+
+// the arrays may be reallocated, so the branch addresses are set again
+void EcalEventStoreWriter::copy(Columns& columns, const std::vector<EcalHitRecord>& records)
+{
+    columns.n = records.size();
+    if(columns.hash.size() < records.size()) {
+        columns.hash.resize(records.size());
+        columns.energy.resize(records.size());
+        columns.time.resize(records.size());
+        columns.flags.resize(records.size());
+    }
+    for(uint32_t i=0; i<columns.n; ++i) {
+        columns.hash[i] = records[i].hash;
+        columns.energy[i] = records[i].energy;
+        columns.time[i] = records[i].time;
+        columns.flags[i] = records[i].flags;
+    }
+    columns.branches[0]->SetAddress(&columns.hash[0]);
+    columns.branches[1]->SetAddress(&columns.energy[0]);
+    columns.branches[2]->SetAddress(&columns.time[0]);
+    columns.branches[3]->SetAddress(&columns.flags[0]);
+}
+
+void EcalEventStoreWriter::fill(const EcalEventStoreHeader& header, const std::vector<EcalHitRecord>& eb,
+                                const std::vector<EcalHitRecord>& ee, const std::vector<EcalHitRecord>& es)
+{
+    if(!tree_) throw cms::Exception("EcalEventStore") << "the rechit store is not open\n";
+    if(header.l1Seeds.size() > EcalEventStoreReader::kMaxL1Seeds)
+        throw cms::Exception("EcalEventStore") << header.l1Seeds.size() << " L1 seeds, at most " << EcalEventStoreReader::kMaxL1Seeds << " can be stored\n";
+
+    header_.run = header.run;
+    header_.lumi = header.lumi;
+    header_.event = header.event;
+    header_.bx = header.bx;
+    header_.ebHLT = header.ebHLT;
+    header_.eeHLT = header.eeHLT;
+    nL1_ = header.l1Seeds.size();
+    if(nL1_ > 0) {
+        l1Seeds_ = header.l1Seeds;
+        l1Branch_->SetAddress(&l1Seeds_[0]);
+    }
+    copy(eb_, eb);
+    copy(ee_, ee);
+    copy(es_, es);
+    tree_->Fill();
+}
+
+void EcalEventStoreWriter::close()
+{
+    if(!file_) return;
+    file_->cd();
+    tree_->Write();
+    file_->Close();
+    delete file_;
+    file_ = 0;
+    tree_ = 0;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+EcalEventStoreReader::EcalEventStoreReader(const std::vector<std::string>& fileNames, bool readES) :
+  chain_(new TChain(treeName)),
+  readES_(readES)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    for(std::vector<std::string>::const_iterator it = fileNames.begin(); it != fileNames.end(); ++it)
+        if(chain_->Add(it->c_str(), 0) == 0) throw cms::Exception("EcalEventStore") << "no rechit store in " << *it << "\n";
+
+    chain_->SetBranchAddress("run",   &run_);
+    chain_->SetBranchAddress("lumi",  &lumi_);
+    chain_->SetBranchAddress("event", &event_);
+    chain_->SetBranchAddress("bx",    &bx_);
+    chain_->SetBranchAddress("ebHLT", &ebHLT_);
+    chain_->SetBranchAddress("eeHLT", &eeHLT_);
+    chain_->SetBranchAddress("nL1",   &nL1_);
+    chain_->SetBranchAddress("l1Seeds", l1Seeds_);
+    attach(eb_, "eb", EBDetId::kSizeForDenseIndexing);
+    attach(ee_, "ee", EEDetId::kSizeForDenseIndexing);
+    if(readES_) attach(es_, "es", ESDetId::kSizeForDenseIndexing);
+    else chain_->SetBranchStatus("es*", 0);
+    chain_->SetBranchStatus("nes", readES_);
+}
+
+EcalEventStoreReader::~EcalEventStoreReader()
+{
+    delete chain_;
+}
+
+// buffers as large as the number of channels, one rechit per channel at most
+void EcalEventStoreReader::attach(Columns& columns, const char* prefix, uint32_t maxHits)
+{
+    const std::string p(prefix);
+    columns.n = 0;
+    columns.hash.resize(maxHits);
+    columns.energy.resize(maxHits);
+    columns.time.resize(maxHits);
+    columns.flags.resize(maxHits);
+    chain_->SetBranchAddress(("n" + p).c_str(),      &columns.n);
+    chain_->SetBranchAddress((p + "Hash").c_str(),   &columns.hash[0]);
+    chain_->SetBranchAddress((p + "Energy").c_str(), &columns.energy[0]);
+    chain_->SetBranchAddress((p + "Time").c_str(),   &columns.time[0]);
+    chain_->SetBranchAddress((p + "Flags").c_str(),  &columns.flags[0]);
+}
+
+int64_t EcalEventStoreReader::entries() const
+{
+    return chain_->GetEntries();
+}
+
+void EcalEventStoreReader::toRecords(Columns& columns)
+{
+    columns.records.resize(columns.n);
+    for(uint32_t i=0; i<columns.n; ++i) {
+        EcalHitRecord& rec = columns.records[i];
+        rec.hash = columns.hash[i];
+        rec.energy = columns.energy[i];
+        rec.time = columns.time[i];
+        rec.flags = columns.flags[i];
+    }
+}
+
+void EcalEventStoreReader::read(int64_t entry)
+{
+    if(chain_->GetEntry(entry) <= 0) throw cms::Exception("EcalEventStore") << "cannot read entry " << entry << " of the rechit store\n";
+
+    header_.run = run_;
+    header_.lumi = lumi_;
+    header_.event = event_;
+    header_.bx = bx_;
+    header_.ebHLT = ebHLT_;
+    header_.eeHLT = eeHLT_;
+    header_.l1Seeds.assign(l1Seeds_, l1Seeds_ + nL1_);
+    toRecords(eb_);
+    toRecords(ee_);
+    if(readES_) toRecords(es_);
+    else es_.records.clear();
+}
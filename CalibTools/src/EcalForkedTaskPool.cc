@@ -0,0 +1,151 @@
+#include "CalibCode/CalibTools/interface/EcalForkedTaskPool.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include <iostream>
+#include <exception>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// a result is sent as its size n and its n bytes, a failure as -(n+1) and the n bytes of the message
+
+static bool writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = ::read(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+EcalForkedTaskPool::EcalForkedTaskPool(int begin, int end, unsigned int nWorkers, const Task& task) :
+  begin_(begin),
+  end_(end)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if (nWorkers == 0) nWorkers = 1;
+    // what is buffered would be printed again by each worker
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(stdout);
+    fflush(stderr);
+
+    for (unsigned int w = 0; w < nWorkers && begin + int(w) < end; ++w) {
+        int fd[2];
+        if (pipe(fd) != 0) {
+            stop();
+            throw cms::Exception("EcalForkedTaskPool") << "cannot create a pipe: " << strerror(errno) << "\n";
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fd[0]);
+            close(fd[1]);
+            stop();
+            throw cms::Exception("EcalForkedTaskPool") << "cannot start a worker: " << strerror(errno) << "\n";
+        }
+        if (pid == 0) {
+            // the worker only keeps the write end of its own pipe
+            close(fd[0]);
+            for (size_t k = 0; k < fds_.size(); ++k) close(fds_[k]);
+            runWorker(fd[1], begin + w, end, nWorkers, task);
+        }
+        close(fd[1]);
+        pids_.push_back(pid);
+        fds_.push_back(fd[0]);
+        nextIndex_.push_back(begin + w);
+    }
+}
+
+EcalForkedTaskPool::~EcalForkedTaskPool()
+{
+    stop();
+}
+
+void EcalForkedTaskPool::runWorker(int fd, int first, int end, int step, const Task& task)
+{
+    int status = 0;
+    std::string result;
+    for (int i = first; i < end && status == 0; i += step) {
+        int64_t size;
+        result.clear();
+        try {
+            task(i, result);
+            size = result.size();
+        } catch (std::exception& e) {
+            result = e.what();
+            size = -int64_t(result.size()) - 1;
+            status = 1;
+        } catch (...) {
+            result = "unknown exception";
+            size = -int64_t(result.size()) - 1;
+            status = 1;
+        }
+        if (!writeAll(fd, (const char*) &size, sizeof(size)) || !writeAll(fd, result.data(), result.size())) status = 1;
+    }
+    close(fd);
+    std::cout.flush();
+    fflush(stdout);
+    // no destructors or atexit handlers of the copied process (its open files belong to the parent)
+    _exit(status);
+}
+
+void EcalForkedTaskPool::read(int i, std::string& result)
+{
+    if (i < begin_ || i >= end_)
+        throw cms::Exception("EcalForkedTaskPool") << "task " << i << " is not in [" << begin_ << ", " << end_ << ")\n";
+    size_t w = (i - begin_) % fds_.size();
+    if (i != nextIndex_[w])
+        throw cms::Exception("EcalForkedTaskPool") << "task " << i << " read out of order, expected " << nextIndex_[w] << "\n";
+
+    int64_t size;
+    if (!readAll(fds_[w], (char*) &size, sizeof(size)))
+        throw cms::Exception("EcalForkedTaskPool") << "worker " << w << " ended before task " << i << "\n";
+    bool failed = size < 0;
+    if (failed) size = -size - 1;
+    result.resize(size);
+    if (size > 0 && !readAll(fds_[w], &result[0], size))
+        throw cms::Exception("EcalForkedTaskPool") << "worker " << w << " ended during task " << i << "\n";
+    nextIndex_[w] += fds_.size();
+    if (failed)
+        throw cms::Exception("EcalForkedTaskPool") << "task " << i << " failed: " << result << "\n";
+}
+
+void EcalForkedTaskPool::stop()
+{
+    for (size_t w = 0; w < pids_.size(); ++w) {
+        close(fds_[w]);
+        // all its results read: the worker ends by itself
+        if (nextIndex_[w] < end_) kill(pids_[w], SIGKILL);
+        int status;
+        while (waitpid(pids_[w], &status, 0) < 0 && errno == EINTR) {}
+    }
+    pids_.clear();
+    fds_.clear();
+    nextIndex_.clear();
+}
@@ -0,0 +1,61 @@
+#include "CalibCode/CalibTools/interface/EcalGeometryTable.h"
+#include "CalibCode/CalibTools/interface/ECALGeometry.h"
+
+#include <cmath>
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "Geometry/CaloGeometry/interface/CaloGeometry.h"
+#include "Geometry/CaloGeometry/interface/TruncatedPyramid.h"
+
+void EcalGeometryTable::resize()
+{
+    posX_.assign(kSize, 0.); posY_.assign(kSize, 0.); posZ_.assign(kSize, 0.);
+    axisX_.assign(kSize, 0.); axisY_.assign(kSize, 0.); axisZ_.assign(kSize, 0.);
+    front_.assign(kSize, 0.);
+    sinTheta_.assign(kSize, 0.);
+}
+
+void EcalGeometryTable::set(uint32_t i, const GlobalPoint& pos, const GlobalVector& axis)
+{
+    posX_[i] = pos.x(); posY_[i] = pos.y(); posZ_[i] = pos.z();
+    axisX_[i] = axis.x(); axisY_[i] = axis.y(); axisZ_[i] = axis.z();
+    front_[i] = pos.mag();
+    sinTheta_[i] = std::sin(pos.theta());
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalGeometryTable::fill(const ECALGeometry* geom)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if(!geom) throw cms::Exception("EcalGeometryTable") << "null ECALGeometry pointer\n";
+    resize();
+
+    const std::map<DetId,GlobalPoint> & posMap = geom->getPositionMap();
+    const std::map<DetId,GlobalVector> & axisMap = geom->getAxisMap();
+
+    for(uint32_t i=0; i<kSize; ++i) {
+        DetId id = i < kSizeEB ? DetId(EBDetId::unhashIndex(i)) : DetId(EEDetId::unhashIndex(i-kSizeEB));
+        std::map<DetId,GlobalPoint>::const_iterator ipos = posMap.find(id);
+        std::map<DetId,GlobalVector>::const_iterator iax = axisMap.find(id);
+        if(ipos == posMap.end() || iax == axisMap.end())
+            throw cms::Exception("EcalGeometryTable") << "xtal " << id.rawId() << " missing in external geometry\n";
+        set(i, ipos->second, iax->second.unit());
+    }
+    isFilled_ = true;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalGeometryTable::fill(const CaloGeometry* geom)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if(!geom) throw cms::Exception("EcalGeometryTable") << "null CaloGeometry pointer\n";
+    resize();
+
+    for(uint32_t i=0; i<kSize; ++i) {
+        DetId id = i < kSizeEB ? DetId(EBDetId::unhashIndex(i)) : DetId(EEDetId::unhashIndex(i-kSizeEB));
+        const TruncatedPyramid* cell = dynamic_cast<const TruncatedPyramid*>( geom->getGeometry(id).get() );
+        if(!cell) throw cms::Exception("EcalGeometryTable") << "no TruncatedPyramid for xtal " << id.rawId() << "\n";
+        set(i, cell->getPosition(0.), cell->axis());
+    }
+    isFilled_ = true;
+}
@@ -0,0 +1,50 @@
+#include "CalibCode/CalibTools/interface/EcalIOVList.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+static uint32_t parseNumber(const std::string& boundary, const std::string& text)
+{
+    char* end = 0;
+    unsigned long value = std::strtoul(text.c_str(), &end, 10);
+    if(text.empty() || *end != '\0' || value > 0xffffffffUL)
+        throw cms::Exception("EcalIOVList") << "malformed IOV boundary '" << boundary << "', use run or run:lumi\n";
+    return value;
+}
+
+void EcalIOVList::configure(const std::vector<std::string>& boundaries)
+{
+    starts_.clear();
+    for(std::vector<std::string>::const_iterator it = boundaries.begin(); it != boundaries.end(); ++it) {
+        size_t colon = it->find(':');
+        uint32_t run = parseNumber(*it, it->substr(0, colon));
+        uint32_t lumi = colon == std::string::npos ? 0 : parseNumber(*it, it->substr(colon+1));
+        starts_.push_back((uint64_t(run) << 32) | lumi);
+    }
+    std::sort(starts_.begin(), starts_.end());
+    if(std::adjacent_find(starts_.begin(), starts_.end()) != starts_.end())
+        throw cms::Exception("EcalIOVList") << "the same IOV boundary is given twice\n";
+
+    cachedIOV_ = -1;
+    cachedBegin_ = 1;
+    cachedEnd_ = 0;
+}
+
+int EcalIOVList::lookup(uint64_t key)
+{
+    std::vector<uint64_t>::const_iterator next = std::upper_bound(starts_.begin(), starts_.end(), key);
+    cachedIOV_ = int(next - starts_.begin()) - 1;
+    cachedBegin_ = cachedIOV_ < 0 ? 0 : starts_[cachedIOV_];
+    cachedEnd_ = next == starts_.end() ? ~uint64_t(0) : *next;
+    return cachedIOV_;
+}
+
+std::string EcalIOVList::label(size_t iov) const
+{
+    std::ostringstream s;
+    s << firstRun(iov) << ":" << firstLumi(iov);
+    return s.str();
+}
@@ -0,0 +1,183 @@
+#include "CalibCode/CalibTools/interface/EcalPi0CandidateReplay.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "DataFormats/Math/interface/Vector3D.h"
+#include "DataFormats/CaloRecHit/interface/CaloCluster.h"
+#include "CalibCode/CalibTools/interface/PreshowerTools.h"
+#include "CalibCode/CalibTools/interface/EcalClusterGrid.h"
+
+static DetId detId(bool isEB, uint32_t hash)
+{
+    return isEB ? DetId(EBDetId::unhashIndex(hash)) : DetId(EEDetId::unhashIndex(hash));
+}
+
+void EcalPi0CandidateReplay::setCalibration(EcalCalibMapBase* map)
+{
+    ic_.clear();
+    if(!map) return;
+    ic_.resize(EcalGeometryTable::kSize);
+    for(uint32_t h=0; h<EcalGeometryTable::kSizeEB; ++h) ic_[h] = map->coeff(EBDetId::unhashIndex(h));
+    for(uint32_t h=0; h<EcalGeometryTable::kSizeEE; ++h) ic_[EcalGeometryTable::kSizeEB + h] = map->coeff(EEDetId::unhashIndex(h));
+}
+
+// energy and position of photon p from its calibrated xtals, as EcalPi0Clustering::run
+// and the ES matching of FillEpsilonPlot::fillEEClusters
+template<class DetIdType>
+void EcalPi0CandidateReplay::computePhoton(const EcalPi0CandidateBlock& block, uint32_t p, const EcalNeighbourTable<DetIdType>* window,
+                                           const EcalPi0ClusteringParameters& par)
+{
+    const uint32_t offset = DetIdType::Subdet == EcalEndcap ? EcalGeometryTable::kSizeEB : 0;
+    const uint32_t first = block.firstXtal[p];
+    const uint32_t nXtal = block.nXtal[p];
+    const uint32_t seed = block.seed[p];
+
+    const uint32_t* clus_v = window->window(seed);
+    const int8_t* clus_dx = window->dx(seed);
+    const int8_t* clus_dy = window->dy(seed);
+
+    // position weights use the uncalibrated total, as in the clustering
+    float posTotalEnergy = 0.;
+    for(uint32_t x=first; x<first+nXtal; ++x)
+        if(block.energy[x]>0.) posTotalEnergy += block.energy[x];
+
+    float s4s9_tmp[4] = {0., 0., 0., 0.};
+    float e3x3 = 0.;
+    float xclu = 0., yclu = 0., zclu = 0.;
+    float total_weight = 0.;
+    float maxDepth = par.position.param_X0_ * ( par.T0 + std::log( posTotalEnergy ) );
+    float maxToFront = geometry_->frontDistance( offset + seed );
+
+    for(uint32_t x=first; x<first+nXtal; ++x)
+    {
+        const float en = calibrated_[x];
+        int slot = 0;
+        while(slot < window->slots() && clus_v[slot] != block.hash[x]) ++slot;
+        if(slot == window->slots()) throw cms::Exception("EcalPi0CandidateReplay") << "xtal " << block.hash[x] << " not in the window of its seed\n";
+        const int dx = clus_dx[slot];
+        const int dy = clus_dy[slot];
+
+        e3x3 += en;
+        if(dx <= 0 && dy <=0){ s4s9_tmp[0] += en; }
+        if(dx >= 0 && dy <=0){ s4s9_tmp[1] += en; }
+        if(dx <= 0 && dy >=0){ s4s9_tmp[2] += en; }
+        if(dx >= 0 && dy >=0){ s4s9_tmp[3] += en; }
+
+        if(en>0.)
+        {
+            float weight = std::max( float(0.), par.position.param_W0_ + std::log(en/posTotalEnergy) );
+            uint32_t igeo = offset + block.hash[x];
+            float pos_geo = geometry_->frontDistance(igeo);
+            float depth = maxDepth + maxToFront - pos_geo;
+            GlobalPoint posThis = geometry_->position(igeo, depth);
+            xclu += weight*posThis.x();
+            yclu += weight*posThis.y();
+            zclu += weight*posThis.z();
+            total_weight += weight;
+        }
+    }
+
+    float e2x2 = *std::max_element(s4s9_tmp, s4s9_tmp+4);
+    float s4s9 = e2x2/e3x3;
+    float inv_total_weight = 1./total_weight;
+    math::XYZPoint clusPos( xclu * inv_total_weight, yclu * inv_total_weight, zclu * inv_total_weight );
+
+    bool low = std::fabs( clusPos.eta() ) < par.etaBoundary;
+    bool passes = !( s4s9 < (low ? par.s4s9Low : par.s4s9High) || nXtal < (low ? par.nXtalLow : par.nXtalHigh) );
+    float ptClus = e3x3*std::sin(clusPos.Theta());
+    passes = passes && !( ptClus < (low ? par.ptLow : par.ptHigh) );
+
+    double energy = e3x3;
+    if(block.es1[p] > -998.) {
+        // matched to the preshower: ES energy added, position from the ES clusters
+        energy += PreshowerTools::gamma_*(PreshowerTools::calib_planeX_*block.es1[p] + PreshowerTools::calib_planeY_*block.es2[p]);
+        clusPos = math::XYZPoint(block.esX[p], block.esY[p], block.esZ[p]);
+    }
+    energy_[p] = energy;
+    position_[p] = clusPos;
+    passes_[p] = passes;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalPi0CandidateReplay::run(const EcalPi0CandidateBlock& block, EcalRegionalCalibrationBase& calibration,
+                                 EcalRegionHistogram* ebHistogram, EcalRegionHistogram* eeHistogram)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    const uint32_t nCandidates = block.size();
+    const uint32_t nPhotons = 2*nCandidates;
+    nRead_ += nCandidates;
+
+    // calibrated xtal energies
+    calibrated_.assign(block.energy.begin(), block.energy.end());
+    if(!ic_.empty()) {
+        for(uint32_t p=0; p<nPhotons; ++p) {
+            const uint32_t offset = block.isEB[p/2] ? 0 : EcalGeometryTable::kSizeEB;
+            const uint32_t end = block.firstXtal[p] + block.nXtal[p];
+            for(uint32_t x=block.firstXtal[p]; x<end; ++x) calibrated_[x] *= ic_[offset + block.hash[x]];
+        }
+    }
+
+    // photons
+    energy_.resize(nPhotons);
+    position_.resize(nPhotons);
+    passes_.resize(nPhotons);
+    for(uint32_t p=0; p<nPhotons; ++p) {
+        if(block.isEB[p/2]) computePhoton<EBDetId>(block, p, ebWindow_, eb_);
+        else computePhoton<EEDetId>(block, p, eeWindow_, ee_);
+    }
+
+    // pairs, as computeEpsilon without containment corrections
+    std::vector<std::pair<DetId,float> > hits1, hits2;
+    for(uint32_t k=0; k<nCandidates; ++k) {
+        const uint32_t p1 = 2*k, p2 = 2*k+1;
+        if(!passes_[p1] || !passes_[p2]) continue;
+        const bool isEB = block.isEB[k];
+
+        const math::XYZPoint& pos1 = position_[p1];
+        const math::XYZPoint& pos2 = position_[p2];
+        float g1eta = pos1.eta(), g2eta = pos2.eta();
+        float g1phi = pos1.phi(), g2phi = pos2.phi();
+        if(EcalClusterGrid::deltaR(g1eta, g2eta, g1phi, g2phi) > 0.4) continue;
+        if(g1eta == g2eta && g1phi == g2phi) continue;
+
+        const float energy1 = energy_[p1];
+        const float energy2 = energy_[p2];
+        math::XYZVector photon1, photon2;
+        float mass, pt, eta, phi;
+        EcalPi0PairSelection::pairProperties(pos1, energy1, pos2, energy2, photon1, photon2, mass, pt, eta, phi);
+        if(!selection_.inWindowNoCorr(mass)) continue;
+
+        const int r = EcalPi0PairSelection::etaRegion(std::fabs(eta), isEB);
+        int nXtalMore = block.nXtal[p1], nXtalLess = block.nXtal[p2];
+        if(!(energy1 > energy2)) std::swap(nXtalMore, nXtalLess);
+        if(!selection_.passesKinematics(r, mass, pt, nXtalMore, nXtalLess)) continue;
+        if(!selection_.passesIsolation(r, block.nextClu[k])) continue;
+        if(!selection_.passesHLTIsolation(r, block.isoPtSum[k]/pt)) continue;
+        ++nAccepted_;
+
+        EcalRegionHistogram* histogram = isEB ? ebHistogram : eeHistogram;
+        if(!histogram) continue;
+
+        // region weights from clusters carrying the calibrated xtal energies
+        hits1.clear();
+        hits2.clear();
+        for(uint32_t x=block.firstXtal[p1]; x<block.firstXtal[p1]+block.nXtal[p1]; ++x)
+            hits1.push_back(std::make_pair(detId(isEB, block.hash[x]), calibrated_[x]));
+        for(uint32_t x=block.firstXtal[p2]; x<block.firstXtal[p2]+block.nXtal[p2]; ++x)
+            hits2.push_back(std::make_pair(detId(isEB, block.hash[x]), calibrated_[x]));
+        reco::CaloID caloId(isEB ? reco::CaloID::DET_ECAL_BARREL : reco::CaloID::DET_ECAL_ENDCAP);
+        reco::CaloCluster g1(energy1, pos1, caloId, hits1, reco::CaloCluster::undefined, detId(isEB, block.seed[p1]));
+        reco::CaloCluster g2(energy2, pos2, caloId, hits2, reco::CaloCluster::undefined, detId(isEB, block.seed[p2]));
+        RegionWeightVector w1 = calibration.getWeights(&g1, isEB ? EcalBarrel : EcalEndcap);
+        RegionWeightVector w2 = calibration.getWeights(&g2, isEB ? EcalBarrel : EcalEndcap);
+        w1.insert(w1.end(), w2.begin(), w2.end());
+
+        float r2 = mass/selection_.referenceMass;
+        r2 = r2*r2;
+        float eps_k = 0.5 * ( r2 - 1. );
+        for(RegionWeightVector::const_iterator it = w1.begin(); it != w1.end(); ++it)
+            histogram->fill(useMassInsteadOfEpsilon_ ? mass : eps_k, it->iRegion, it->value);
+    }
+}
@@ -0,0 +1,162 @@
+#include "CalibCode/CalibTools/interface/EcalPi0CandidateStore.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TChain.h"
+
+static const char* const treeName = "pi0Candidates";
+
+void EcalPi0CandidateBlock::clear()
+{
+    run.clear(); lumi.clear(); event.clear();
+    ebHLT.clear(); eeHLT.clear(); isEB.clear();
+    nextClu.clear(); isoPtSum.clear();
+    seed.clear(); firstXtal.clear(); nXtal.clear();
+    es1.clear(); es2.clear(); esX.clear(); esY.clear(); esZ.clear();
+    hash.clear(); energy.clear();
+}
+
+static void pushPhoton(EcalPi0CandidateBlock& block, const EcalPi0CandidatePhoton& photon)
+{
+    block.seed.push_back(photon.seed);
+    block.firstXtal.push_back(block.hash.size());
+    block.nXtal.push_back(photon.nXtal);
+    block.es1.push_back(photon.es1);
+    block.es2.push_back(photon.es2);
+    block.esX.push_back(photon.esX);
+    block.esY.push_back(photon.esY);
+    block.esZ.push_back(photon.esZ);
+    block.hash.insert(block.hash.end(), photon.hash, photon.hash + photon.nXtal);
+    block.energy.insert(block.energy.end(), photon.energy, photon.energy + photon.nXtal);
+}
+
+void EcalPi0CandidateBlock::push_back(const EcalPi0Candidate& candidate)
+{
+    run.push_back(candidate.run);
+    lumi.push_back(candidate.lumi);
+    event.push_back(candidate.event);
+    ebHLT.push_back(candidate.ebHLT);
+    eeHLT.push_back(candidate.eeHLT);
+    isEB.push_back(candidate.isEB);
+    nextClu.push_back(candidate.nextClu);
+    isoPtSum.push_back(candidate.isoPtSum);
+    pushPhoton(*this, candidate.g1);
+    pushPhoton(*this, candidate.g2);
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalPi0CandidateStoreWriter::open(const std::string& fileName)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    close();
+    // compression 404: LZ4, level 4
+    file_ = TFile::Open(fileName.c_str(), "RECREATE", "pi0 candidate store", 404);
+    if(!file_ || !file_->IsOpen()) throw cms::Exception("EcalPi0CandidateStore") << "cannot create the candidate store " << fileName << "\n";
+
+    tree_ = new TTree(treeName, "preselected photon pairs with their 3x3 xtals");
+    tree_->SetDirectory(file_);
+    tree_->Branch("run",      &candidate_.run,      "run/i");
+    tree_->Branch("lumi",     &candidate_.lumi,     "lumi/i");
+    tree_->Branch("event",    &candidate_.event,    "event/l");
+    tree_->Branch("ebHLT",    &candidate_.ebHLT,    "ebHLT/O");
+    tree_->Branch("eeHLT",    &candidate_.eeHLT,    "eeHLT/O");
+    tree_->Branch("isEB",     &candidate_.isEB,     "isEB/O");
+    tree_->Branch("nextClu",  &candidate_.nextClu,  "nextClu/F");
+    tree_->Branch("isoPtSum", &candidate_.isoPtSum, "isoPtSum/F");
+    book(candidate_.g1, "g1");
+    book(candidate_.g2, "g2");
+}
+
+void EcalPi0CandidateStoreWriter::book(EcalPi0CandidatePhoton& photon, const char* prefix)
+{
+    const std::string p(prefix);
+    const std::string n = p + "nXtal";
+    tree_->Branch((p + "seed").c_str(),   &photon.seed,   (p + "seed/i").c_str());
+    tree_->Branch(n.c_str(),              &photon.nXtal,  (n + "/i").c_str());
+    tree_->Branch((p + "hash").c_str(),   photon.hash,    (p + "hash[" + n + "]/i").c_str());
+    tree_->Branch((p + "energy").c_str(), photon.energy,  (p + "energy[" + n + "]/F").c_str());
+    tree_->Branch((p + "es1").c_str(),    &photon.es1,    (p + "es1/F").c_str());
+    tree_->Branch((p + "es2").c_str(),    &photon.es2,    (p + "es2/F").c_str());
+    tree_->Branch((p + "esX").c_str(),    &photon.esX,    (p + "esX/F").c_str());
+    tree_->Branch((p + "esY").c_str(),    &photon.esY,    (p + "esY/F").c_str());
+    tree_->Branch((p + "esZ").c_str(),    &photon.esZ,    (p + "esZ/F").c_str());
+}
+
+void EcalPi0CandidateStoreWriter::fill(const EcalPi0Candidate& candidate)
+{
+    if(!tree_) throw cms::Exception("EcalPi0CandidateStore") << "the candidate store is not open\n";
+    if(candidate.g1.nXtal > EcalPi0CandidatePhoton::kMaxXtals || candidate.g2.nXtal > EcalPi0CandidatePhoton::kMaxXtals)
+        throw cms::Exception("EcalPi0CandidateStore") << "more than " << EcalPi0CandidatePhoton::kMaxXtals << " xtals in a photon\n";
+    candidate_ = candidate;
+    tree_->Fill();
+}
+
+void EcalPi0CandidateStoreWriter::close()
+{
+    if(!file_) return;
+    file_->cd();
+    tree_->Write();
+    file_->Close();
+    delete file_;
+    file_ = 0;
+    tree_ = 0;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+EcalPi0CandidateStoreReader::EcalPi0CandidateStoreReader(const std::vector<std::string>& fileNames) :
+  chain_(new TChain(treeName)),
+  next_(0)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    for(std::vector<std::string>::const_iterator it = fileNames.begin(); it != fileNames.end(); ++it)
+        if(chain_->Add(it->c_str(), 0) == 0) throw cms::Exception("EcalPi0CandidateStore") << "no candidate store in " << *it << "\n";
+
+    chain_->SetBranchAddress("run",      &candidate_.run);
+    chain_->SetBranchAddress("lumi",     &candidate_.lumi);
+    chain_->SetBranchAddress("event",    &event_);
+    chain_->SetBranchAddress("ebHLT",    &candidate_.ebHLT);
+    chain_->SetBranchAddress("eeHLT",    &candidate_.eeHLT);
+    chain_->SetBranchAddress("isEB",     &candidate_.isEB);
+    chain_->SetBranchAddress("nextClu",  &candidate_.nextClu);
+    chain_->SetBranchAddress("isoPtSum", &candidate_.isoPtSum);
+    attach(candidate_.g1, "g1");
+    attach(candidate_.g2, "g2");
+}
+
+EcalPi0CandidateStoreReader::~EcalPi0CandidateStoreReader()
+{
+    delete chain_;
+}
+
+void EcalPi0CandidateStoreReader::attach(EcalPi0CandidatePhoton& photon, const char* prefix)
+{
+    const std::string p(prefix);
+    chain_->SetBranchAddress((p + "seed").c_str(),   &photon.seed);
+    chain_->SetBranchAddress((p + "nXtal").c_str(),  &photon.nXtal);
+    chain_->SetBranchAddress((p + "hash").c_str(),   photon.hash);
+    chain_->SetBranchAddress((p + "energy").c_str(), photon.energy);
+    chain_->SetBranchAddress((p + "es1").c_str(),    &photon.es1);
+    chain_->SetBranchAddress((p + "es2").c_str(),    &photon.es2);
+    chain_->SetBranchAddress((p + "esX").c_str(),    &photon.esX);
+    chain_->SetBranchAddress((p + "esY").c_str(),    &photon.esY);
+    chain_->SetBranchAddress((p + "esZ").c_str(),    &photon.esZ);
+}
+
+int64_t EcalPi0CandidateStoreReader::entries() const
+{
+    return chain_->GetEntries();
+}
+
+bool EcalPi0CandidateStoreReader::readBlock(EcalPi0CandidateBlock& block, size_t maxCandidates)
+{
+    block.clear();
+    const int64_t n = entries();
+    for(; next_ < n && block.size() < maxCandidates; ++next_) {
+        if(chain_->GetEntry(next_) <= 0) throw cms::Exception("EcalPi0CandidateStore") << "cannot read entry " << next_ << " of the candidate store\n";
+        candidate_.event = event_;
+        block.push_back(candidate_);
+    }
+    return block.size() > 0;
+}
@@ -0,0 +1,137 @@
+#include "CalibCode/CalibTools/interface/EcalPi0PairSelection.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "CalibCode/CalibTools/interface/EcalRegionalCalibration.h"
+
+EcalMesonSelection::EcalMesonSelection(bool pi0) :
+  isPi0(pi0),
+  massLowNoCorr(pi0 ? 0.050 : 0.340), massHighNoCorr(pi0 ? 0.250 : 0.720),
+  massLow(pi0 ? 0.060 : 0.360), massHigh(pi0 ? 0.240 : 0.700),
+  hltIsoDR(pi0 ? 0.2 : 0.3), hltIsoDEta(pi0 ? 0.05 : 0.1),
+  referenceMass(pi0 ? PI0MASS : ETAMASS)
+{
+}
+
+void EcalPi0PairSelection::pairProperties(const math::XYZPoint& position1, float energy1,
+                                          const math::XYZPoint& position2, float energy2,
+                                          math::XYZVector& photon1, math::XYZVector& photon2,
+                                          float& mass, float& pt, float& eta, float& phi)
+{
+    // massless photons: the position is scaled to the energy (it is never at the origin)
+    photon1 = position1;
+    photon1 *= (energy1 / photon1.R());
+    photon2 = position2;
+    photon2 *= (energy2 / photon2.R());
+
+    math::XYZVector pair = photon1 + photon2;
+    float energy = energy1 + energy2;
+
+    mass = std::sqrt(energy * energy - pair.Mag2());
+    pt = pair.Rho();
+    eta = pair.Eta();
+    phi = pair.Phi();
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalPi0PairSelection::run(const std::vector<reco::CaloCluster>& clusters, const std::vector<int>& nXtal,
+                               const std::vector<uint8_t>* photonSelections, bool isEB, Hooks& hooks, EcalStageProfiler& profiler)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if(!selections_) throw cms::Exception("EcalPi0PairSelection") << "no selections set\n";
+    if(nXtal.size() < clusters.size()) throw cms::Exception("EcalPi0PairSelection") << "nXtal of " << nXtal.size() << " clusters for " << clusters.size() << "\n";
+    const std::vector<EcalMesonSelection>& selections = *selections_;
+    const float ptMinIso = ptMinForIso(isEB);
+
+    // grid cells contain all the pairs passing the DeltaR < 0.4 cut below
+    grid_.fill(clusters);
+
+    EcalPi0Pair pair;
+    for(size_t i=0; i<clusters.size(); ++i)
+    {
+        // j > i in increasing order, so pairs are processed in the same order as a loop over all j > i
+        grid_.pairCandidates(i, candidates_);
+        nTested_ += candidates_.size();
+        nSkipped_ += (clusters.size() - 1 - i) - candidates_.size();
+        profiler.count(EcalStageProfiler::kPairsTested, candidates_.size());
+
+        for(std::vector<unsigned int>::const_iterator ic = candidates_.begin(); ic != candidates_.end(); ++ic)
+        {
+            const size_t j = *ic;
+            pair.i = i;
+            pair.j = j;
+            pair.g1eta = grid_.eta(i);
+            pair.g2eta = grid_.eta(j);
+            pair.g1phi = grid_.phi(i);
+            pair.g2phi = grid_.phi(j);
+            pair.deltaR = EcalClusterGrid::deltaR(pair.g1eta, pair.g2eta, pair.g1phi, pair.g2phi);
+            if(pair.deltaR > 0.4) continue;
+            if(pair.g1eta == pair.g2eta && pair.g1phi == pair.g2phi) continue;
+
+            pairProperties(clusters[i].position(), clusters[i].energy(), clusters[j].position(), clusters[j].energy(),
+                           pair.g1, pair.g2, pair.massNoCorr, pair.ptNoCorr, pair.etaNoCorr, pair.phiNoCorr);
+
+            // selections whose mass window contains the pair
+            pair.inWindow = 0;
+            for(size_t s=0; s<selections.size(); ++s)
+                if(selections[s].inWindowNoCorr(pair.massNoCorr)) pair.inWindow |= 1 << s;
+            if(!pair.inWindow) continue;
+
+            hooks.preselected(pair);
+
+            pair.g1Corr = pair.g1;
+            pair.g2Corr = pair.g2;
+            pair.mass = pair.massNoCorr;
+            pair.pt = pair.ptNoCorr;
+            pair.eta = pair.etaNoCorr;
+            pair.phi = pair.phiNoCorr;
+            hooks.correct(pair);
+
+            pair.nXtal1 = nXtal[i];
+            pair.nXtal2 = nXtal[j];
+            // nXtal cuts are on the more and on the less energetic photon
+            const bool firstMoreEnergetic = clusters[i].energy() > clusters[j].energy();
+            const int nXtalMore = firstMoreEnergetic ? pair.nXtal1 : pair.nXtal2;
+            const int nXtalLess = firstMoreEnergetic ? pair.nXtal2 : pair.nXtal1;
+
+            const float absEta = std::fabs(pair.eta);
+            pair.etaRegion = etaRegion(absEta, isEB);
+            pair.streamRegion = isEB || absEta < 2.0 ? pair.etaRegion : 4;
+
+            for(size_t s=0; s<selections.size(); ++s)
+            {
+                const EcalMesonSelection& sel = selections[s];
+                if(!(pair.inWindow & (1 << s))) continue;
+                if(photonSelections && !((*photonSelections)[i] & (*photonSelections)[j] & (1 << s))) continue;
+
+                const int r = pair.etaRegion;
+                if(!sel.passesKinematics(r, pair.mass, pair.pt, nXtalMore, nXtalLess)) continue;
+
+                hooks.passedKinematics(pair, s);
+
+                // isolation: DeltaR of the closest other cluster to either photon, and the
+                // HLT eta-band isolation (HLTrigger/special/src/HLTEcalResonanceFilter.cc),
+                // over the clusters of this selection only
+                const uint8_t bit = 1 << s;
+                pair.nextClu = 999.;
+                pair.hltIso = 0.;
+                {
+                    EcalStageProfiler::Scope timer(profiler, EcalStageProfiler::kIsolation);
+                    if(sel.appliesIsoCut(r)) {
+                        pair.nextClu = std::min(grid_.nearestDeltaR(pair.g1eta, pair.g1phi, i, j, photonSelections, bit),
+                                                grid_.nearestDeltaR(pair.g2eta, pair.g2phi, i, j, photonSelections, bit));
+                        if(!sel.passesIsolation(r, pair.nextClu)) continue;
+                    }
+                    pair.hltIso = grid_.etaBandPtSum(pair.eta, pair.phi, sel.hltIsoDEta, sel.hltIsoDR, ptMinIso, i, j, photonSelections, bit);
+                    pair.hltIso /= pair.pt;
+                }
+                if(!sel.passesHLTIsolation(r, pair.hltIso)) continue;
+                profiler.count(EcalStageProfiler::kPairsAccepted);
+
+                hooks.selected(pair, s);
+            }
+        }
+    }
+}
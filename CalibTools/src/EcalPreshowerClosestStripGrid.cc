@@ -0,0 +1,205 @@
+#include "CalibCode/CalibTools/interface/EcalPreshowerClosestStripGrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "DataFormats/EcalDetId/interface/ESDetId.h"
+#include "Geometry/EcalAlgo/interface/EcalPreshowerGeometry.h"
+
+namespace {
+    // cell size along the strips (cm); across the strips it is half the strip pitch
+    const float kCellAlongStrip = 1.;
+    // margin around the strip centers covered by the grid (cm)
+    const float kMargin = 5.;
+    // points closer than this to a cell edge (in units of the cell size) use the exact search
+    const double kEdge = 1.e-4;
+    // sensors (in six and siy) around the strip of a cell where a nearer strip is looked for
+    const int kSensorReach = 3;
+}
+
+const uint32_t EcalPreshowerClosestStripGrid::kNotComputed;
+const uint32_t EcalPreshowerClosestStripGrid::kMixed;
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalPreshowerClosestStripGrid::fill(const EcalPreshowerGeometry* esGeometry)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if(!esGeometry) throw cms::Exception("EcalPreshowerClosestStripGrid") << "null EcalPreshowerGeometry pointer\n";
+    esGeometry_ = esGeometry;
+
+    // extent, z and strip pitch of each plane and side from the strip centers
+    float xMin[2][2], xMax[2][2], yMin[2][2], yMax[2][2], pitch[2][2];
+    bool acrossX[2][2];
+    double zSum[2][2];
+    int nStrips[2][2];
+    for(int p=0; p<2; ++p) for(int s=0; s<2; ++s) {
+        xMin[p][s] = yMin[p][s] = 1.e6;
+        xMax[p][s] = yMax[p][s] = -1.e6;
+        pitch[p][s] = 0.;
+        acrossX[p][s] = true;
+        zSum[p][s] = 0.;
+        nStrips[p][s] = 0;
+    }
+    stripX_.assign(ESDetId::kSizeForDenseIndexing, 0.);
+    stripY_.assign(ESDetId::kSizeForDenseIndexing, 0.);
+    sensorSpacing_ = 1.e6;
+
+    for(uint32_t h=0; h<ESDetId::kSizeForDenseIndexing; ++h) {
+        ESDetId id = ESDetId::unhashIndex(h);
+        if(!ESDetId::validDetId(id.strip(), id.six(), id.siy(), id.plane(), id.zside())) continue;
+        int p = id.plane()-1, s = id.zside() > 0 ? 1 : 0;
+        GlobalPoint pos = esGeometry->getGeometry(id)->getPosition();
+        stripX_[h] = pos.x();
+        stripY_[h] = pos.y();
+        if(id.strip() == 1) {
+            if(ESDetId::validDetId(1, id.six()+1, id.siy(), id.plane(), id.zside())) {
+                GlobalPoint next = esGeometry->getGeometry(ESDetId(1, id.six()+1, id.siy(), id.plane(), id.zside()))->getPosition();
+                sensorSpacing_ = std::min(sensorSpacing_, (float) (next - pos).perp());
+            }
+            if(ESDetId::validDetId(1, id.six(), id.siy()+1, id.plane(), id.zside())) {
+                GlobalPoint next = esGeometry->getGeometry(ESDetId(1, id.six(), id.siy()+1, id.plane(), id.zside()))->getPosition();
+                sensorSpacing_ = std::min(sensorSpacing_, (float) (next - pos).perp());
+            }
+        }
+        xMin[p][s] = std::min(xMin[p][s], pos.x()); xMax[p][s] = std::max(xMax[p][s], pos.x());
+        yMin[p][s] = std::min(yMin[p][s], pos.y()); yMax[p][s] = std::max(yMax[p][s], pos.y());
+        zSum[p][s] += pos.z();
+        ++nStrips[p][s];
+        if(id.strip() == 2 && ESDetId::validDetId(1, id.six(), id.siy(), id.plane(), id.zside())) {
+            GlobalPoint pos1 = esGeometry->getGeometry(ESDetId(1, id.six(), id.siy(), id.plane(), id.zside()))->getPosition();
+            float dx = std::fabs(pos.x()-pos1.x()), dy = std::fabs(pos.y()-pos1.y());
+            float d = std::max(dx, dy);
+            if(pitch[p][s] == 0. || d < pitch[p][s]) {
+                pitch[p][s] = d;
+                acrossX[p][s] = dx > dy;
+            }
+        }
+    }
+
+    for(int p=0; p<2; ++p) for(int s=0; s<2; ++s) {
+        if(nStrips[p][s] == 0 || pitch[p][s] <= 0.)
+            throw cms::Exception("EcalPreshowerClosestStripGrid") << "no strips found for plane " << p+1 << " side " << s << "\n";
+        PlaneGrid& grid = grids_[p][s];
+        grid.zRef = zSum[p][s]/nStrips[p][s];
+        grid.xMin = xMin[p][s] - kMargin;
+        grid.yMin = yMin[p][s] - kMargin;
+        grid.dx = acrossX[p][s] ? 0.5*pitch[p][s] : kCellAlongStrip;
+        grid.dy = acrossX[p][s] ? kCellAlongStrip : 0.5*pitch[p][s];
+        grid.nx = (int)std::ceil((xMax[p][s] + kMargin - grid.xMin)/grid.dx);
+        grid.ny = (int)std::ceil((yMax[p][s] + kMargin - grid.yMin)/grid.dy);
+        grid.cells.assign(grid.nx*grid.ny, kNotComputed);
+    }
+
+    isFilled_ = true;
+    isEnabled_ = isProjective();
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+DetId EcalPreshowerClosestStripGrid::getClosestCellInPlane(const GlobalPoint& point, int plane)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if(!isEnabled_ || point.z() == 0. || plane < 1 || plane > 2) return esGeometry_->getClosestCellInPlane(point, plane);
+
+    PlaneGrid& grid = planeGrid(plane, point.z() > 0.);
+    double scale = grid.zRef/point.z();
+    double fx = (point.x()*scale - grid.xMin)/grid.dx;
+    double fy = (point.y()*scale - grid.yMin)/grid.dy;
+    if(fx < 0. || fy < 0. || fx >= grid.nx || fy >= grid.ny) return esGeometry_->getClosestCellInPlane(point, plane);
+
+    int ix = (int)fx, iy = (int)fy;
+    if(fx-ix < kEdge || ix+1-fx < kEdge || fy-iy < kEdge || iy+1-fy < kEdge) return esGeometry_->getClosestCellInPlane(point, plane);
+
+    uint32_t id = cell(grid, plane, ix, iy);
+    if(id == kMixed) return esGeometry_->getClosestCellInPlane(point, plane);
+    return DetId(id);
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+uint32_t EcalPreshowerClosestStripGrid::cell(PlaneGrid& grid, int plane, int ix, int iy)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    uint32_t& c = grid.cells[iy*grid.nx + ix];
+    if(c != kNotComputed) return c;
+
+    uint32_t corner[4];
+    float x[4], y[4];
+    for(int k=0; k<4; ++k) {
+        x[k] = grid.xMin + (ix + (k&1))*grid.dx;
+        y[k] = grid.yMin + (iy + (k>>1))*grid.dy;
+        corner[k] = esGeometry_->getClosestCellInPlane(GlobalPoint(x[k], y[k], grid.zRef), plane).rawId();
+    }
+    c = corner[0];
+    for(int k=1; k<4; ++k) if(corner[k] != corner[0]) c = kMixed;
+    // the region outside the strips is not convex
+    if(c == 0) c = kMixed;
+    // the sensors searched by the exact search change at the sensor edges: the cell is only given to its strip
+    // if it is the nearest of all the strips at the four corners, so that no window can miss it inside the cell
+    for(int k=0; k<4 && c != kMixed; ++k)
+        if(!isNearestStrip(ESDetId(c), x[k], y[k])) c = kMixed;
+    return c;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+bool EcalPreshowerClosestStripGrid::isNearestStrip(const ESDetId& strip, float x, float y) const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    // a nearer strip is closer than twice this distance to the strip, i.e. in one of the sensors around it
+    // as long as the distance is below the sensor spacing
+    float dx = stripX_[strip.hashedIndex()] - x, dy = stripY_[strip.hashedIndex()] - y;
+    float d2 = dx*dx + dy*dy;
+    if(d2 >= sensorSpacing_*sensorSpacing_) return false;
+
+    for(int six = strip.six()-kSensorReach; six <= strip.six()+kSensorReach; ++six)
+        for(int siy = strip.siy()-kSensorReach; siy <= strip.siy()+kSensorReach; ++siy)
+            for(int istrip = ESDetId::ISTRIP_MIN; istrip <= ESDetId::ISTRIP_MAX; ++istrip) {
+                if(!ESDetId::validDetId(istrip, six, siy, strip.plane(), strip.zside())) continue;
+                int h = ESDetId(istrip, six, siy, strip.plane(), strip.zside()).hashedIndex();
+                float ex = stripX_[h] - x, ey = stripY_[h] - y;
+                if(ex*ex + ey*ey < d2) return false;
+            }
+    return true;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+bool EcalPreshowerClosestStripGrid::isProjective()
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    // moving a point along the line from the origin must not change the exact answer
+    const int nSteps = 20;
+    const double scales[2] = { 0.93, 1.07 };
+    for(int plane=1; plane<=2; ++plane) for(int s=0; s<2; ++s) {
+        const PlaneGrid& grid = grids_[plane-1][s];
+        for(int i=0; i<nSteps; ++i) for(int j=0; j<nSteps; ++j) {
+            double x = grid.xMin + (i+0.37)/nSteps*grid.nx*grid.dx;
+            double y = grid.yMin + (j+0.61)/nSteps*grid.ny*grid.dy;
+            DetId ref = esGeometry_->getClosestCellInPlane(GlobalPoint(x, y, grid.zRef), plane);
+            for(int k=0; k<2; ++k) {
+                GlobalPoint scaled(x*scales[k], y*scales[k], grid.zRef*scales[k]);
+                if(esGeometry_->getClosestCellInPlane(scaled, plane) != ref) return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+int EcalPreshowerClosestStripGrid::validate(int nPoints)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    if(!isFilled_) throw cms::Exception("EcalPreshowerClosestStripGrid") << "validate called before fill\n";
+
+    // quasi-random points over the grid, with z spread around the plane
+    int nMismatch = 0;
+    for(int plane=1; plane<=2; ++plane) for(int s=0; s<2; ++s) {
+        const PlaneGrid& grid = grids_[plane-1][s];
+        for(int k=1; k<=nPoints; ++k) {
+            double u = std::fmod(k*0.6180339887, 1.);
+            double v = std::fmod(k*0.7548776662, 1.);
+            double w = 1. + 0.1*std::fmod(k*0.5698402910, 1.);
+            GlobalPoint pos((grid.xMin + u*grid.nx*grid.dx)*w, (grid.yMin + v*grid.ny*grid.dy)*w, grid.zRef*w);
+            if(getClosestCellInPlane(pos, plane) != esGeometry_->getClosestCellInPlane(pos, plane)) ++nMismatch;
+        }
+    }
+    return nMismatch;
+}
@@ -0,0 +1,66 @@
+#include "CalibCode/CalibTools/interface/EcalRegionHistogram.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "TH2F.h"
+
+#include <algorithm>
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+EcalRegionHistogram::EcalRegionHistogram(const char *name, const char *title, int nBins, double xMin, double xMax, int nRegions, bool useSumw2) :
+  name_(name),
+  title_(title),
+  nBins_(nBins),
+  xMin_(xMin),
+  xMax_(xMax),
+  nRegions_(nRegions),
+  useSumw2_(useSumw2),
+  sumw_(size_t(nBins+2)*(nRegions+2), 0.),
+  sumw2_(useSumw2 ? size_t(nBins+2)*(nRegions+2) : 0, 0.),
+  entries_(0.)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    std::fill(stats_, stats_+7, 0.);
+}
+
+void EcalRegionHistogram::add(const EcalRegionHistogram& other)
+{
+    if (other.nBins_ != nBins_ || other.nRegions_ != nRegions_ || other.xMin_ != xMin_ || other.xMax_ != xMax_ || other.useSumw2_ != useSumw2_)
+        throw cms::Exception("EcalRegionHistogram") << "Cannot add " << other.name_ << " to " << name_ << ": different binning\n";
+
+    for (size_t i = 0; i < sumw_.size(); ++i) sumw_[i] += other.sumw_[i];
+    for (size_t i = 0; i < sumw2_.size(); ++i) sumw2_[i] += other.sumw2_[i];
+    entries_ += other.entries_;
+    for (int i = 0; i < 7; ++i) stats_[i] += other.stats_[i];
+}
+
+void EcalRegionHistogram::reset()
+{
+    std::fill(sumw_.begin(), sumw_.end(), 0.);
+    std::fill(sumw2_.begin(), sumw2_.end(), 0.);
+    entries_ = 0.;
+    std::fill(stats_, stats_+7, 0.);
+}
+
+TH2F* EcalRegionHistogram::toTH2F() const
+{
+    TH2F *h = new TH2F(name_.c_str(), title_.c_str(),
+                       nBins_, xMin_, xMax_,
+                       nRegions_, -0.5, ((double) nRegions_) - 0.5);
+    h->SetDirectory(0);
+    if (useSumw2_ && h->GetSumw2N() == 0) h->Sumw2();
+    if (!useSumw2_ && h->GetSumw2N() != 0) h->Sumw2(kFALSE);
+    h->GetXaxis()->SetTitle(xTitle_.c_str());
+    h->GetYaxis()->SetTitle(yTitle_.c_str());
+
+    // same global bin numbering as TH2F
+    std::copy(sumw_.begin(), sumw_.end(), h->GetArray());
+    if (useSumw2_) std::copy(sumw2_.begin(), sumw2_.end(), h->GetSumw2()->GetArray());
+
+    double stats[7];
+    std::copy(stats_, stats_+7, stats);
+    h->PutStats(stats);
+    h->SetEntries(entries_);
+
+    return h;
+}
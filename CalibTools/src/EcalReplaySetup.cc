@@ -0,0 +1,133 @@
+#include "CalibCode/CalibTools/interface/EcalReplaySetup.h"
+
+#include <memory>
+#include <algorithm>
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "Geometry/CaloTopology/interface/EcalBarrelHardcodedTopology.h"
+#include "Geometry/CaloTopology/interface/EcalEndcapHardcodedTopology.h"
+#include "CalibCode/CalibTools/interface/ECALGeometry.h"
+#include "CalibCode/CalibTools/interface/GeometryService.h"
+#include "CalibCode/CalibTools/interface/EndcapTools.h"
+
+#include "TFile.h"
+#include "TH2F.h"
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+EcalReplaySetup::EcalReplaySetup(const std::string& geometryFile, const std::string& deadMapFile) :
+  deadXtalFlags_(0)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    // as in FillEpsilonPlotGlobalCache
+    TFile* geometryTFile = TFile::Open(geometryFile.c_str());
+    if(!geometryTFile || !geometryTFile->IsOpen()) throw cms::Exception("ExtGeom") << "External Geometry file (" << geometryFile << ") not found\n";
+    ECALGeometry* geom = ECALGeometry::getGeometry(geometryTFile);
+    std::string geometryName = geometryFile;
+    GeometryService::setGeometryName(geometryName);
+    GeometryService::setGeometryPtr(geom);
+    EndcapTools::getDetIdsInRing(0);
+    geometryTFile->Close();
+    geomTable_.fill(geom);
+
+    ebTopology_.setSubdetTopology(DetId::Ecal, EcalBarrel, std::unique_ptr<const EcalBarrelHardcodedTopology>(new EcalBarrelHardcodedTopology()));
+    eeTopology_.setSubdetTopology(DetId::Ecal, EcalEndcap, std::unique_ptr<const EcalEndcapHardcodedTopology>(new EcalEndcapHardcodedTopology()));
+    ebWindow3x3_.fill(&ebTopology_, 3);
+    eeWindow3x3_.fill(&eeTopology_, 3);
+
+    if(deadMapFile != "") {
+        TFile* deadMap = TFile::Open(deadMapFile.c_str());
+        if(!deadMap || !deadMap->IsOpen()) throw cms::Exception("DeadMap") << "dead xtal map " << deadMapFile << " not found\n";
+        badChannels_.setDeadMap((TH2F*)deadMap->Get("rms_EB"), (TH2F*)deadMap->Get("rms_EEm"), (TH2F*)deadMap->Get("rms_EEp"));
+        badChannels_.setNeighbours(ebWindow3x3_, eeWindow3x3_);
+        deadMap->Close();
+        deadXtalFlags_ = EcalBadChannelMask::kDeadMap;
+    }
+}
+
+PosCalcParams EcalReplaySetup::positionParameters()
+{
+    PosCalcParams pc;
+    pc.param_LogWeighted_ = true;
+    pc.param_T0_barl_     = 7.4;
+    pc.param_T0_endc_     = 3.1;
+    pc.param_T0_endcES_   = 1.2;
+    pc.param_W0_          = 4.2;
+    pc.param_X0_          = 0.89;
+    return pc;
+}
+
+std::map<std::string,double> EcalReplaySetup::defaultCuts(bool isPi0)
+{
+    std::map<std::string,double> cuts;
+    cuts["EB_Seed_E"] = 0.5;         cuts["EE_Seed_E"] = 1.0;
+    cuts["useEE_EtSeed"] = 0.;       cuts["EE_Seed_Et"] = 0.0;
+    cuts["RemoveSeedsCloseToDeadXtal"] = 0.;
+    if(isPi0) {
+        cuts["S4S9_EB_low"] = 0.88;      cuts["S4S9_EB_high"] = 0.9;
+        cuts["S4S9_EE_low"] = 0.85;      cuts["S4S9_EE_high"] = 0.92;
+        cuts["nXtal_1_EB_low"] = 7;      cuts["nXtal_2_EB_low"] = 7;
+        cuts["nXtal_1_EB_high"] = 7;     cuts["nXtal_2_EB_high"] = 7;
+        cuts["nXtal_1_EE_low"] = 6;      cuts["nXtal_2_EE_low"] = 6;
+        cuts["nXtal_1_EE_high"] = 6;     cuts["nXtal_2_EE_high"] = 6;
+        cuts["gPtCutEB_low"] = 0.65;     cuts["gPtCutEB_high"] = 0.65;
+        cuts["gPtCutEE_low"] = 1.1;      cuts["gPtCutEE_high"] = 0.95;
+        cuts["Pi0PtCutEB_low"] = 2.0;    cuts["Pi0PtCutEB_high"] = 1.75;
+        cuts["Pi0PtCutEE_low"] = 3.75;   cuts["Pi0PtCutEE_high"] = 2.0;
+        cuts["Pi0IsoCutEB_low"] = 0.2;   cuts["Pi0IsoCutEB_high"] = 0.2;
+        cuts["Pi0IsoCutEE_low"] = 0.2;   cuts["Pi0IsoCutEE_high"] = 0.2;
+        cuts["Pi0HLTIsoCutEB_low"] = 0.5; cuts["Pi0HLTIsoCutEB_high"] = 0.5;
+        cuts["Pi0HLTIsoCutEE_low"] = 0.5; cuts["Pi0HLTIsoCutEE_high"] = 0.5;
+    } else {
+        cuts["S4S9_EB_low"] = 0.85;      cuts["S4S9_EB_high"] = 0.85;
+        cuts["S4S9_EE_low"] = 0.85;      cuts["S4S9_EE_high"] = 0.85;
+        cuts["nXtal_1_EB_low"] = 7;      cuts["nXtal_2_EB_low"] = 6;
+        cuts["nXtal_1_EB_high"] = 7;     cuts["nXtal_2_EB_high"] = 6;
+        cuts["nXtal_1_EE_low"] = 7;      cuts["nXtal_2_EE_low"] = 6;
+        cuts["nXtal_1_EE_high"] = 7;     cuts["nXtal_2_EE_high"] = 6;
+        cuts["gPtCutEB_low"] = 1.0;      cuts["gPtCutEB_high"] = 1.0;
+        cuts["gPtCutEE_low"] = 0.7;      cuts["gPtCutEE_high"] = 0.6;
+        cuts["Pi0PtCutEB_low"] = 3.0;    cuts["Pi0PtCutEB_high"] = 3.0;
+        cuts["Pi0PtCutEE_low"] = 3.0;    cuts["Pi0PtCutEE_high"] = 3.0;
+        cuts["Pi0IsoCutEB_low"] = 0.0;   cuts["Pi0IsoCutEB_high"] = 0.0;
+        cuts["Pi0IsoCutEE_low"] = 0.0;   cuts["Pi0IsoCutEE_high"] = 0.0;
+        cuts["Pi0HLTIsoCutEB_low"] = 0.5; cuts["Pi0HLTIsoCutEB_high"] = 0.5;
+        cuts["Pi0HLTIsoCutEE_low"] = 0.5; cuts["Pi0HLTIsoCutEE_high"] = 0.5;
+    }
+    return cuts;
+}
+
+EcalPi0ClusteringParameters EcalReplaySetup::clusteringParameters(const std::map<std::string,double>& cuts, bool isEB, const PosCalcParams& pc)
+{
+    const std::string d = isEB ? "EB" : "EE";
+    EcalPi0ClusteringParameters par;
+    par.seedEnergy = cuts.at(d + "_Seed_E");
+    par.useSeedEt = !isEB && cuts.at("useEE_EtSeed") != 0.;
+    par.seedEt = cuts.at("EE_Seed_Et");
+    par.etaBoundary = isEB ? 1. : 1.8;
+    par.s4s9Low = cuts.at("S4S9_" + d + "_low");
+    par.s4s9High = cuts.at("S4S9_" + d + "_high");
+    par.nXtalLow = std::min(cuts.at("nXtal_1_" + d + "_low"), cuts.at("nXtal_2_" + d + "_low"));
+    par.nXtalHigh = std::min(cuts.at("nXtal_1_" + d + "_high"), cuts.at("nXtal_2_" + d + "_high"));
+    par.ptLow = cuts.at("gPtCut" + d + "_low");
+    par.ptHigh = cuts.at("gPtCut" + d + "_high");
+    par.removeSeedsCloseToDead = cuts.at("RemoveSeedsCloseToDeadXtal") != 0.;
+    par.T0 = isEB ? pc.param_T0_barl_ : pc.param_T0_endc_;
+    par.position = pc;
+    return par;
+}
+
+EcalMesonSelection EcalReplaySetup::mesonSelection(const std::map<std::string,double>& cuts, bool isPi0)
+{
+    EcalMesonSelection sel(isPi0);
+    const std::string region[4] = { "EB_low", "EB_high", "EE_low", "EE_high" };
+    for(int r=0; r<4; ++r) {
+        sel.pi0PtCut.push_back(cuts.at("Pi0PtCut" + region[r]));
+        sel.gPtCut.push_back(cuts.at("gPtCut" + region[r]));
+        sel.S4S9Cut.push_back(cuts.at("S4S9_" + region[r]));
+        sel.isoCut.push_back(cuts.at("Pi0IsoCut" + region[r]));
+        sel.hltIsoCut.push_back(cuts.at("Pi0HLTIsoCut" + region[r]));
+        sel.nXtal1Cut.push_back(int(cuts.at("nXtal_1_" + region[r])));
+        sel.nXtal2Cut.push_back(int(cuts.at("nXtal_2_" + region[r])));
+    }
+    return sel;
+}
@@ -0,0 +1,70 @@
+#include "CalibCode/CalibTools/interface/EcalSparseRegionHistogram.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "TH2F.h"
+
+#include <algorithm>
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+EcalSparseRegionHistogram::EcalSparseRegionHistogram(const char *name, const char *title, int nBins, double xMin, double xMax, int nRegions, bool useSumw2) :
+  name_(name),
+  title_(title),
+  nBins_(nBins),
+  xMin_(xMin),
+  xMax_(xMax),
+  nRegions_(nRegions),
+  useSumw2_(useSumw2),
+  rows_(nRegions+2, kNoRow),
+  nRows_(0),
+  entries_(0.)
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    std::fill(stats_, stats_+7, 0.);
+}
+
+void EcalSparseRegionHistogram::add(const EcalSparseRegionHistogram& other)
+{
+    if (other.nBins_ != nBins_ || other.nRegions_ != nRegions_ || other.xMin_ != xMin_ || other.xMax_ != xMax_ || other.useSumw2_ != useSumw2_)
+        throw cms::Exception("EcalSparseRegionHistogram") << "Cannot add " << other.name_ << " to " << name_ << ": different binning\n";
+
+    const size_t rowSize = nBins_ + 2;
+    for (size_t biny = 0; biny < rows_.size(); ++biny) {
+        if (other.rows_[biny] == kNoRow) continue;
+        const size_t offset = rowOffset(biny);
+        const size_t otherOffset = size_t(other.rows_[biny])*rowSize;
+        for (size_t i = 0; i < rowSize; ++i) sumw_[offset + i] += other.sumw_[otherOffset + i];
+        if (useSumw2_)
+            for (size_t i = 0; i < rowSize; ++i) sumw2_[offset + i] += other.sumw2_[otherOffset + i];
+    }
+    entries_ += other.entries_;
+    for (int i = 0; i < 7; ++i) stats_[i] += other.stats_[i];
+}
+
+TH2F* EcalSparseRegionHistogram::toTH2F() const
+{
+    TH2F *h = new TH2F(name_.c_str(), title_.c_str(),
+                       nBins_, xMin_, xMax_,
+                       nRegions_, -0.5, ((double) nRegions_) - 0.5);
+    h->SetDirectory(0);
+    if (useSumw2_ && h->GetSumw2N() == 0) h->Sumw2();
+    if (!useSumw2_ && h->GetSumw2N() != 0) h->Sumw2(kFALSE);
+    h->GetXaxis()->SetTitle(xTitle_.c_str());
+    h->GetYaxis()->SetTitle(yTitle_.c_str());
+
+    // rows copied at their TH2F global bins, the others stay empty
+    const size_t rowSize = nBins_ + 2;
+    for (size_t biny = 0; biny < rows_.size(); ++biny) {
+        if (rows_[biny] == kNoRow) continue;
+        const size_t offset = size_t(rows_[biny])*rowSize;
+        std::copy(sumw_.begin() + offset, sumw_.begin() + offset + rowSize, h->GetArray() + biny*rowSize);
+        if (useSumw2_) std::copy(sumw2_.begin() + offset, sumw2_.begin() + offset + rowSize, h->GetSumw2()->GetArray() + biny*rowSize);
+    }
+
+    double stats[7];
+    std::copy(stats_, stats_+7, stats);
+    h->PutStats(stats);
+    h->SetEntries(entries_);
+
+    return h;
+}
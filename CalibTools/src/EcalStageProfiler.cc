@@ -0,0 +1,101 @@
+#include "CalibCode/CalibTools/interface/EcalStageProfiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "TH1D.h"
+
+static const char* const stageNames[EcalStageProfiler::nStages] = {
+    "triggerFilter", "mcTruth", "ebClustering", "eeClustering", "esMatching",
+    "pairSearch", "isolation", "regionWeights", "histogramFill", "histogramMerge", "histogramWrite"
+};
+
+static const char* const counterNames[EcalStageProfiler::nCounters] = {
+    "events", "seeds", "clusters", "pairsTested", "pairsAccepted", "fills"
+};
+
+EcalStageProfiler::EcalStageProfiler(bool enabled) :
+  enabled_(enabled)
+{
+    for(int s=0; s<nStages; ++s) { nanoseconds_[s] = 0; calls_[s] = 0; }
+    for(int c=0; c<nCounters; ++c) counters_[c] = 0;
+}
+
+const char* EcalStageProfiler::stageName(Stage stage) { return stageNames[stage]; }
+const char* EcalStageProfiler::counterName(Counter counter) { return counterNames[counter]; }
+
+void EcalStageProfiler::merge(const EcalStageProfiler& other)
+{
+    for(int s=0; s<nStages; ++s) {
+        nanoseconds_[s] += other.nanoseconds_[s];
+        calls_[s] += other.calls_[s];
+    }
+    for(int c=0; c<nCounters; ++c) counters_[c] += other.counters_[c];
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+TH1D* EcalStageProfiler::timeHistogram(const char* name) const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    TH1D* h = new TH1D(name, "wall time per stage;;seconds", nStages, 0, nStages);
+    for(int s=0; s<nStages; ++s) {
+        h->GetXaxis()->SetBinLabel(s+1, stageNames[s]);
+        h->SetBinContent(s+1, seconds(Stage(s)));
+    }
+    return h;
+}
+
+TH1D* EcalStageProfiler::callsHistogram(const char* name) const
+{
+    TH1D* h = new TH1D(name, "timed calls per stage", nStages, 0, nStages);
+    for(int s=0; s<nStages; ++s) {
+        h->GetXaxis()->SetBinLabel(s+1, stageNames[s]);
+        h->SetBinContent(s+1, calls_[s]);
+    }
+    return h;
+}
+
+TH1D* EcalStageProfiler::counterHistogram(const char* name) const
+{
+    TH1D* h = new TH1D(name, "fill job counters", nCounters, 0, nCounters);
+    for(int c=0; c<nCounters; ++c) {
+        h->GetXaxis()->SetBinLabel(c+1, counterNames[c]);
+        h->SetBinContent(c+1, counters_[c]);
+    }
+    return h;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalStageProfiler::print() const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    std::cout << "stage               seconds      calls" << std::endl;
+    for(int s=0; s<nStages; ++s)
+        std::cout << std::left << std::setw(16) << stageNames[s] << std::right
+                  << std::setw(12) << std::fixed << std::setprecision(3) << seconds(Stage(s))
+                  << std::setw(11) << calls_[s] << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+    for(int c=0; c<nCounters; ++c)
+        std::cout << std::left << std::setw(16) << counterNames[c] << std::right << std::setw(23) << counters_[c] << std::endl;
+}
+
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+void EcalStageProfiler::writeJSON(const std::string& fileName, unsigned int nStreams) const
+/*+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-*/
+{
+    std::ofstream out(fileName.c_str());
+    if(!out) throw cms::Exception("EcalStageProfiler") << "cannot write the profile report " << fileName << "\n";
+
+    out << "{\n  \"streams\": " << nStreams << ",\n  \"stages\": {\n";
+    for(int s=0; s<nStages; ++s)
+        out << "    \"" << stageNames[s] << "\": { \"seconds\": " << std::setprecision(9) << seconds(Stage(s))
+            << ", \"calls\": " << calls_[s] << " }" << (s+1 < nStages ? "," : "") << "\n";
+    out << "  },\n  \"counters\": {\n";
+    for(int c=0; c<nCounters; ++c)
+        out << "    \"" << counterNames[c] << "\": " << counters_[c] << (c+1 < nCounters ? "," : "") << "\n";
+    out << "  }\n}\n";
+}
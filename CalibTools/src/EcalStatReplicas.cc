@@ -0,0 +1,55 @@
+#include "CalibCode/CalibTools/interface/EcalStatReplicas.h"
+
+#include <cmath>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+// splitmix64 finalizer, a well mixed 64 bit hash
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Poisson(1) by inversion of its cumulative distribution, u in [0,1)
+static unsigned int poisson1(double u)
+{
+    double p = std::exp(-1.);
+    double cdf = p;
+    unsigned int k = 0;
+    while(u >= cdf && k < 20) {
+        ++k;
+        p /= k;
+        cdf += p;
+    }
+    return k;
+}
+
+void EcalStatReplicas::configure(const std::string& mode, unsigned int nBootstrap)
+{
+    if(mode == "") {
+        mode_ = kNone;
+        weights_.clear();
+    } else if(mode == "evenOdd") {
+        mode_ = kEvenOdd;
+        weights_.assign(2, 0.);
+    } else if(mode == "bootstrap") {
+        if(nBootstrap < 2) throw cms::Exception("StatReplicas") << "at least 2 bootstrap replicas are needed, " << nBootstrap << " given\n";
+        mode_ = kBootstrap;
+        weights_.assign(nBootstrap, 0.);
+    } else throw cms::Exception("StatReplicas") << "unknown replica mode " << mode << ", use evenOdd or bootstrap\n";
+}
+
+void EcalStatReplicas::setEvent(uint32_t run, uint64_t event)
+{
+    if(mode_ == kEvenOdd) {
+        weights_[0] = event%2 == 0 ? 1. : 0.;
+        weights_[1] = event%2 == 0 ? 0. : 1.;
+    } else if(mode_ == kBootstrap) {
+        const uint64_t seed = mix(event ^ mix(run));
+        for(unsigned int k=0; k<weights_.size(); ++k)
+            weights_[k] = poisson1((mix(seed + k) >> 11) * (1./9007199254740992.));
+    }
+}
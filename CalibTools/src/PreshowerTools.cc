@@ -1,4 +1,5 @@
 //#include "Analysis/Modules/interface/PreshowerCluster.h"
+#include <iostream>
 #include <utility>
 #include <vector>
 #include "DataFormats/EgammaReco/interface/PreshowerCluster.h"
@@ -12,191 +13,145 @@ const double PreshowerTools::gamma_ = 0.024;
 const double PreshowerTools::calib_planeX_ = 1.0;
 const double PreshowerTools::calib_planeY_ = 0.7;
 const int    PreshowerTools::clusterwindowsize_ = 15;
+const uint32_t PreshowerTools::kNoStrip;
 
-//PreshowerTools::PreshowerTools(CaloSubdetectorGeometry* extGeom, CaloSubdetectorTopology* topology_p,  edm::Handle< ESRecHitCollection > & esHandle)
-PreshowerTools::PreshowerTools(const CaloGeometry* extGeom, CaloSubdetectorTopology* topology_p,  edm::Handle< ESRecHitCollection > & esHandle) : geom_(extGeom)
+PreshowerTools::PreshowerTools(const CaloSubdetectorTopology* topology_p) : geom_(0)
 {
-    //geom_ = extGeom; 
-    estopology_ = topology_p; 
-
-    for (ESRecHitCollection::const_iterator it = esHandle->begin(); it != esHandle->end(); it++) {
-        //Make the map of DetID, EcalRecHit pairs
-        rechits_map.insert(std::make_pair(it->id(), *it));
+    const uint32_t nStrips = ESDetId::kSizeForDenseIndexing;
+    for (int dir = 0; dir < kNDirections; dir++) neighbours_[dir].assign(nStrips, kNoStrip);
+    used_strips.assign(nStrips, false);
+
+    for (uint32_t hash = 0; hash < nStrips; hash++) {
+        ESDetId strip = ESDetId::unhashIndex(hash);
+        if (!ESDetId::validDetId(strip.strip(), strip.six(), strip.siy(), strip.plane(), strip.zside())) continue;
+
+        std::vector<DetId> step[kNDirections];
+        step[kNorth] = topology_p->north(strip);
+        step[kSouth] = topology_p->south(strip);
+        step[kEast]  = topology_p->east(strip);
+        step[kWest]  = topology_p->west(strip);
+        // same as EcalPreshowerNavigator: first neighbour, nothing if the list is empty
+        for (int dir = 0; dir < kNDirections; dir++)
+            if (!step[dir].empty() && step[dir][0] != DetId(0)) neighbours_[dir][hash] = ESDetId(step[dir][0]).hashedIndex();
     }
 }
 
 
+void PreshowerTools::setEvent(const CaloGeometry* extGeom, const ESRecHitCollection& esRecHits)
+{
+    geom_ = extGeom;
+    rechits_.fill(esRecHits);
+    clearUsed();
+}
+
+
 
 PreshowerCluster PreshowerTools::makeOnePreshowerCluster(int stripwindow, ESDetId *strip)
 {
    //the output class
    PreshowerCluster finalcluster;
 
-
-   // The set of used DetID's
-   //HitsID *used_s;
-
    esroad_2d.clear();
+   clearUsed();
 
-
-   //used_s = used_strips;
-   used_strips.clear();
-
-  
    int plane = strip->plane();
+   uint32_t home = strip->hashedIndex();
 
-  
-  // Collection of cluster strips
-   EcalRecHitCollection clusterRecHits;
-   // Map of strips for position calculation
-   RecHitsMap recHits_pos;
+   // Collection of cluster strips
+   std::vector<const EcalRecHit*> clusterRecHits;
 
-   //Make a navigator, and set it to the strip cell.
-   EcalPreshowerNavigator navigator(*strip, estopology_);
-   navigator.setHome(*strip);
    //search for neighbours in the central road
-   findESRoad(stripwindow,*strip,navigator,plane);
+   findESRoad(stripwindow,home,plane);
 
    if ( plane == 1 ) {
-      ESDetId strip_north = navigator.north();
-      findESRoad(stripwindow,strip_north,navigator,plane);
-      navigator.home();
-      ESDetId strip_south = navigator.south();
-      findESRoad(stripwindow,strip_south,navigator,plane);
-      navigator.home();
+      findESRoad(stripwindow,next(home,kNorth),plane);
+      findESRoad(stripwindow,next(home,kSouth),plane);
    }
    if ( plane == 2 ) {
-      ESDetId strip_east = navigator.east();
-      findESRoad(stripwindow,strip_east,navigator,plane);
-      navigator.home();
-      ESDetId strip_west = navigator.west();
-      findESRoad(stripwindow,strip_west,navigator,plane);
-      navigator.home();
+      findESRoad(stripwindow,next(home,kEast),plane);
+      findESRoad(stripwindow,next(home,kWest),plane);
    }
 
    // Start clustering from strip with max Energy in the road
    float E_max = 0.;
    bool found = false;
-   RecHitsMap::iterator max_it;
+   uint32_t max_strip = kNoStrip;
    // Loop over strips:
-   std::vector<ESDetId>::iterator itID;
-   for (itID = esroad_2d.begin(); itID != esroad_2d.end(); itID++) {
-     RecHitsMap::iterator strip_it = rechits_map.find(*itID);   
-     if(!goodStrip(strip_it)) continue;
+   for (std::vector<uint32_t>::const_iterator itID = esroad_2d.begin(); itID != esroad_2d.end(); itID++) {
+     if(!goodStrip(*itID)) continue;
 
-     DetId nonblindstripid (itID->rawId());
-     //GlobalPoint position = geom_->getPosition(nonblindstripid);
-     //if (position.z() > 0.)eventCont->hist("nonBlindstripPositionZpos")->Fill(position.x(),position.y());
-     //if (position.z() < 0.)eventCont->hist("nonBlindstripPositionZneg")->Fill(position.x(),position.y());
-
-     float E = strip_it->second.energy();
+     float E = rechits_.find(*itID)->energy();
      if ( E > E_max) {
         E_max = E;
         found = true;
-        max_it = strip_it;
+        max_strip = *itID;
      }
    }
-  
-	     if ( !found ) {//cout<<"WARNING: HOTSTRIP NOT FOUND!!!"<<endl;
-
-           for (itID = esroad_2d.begin(); itID != esroad_2d.end(); itID++) {
-               DetId blindstripid (itID->rawId());
-               //GlobalPoint position = geom_->getPosition(blindstripid);
-               //cout << "X Position: " << position.x() << "Y Position: " << position.y() << "Z Position: " << position.z() << endl;
-               //if (position.z() > 0.)eventCont->hist("BlindstripPositionZpos")->Fill(position.x(),position.y());
-               //if (position.z() < 0.)eventCont->hist("BlindstripPositionZneg")->Fill(position.x(),position.y());    
-           }
 
-           return finalcluster;}
+   if ( !found ) return finalcluster; //cout<<"WARNING: HOTSTRIP NOT FOUND!!!"<<endl;
 
    // First, save the hottest strip
-   clusterRecHits.push_back(max_it->second);  
-   recHits_pos.insert(std::make_pair(max_it->first, max_it->second));
-   used_strips.insert(max_it->first);
-
-   // Find positions of adjacent strips:
-   ESDetId next, strip_1, strip_2;
-   navigator.setHome(max_it->first);
-   ESDetId startES = max_it->first;
-  
+   clusterRecHits.push_back(rechits_.find(max_strip));
+   setUsed(max_strip);
+
+   // Find positions of adjacent strips: two on each side of the hottest one,
+   // east-west for plane 1 and north-south for plane 2
+   Direction side1, side2;
    if (plane == 1) {
-     // Save two neighbouring strips to the east
-     int nadjacents_east = 0;
-     while ( (next=navigator.east()) != ESDetId(0) && next != startES && nadjacents_east < 2 ) {
-       ++nadjacents_east;
-       RecHitsMap::iterator strip_it = rechits_map.find(next);
-      
-		   if(!goodStrip(strip_it)) continue;
-       // Save strip for clustering if it exists, not already in use, and satisfies an energy threshold
-        clusterRecHits.push_back(strip_it->second);       
-        // save strip for position calculation
-        if ( nadjacents_east==1 ) strip_1 = next;
-        used_strips.insert(strip_it->first);             
-     }
-     // Save two neighbouring strips to the west
-     navigator.home();
-     int nadjacents_west = 0;
-     while ( (next=navigator.west()) != ESDetId(0) && next != startES && nadjacents_west < 2 ) {
-        ++nadjacents_west;
-        RecHitsMap::iterator strip_it = rechits_map.find(next);
-        if(!goodStrip(strip_it)) continue;
-        clusterRecHits.push_back(strip_it->second);
-        if ( nadjacents_west==1 ) strip_2 = next;
-        used_strips.insert(strip_it->first);       
-     }
+     side1 = kEast;
+     side2 = kWest;
    }
-  else if (plane == 2) {
-
-   // Save two neighbouring strips to the north
-     int nadjacents_north = 0;
-     while ( (next=navigator.north()) != ESDetId(0) && next != startES && nadjacents_north < 2 ) {
-        ++nadjacents_north; 
-        RecHitsMap::iterator strip_it = rechits_map.find(next); 
-        if(!goodStrip(strip_it)) continue;      
-        clusterRecHits.push_back(strip_it->second);
-        if ( nadjacents_north==1 ) strip_1 = next;
-        used_strips.insert(strip_it->first);    
-     }
-     // Save two neighbouring strips to the south
-     navigator.home();
-     int nadjacents_south = 0;
-     while ( (next=navigator.south()) != ESDetId(0) && next != startES && nadjacents_south < 2 ) {
-        ++nadjacents_south;   
-        RecHitsMap::iterator strip_it = rechits_map.find(next);   
-        if(!goodStrip(strip_it)) continue;      
-        clusterRecHits.push_back(strip_it->second);
-        if ( nadjacents_south==1 ) strip_2 = next;
-        used_strips.insert(strip_it->first);    
-     }
+   else if (plane == 2) {
+     side1 = kNorth;
+     side2 = kSouth;
    }
    else {
      std::cout << " Wrong plane number" << plane <<", null cluster will be returned! " << std::endl;
      return finalcluster;
    } // end of if
 
-   // strips for position calculation
-   RecHitsMap::iterator strip_it1, strip_it2;
-   if ( strip_1 != ESDetId(0)) {
-     strip_it1 = rechits_map.find(strip_1);
-     recHits_pos.insert(std::make_pair(strip_it1->first, strip_it1->second));  
+   uint32_t strip_1 = kNoStrip, strip_2 = kNoStrip;
+   uint32_t nextStrip = max_strip;
+   int nadjacents = 0;
+   while ( (nextStrip=next(nextStrip,side1)) != kNoStrip && nextStrip != max_strip && nadjacents < 2 ) {
+     ++nadjacents;
+     // Save strip for clustering if it exists, not already in use, and satisfies an energy threshold
+     if(!goodStrip(nextStrip)) continue;
+     clusterRecHits.push_back(rechits_.find(nextStrip));
+     // save strip for position calculation
+     if ( nadjacents==1 ) strip_1 = nextStrip;
+     setUsed(nextStrip);
    }
-   if ( strip_2 != ESDetId(0) ) {
-     strip_it2 = rechits_map.find(strip_2);
-     recHits_pos.insert(std::make_pair(strip_it2->first, strip_it2->second));  
+   nextStrip = max_strip;
+   nadjacents = 0;
+   while ( (nextStrip=next(nextStrip,side2)) != kNoStrip && nextStrip != max_strip && nadjacents < 2 ) {
+     ++nadjacents;
+     if(!goodStrip(nextStrip)) continue;
+     clusterRecHits.push_back(rechits_.find(nextStrip));
+     if ( nadjacents==1 ) strip_2 = nextStrip;
+     setUsed(nextStrip);
    }
-   
-   RecHitsMap::iterator cp;
+
+   // strips for position calculation, summed in DetId order
+   const EcalRecHit* recHits_pos[3];
+   int nPos = 0;
+   recHits_pos[nPos++] = rechits_.find(max_strip);
+   if ( strip_1 != kNoStrip ) recHits_pos[nPos++] = rechits_.find(strip_1);
+   if ( strip_2 != kNoStrip && strip_2 != strip_1 ) recHits_pos[nPos++] = rechits_.find(strip_2);
+   for (int i = 1; i < nPos; i++)
+     for (int j = i; j > 0 && recHits_pos[j]->id() < recHits_pos[j-1]->id(); j--) std::swap(recHits_pos[j], recHits_pos[j-1]);
+
    double energy_pos = 0;
    double x_pos = 0;
    double y_pos = 0;
    double z_pos = 0;
-   for (cp = recHits_pos.begin(); cp!=recHits_pos.end(); cp++ ) {
-      double E = cp->second.energy();
-      energy_pos += E; 
-      GlobalPoint position = geom_->getPosition(cp->first);
+   for (int i = 0; i < nPos; i++) {
+      double E = recHits_pos[i]->energy();
+      energy_pos += E;
+      GlobalPoint position = geom_->getPosition(recHits_pos[i]->id());
       x_pos += E * position.x();
       y_pos += E * position.y();
-      z_pos += E * position.z();     
+      z_pos += E * position.z();
    }
   if(energy_pos>0.) {
      x_pos /= energy_pos;
@@ -204,118 +159,84 @@ PreshowerCluster PreshowerTools::makeOnePreshowerCluster(int stripwindow, ESDetI
      z_pos /= energy_pos;
   }
 
-  EcalRecHitCollection::iterator it;
   double Eclust = 0;
-  int stripscounter = 0;
-
-  for (it=clusterRecHits.begin(); it != clusterRecHits.end(); it++) {
-     Eclust += it->energy();
-     stripscounter++;
+  for (std::vector<const EcalRecHit*>::const_iterator it=clusterRecHits.begin(); it != clusterRecHits.end(); it++) {
+     Eclust += (*it)->energy();
   }
 
   //Filling PreshowerCluster
-
-  //finalcluster.set_x(x_pos);
-  //finalcluster.set_y(y_pos);
-  //finalcluster.set_z(z_pos);
-
-  //finalcluster.set_energy(Eclust);
-  //finalcluster.set_plane(plane);
-
-  //finalcluster.set_goodcluster(true);
- 
   std::vector< std::pair<DetId, float> > usedHits;
   PreshowerCluster output(Eclust,   math::XYZPoint(x_pos,y_pos, z_pos) , usedHits , plane);
-  //finalcluster = PreshowerCluster(Eclust,   math::XYZPoint(x_pos,y_pos, z_pos) , std::vector< std::pair<DetId, float> > usedHits, plane);
-
-  //used for debugging purposes 
-/*
-  cout << "//-------------------------------------------//"<<endl;
-  cout << " ES Cluster is created with " << endl;
-  cout << " energy = " << finalcluster.get_energy() << endl;
-  cout << " plane = " << finalcluster.get_plane() << endl;
-  cout << " stripscounter = "<<stripscounter<< endl;
-  cout << " (x,y,z) = " << "(" << finalcluster.get_x() <<", "<< finalcluster.get_y() <<", "<< finalcluster.get_z()<<")"<< std::endl; 
-  cout << "//-------------------------------------------//"<<endl;
-*/
-
-  //return finalcluster;
+
   return output;
 
 }
 
 
 
-void PreshowerTools::findESRoad(int stripwindow, ESDetId strip, EcalPreshowerNavigator theESNav, int plane) {
-  
-   if ( strip == ESDetId(0) ) return;
-
-    ESDetId next;
-    theESNav.setHome(strip);
- // First, add a central strip to the road 
-    esroad_2d.push_back(strip);   
-   
-    if (plane == 1) {
-      // east road
-      int n_east= 0;
-      while ( ((next=theESNav.east()) != ESDetId(0) && next != strip) ) {
-         esroad_2d.push_back(next);   
-         ++n_east;  
-         if (n_east == stripwindow) break; 
-      }
-      // west road
-
-      int n_west= 0;
-      theESNav.home();
-      while ( ((next=theESNav.west()) != ESDetId(0) && next != strip )) {
-         esroad_2d.push_back(next);   
-         ++n_west;  
-         if (n_west == stripwindow) break; 
-      }
-   } 
-   else if (plane == 2) {
-     // north road
-     int n_north= 0;
-     while ( ((next=theESNav.north()) != ESDetId(0) && next != strip) ) {       
-        esroad_2d.push_back(next);   
-        ++n_north;  
-        if (n_north == stripwindow) break; 
-     }
-     // south road
-     int n_south= 0;
-     theESNav.home();
-     while ( ((next=theESNav.south()) != ESDetId(0) && next != strip) ) {
-        esroad_2d.push_back(next);   
-        ++n_south;  
-        if (n_south == stripwindow) break; 
-     }
-   } 
+void PreshowerTools::findESRoad(int stripwindow, uint32_t strip, int plane) {
 
-   theESNav.home();
- }
+   if ( strip == kNoStrip ) return;
+
+   // First, add a central strip to the road
+   esroad_2d.push_back(strip);
+
+   Direction side1, side2;
+   if (plane == 1) {
+      side1 = kEast;
+      side2 = kWest;
+   }
+   else if (plane == 2) {
+      side1 = kNorth;
+      side2 = kSouth;
+   }
+   else return;
+
+   uint32_t nextStrip = strip;
+   int n_side = 0;
+   while ( (nextStrip=next(nextStrip,side1)) != kNoStrip && nextStrip != strip ) {
+      esroad_2d.push_back(nextStrip);
+      ++n_side;
+      if (n_side == stripwindow) break;
+   }
+   nextStrip = strip;
+   n_side = 0;
+   while ( (nextStrip=next(nextStrip,side2)) != kNoStrip && nextStrip != strip ) {
+      esroad_2d.push_back(nextStrip);
+      ++n_side;
+      if (n_side == stripwindow) break;
+   }
+}
 
 
 
  // returns true if the candidate strip fulfills the requirements to be added to the cluster:
  //=====================================================================================================
- bool PreshowerTools::goodStrip(RecHitsMap::iterator candidate_it)
+ bool PreshowerTools::goodStrip(uint32_t hash) const
  //======================================================================================================
  {
-   // crystal should not be included...
-
-      if ( (used_strips.find(candidate_it->first) != used_strips.end())  ||        //...if it already belongs to a cluster
-        (candidate_it == rechits_map.end() )                    ||        //...if it corresponds to a hit
-        (candidate_it->second.energy() <= 0. ) )   // ...if it has a negative or zero energy
+   // strip should not be included...
+   const EcalRecHit* candidate = rechits_.find(hash);
+   if ( (used_strips[hash])  ||                 //...if it already belongs to a cluster
+        (candidate == 0 )    ||                 //...if it has no rechit
+        (candidate->energy() <= 0. ) )          // ...if it has a negative or zero energy
      {
      return false;
      }
-      //Used for debug
-      /*   if (used_strips.find(candidate_it->first) != used_strips.end()){cout<<"The Strip Already belongs to a cluster"<<endl;
-       return false;} else if (candidate_it == rechits_map.end()){cout<<"The Strip correspond to a hit"<<endl;
-       return false;} else if (candidate_it->second.energy() <= 0. ) {cout<<"the strip has a negative or zero energy"<<endl;
-       return false;}*/
-     
+
    return true;
  }
 
 
+
+void PreshowerTools::setUsed(uint32_t hash)
+{
+   used_strips[hash] = true;
+   used_list.push_back(hash);
+}
+
+void PreshowerTools::clearUsed()
+{
+   for (std::vector<uint32_t>::const_iterator it = used_list.begin(); it != used_list.end(); it++) used_strips[*it] = false;
+   used_list.clear();
+}
@@ -0,0 +1,145 @@
+// Refills the epsilon (or mass) histograms of FillEpsilonPlot from pi0 candidate stores
+// (CandidateStoreOutput) with a new IC map, without reading the rechits again:
+// the 3x3 xtal energies of the stored pairs are recalibrated and the photon and pair
+// cuts redone, see EcalPi0CandidateReplay for what differs from a full pass.
+// The output has epsilon_EB_iR and epsilon_EE_iR as the FillEpsilonPlot output, for FitEpsilonPlot.
+//
+//   replayCandidates [options] store1.root [store2.root ...]
+//
+//   --geometry file      external geometry (caloGeometry.root)
+//   --calibMap file      IC map of the iteration, uncalibrated if not given
+//   --calibType type     xtal, tt or etaring
+//   --eta                eta selection (mass windows and default cuts) instead of the pi0 one
+//   --useMass            fill the mass instead of epsilon
+//   --blockSize n        candidates per block
+//   --output file
+//   --set name=value     clustering and pair cuts, names as in FillEpsilonPlot (S4S9_EB_low, ...)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+
+#include "TFile.h"
+#include "TH1.h"
+#include "TH2F.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "CalibCode/CalibTools/interface/EcalCalibTypes.h"
+#include "CalibCode/CalibTools/interface/EcalCalibMap.h"
+#include "CalibCode/CalibTools/interface/EcalRegionalCalibration.h"
+#include "CalibCode/CalibTools/interface/EcalRegionHistogram.h"
+#include "CalibCode/CalibTools/interface/EcalReplaySetup.h"
+#include "CalibCode/CalibTools/interface/EcalPi0CandidateStore.h"
+#include "CalibCode/CalibTools/interface/EcalPi0CandidateReplay.h"
+#include "CalibCode/CalibTools/interface/EcalStageProfiler.h"
+
+using namespace std;
+
+static void usage()
+{
+    cout << "usage: replayCandidates [--geometry f] [--calibMap f] [--calibType xtal|tt|etaring] [--eta] [--useMass]" << endl
+         << "                        [--blockSize n] [--output f] [--set name=value ...] store1.root [store2.root ...]" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    string geometryFile = "caloGeometry.root";
+    string calibMapFile;
+    string calibType = "xtal";
+    string outputFile = "replayCandidates.root";
+    bool arePi0 = true;
+    bool useMass = false;
+    size_t blockSize = 100000;
+    vector<string> inputFiles;
+
+    // defaults of submit/parameters.py, the eta ones (etaSelection) with --eta
+    for(int i=1; i<argc; ++i) if(string(argv[i]) == "--eta") arePi0 = false;
+    map<string,double> cuts = EcalReplaySetup::defaultCuts(arePi0);
+
+    for(int i=1; i<argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if(arg == "--help" || arg == "-h") { usage(); return 0; }
+        else if(arg == "--geometry" && hasValue) geometryFile = argv[++i];
+        else if(arg == "--calibMap" && hasValue) calibMapFile = argv[++i];
+        else if(arg == "--calibType" && hasValue) calibType = argv[++i];
+        else if(arg == "--eta") arePi0 = false;
+        else if(arg == "--useMass") useMass = true;
+        else if(arg == "--blockSize" && hasValue) blockSize = atol(argv[++i]);
+        else if(arg == "--output" && hasValue) outputFile = argv[++i];
+        else if(arg == "--set" && hasValue) {
+            string nameValue = argv[++i];
+            size_t eq = nameValue.find('=');
+            if(eq == string::npos || !cuts.count(nameValue.substr(0, eq))) {
+                cout << "replayCandidates: unknown cut " << nameValue << endl;
+                return 1;
+            }
+            cuts[nameValue.substr(0, eq)] = atof(nameValue.substr(eq+1).c_str());
+        }
+        else if(arg.compare(0, 2, "--") == 0) { usage(); return 1; }
+        else inputFiles.push_back(arg);
+    }
+    if(inputFiles.empty() || blockSize == 0) { usage(); return 1; }
+
+    EcalReplaySetup setup(geometryFile);
+    PosCalcParams pc = EcalReplaySetup::positionParameters();
+
+    EcalRegionalCalibrationBase* calibration = 0;
+    if(     calibType == "xtal")    calibration = new EcalRegionalCalibration<EcalCalibType::Xtal>();
+    else if(calibType == "tt")      calibration = new EcalRegionalCalibration<EcalCalibType::TrigTower>();
+    else if(calibType == "etaring") calibration = new EcalRegionalCalibration<EcalCalibType::EtaRing>();
+    else throw cms::Exception("CalibType") << "Calib type not recognized\n";
+    if(calibMapFile != "") calibration->getCalibMap()->loadCalibMapFromFile(calibMapFile.c_str(), false);
+
+    // pair selection and binning of FillEpsilonPlot
+    EcalMesonSelection selection = EcalReplaySetup::mesonSelection(cuts, arePi0);
+
+    EcalPi0CandidateReplay replay;
+    replay.setTables(&setup.geometry(), &setup.ebWindow3x3(), &setup.eeWindow3x3());
+    replay.setParameters(EcalReplaySetup::clusteringParameters(cuts, true, pc), EcalReplaySetup::clusteringParameters(cuts, false, pc),
+                         selection, useMass);
+    replay.setCalibration(calibMapFile != "" ? calibration->getCalibMap() : 0);
+
+    int nBins = 120;
+    double xMin = -0.5, xMax = 1.0;
+    if(useMass) {
+        xMin = selection.massLow;
+        xMax = selection.massHigh;
+        nBins = (xMax-xMin+0.000001)/0.004;
+    }
+    TH1::SetDefaultSumw2();
+    EcalRegionHistogram epsilonEB("epsilon_EB_iR", useMass ? "#pi^{0} Mass distribution EB" : "Epsilon distribution EB",
+                                  nBins, xMin, xMax, calibration->getCalibMap()->getNRegionsEB());
+    EcalRegionHistogram epsilonEE("epsilon_EE_iR", useMass ? "#pi^{0} Mass distribution EE" : "Epsilon distribution EE",
+                                  nBins, xMin, xMax, calibration->getCalibMap()->getNRegionsEE());
+    epsilonEB.setAxisTitles(useMass ? "Mass(#gamma#gamma)" : "Epsilon", "crystal index");
+    epsilonEE.setAxisTitles(useMass ? "Mass(#gamma#gamma)" : "Epsilon", "crystal index");
+
+    EcalStageProfiler profiler(true);
+    EcalPi0CandidateStoreReader reader(inputFiles);
+    EcalPi0CandidateBlock block;
+    while(reader.readBlock(block, blockSize)) {
+        EcalStageProfiler::Scope scope(profiler, EcalStageProfiler::kPairSearch);
+        replay.run(block, *calibration, &epsilonEB, &epsilonEE);
+    }
+    profiler.count(EcalStageProfiler::kPairsTested, replay.nRead());
+    profiler.count(EcalStageProfiler::kPairsAccepted, replay.nAccepted());
+
+    cout << "replayCandidates: " << replay.nRead() << " candidates, " << replay.nAccepted() << " accepted" << endl;
+    profiler.print();
+
+    TFile* out = TFile::Open(outputFile.c_str(), "RECREATE");
+    if(!out || !out->IsOpen()) throw cms::Exception("Output") << "cannot create " << outputFile << "\n";
+    TH2F* h = epsilonEB.toTH2F();
+    h->Write();
+    delete h;
+    h = epsilonEE.toTH2F();
+    h->Write();
+    delete h;
+    out->Close();
+    delete calibration;
+    return 0;
+}
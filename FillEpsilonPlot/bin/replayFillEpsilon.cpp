@@ -0,0 +1,245 @@
+// Replays the 3x3 clustering and the photon pair search of FillEpsilonPlot on local
+// EDM files, without cmsRun: it needs only the rechit collections and the external
+// geometry, so the clustering can be timed and checked on a laptop.
+// With --eventStore the inputs are rechit stores written by FillEpsilonPlot (EventStoreOutput)
+// instead of EDM files, which skips the EDM decoding.
+//
+//   replayFillEpsilon [options] file1.root [file2.root ...]
+//
+//   --eventStore         inputs are rechit stores
+//   --geometry file      external geometry (caloGeometry.root)
+//   --calibMap file      IC map (calibMap/calibMapEE TH2F), uncalibrated if not given
+//   --deadMap file       dead xtal map (rms_EB, rms_EEm, rms_EEp)
+//   --ebTag label:instance[:process]
+//   --eeTag label:instance[:process]
+//   --maxEvents n
+//   --output file        diphoton mass histograms
+//   --set name=value     clustering and pair cuts, names as in FillEpsilonPlot (S4S9_EB_low, ...)
+//
+// Pairs pass the same selection as in FillEpsilonPlot::computeEpsilon (EcalPi0PairSelection), pi0 only.
+// The ES matching of the EE clusters is not replayed, it needs the full CaloGeometry, and neither
+// are the containment corrections.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+
+#include "TFile.h"
+#include "TH1F.h"
+
+#include "FWCore/FWLite/interface/FWLiteEnabler.h"
+#include "FWCore/Utilities/interface/Exception.h"
+#include "DataFormats/FWLite/interface/Event.h"
+#include "DataFormats/FWLite/interface/Handle.h"
+#include "DataFormats/EcalRecHit/interface/EcalRecHitCollections.h"
+#include "DataFormats/CaloRecHit/interface/CaloCluster.h"
+
+#include "CalibCode/CalibTools/interface/EcalCalibTypes.h"
+#include "CalibCode/CalibTools/interface/EcalCalibMap.h"
+#include "CalibCode/CalibTools/interface/EcalReplaySetup.h"
+#include "CalibCode/CalibTools/interface/EcalEventStore.h"
+#include "CalibCode/CalibTools/interface/EcalHitRecord.h"
+#include "CalibCode/CalibTools/interface/EcalPi0Clustering.h"
+#include "CalibCode/CalibTools/interface/EcalPi0PairSelection.h"
+#include "CalibCode/CalibTools/interface/EcalStageProfiler.h"
+
+using namespace std;
+
+struct InputTag
+{
+    string label, instance, process;
+};
+
+static InputTag parseTag(const string& tag)
+{
+    InputTag t;
+    size_t c1 = tag.find(':');
+    t.label = tag.substr(0, c1);
+    if(c1 != string::npos) {
+        size_t c2 = tag.find(':', c1+1);
+        t.instance = tag.substr(c1+1, c2 == string::npos ? string::npos : c2-c1-1);
+        if(c2 != string::npos) t.process = tag.substr(c2+1);
+    }
+    return t;
+}
+
+static void usage()
+{
+    cout << "usage: replayFillEpsilon [--eventStore] [--geometry f] [--calibMap f] [--deadMap f] [--ebTag l:i[:p]] [--eeTag l:i[:p]]" << endl
+         << "                         [--maxEvents n] [--output f] [--set name=value ...] file1.root [file2.root ...]" << endl;
+}
+
+// clustering and pair search of one event, the same for EDM and rechit store inputs.
+// Pairs go through the EcalPi0PairSelection of FillEpsilonPlot::computeEpsilon, without containment corrections
+class EventReplay : private EcalPi0PairSelection::Hooks
+{
+    public:
+        EventReplay(EcalPi0Clustering<EBDetId>& eb, EcalPi0Clustering<EEDetId>& ee, const vector<EcalMesonSelection>& selections,
+                    TH1F* massEB, TH1F* massEE, EcalStageProfiler& profiler) :
+            eb_(eb), ee_(ee), massEB_(massEB), massEE_(massEE), mass_(0), profiler_(profiler)
+        {
+            pairSelection_.setSelections(&selections);
+        }
+
+        void event(const vector<EcalHitRecord>& ebRecords, const vector<EcalHitRecord>& eeRecords)
+        {
+            profiler_.count(EcalStageProfiler::kEvents);
+            {
+                EcalStageProfiler::Scope scope(profiler_, EcalStageProfiler::kEBClustering);
+                eb_.run(ebRecords.data(), ebRecords.size());
+            }
+            {
+                EcalStageProfiler::Scope scope(profiler_, EcalStageProfiler::kEEClustering);
+                ee_.run(eeRecords.data(), eeRecords.size());
+            }
+            profiler_.count(EcalStageProfiler::kSeeds, eb_.nSeeds() + ee_.nSeeds());
+            profiler_.count(EcalStageProfiler::kClusters, eb_.clusters().size() + ee_.clusters().size());
+
+            EcalStageProfiler::Scope scope(profiler_, EcalStageProfiler::kPairSearch);
+            // FillEpsilonPlot makes pairs only with at least two clusters
+            if(eb_.clusters().size() > 1) pairSearch(eb_.clusters(), true, massEB_);
+            if(ee_.clusters().size() > 1) pairSearch(ee_.clusters(), false, massEE_);
+        }
+
+        const EcalPi0PairSelection& pairSelection() const { return pairSelection_; }
+
+    private:
+        void pairSearch(const vector<EcalPi0Cluster>& clusters, bool isEB, TH1F* mass)
+        {
+            clusters_.clear();
+            nXtal_.clear();
+            for(vector<EcalPi0Cluster>::const_iterator c = clusters.begin(); c != clusters.end(); ++c) {
+                clusters_.push_back(reco::CaloCluster(c->energy, c->position, isEB ? reco::CaloID::DET_ECAL_BARREL : reco::CaloID::DET_ECAL_ENDCAP));
+                nXtal_.push_back(c->nXtal);
+            }
+            mass_ = mass;
+            pairSelection_.run(clusters_, nXtal_, 0, isEB, *this, profiler_);
+        }
+
+        void selected(const EcalPi0Pair& pair, size_t s) override
+        {
+            if(s == 0) mass_->Fill(pair.mass);
+        }
+
+        EcalPi0Clustering<EBDetId>& eb_;
+        EcalPi0Clustering<EEDetId>& ee_;
+        TH1F* massEB_;
+        TH1F* massEE_;
+        TH1F* mass_;
+        EcalStageProfiler& profiler_;
+        EcalPi0PairSelection pairSelection_;
+        vector<reco::CaloCluster> clusters_;
+        vector<int> nXtal_;
+};
+
+int main(int argc, char** argv)
+{
+    string geometryFile = "caloGeometry.root";
+    string calibMapFile, deadMapFile;
+    string outputFile = "replayFillEpsilon.root";
+    InputTag ebTag = parseTag("ecalRecHit:EcalRecHitsEB");
+    InputTag eeTag = parseTag("ecalRecHit:EcalRecHitsEE");
+    long maxEvents = -1;
+    bool eventStore = false;
+    vector<string> inputFiles;
+
+    // pi0 defaults of submit/parameters.py
+    map<string,double> cuts = EcalReplaySetup::defaultCuts(true);
+
+    for(int i=1; i<argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if(arg == "--help" || arg == "-h") { usage(); return 0; }
+        else if(arg == "--eventStore") eventStore = true;
+        else if(arg == "--geometry" && hasValue) geometryFile = argv[++i];
+        else if(arg == "--calibMap" && hasValue) calibMapFile = argv[++i];
+        else if(arg == "--deadMap" && hasValue) deadMapFile = argv[++i];
+        else if(arg == "--ebTag" && hasValue) ebTag = parseTag(argv[++i]);
+        else if(arg == "--eeTag" && hasValue) eeTag = parseTag(argv[++i]);
+        else if(arg == "--maxEvents" && hasValue) maxEvents = atol(argv[++i]);
+        else if(arg == "--output" && hasValue) outputFile = argv[++i];
+        else if(arg == "--set" && hasValue) {
+            string nameValue = argv[++i];
+            size_t eq = nameValue.find('=');
+            if(eq == string::npos || !cuts.count(nameValue.substr(0, eq))) {
+                cout << "replayFillEpsilon: unknown cut " << nameValue << endl;
+                return 1;
+            }
+            cuts[nameValue.substr(0, eq)] = atof(nameValue.substr(eq+1).c_str());
+        }
+        else if(arg.compare(0, 2, "--") == 0) { usage(); return 1; }
+        else inputFiles.push_back(arg);
+    }
+    if(inputFiles.empty()) { usage(); return 1; }
+
+    FWLiteEnabler::enable();
+
+    EcalReplaySetup setup(geometryFile, deadMapFile);
+    PosCalcParams pc = EcalReplaySetup::positionParameters();
+
+    EcalPi0Clustering<EBDetId> ebClustering;
+    EcalPi0Clustering<EEDetId> eeClustering;
+    ebClustering.setTables(&setup.ebWindow3x3(), &setup.geometry(), &setup.badChannels());
+    eeClustering.setTables(&setup.eeWindow3x3(), &setup.geometry(), &setup.badChannels());
+    EcalPi0ClusteringParameters ebPar = EcalReplaySetup::clusteringParameters(cuts, true, pc);
+    EcalPi0ClusteringParameters eePar = EcalReplaySetup::clusteringParameters(cuts, false, pc);
+    ebPar.deadXtalFlags = eePar.deadXtalFlags = setup.deadXtalFlags();
+    ebClustering.setParameters(ebPar);
+    eeClustering.setParameters(eePar);
+
+    if(calibMapFile != "") {
+        EcalCalibMap<EcalCalibType::Xtal> calibMap;
+        calibMap.loadCalibMapFromFile(calibMapFile.c_str(), false);
+        ebClustering.setCalibration(&calibMap);
+        eeClustering.setCalibration(&calibMap);
+    }
+
+    TFile* out = TFile::Open(outputFile.c_str(), "RECREATE");
+    if(!out || !out->IsOpen()) throw cms::Exception("Output") << "cannot create " << outputFile << "\n";
+    TH1F* massEB = new TH1F("pi0MassEB", "#gamma#gamma mass EB;m_{#gamma#gamma} (GeV);pairs", 200, 0., 0.8);
+    TH1F* massEE = new TH1F("pi0MassEE", "#gamma#gamma mass EE (no ES);m_{#gamma#gamma} (GeV);pairs", 200, 0., 0.8);
+
+    EcalStageProfiler profiler(true);
+    vector<EcalHitRecord> ebRecords, eeRecords;
+
+    long nEvents = 0;
+    vector<EcalMesonSelection> selections(1, EcalReplaySetup::mesonSelection(cuts, true));
+    EventReplay replay(ebClustering, eeClustering, selections, massEB, massEE, profiler);
+    if(eventStore) {
+        EcalEventStoreReader reader(inputFiles, false);
+        for(int64_t entry = 0; entry < reader.entries() && nEvents != maxEvents; ++entry, ++nEvents) {
+            reader.read(entry);
+            replay.event(reader.eb(), reader.ee());
+        }
+    }
+    for(vector<string>::const_iterator f = inputFiles.begin(); !eventStore && f != inputFiles.end() && nEvents != maxEvents; ++f) {
+        TFile* in = TFile::Open(f->c_str());
+        if(!in || !in->IsOpen()) {
+            cout << "replayFillEpsilon: cannot open " << *f << ", skipped" << endl;
+            continue;
+        }
+        fwlite::Event ev(in);
+        for(ev.toBegin(); !ev.atEnd() && nEvents != maxEvents; ++ev, ++nEvents) {
+            fwlite::Handle<EcalRecHitCollection> ebHandle, eeHandle;
+            ebHandle.getByLabel(ev, ebTag.label.c_str(), ebTag.instance.c_str(), ebTag.process.c_str());
+            eeHandle.getByLabel(ev, eeTag.label.c_str(), eeTag.instance.c_str(), eeTag.process.c_str());
+            fillHitRecords<EBDetId>(*ebHandle, ebRecords);
+            fillHitRecords<EEDetId>(*eeHandle, eeRecords);
+            replay.event(ebRecords, eeRecords);
+        }
+        in->Close();
+    }
+
+    cout << "replayFillEpsilon: " << nEvents << " events" << endl;
+    cout << "pi0 pairs: tested " << replay.pairSelection().nTested() << ", skipped by the eta-phi grid " << replay.pairSelection().nSkipped() << endl;
+    profiler.print();
+
+    out->cd();
+    massEB->Write();
+    massEE->Write();
+    out->Close();
+    return 0;
+}
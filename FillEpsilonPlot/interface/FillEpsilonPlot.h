@@ -1,12 +1,18 @@
+#include <mutex>
+#include <memory>
+
 #include "TFile.h"
 #include "TH2F.h"
 #include "TH1F.h"
+#include "TTree.h"
 #include "TLorentzVector.h"
 
 #include "FWCore/Framework/interface/Frameworkfwd.h"
-#include "FWCore/Framework/interface/EDAnalyzer.h"
+#include "FWCore/Framework/interface/stream/EDAnalyzer.h"
 
 #include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Common/interface/TriggerNames.h"
+#include "DataFormats/Common/interface/TriggerResults.h"
 #include "FWCore/Framework/interface/MakerMacros.h"
 #include "SimDataFormats/PileupSummaryInfo/interface/PileupSummaryInfo.h"
 
@@ -18,11 +24,26 @@
 
 #include "CalibCode/CalibTools/interface/PosCalcParams.h"
 #include "CalibCode/CalibTools/interface/ECALGeometry.h"
+#include "CalibCode/CalibTools/interface/EcalGeometryTable.h"
 #include "CalibCode/CalibTools/interface/EcalEnerCorr.h"
 #include "CalibCode/CalibTools/interface/EndcapTools.h"
 #include "CalibCode/CalibTools/interface/EcalCalibTypes.h"
 #include "CalibCode/CalibTools/interface/EcalRegionalCalibration.h"
 #include "CalibCode/CalibTools/interface/EcalPreshowerHardcodedTopology.h"
+#include "CalibCode/CalibTools/interface/EcalPi0Clustering.h"
+#include "CalibCode/CalibTools/interface/EcalBadChannelMask.h"
+#include "CalibCode/CalibTools/interface/EcalPreshowerClosestStripGrid.h"
+#include "CalibCode/CalibTools/interface/EcalRecHitCompare.h"
+#include "CalibCode/CalibTools/interface/EcalNeighbourTable.h"
+#include "CalibCode/CalibTools/interface/EcalClusterGrid.h"
+#include "CalibCode/CalibTools/interface/EcalPi0PairSelection.h"
+#include "CalibCode/CalibTools/interface/EcalRegionHistogram.h"
+#include "CalibCode/CalibTools/interface/EcalStageProfiler.h"
+#include "CalibCode/CalibTools/interface/EcalStatReplicas.h"
+#include "CalibCode/CalibTools/interface/EcalIOVList.h"
+#include "CalibCode/CalibTools/interface/EcalSparseRegionHistogram.h"
+#include "CalibCode/CalibTools/interface/EcalEventStore.h"
+#include "CalibCode/CalibTools/interface/EcalPi0CandidateStore.h"
 #include "Geometry/EcalAlgo/interface/EcalPreshowerGeometry.h"
 #include "Geometry/CaloGeometry/interface/CaloGeometry.h"
 #include "CondFormats/EcalObjects/interface/EcalChannelStatus.h"
@@ -49,22 +70,46 @@ struct iXiYtoRing {
     int sign;
     int Ring;
     iXiYtoRing() : iX(0), iY(0), sign(0), Ring(-1) { }
-} GiveRing;
+};
 
 using namespace reco;
 
-class FillEpsilonPlot : public edm::EDAnalyzer {
+class FillEpsilonPlot;
+class PreshowerTools;
+
+// shared by all the streams: the external geometry (ECALGeometry is a singleton,
+// also used by EndcapTools through GeometryService) and the stream instances,
+// handed over at endStream and merged in globalEndJob
+class FillEpsilonPlotGlobalCache {
    public:
-      explicit FillEpsilonPlot(const edm::ParameterSet&);
+      explicit FillEpsilonPlotGlobalCache(const edm::ParameterSet&);
+      ~FillEpsilonPlotGlobalCache();
+
+      TFile *externalGeometryFile_;
+      ECALGeometry *geom_;
+
+      mutable std::mutex streamsMutex_;
+      mutable std::vector<FillEpsilonPlot*> streams_;  // indexed by stream id
+};
+
+class FillEpsilonPlot : public edm::stream::EDAnalyzer< edm::GlobalCache<FillEpsilonPlotGlobalCache> >, private EcalPi0PairSelection::Hooks {
+   public:
+      explicit FillEpsilonPlot(const edm::ParameterSet&, const FillEpsilonPlotGlobalCache*);
       ~FillEpsilonPlot();
 
       static void fillDescriptions(edm::ConfigurationDescriptions& descriptions);
 
+      static std::unique_ptr<FillEpsilonPlotGlobalCache> initializeGlobalCache(const edm::ParameterSet&);
+      static void globalEndJob(const FillEpsilonPlotGlobalCache*);
 
    private:
-      virtual void beginJob() ;
+      virtual void beginStream(edm::StreamID) ;
       virtual void analyze(const edm::Event&, const edm::EventSetup&);
-      virtual void endJob() ;
+      virtual void endStream() ;
+
+      // histograms and tree of the other streams are added to the ones of this stream
+      void mergeStream(FillEpsilonPlot &other);
+      void writeOutput(const std::vector<FillEpsilonPlot*> &streams);
 
       virtual void beginRun(edm::Run const&, edm::EventSetup const&);
       virtual void endRun(edm::Run const&, edm::EventSetup const&);
@@ -72,29 +117,37 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       virtual void endLuminosityBlock(edm::LuminosityBlock const&, edm::EventSetup const&);
 
       // ---------- user defined ------------------------
-      void fillEBClusters(std::vector< CaloCluster > & ebclusters, const edm::Event& iEvent, const EcalChannelStatus &channelStatus);
-      void fillEEClusters(std::vector< CaloCluster > & eseeclusters,std::vector< CaloCluster > & eseeclusters_tot, const edm::Event& iEvent, const EcalChannelStatus &channelStatus);
+      void fillEBClusters(std::vector< CaloCluster > & ebclusters, const edm::Event& iEvent);
+      void fillEEClusters(std::vector< CaloCluster > & eseeclusters,std::vector< CaloCluster > & eseeclusters_tot, const edm::Event& iEvent);
       //std::vector< CaloCluster > MCTruthAssociate(std::vector< CaloCluster > & clusters, double deltaR, bool isEB);
       std::vector< CaloCluster > MCTruthAssociateMultiPi0(std::vector< CaloCluster > & clusters, int& retNumberUnmergedGen, int& retNumberMatchedGen, std::vector<TLorentzVector*>& retClusters_matchedGenPhotonEnergy, const double deltaR, const bool isEB);
       // void computePairProperties(std::vector<CaloCluster>::const_iterator g1, std::vector<CaloCluster>::const_iterator g2, math::XYZVector &tmp_photon1, math::XYZVector &tmp_photon2, float &m_pair, float &pt_pair, float &eta_pair, float &phi_pair);
       void computePairProperties(const CaloCluster* g1, const CaloCluster* g2, math::XYZVector &tmp_photon1, math::XYZVector &tmp_photon2, float &m_pair, float &pt_pair, float &eta_pair, float &phi_pair);
+      void computePairProperties(const math::XYZPoint& position1, const float energy1, const math::XYZPoint& position2, const float energy2, math::XYZVector &tmp_photon1, math::XYZVector &tmp_photon2, float &m_pair, float &pt_pair, float &eta_pair, float &phi_pair);
       void computeEpsilon(std::vector< CaloCluster > & clusters, std::vector<TLorentzVector*>& clusters_matchedGenPhoton, int subDetId);
+      // EcalPi0PairSelection::Hooks of computeEpsilon
+      void preselected(const EcalPi0Pair& pair) override;
+      void correct(EcalPi0Pair& pair) override;
+      void passedKinematics(const EcalPi0Pair& pair, size_t s) override;
+      void selected(const EcalPi0Pair& pair, size_t s) override;
       void computeEoverEtrue(std::vector< CaloCluster > & clusters, std::vector<TLorentzVector*>& clusters_matchedGenPhoton, int subDetId);
-      bool checkStatusOfEcalRecHit(const EcalChannelStatus &channelStatus,const EcalRecHit &rh);
-      bool isInDeadMap( bool isEB, const EcalRecHit &rh );
       float GetDeltaR(float eta1, float eta2, float phi1, float phi2);
       float DeltaPhi(float phi1, float phi2);
       double min( double a, double b);
       int getNumberOverlappingCrystals(std::vector<CaloCluster>::const_iterator g1, std::vector<CaloCluster>::const_iterator g2, const bool isEB);
 
 
-      TH2F* initializeEpsilonHistograms2D(const char *name, const char *title, int size );
-      void deleteEpsilonPlot2D(TH2F *h);
-      void writeEpsilonPlot2D(TH2F *h);
+      EcalRegionHistogram* initializeEpsilonHistograms2D(const char *name, const char *title, int size, bool arePi0 );
+      void deleteEpsilonPlot2D(EcalRegionHistogram *h);
+      void writeEpsilonPlot2D(EcalRegionHistogram *h);
+      EcalSparseRegionHistogram* initializeIOVHistogram2D(const EcalRegionHistogram *nominal, size_t iov);
+      void writeEpsilonPlot2D(EcalSparseRegionHistogram *h);
 
       bool getTriggerResult(const edm::Event& iEvent, const edm::EventSetup& iSetup);
+      void updateL1Menu(const edm::EventSetup& iSetup);
       //bool getTriggerByName( std::string s ); not used anymore
-      bool GetHLTResults(const edm::Event& iEvent, std::string s);
+      void updateHLTPathIndices(const edm::Event& iEvent, const edm::TriggerResults& hltResults);
+      int findHLTPath(const edm::TriggerNames& HLTNames, std::string s);
      
       TFile* DeadMap;
       TH2F * EBMap_DeadXtal;
@@ -106,14 +159,46 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       TH2F* hCC_EoverEtrue_g2 = nullptr;
       void loadEoverEtrueContainmentCorrections(const string& fileName);
       CaloCluster getClusterAfterContainmentCorrections(std::vector<CaloCluster>::const_iterator, const bool isSecondPhoton, const bool isEB);
+      void applyContainmentCorrections(const CaloCluster& gam, const bool isSecondPhoton, float& energy, math::XYZPoint& position, std::vector< std::pair<DetId, float> >* correctedHitsAndFrac);
+      // containment corrections of hCC_EoverEtrue_g1/g2 by EB hashed index
+      std::vector<float> ccEoverEtrueEB_g1_;
+      std::vector<float> ccEoverEtrueEB_g2_;
+      std::vector<float> ccHitEnergyBuffer_;
+      // per-event memo of the corrected clusters, [0] as first photon and [1] as second photon
+      struct CorrectedCluster {
+        bool isSet;
+        float energy;
+        math::XYZPoint position;
+        CorrectedCluster() : isSet(false), energy(0.) {}
+      };
+      std::vector<CorrectedCluster> contCorrClusters_[2];
+      const CorrectedCluster& getContainmentCorrectedCluster(const std::vector<CaloCluster>& clusters, const size_t index, const bool isSecondPhoton, const bool isEB);
 
       // ----------member data ---------------------------
       edm::Handle< EBRecHitCollection > ebHandle;
       edm::Handle< EBRecHitCollection > eeHandle;
       edm::Handle< ESRecHitCollection > esHandle;
+      // framework independent 3x3 clustering, run on a copy of the rechits of the event
+      EcalPi0Clustering<EBDetId> ebClustering_;
+      EcalPi0Clustering<EEDetId> eeClustering_;
+      std::vector<EcalHitRecord> ebHitRecords_;
+      std::vector<EcalHitRecord> eeHitRecords_;
+      std::vector<EcalPi0ClusteringParameters> getClusteringParameters(int subDetId);
+      // rechit store of the selected events and pi0 candidate store, one file per stream
+      std::string eventStoreOutput_;
+      std::string candidateStoreOutput_;
+      EcalEventStoreWriter eventStore_;
+      EcalPi0CandidateStoreWriter candidateStore_;
+      std::vector<EcalHitRecord> esHitRecords_;
+      std::string streamFileName(const std::string& fileName) const;
+      void writeEventStore(const edm::Event& iEvent);
+      void fillCandidatePhoton(const CaloCluster& g, size_t index, int subDetId, EcalPi0CandidatePhoton& photon);
       // edm::Handle< edm::SortedCollection<EcalRecHit,edm::StrictWeakOrdering<EcalRecHit> > > esHandle;
 
       const EcalPreshowerGeometry *esGeometry_;     
+      EcalPreshowerClosestStripGrid esStripGrid_;  // closest ES strip lookup, filled in beginRun
+      unsigned long long esGeometryCacheId_;
+      bool validateESStripGrid_;
       const CaloGeometry* geometry;
       bool GeometryFromFile_;
 
@@ -136,9 +221,18 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       bool HLTResults_;
       std::string HLTResultsNameEB_;
       std::string HLTResultsNameEE_;
+      // index of the first path matching HLTResultsNameEB(EE), -1 if none, for the trigger names with ID hltNamesID_
+      int hltPathIndexEB_;
+      int hltPathIndexEE_;
+      edm::ParameterSetID hltNamesID_;
+      unsigned int nHLTPathResolutions_;
       bool RemoveDead_Flag_;
       TString RemoveDead_Map_;
       bool RemoveSeedsCloseToDeadXtal_;
+      // channel status, dead map and neighbours of dead xtals, by hashed index
+      EcalBadChannelMask badChannels_;
+      unsigned long long channelStatusCacheId_;
+      uint8_t deadXtalFlags_;
       TString L1_Bit_Sele_;
       //float L1BitCollection_[NL1SEED];
 
@@ -164,9 +258,14 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       //const double preshowerStartEta_ =  1.653;
 
       ECALGeometry* geom_;
+      EcalGeometryTable geomTable_;  // flat copy of geom_ or geometry, filled in beginRun
+      unsigned long long geometryCacheId_;
       CaloTopology *ebtopology_;
       CaloTopology *eetopology_;
       CaloSubdetectorTopology *estopology_;
+      PreshowerTools *esClusteringAlgo_;
+      EcalNeighbourTable<EBDetId> ebWindow3x3_;
+      EcalNeighbourTable<EEDetId> eeWindow3x3_;
       
       std::string calibTypeString_;
       calibGranularity calibTypeNumber_;
@@ -179,28 +278,28 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       // selection criteria
       double gPtCut_low_[3];
       double gPtCut_high_[3];
-      std::vector<double> gPtCut_;
       double pi0PtCut_low_[3];
       double pi0PtCut_high_[3];
-      std::vector<double> pi0PtCut_;
 
       double pi0IsoCut_low_[3];
       double pi0IsoCut_high_[3];
-      std::vector<double> pi0IsoCut_;
       bool   CutOnHLTIso_;
       double pi0HLTIsoCut_low_[3];
       double pi0HLTIsoCut_high_[3];
-      std::vector<double> pi0HLTIsoCut_;
 
       int nXtal_1_cut_low_[3];
       int nXtal_1_cut_high_[3];
       int nXtal_2_cut_low_[3];
       int nXtal_2_cut_high_[3];
-      std::vector<int> nXtal_1_cut_;
-      std::vector<int> nXtal_2_cut_;
       double S4S9_cut_low_[3];
       double S4S9_cut_high_[3];
-      std::vector<double> S4S9_cut_;
+      // [0] the selection of Are_pi0, [1] the eta one evaluated on the same pairs with FillEtaAlongPi0
+      bool fillEtaAlongPi0_;
+      std::vector<EcalMesonSelection> selections_;
+      EcalMesonSelection getMesonSelection(const edm::ParameterSet& cuts, bool isPi0);
+      // bit s set if the clustering of selections_[s] built the cluster, only with FillEtaAlongPi0
+      std::vector<uint8_t> photonSelectionsEB_;
+      std::vector<uint8_t> photonSelectionsEE_;
       int SystOrNot_;
 
       // MC stuff
@@ -236,10 +335,10 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       TH1F **EoverEtrue_g1_EE_h;  
       TH1F **EoverEtrue_g2_EB_h;  
       TH1F **EoverEtrue_g2_EE_h;  
-      TH2F *EoverEtrue_g1_EB_h2D;  
-      TH2F *EoverEtrue_g2_EB_h2D;  
-      TH2F *EoverEtrue_g1_EE_h2D;  
-      TH2F *EoverEtrue_g2_EE_h2D;  
+      EcalRegionHistogram *EoverEtrue_g1_EB_h2D;  
+      EcalRegionHistogram *EoverEtrue_g2_EB_h2D;  
+      EcalRegionHistogram *EoverEtrue_g1_EE_h2D;  
+      EcalRegionHistogram *EoverEtrue_g2_EE_h2D;  
       /* TH1F *allEoverEtrue_g1_EE;  */
       /* TH1F *allEoverEtrue_g1_EEnw;  */
       /* TH1F *allEoverEtrue_g1_EB; */
@@ -287,21 +386,51 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       string outputDir_;
 
       TFile *outfile_;
-      TFile *externalGeometryFile_;
+      unsigned int streamId_;
 
       std::vector<int> Ncristal_EE, Ncristal_EE_used;
       std::vector<int> Ncristal_EB, Ncristal_EB_used;
 
       TH1F **epsilon_EB_h;  // epsilon distribution by region
       TH1F **epsilon_EE_h;  // epsilon distribution in EE
-      TH2F *epsilon_EB_h2D;  // epsilon distribution by region
-      TH2F *epsilon_EE_h2D;  // epsilon distribution by region
+      EcalRegionHistogram *epsilon_EB_h2D;  // epsilon distribution by region
+      EcalRegionHistogram *epsilon_EE_h2D;  // epsilon distribution by region
+      // same distributions for the statistical replicas, filled with the event weights of statReplicas_
+      EcalStatReplicas statReplicas_;
+      std::vector<EcalRegionHistogram*> epsilon_EB_rep_h2D;
+      std::vector<EcalRegionHistogram*> epsilon_EE_rep_h2D;
+      // same distributions for each IOV of iovs_, currentIOV_ is the one of the event (-1 if none)
+      EcalIOVList iovs_;
+      int currentIOV_;
+      std::vector<EcalSparseRegionHistogram*> epsilon_EB_iov_h2D;
+      std::vector<EcalSparseRegionHistogram*> epsilon_EE_iov_h2D;
+      // distributions of the eta selection with FillEtaAlongPi0, null or empty otherwise
+      EcalRegionHistogram *epsilon_EB_eta_h2D;
+      EcalRegionHistogram *epsilon_EE_eta_h2D;
+      std::vector<EcalRegionHistogram*> epsilon_EB_eta_rep_h2D;
+      std::vector<EcalRegionHistogram*> epsilon_EE_eta_rep_h2D;
+      std::vector<EcalSparseRegionHistogram*> epsilon_EB_eta_iov_h2D;
+      std::vector<EcalSparseRegionHistogram*> epsilon_EE_eta_iov_h2D;
+      // nominal distributions in the granularities of ExtraCalibTypes, from the weights of the same pass:
+      // weightCalibrations_[0] is regionalCalibration_, [g] fills epsilon_EB_extra_h2D[g-1] (empty if not filled)
+      std::vector<std::string> extraCalibTypes_;
+      std::vector<EcalRegionalCalibrationBase*> weightCalibrations_;
+      std::vector<RegionWeightVector> weights1_;
+      std::vector<RegionWeightVector> weights2_;
+      std::vector<EcalRegionHistogram*> epsilon_EB_extra_h2D;
+      std::vector<EcalRegionHistogram*> epsilon_EE_extra_h2D;
+      void fillEpsilon(EcalRegionHistogram *h, std::vector<EcalRegionHistogram*> &replicas, std::vector<EcalSparseRegionHistogram*> &iovs, float x, uint32_t row, float w);
+      // distributions of selections_[s]
+      void fillEpsilon(size_t s, int subDetId, float x, uint32_t row, float w);
       TH2F *pi0MassVsIetaEB;
       TH2F *pi0MassVsETEB;
       TH2F *photonDeltaRVsIetaEB;
       bool useMassInsteadOfEpsilon_;
 
       TTree*  Tree_Optim;
+      // file of the stream where Tree_Optim is written while it is filled
+      TFile*  optimFile_;
+      std::string optimFileName_;
       Int_t   nPi0;
       //Int_t   Op_L1Seed[NL1SEED];
       Int_t   Op_NPi0;
@@ -385,7 +514,26 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       std::map<int,vector<int>> ListQuadFix_xtalEEp;
       std::map<int,vector<int>> List_IR_EtaPhi;
       std::map<int,vector<int>> List_IR_XYZ;
+      // (ix,iy) -> EE ring and region -> histogram rows for eta ring / SM / quadrant calibration
+      static const int kEERingTableSize = 101;
+      std::vector<int> EERingTable_;
+      int getEERing(int ix, int iy) const;
+      void fillRegionExpansionTables();
+      std::vector<uint32_t> regionRowsBeginEB_;
+      std::vector<int> regionRowsEB_;
+      std::vector<uint32_t> regionRowsBeginEE_;
+      std::vector<int> regionRowsEE_;
       vector<float> vs4s9EE;
+      // pair search and cuts of computeEpsilon, the pairs come back to the EcalPi0PairSelection::Hooks
+      EcalPi0PairSelection pairSelection_;
+      const std::vector<CaloCluster>* pairClusters_;
+      std::vector<TLorentzVector*>* pairMatchedGen_;
+      int pairSubDetId_;
+      // eta-phi grid and used flags for the gen matching in MCTruthAssociateMultiPi0
+      EcalClusterGrid mcMatchGrid_;
+      std::vector<bool> mcMatchUsed_;
+      // stage timers and counters, enabled with profileStages
+      EcalStageProfiler profiler_;
       vector<float> vSeedTime;
       vector<float> vSeedTimeEE;
       vector<float> vs1s9EE;
@@ -409,6 +557,13 @@ class FillEpsilonPlot : public edm::EDAnalyzer {
       std::string L1SeedsPi0Stream_;
       int nL1SeedsPi0Stream_; // number of seeds used by the stream (given L1SeedsPi0Stream_, it is the number of " OR " +1, e.g. "seed1 OR seed2 OR seed3" has 3 seeds
       int *seedIsInStream;
+      // bits of the seeds used by the stream and their bin in triggerComposition (0 if none), updated when the menu changes
+      std::vector<unsigned int> streamSeedBits_;
+      std::vector<int> streamSeedBins_;
+      // L1 decision of the seed of each triggerComposition bin (-1 if not in the menu), for the Tree_Optim branches
+      std::vector<short> seedFlagByBin_;
+      unsigned long long l1MenuCacheId_;
+      int trigCompBin_; // next free bin of triggerComposition
 
       // store for each event if AlCa_EcalPi0(Eta)EB(EE)only_v* fired
       bool EB_HLT, EE_HLT;
@@ -3,12 +3,19 @@
 
 #include <vector>
 #include <map>
+#include <stdint.h>
 
 typedef std::pair< int, int> aLSSegment;
 typedef std::vector< aLSSegment > GoodLSVector;
 typedef std::map< int, GoodLSVector  >    LSRange ;
 typedef std::pair < int, GoodLSVector > LSRangeElement;
 
+// Lumi mask from a certification JSON file ({"run": [[firstLS, lastLS], ...], ...}).
+// Runs are kept sorted with their LS ranges sorted and merged, so isGoodLS is a
+// binary search on the run (skipped when the run does not change) and one on the ranges.
+// Runs with many ranges also get a bitmap with one bit per LS.
+// Only the standard library is used, so the class can also be compiled in the ROOT macros
+// (e.g. gSystem->AddIncludePath("-I$CMSSW_BASE/src"); .L JSON.cc+).
 class JSON {
  public:
    JSON(const char* file);
@@ -16,10 +23,20 @@ class JSON {
    void ReadJSONFile(const char* json);
    bool isGoodLS(int run, int lumi);
 
+   unsigned int nRuns() const { return runs_.size(); }
+   unsigned int nLS() const;
+
  private:
-   int oldRun;   
-   LSRange goodLS_;
-   LSRange::const_iterator goodLSCache_; // ptr to list of good LS for last run
+   void addRun(int run, GoodLSVector& segments);
+
+   int oldRun;
+   int oldRunIndex_;          // index of oldRun in runs_, -1 if not a good run
+
+   std::vector<int> runs_;                   // sorted
+   std::vector<unsigned int> segmentsBegin_; // ranges of runs_[i] are segments_[segmentsBegin_[i] .. segmentsBegin_[i+1])
+   GoodLSVector segments_;                   // sorted and merged within each run
+   std::vector<int> bitmapBegin_;            // first word of the bitmap of run i in bitmap_, -1 if none
+   std::vector<uint64_t> bitmap_;
 
 };
 #endif
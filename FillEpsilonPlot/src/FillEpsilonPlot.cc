@@ -27,12 +27,15 @@ Implementation:
 
 // user include files
 #include "TFile.h"
+#include "TH1D.h"
+#include "TList.h"
+#include "TChain.h"
 #include "TSystem.h"
 #include "TRegexp.h"
 //#include "TStopwatch.h"
 
 #include "FWCore/Framework/interface/Frameworkfwd.h"
-#include "FWCore/Framework/interface/EDAnalyzer.h"
+#include "FWCore/Framework/interface/stream/EDAnalyzer.h"
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/Framework/interface/MakerMacros.h"
 
@@ -71,6 +74,8 @@ Implementation:
 #include "CalibCode/CalibTools/interface/EcalRecHitCompare.h"
 #include "CalibCode/CalibTools/interface/PreshowerTools.h"
 #include "CalibCode/CalibTools/interface/GeometryService.h"
+#include "CalibCode/CalibTools/interface/EcalGeometryTable.h"
+#include "CalibCode/CalibTools/interface/EcalClusterGrid.h"
 #include "CondFormats/EcalObjects/interface/EcalChannelStatus.h"
 #include "CondFormats/DataRecord/interface/EcalChannelStatusRcd.h"
 //Geom
@@ -116,27 +121,44 @@ using namespace edm;
 
 static float mass_pi0_bin_width = 0.004; // set following numbers accordingly, please
 static float mass_eta_bin_width = 0.004; // set following numbers accordingly, please
-static float mass_pi0_low  = 0.060;
-static float mass_pi0_high = 0.240;
-static float mass_eta_low  = 0.360;
-static float mass_eta_high = 0.700;
-
-// we would cut on corrected mass, but uncorrected mass is available before
-// and can be used to cut events and speed up the algorithm
-// let them be looser than those with correction, although the fit will be in an even narrower range
-// 
-static float mass_pi0_low_noCorrCut  = 0.050;
-static float mass_pi0_high_noCorrCut = 0.250;
-static float mass_eta_low_noCorrCut  = 0.340;
-static float mass_eta_high_noCorrCut = 0.720;
+// the mass windows of the selections and of the histograms are those of EcalMesonSelection
+
+// the histograms of a stream are kept out of the current directory (the ROOT default is left as it is for
+// the other modules of the job): they are merged and written in globalEndJob
+template<class H> static H* detached(H* h) { h->SetDirectory(0); return h; }
 
 //Function
 double max_array(double *A, int n);
 double max(double x, double y);
-int GetRing(int x, int y, vector<iXiYtoRing> VectRing, bool debug3);
 
 
-FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
+FillEpsilonPlotGlobalCache::FillEpsilonPlotGlobalCache(const edm::ParameterSet& iConfig)
+{
+    /// external hardcoded geometry, read once for all the streams
+    std::string externalGeometry = iConfig.getUntrackedParameter<std::string>("ExternalGeometry");
+    externalGeometryFile_ = TFile::Open( edm::FileInPath( externalGeometry.c_str() ).fullPath().c_str() );
+    if(!externalGeometryFile_ or not externalGeometryFile_->IsOpen()) throw cms::Exception("ExtGeom") << "External Geometry file (" << externalGeometry << ") not found\n";
+    geom_ = ECALGeometry::getGeometry(externalGeometryFile_);
+    GeometryService::setGeometryName(externalGeometry);
+    GeometryService::setGeometryPtr(geom_);
+    // EE rings are computed on first use, do it now and not concurrently in the streams
+    EndcapTools::getDetIdsInRing(0);
+}
+
+FillEpsilonPlotGlobalCache::~FillEpsilonPlotGlobalCache()
+{
+    EndcapTools::freeMemory();
+    delete geom_;
+    externalGeometryFile_->Close();
+}
+
+std::unique_ptr<FillEpsilonPlotGlobalCache> FillEpsilonPlot::initializeGlobalCache(const edm::ParameterSet& iConfig)
+{
+    return std::unique_ptr<FillEpsilonPlotGlobalCache>(new FillEpsilonPlotGlobalCache(iConfig));
+}
+
+
+FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig, const FillEpsilonPlotGlobalCache* cache)
 {
 
     /// parameters from python
@@ -208,14 +230,22 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
     S4S9_cut_high_[EcalBarrel]         = iConfig.getUntrackedParameter<double>("S4S9_EB_high");
     S4S9_cut_low_[EcalEndcap]          = iConfig.getUntrackedParameter<double>("S4S9_EE_low");
     S4S9_cut_high_[EcalEndcap]         = iConfig.getUntrackedParameter<double>("S4S9_EE_high");
+    fillEtaAlongPi0_                   = iConfig.getUntrackedParameter<bool>("FillEtaAlongPi0",false);
     SystOrNot_                         = iConfig.getUntrackedParameter<int>("SystOrNot",0);
+    statReplicas_.configure( iConfig.getUntrackedParameter<std::string>("StatReplicas",""), iConfig.getUntrackedParameter<int>("nStatReplicas",10) );
+    iovs_.configure( iConfig.getUntrackedParameter<std::vector<std::string> >("IOVBoundaries",std::vector<std::string>()) );
+    currentIOV_ = -1;
     useMassInsteadOfEpsilon_           = iConfig.getUntrackedParameter<bool>("useMassInsteadOfEpsilon",true);
     isMC_                              = iConfig.getUntrackedParameter<bool>("isMC",false);
     MC_Assoc_                          = iConfig.getUntrackedParameter<bool>("MC_Assoc",false);
     MC_Assoc_DeltaR                    = iConfig.getUntrackedParameter<double>("MC_Assoc_DeltaR",0.1);
     MakeNtuple4optimization_           = iConfig.getUntrackedParameter<bool>("MakeNtuple4optimization",false);
     GeometryFromFile_                  = iConfig.getUntrackedParameter<bool>("GeometryFromFile",false);
+    validateESStripGrid_               = iConfig.getUntrackedParameter<bool>("validateESStripGrid",false);
+    profiler_.setEnabled(                iConfig.getUntrackedParameter<bool>("profileStages",false) );
     JSONfile_                          = iConfig.getUntrackedParameter<std::string>("JSONfile","");
+    eventStoreOutput_                  = iConfig.getUntrackedParameter<std::string>("EventStoreOutput","");
+    candidateStoreOutput_              = iConfig.getUntrackedParameter<std::string>("CandidateStoreOutput","");
 
     L1SeedsPi0Stream_                  = iConfig.getUntrackedParameter<std::string>("L1SeedsPi0Stream");    
     nL1SeedsPi0Stream_                 = iConfig.getUntrackedParameter<int>("nL1SeedsPi0Stream");
@@ -226,6 +256,16 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
     if (isMC_)
       pileupSummaryToken_                = consumes<std::vector<PileupSummaryInfo> >(iConfig.getUntrackedParameter<edm::InputTag>("pileupSummaryTag"));
     fillKinematicVariables_            = iConfig.getUntrackedParameter<bool>("fillKinematicVariables",false);
+    // the ES energies of the candidates are indexed as the clusters before the MC association
+    if( candidateStoreOutput_!="" && isMC_ && MC_Assoc_ )
+      throw cms::Exception("CandidateStore") << "CandidateStoreOutput cannot be used with MC_Assoc\n";
+    if( statReplicas_.size() > 0 && isEoverEtrue_ )
+      throw cms::Exception("StatReplicas") << "StatReplicas cannot be used with isEoverEtrue\n";
+    if( iovs_.size() > 0 && isEoverEtrue_ )
+      throw cms::Exception("IOVBoundaries") << "IOVBoundaries cannot be used with isEoverEtrue\n";
+    // the photon cuts of each selection are redone on the clusters in the order they were made
+    if( fillEtaAlongPi0_ && (!Are_pi0_ || isEoverEtrue_ || MakeNtuple4optimization_ || (isMC_ && MC_Assoc_) || candidateStoreOutput_!="") )
+      throw cms::Exception("FillEtaAlongPi0") << "FillEtaAlongPi0 needs Are_pi0 and cannot be used with isEoverEtrue, MakeNtuple4optimization, MC_Assoc or CandidateStoreOutput\n";
 
     // for MC-truth association
     // g4_simTk_Token_  = consumes<edm::SimTrackContainer>(edm::InputTag("g4SimHits"));
@@ -262,42 +302,17 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
 	<<", Nxtal_2: "<<nXtal_2_cut_high_[EcalEndcap]
 	<<", S4S9: "<<S4S9_cut_high_[EcalEndcap]<<endl;
     cout<<"The StatError option choose is: "<<SystOrNot_<<" [0= No error stat computation, 1 = yes only even events, 2 = yes only odd events]"<<endl;
-
-    // pi0 pt
-    pi0PtCut_.push_back(pi0PtCut_low_[EcalBarrel]);
-    pi0PtCut_.push_back(pi0PtCut_high_[EcalBarrel]);
-    pi0PtCut_.push_back(pi0PtCut_low_[EcalEndcap]);
-    pi0PtCut_.push_back(pi0PtCut_high_[EcalEndcap]);
-    // photon pt
-    gPtCut_.push_back(gPtCut_low_[EcalBarrel]);
-    gPtCut_.push_back(gPtCut_high_[EcalBarrel]);
-    gPtCut_.push_back(gPtCut_low_[EcalEndcap]);
-    gPtCut_.push_back(gPtCut_high_[EcalEndcap]);
-    // S4/S9
-    S4S9_cut_.push_back(S4S9_cut_low_[EcalBarrel]);
-    S4S9_cut_.push_back(S4S9_cut_high_[EcalBarrel]);
-    S4S9_cut_.push_back(S4S9_cut_low_[EcalEndcap]);
-    S4S9_cut_.push_back(S4S9_cut_high_[EcalEndcap]);
-    // HLT iso
-    pi0HLTIsoCut_.push_back(pi0HLTIsoCut_low_[EcalBarrel]);
-    pi0HLTIsoCut_.push_back(pi0HLTIsoCut_high_[EcalBarrel]);
-    pi0HLTIsoCut_.push_back(pi0HLTIsoCut_low_[EcalEndcap]);
-    pi0HLTIsoCut_.push_back(pi0HLTIsoCut_high_[EcalEndcap]);
-    // pi0 iso (tighter than HLT iso)
-    pi0IsoCut_.push_back(pi0IsoCut_low_[EcalBarrel]);
-    pi0IsoCut_.push_back(pi0IsoCut_high_[EcalBarrel]);
-    pi0IsoCut_.push_back(pi0IsoCut_low_[EcalEndcap]);
-    pi0IsoCut_.push_back(pi0IsoCut_high_[EcalEndcap]);
-    // Nxtal photon 1
-    nXtal_1_cut_.push_back(nXtal_1_cut_low_[EcalBarrel]);
-    nXtal_1_cut_.push_back(nXtal_1_cut_high_[EcalBarrel]);
-    nXtal_1_cut_.push_back(nXtal_1_cut_low_[EcalEndcap]);
-    nXtal_1_cut_.push_back(nXtal_1_cut_high_[EcalEndcap]);
-    // Nxtal photon 2
-    nXtal_2_cut_.push_back(nXtal_2_cut_low_[EcalBarrel]);
-    nXtal_2_cut_.push_back(nXtal_2_cut_high_[EcalBarrel]);
-    nXtal_2_cut_.push_back(nXtal_2_cut_low_[EcalEndcap]);
-    nXtal_2_cut_.push_back(nXtal_2_cut_high_[EcalEndcap]);
+    if(iovs_.size() > 0) cout<<"Distributions also filled for "<<iovs_.size()<<" IOVs, the first starting at "<<iovs_.label(0)<<endl;
+    cout<<"Statistical replicas filled in the same pass: "<<statReplicas_.size()<<(statReplicas_.mode()==EcalStatReplicas::kBootstrap ? " (bootstrap)" : statReplicas_.mode()==EcalStatReplicas::kEvenOdd ? " (even/odd)" : "")<<endl;
+
+    // pair selections of computeEpsilon: the one of Are_pi0 and, with FillEtaAlongPi0, the eta one
+    // evaluated on the same clusters and pairs, its cuts in EtaSelection with the names above
+    selections_.push_back(getMesonSelection(iConfig, Are_pi0_));
+    if (fillEtaAlongPi0_) {
+      selections_.push_back(getMesonSelection(iConfig.getUntrackedParameter<edm::ParameterSet>("EtaSelection"), false));
+      cout<<"Eta selection filled along the pi0 one, distributions eta_epsilon_EB_iR and eta_epsilon_EE_iR"<<endl;
+    }
+    pairSelection_.setSelections(&selections_);
 
 
 
@@ -336,15 +351,36 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
 
     cout << "crosscheck: selected type: " << regionalCalibration_->printType() << endl;
 
-    TH1::SetDefaultSumw2(); // all new histograms will automatically activate the storage of the sum of squares of errors (i.e, TH1::Sumw2 is automatically called).
+    // other granularities filled in the same pass, with the weights of the same clusters
+    extraCalibTypes_ = iConfig.getUntrackedParameter<std::vector<std::string> >("ExtraCalibTypes",std::vector<std::string>());
+    weightCalibrations_.push_back(regionalCalibration_);
+    for (unsigned int g = 0; g < extraCalibTypes_.size(); ++g) {
+      EcalRegionalCalibrationBase *extraCalib = 0;
+      if(     extraCalibTypes_[g] == "xtal")    extraCalib = &xtalCalib;
+      else if(extraCalibTypes_[g] == "tt")      extraCalib = &TTCalib;
+      else if(extraCalibTypes_[g] == "etaring") extraCalib = &etaCalib;
+      else throw cms::Exception("ExtraCalibTypes") << "Calib type " << extraCalibTypes_[g] << " not recognized\n";
+      if (std::find(weightCalibrations_.begin(), weightCalibrations_.end(), extraCalib) != weightCalibrations_.end())
+        throw cms::Exception("ExtraCalibTypes") << "Calib type " << extraCalibTypes_[g] << " is already filled\n";
+      weightCalibrations_.push_back(extraCalib);
+      cout << "crosscheck: also filled for type: " << extraCalib->printType() << endl;
+    }
+    if( !extraCalibTypes_.empty() && isEoverEtrue_ )
+      throw cms::Exception("ExtraCalibTypes") << "ExtraCalibTypes cannot be used with isEoverEtrue\n";
 
-    /// external hardcoded geometry
+    TH1::SetDefaultSumw2(); // all new histograms will automatically activate the storage of the sum of squares of errors (i.e, TH1::Sumw2 is automatically called).
 
-    externalGeometryFile_ = TFile::Open( edm::FileInPath( externalGeometry_.c_str() ).fullPath().c_str() );
-    if(!externalGeometryFile_ or not externalGeometryFile_->IsOpen()) cms::Exception("ExtGeom") << "External Geometry file (" << externalGeometry_ << ") not found" << endl;
-    geom_ = ECALGeometry::getGeometry(externalGeometryFile_);
-    GeometryService::setGeometryName(externalGeometry_);
-    GeometryService::setGeometryPtr(geom_);
+    /// external hardcoded geometry, owned by the global cache
+    geom_ = cache->geom_;
+    geometryCacheId_ = 0;
+    esGeometryCacheId_ = 0;
+    streamId_ = 0;
+    pairClusters_ = 0;
+    pairMatchedGen_ = 0;
+    pairSubDetId_ = 0;
+    hltPathIndexEB_ = -1;
+    hltPathIndexEE_ = -1;
+    nHLTPathResolutions_ = 0;
 
     // containment corrections
     if (useContainmentCorrectionsFromEoverEtrue_) loadEoverEtrueContainmentCorrections(fileEoverEtrueContainmentCorrections_);
@@ -360,6 +396,15 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
     std::unique_ptr<const EcalEndcapHardcodedTopology> eeHTopology(new EcalEndcapHardcodedTopology());
     eetopology_->setSubdetTopology(DetId::Ecal,EcalEndcap,std::move(eeHTopology));
 
+    // estopology_ = new EcalPreshowerTopology(geoHandle);
+    estopology_ = new EcalPreshowerTopology();
+    /// ES strip neighbours, used for the preshower clustering of every event
+    esClusteringAlgo_ = new PreshowerTools(estopology_);
+
+    /// 3x3 windows of all the xtals, used by the clustering instead of getWindow
+    ebWindow3x3_.fill(ebtopology_,3);
+    eeWindow3x3_.fill(eetopology_,3);
+
     /// retrieving calibration coefficients of the previous iteration
     // if currentIteration_ = 0, calibMapPath_ contains "iter_-1" unless the current set of ICs was started from another existing set (see parameters.py)
     // therefore, the case with extension is included below
@@ -371,6 +416,9 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
       regionalCalibration_->getCalibMap()->loadCalibMapFromFile(calibMapPath_.c_str(),false);
       if (isEoverEtrue_) regionalCalibration_g2_->getCalibMap()->loadCalibMapFromFile(calibMapPath_.c_str(),true);
     }
+    // with E/Etrue the clusters are made with uncalibrated energies
+    ebClustering_.setCalibration(isEoverEtrue_ ? 0 : regionalCalibration_->getCalibMap());
+    eeClustering_.setCalibration(isEoverEtrue_ ? 0 : regionalCalibration_->getCalibMap());
 
     /// epsilon histograms
     if(!MakeNtuple4optimization_){
@@ -378,12 +426,12 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
       if (isEoverEtrue_) {
 
 	if( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) )  {
-	  EoverEtrue_g1_EB_h2D = initializeEpsilonHistograms2D("EoverEtrue_g1_EB_iR","reco/gen #gamma1 energy EB", regionalCalibration_->getCalibMap()->getNRegionsEB() );
-	  EoverEtrue_g2_EB_h2D = initializeEpsilonHistograms2D("EoverEtrue_g2_EB_iR","reco/gen #gamma2 energy EB", regionalCalibration_g2_->getCalibMap()->getNRegionsEB() );
+	  EoverEtrue_g1_EB_h2D = initializeEpsilonHistograms2D("EoverEtrue_g1_EB_iR","reco/gen #gamma1 energy EB", regionalCalibration_->getCalibMap()->getNRegionsEB(), Are_pi0_ );
+	  EoverEtrue_g2_EB_h2D = initializeEpsilonHistograms2D("EoverEtrue_g2_EB_iR","reco/gen #gamma2 energy EB", regionalCalibration_g2_->getCalibMap()->getNRegionsEB(), Are_pi0_ );
 	}
 	if( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) )  {
-	  EoverEtrue_g1_EE_h2D = initializeEpsilonHistograms2D("EoverEtrue_g1_EE_iR","reco/gen #gamma1 energy", regionalCalibration_->getCalibMap()->getNRegionsEE() );
-	  EoverEtrue_g2_EE_h2D = initializeEpsilonHistograms2D("EoverEtrue_g2_EE_iR","reco/gen #gamma2 energy", regionalCalibration_g2_->getCalibMap()->getNRegionsEE() );
+	  EoverEtrue_g1_EE_h2D = initializeEpsilonHistograms2D("EoverEtrue_g1_EE_iR","reco/gen #gamma1 energy", regionalCalibration_->getCalibMap()->getNRegionsEE(), Are_pi0_ );
+	  EoverEtrue_g2_EE_h2D = initializeEpsilonHistograms2D("EoverEtrue_g2_EE_iR","reco/gen #gamma2 energy", regionalCalibration_g2_->getCalibMap()->getNRegionsEE(), Are_pi0_ );
 	}
 
       } else {
@@ -391,19 +439,64 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
 	if(useMassInsteadOfEpsilon_ ) {
 
 	  if( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) )  
-	    epsilon_EB_h2D = initializeEpsilonHistograms2D("epsilon_EB_iR","#pi^{0} Mass distribution EB", regionalCalibration_->getCalibMap()->getNRegionsEB() );
+	    epsilon_EB_h2D = initializeEpsilonHistograms2D("epsilon_EB_iR","#pi^{0} Mass distribution EB", regionalCalibration_->getCalibMap()->getNRegionsEB(), Are_pi0_ );
 	  if( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) )  
-	    epsilon_EE_h2D = initializeEpsilonHistograms2D("epsilon_EE_iR","#pi^{0} Mass distribution EE", regionalCalibration_->getCalibMap()->getNRegionsEE() );
+	    epsilon_EE_h2D = initializeEpsilonHistograms2D("epsilon_EE_iR","#pi^{0} Mass distribution EE", regionalCalibration_->getCalibMap()->getNRegionsEE(), Are_pi0_ );
 	
 	} else {
 	
 	  if( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) )  
-	    epsilon_EB_h2D = initializeEpsilonHistograms2D("epsilon_EB_iR","Epsilon distribution EB", regionalCalibration_->getCalibMap()->getNRegionsEB() );
+	    epsilon_EB_h2D = initializeEpsilonHistograms2D("epsilon_EB_iR","Epsilon distribution EB", regionalCalibration_->getCalibMap()->getNRegionsEB(), Are_pi0_ );
 	  if( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) )  
-	    epsilon_EE_h2D = initializeEpsilonHistograms2D("epsilon_EE_iR","Epsilon distribution EE", regionalCalibration_->getCalibMap()->getNRegionsEE() );
+	    epsilon_EE_h2D = initializeEpsilonHistograms2D("epsilon_EE_iR","Epsilon distribution EE", regionalCalibration_->getCalibMap()->getNRegionsEE(), Are_pi0_ );
 	
 	}
 
+	// replicas for the statistical error, epsilon_EB_iR_rep<k> and epsilon_EE_iR_rep<k>
+	for (unsigned int k = 0; k < statReplicas_.size(); ++k) {
+	  if( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) )
+	    epsilon_EB_rep_h2D.push_back( initializeEpsilonHistograms2D(Form("epsilon_EB_iR_rep%d",k), Form("replica %d EB",k), regionalCalibration_->getCalibMap()->getNRegionsEB(), Are_pi0_) );
+	  if( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) )
+	    epsilon_EE_rep_h2D.push_back( initializeEpsilonHistograms2D(Form("epsilon_EE_iR_rep%d",k), Form("replica %d EE",k), regionalCalibration_->getCalibMap()->getNRegionsEE(), Are_pi0_) );
+	}
+
+	// one per IOV, epsilon_EB_iR_iov<k> and epsilon_EE_iR_iov<k>
+	for (unsigned int k = 0; k < iovs_.size(); ++k) {
+	  if( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) )
+	    epsilon_EB_iov_h2D.push_back( initializeIOVHistogram2D(epsilon_EB_h2D, k) );
+	  if( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) )
+	    epsilon_EE_iov_h2D.push_back( initializeIOVHistogram2D(epsilon_EE_h2D, k) );
+	}
+
+	// the same for the eta selection, prefixed with eta_
+	epsilon_EB_eta_h2D = 0;
+	epsilon_EE_eta_h2D = 0;
+	if (fillEtaAlongPi0_) {
+	  if( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) ) {
+	    epsilon_EB_eta_h2D = initializeEpsilonHistograms2D("eta_epsilon_EB_iR", useMassInsteadOfEpsilon_ ? "#eta Mass distribution EB" : "#eta Epsilon distribution EB", regionalCalibration_->getCalibMap()->getNRegionsEB(), false );
+	    for (unsigned int k = 0; k < statReplicas_.size(); ++k)
+	      epsilon_EB_eta_rep_h2D.push_back( initializeEpsilonHistograms2D(Form("eta_epsilon_EB_iR_rep%d",k), Form("#eta replica %d EB",k), regionalCalibration_->getCalibMap()->getNRegionsEB(), false) );
+	    for (unsigned int k = 0; k < iovs_.size(); ++k)
+	      epsilon_EB_eta_iov_h2D.push_back( initializeIOVHistogram2D(epsilon_EB_eta_h2D, k) );
+	  }
+	  if( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) ) {
+	    epsilon_EE_eta_h2D = initializeEpsilonHistograms2D("eta_epsilon_EE_iR", useMassInsteadOfEpsilon_ ? "#eta Mass distribution EE" : "#eta Epsilon distribution EE", regionalCalibration_->getCalibMap()->getNRegionsEE(), false );
+	    for (unsigned int k = 0; k < statReplicas_.size(); ++k)
+	      epsilon_EE_eta_rep_h2D.push_back( initializeEpsilonHistograms2D(Form("eta_epsilon_EE_iR_rep%d",k), Form("#eta replica %d EE",k), regionalCalibration_->getCalibMap()->getNRegionsEE(), false) );
+	    for (unsigned int k = 0; k < iovs_.size(); ++k)
+	      epsilon_EE_eta_iov_h2D.push_back( initializeIOVHistogram2D(epsilon_EE_eta_h2D, k) );
+	  }
+	}
+
+	// nominal distributions in the ExtraCalibTypes granularities, prefixed with the type (tt_epsilon_EB_iR, ...)
+	for (unsigned int g = 0; g < extraCalibTypes_.size(); ++g) {
+	  const char *type = extraCalibTypes_[g].c_str();
+	  if( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) )
+	    epsilon_EB_extra_h2D.push_back( initializeEpsilonHistograms2D(Form("%s_epsilon_EB_iR",type), Form(useMassInsteadOfEpsilon_ ? "#pi^{0} Mass distribution EB (%s)" : "Epsilon distribution EB (%s)",type), weightCalibrations_[g+1]->getCalibMap()->getNRegionsEB(), Are_pi0_) );
+	  if( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) )
+	    epsilon_EE_extra_h2D.push_back( initializeEpsilonHistograms2D(Form("%s_epsilon_EE_iR",type), Form(useMassInsteadOfEpsilon_ ? "#pi^{0} Mass distribution EE (%s)" : "Epsilon distribution EE (%s)",type), weightCalibrations_[g+1]->getCalibMap()->getNRegionsEE(), Are_pi0_) );
+	}
+
       }
 
     }
@@ -420,17 +513,17 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
       regionStreamPi0.push_back("region3EE");
       int nRegStream = regionStreamPi0.size();
 
-      seedEnergyInCluster = new TH2F("seedEnergyInCluster","energy of seed crystal after single photon cuts",248,-124,124,48,0.0,12.0);
-      pi0pt_afterCuts = new TH2F("pi0pt_afterCuts","#pi^{0} p_{T} after cuts",nRegStream,0,nRegStream,60,0.0,15.0);
-      g1pt_afterCuts = new TH2F("g1pt_afterCuts","leading (seed) #gamma p_{T} after cuts",nRegStream,0,nRegStream,60,0.0,10.0);
-      g2pt_afterCuts = new TH2F("g2pt_afterCuts","trailing (seed) #gamma p_{T} after cuts",nRegStream,0,nRegStream,60,0.0,10.0);
-      g1Nxtal_afterCuts = new TH2F("g1Nxtal_afterCuts","leading (seed) #gamma number of crystals after cuts",nRegStream,0,nRegStream,9,0.5,9.5);
-      g2Nxtal_afterCuts =  new TH2F("g2Nxtal_afterCuts","trailing (seed) #gamma number of crystals after cuts",nRegStream,0,nRegStream,9,0.5,9.5);
-      pi0PhotonsNoverlappingXtals_afterCuts = new TH2F("pi0PhotonsNoverlappingXtals_afterCuts","number of overlapping crystals in #pi^{0}->#gamma#gamma after cuts",nRegStream,0,nRegStream,10,-0.5,9.5);
-      g1g2DR_afterCuts = new TH2F("gig2DR_afterCuts","#Delta R (#gamma_{1},#gamma_{2}) after cuts",nRegStream,0,nRegStream,40,0.0,0.4);
+      seedEnergyInCluster = detached(new TH2F("seedEnergyInCluster","energy of seed crystal after single photon cuts",248,-124,124,48,0.0,12.0));
+      pi0pt_afterCuts = detached(new TH2F("pi0pt_afterCuts","#pi^{0} p_{T} after cuts",nRegStream,0,nRegStream,60,0.0,15.0));
+      g1pt_afterCuts = detached(new TH2F("g1pt_afterCuts","leading (seed) #gamma p_{T} after cuts",nRegStream,0,nRegStream,60,0.0,10.0));
+      g2pt_afterCuts = detached(new TH2F("g2pt_afterCuts","trailing (seed) #gamma p_{T} after cuts",nRegStream,0,nRegStream,60,0.0,10.0));
+      g1Nxtal_afterCuts = detached(new TH2F("g1Nxtal_afterCuts","leading (seed) #gamma number of crystals after cuts",nRegStream,0,nRegStream,9,0.5,9.5));
+      g2Nxtal_afterCuts = detached(new TH2F("g2Nxtal_afterCuts","trailing (seed) #gamma number of crystals after cuts",nRegStream,0,nRegStream,9,0.5,9.5));
+      pi0PhotonsNoverlappingXtals_afterCuts = detached(new TH2F("pi0PhotonsNoverlappingXtals_afterCuts","number of overlapping crystals in #pi^{0}->#gamma#gamma after cuts",nRegStream,0,nRegStream,10,-0.5,9.5));
+      g1g2DR_afterCuts = detached(new TH2F("gig2DR_afterCuts","#Delta R (#gamma_{1},#gamma_{2}) after cuts",nRegStream,0,nRegStream,40,0.0,0.4));
       for (Int_t ireg = 0; ireg < nRegStream; ireg++) {
 	if (isMC_) {
-	  pi0MassVsPU.push_back( new TH2F(Form("pi0MassVsPU_%s",regionStreamPi0[ireg].c_str()),"#pi^{0} mass vs PU",100,0.05,0.25,50,0.5,50.5) );
+	  pi0MassVsPU.push_back( detached(new TH2F(Form("pi0MassVsPU_%s",regionStreamPi0[ireg].c_str()),"#pi^{0} mass vs PU",100,0.05,0.25,50,0.5,50.5)) );
 	}
       }
       
@@ -440,13 +533,13 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
     }
 
 
-    pi0MassVsIetaEB = new TH2F("pi0MassVsIetaEB","#pi^{0} mass vs i#eta",85,0.5,85.5,120,Are_pi0_? 0.:0.3, Are_pi0_? 0.3:0.8);
+    pi0MassVsIetaEB = detached(new TH2F("pi0MassVsIetaEB","#pi^{0} mass vs i#eta",85,0.5,85.5,120,Are_pi0_? 0.:0.3, Are_pi0_? 0.3:0.8));
     pi0MassVsIetaEB->GetXaxis()->SetTitle("i#eta");
     pi0MassVsIetaEB->GetYaxis()->SetTitle("#pi^{0} mass");
-    pi0MassVsETEB = new TH2F("pi0MassVsETEB", "#pi^{0} mass vs E_{T}(#pi^{0}) in EB",120,0.,20.,120,Are_pi0_? 0.:0.3, Are_pi0_? 0.3:0.8);
+    pi0MassVsETEB = detached(new TH2F("pi0MassVsETEB", "#pi^{0} mass vs E_{T}(#pi^{0}) in EB",120,0.,20.,120,Are_pi0_? 0.:0.3, Are_pi0_? 0.3:0.8));
     pi0MassVsETEB->GetXaxis()->SetTitle("E_{T}(#pi^{0})");
     pi0MassVsETEB->GetYaxis()->SetTitle("#pi^{0} mass");
-    photonDeltaRVsIetaEB = new TH2F("photonDeltaRVsIetaEB","#Delta R (#gamma_{1},#gamma_{2}) vs i#eta",85,0.5,85.5,40,0.0, 0.4);
+    photonDeltaRVsIetaEB = detached(new TH2F("photonDeltaRVsIetaEB","#Delta R (#gamma_{1},#gamma_{2}) vs i#eta",85,0.5,85.5,40,0.0, 0.4));
     photonDeltaRVsIetaEB->GetXaxis()->SetTitle("i#eta");
     photonDeltaRVsIetaEB->GetYaxis()->SetTitle("#Delta R (#gamma_{1},#gamma_{2})");
 
@@ -456,15 +549,27 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
       EBMap_DeadXtal  = (TH2F*) DeadMap->Get("rms_EB");
       EEmMap_DeadXtal = (TH2F*) DeadMap->Get("rms_EEm");
       EEpMap_DeadXtal = (TH2F*) DeadMap->Get("rms_EEp");
+      badChannels_.setDeadMap(EBMap_DeadXtal, EEmMap_DeadXtal, EEpMap_DeadXtal);
+      if( RemoveSeedsCloseToDeadXtal_ ) badChannels_.setNeighbours(ebWindow3x3_, eeWindow3x3_);
     }
-    // output file
-    string fileName = "";
-    fileName = outputDir_ + outfilename_;
-    outfile_ = TFile::Open(fileName.c_str(),"RECREATE");
-    if(!outfile_ or not outfile_->IsOpen()) throw cms::Exception("WritingOutputFile") << "It was no possible to create output file " << fileName << "\n";
+    // flags that make the clustering reject a window
+    deadXtalFlags_ = 0;
+    if( RemoveDead_Flag_ ) deadXtalFlags_ |= EcalBadChannelMask::kChannelStatus;
+    if( RemoveDead_Map_!="" ) deadXtalFlags_ |= EcalBadChannelMask::kDeadMap;
+    channelStatusCacheId_ = 0;
+
+    ebClustering_.setTables(&ebWindow3x3_, &geomTable_, &badChannels_);
+    ebClustering_.setParameters(getClusteringParameters(EcalBarrel));
+    eeClustering_.setTables(&eeWindow3x3_, &geomTable_, &badChannels_);
+    eeClustering_.setParameters(getClusteringParameters(EcalEndcap));
+    // output file, opened in writeOutput
+    outfile_ = 0;
+    optimFile_ = 0;
 
     if(MakeNtuple4optimization_){
+	// moved to the file of the stream in beginStream, the files of all the streams are merged in writeOutput
 	Tree_Optim = new TTree("Tree_Optim","Output TTree");
+	Tree_Optim->SetDirectory(0);
 	// event info for data
 	Tree_Optim->Branch( "Event",     &myEvent,     "Event/l"); // l is for ULong64_t
 	Tree_Optim->Branch( "LumiBlock", &myLumiBlock, "LumiBlock/I");
@@ -541,66 +646,39 @@ FillEpsilonPlot::FillEpsilonPlot(const edm::ParameterSet& iConfig)
 
     /// trigger histo
     if (L1TriggerInfo_) {
-      triggerComposition = new TH1F("triggerComposition", "Trigger Composition", nL1SeedsPi0Stream_, -0.5, (double)nL1SeedsPi0Stream_ -0.5);    
-      triggerComposition_EB = new TH1F("triggerComposition_EB", "Trigger Composition in EB", nL1SeedsPi0Stream_, -0.5, (double)nL1SeedsPi0Stream_ -0.5);
-      triggerComposition_EE = new TH1F("triggerComposition_EE", "Trigger Composition in EE", nL1SeedsPi0Stream_, -0.5, (double)nL1SeedsPi0Stream_ -0.5);
+      triggerComposition = detached(new TH1F("triggerComposition", "Trigger Composition", nL1SeedsPi0Stream_, -0.5, (double)nL1SeedsPi0Stream_ -0.5));    
+      triggerComposition_EB = detached(new TH1F("triggerComposition_EB", "Trigger Composition in EB", nL1SeedsPi0Stream_, -0.5, (double)nL1SeedsPi0Stream_ -0.5));
+      triggerComposition_EE = detached(new TH1F("triggerComposition_EE", "Trigger Composition in EE", nL1SeedsPi0Stream_, -0.5, (double)nL1SeedsPi0Stream_ -0.5));
       // for L1
       seedIsInStream = new int[GlobalAlgBlk::maxPhysicsTriggers];
       algoBitToName = new TString[GlobalAlgBlk::maxPhysicsTriggers];
       l1flag = new short[GlobalAlgBlk::maxPhysicsTriggers];
+      // one per triggerComposition bin, never resized: the Tree_Optim branches point to them
+      seedFlagByBin_.assign(nL1SeedsPi0Stream_, -1);
     }
     areLabelsSet_ = false;
+    l1MenuCacheId_ = 0;
+    trigCompBin_ = 1;
     //L1_nameAndNumb.clear();
     //for(unsigned int i=0; i<NL1SEED; i++) L1BitCollection_[i]=-1;
 
     if (isMC_ and MC_Assoc_) {
       // since we have 20 gen pi0, use 21,-0.5,20.5 as range if counting integer number
-      h_numberUnmergedGenPhotonPairs_EB = new TH1F("h_numberUnmergedGenPhotonPairs_EB",Form("fraction of gen photon pairs in EB with #DeltaR > %.3f",DR_FOR_UNMERGED_GEN_PHOTONS),20,0,1.01);
-      h_numberMatchedGenPhotonPairs_EB = new TH1F("h_numberMatchedGenPhotonPairs_EB","fraction of gen photon pairs in EB matched to reco clusters",20,0,1.01);
-      h_numberUnmergedGenPhotonPairs_EE = new TH1F("h_numberUnmergedGenPhotonPairs_EE",Form("fraction of gen photon pairs in EE with #DeltaR > %.3f",DR_FOR_UNMERGED_GEN_PHOTONS),20,0,1.01);
-      h_numberMatchedGenPhotonPairs_EE = new TH1F("h_numberMatchedGenPhotonPairs_EE","fraction of gen photon pairs in EE matched to reco clusters",20,0,1.01);
-      h_numberUnmergedGenPhotonPairs = new TH1F("h_numberUnmergedGenPhotonPairs",Form("gen photon pairs with #DeltaR > %.3f",DR_FOR_UNMERGED_GEN_PHOTONS),21,-0.5,20.5);
-      h_numberMatchedGenPhotonPairs = new TH1F("h_numberMatchedGenPhotonPairs","gen photon pairs succesfully matched to reco clusters",21,-0.5,20.5);
-      g1RecoGenDR_EB = new TH1F("g1RecoGenDR_EB","#DeltaR(#gamma_{1}^{gen},#gamma_{1}^{reco})",100,0.0,MC_Assoc_DeltaR);
-      g2RecoGenDR_EB = new TH1F("g2RecoGenDR_EB","#DeltaR(#gamma_{2}^{gen},#gamma_{2}^{reco})",100,0.0,MC_Assoc_DeltaR);
-      diff_g2Recog1GenDR_g2RecoGenDR_EB = new TH1F("diff_g2Recog1GenDR_g2RecoGenDR_EB","#DeltaR(#gamma_{1}^{gen},#gamma_{2}^{reco}) - #DeltaR(#gamma_{2}^{gen},#gamma_{2}^{reco})",300,0.0,0.3);
+      h_numberUnmergedGenPhotonPairs_EB = detached(new TH1F("h_numberUnmergedGenPhotonPairs_EB",Form("fraction of gen photon pairs in EB with #DeltaR > %.3f",DR_FOR_UNMERGED_GEN_PHOTONS),20,0,1.01));
+      h_numberMatchedGenPhotonPairs_EB = detached(new TH1F("h_numberMatchedGenPhotonPairs_EB","fraction of gen photon pairs in EB matched to reco clusters",20,0,1.01));
+      h_numberUnmergedGenPhotonPairs_EE = detached(new TH1F("h_numberUnmergedGenPhotonPairs_EE",Form("fraction of gen photon pairs in EE with #DeltaR > %.3f",DR_FOR_UNMERGED_GEN_PHOTONS),20,0,1.01));
+      h_numberMatchedGenPhotonPairs_EE = detached(new TH1F("h_numberMatchedGenPhotonPairs_EE","fraction of gen photon pairs in EE matched to reco clusters",20,0,1.01));
+      h_numberUnmergedGenPhotonPairs = detached(new TH1F("h_numberUnmergedGenPhotonPairs",Form("gen photon pairs with #DeltaR > %.3f",DR_FOR_UNMERGED_GEN_PHOTONS),21,-0.5,20.5));
+      h_numberMatchedGenPhotonPairs = detached(new TH1F("h_numberMatchedGenPhotonPairs","gen photon pairs succesfully matched to reco clusters",21,-0.5,20.5));
+      g1RecoGenDR_EB = detached(new TH1F("g1RecoGenDR_EB","#DeltaR(#gamma_{1}^{gen},#gamma_{1}^{reco})",100,0.0,MC_Assoc_DeltaR));
+      g2RecoGenDR_EB = detached(new TH1F("g2RecoGenDR_EB","#DeltaR(#gamma_{2}^{gen},#gamma_{2}^{reco})",100,0.0,MC_Assoc_DeltaR));
+      diff_g2Recog1GenDR_g2RecoGenDR_EB = detached(new TH1F("diff_g2Recog1GenDR_g2RecoGenDR_EB","#DeltaR(#gamma_{1}^{gen},#gamma_{2}^{reco}) - #DeltaR(#gamma_{2}^{gen},#gamma_{2}^{reco})",300,0.0,0.3));
     }
 
 }
 
 FillEpsilonPlot::~FillEpsilonPlot()
 {
-  delete geom_;
-  externalGeometryFile_->Close();
-  outfile_->Write(); // is this needed? I usually Write() each single object individually
-  std::string outname = outfile_->GetName();
-  outfile_->Close();
-
-  // check goodness of file inside this job
-  std::cout << "Inside destructor: check goodness of file" << std::endl;
-  std::cout << "file name: " << outname << std::endl;
-  bool isGood = true;
-  TFile * fcheck = TFile::Open(outname.c_str(),"READ");
-  if (not fcheck or fcheck->IsZombie()) {
-    isGood = false;
-  } else {
-    if (fcheck->GetSize() < 1048576) isGood = false; // set limit at 1 MB, file is actually larger
-    //if (fcheck->GetSize() < 500000) isGood = false; // set limit at 500 kB, file is actually larger
-    else if (fcheck->TestBit(TFile::kRecovered)) isGood = false;
-    fcheck->Close();    
-  }
-
-  if (isGood) {
-    std::cout << ">>>> File looks good" << std::endl;
-  } else {
-    std::cout << "#### File is bad or non existing. Will be deleted if existing" << std::endl;
-    if (not gSystem->AccessPathName(outname.c_str())) {
-      // file exists, let's delete it
-      //gSystem->Exec(Form("rm %s",outname.c_str()));
-      gSystem->Unlink(outname.c_str()); // this works also for non-Unix systems, just in case
-    }
-  }
-
   if (useContainmentCorrectionsFromEoverEtrue_) {
     delete hCC_EoverEtrue_g1;
     delete hCC_EoverEtrue_g2;
@@ -613,6 +691,12 @@ FillEpsilonPlot::~FillEpsilonPlot()
       deleteEpsilonPlot2D(EoverEtrue_g2_EB_h2D);
     } else {
       deleteEpsilonPlot2D(epsilon_EB_h2D);
+      for (unsigned int k = 0; k < epsilon_EB_rep_h2D.size(); ++k) deleteEpsilonPlot2D(epsilon_EB_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EB_iov_h2D.size(); ++k) delete epsilon_EB_iov_h2D[k];
+      if (fillEtaAlongPi0_) deleteEpsilonPlot2D(epsilon_EB_eta_h2D);
+      for (unsigned int k = 0; k < epsilon_EB_eta_rep_h2D.size(); ++k) deleteEpsilonPlot2D(epsilon_EB_eta_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EB_eta_iov_h2D.size(); ++k) delete epsilon_EB_eta_iov_h2D[k];
+      for (unsigned int g = 0; g < epsilon_EB_extra_h2D.size(); ++g) deleteEpsilonPlot2D(epsilon_EB_extra_h2D[g]);
     }
   }
 
@@ -622,6 +706,12 @@ FillEpsilonPlot::~FillEpsilonPlot()
       deleteEpsilonPlot2D(EoverEtrue_g2_EE_h2D);
     } else {
       deleteEpsilonPlot2D(epsilon_EE_h2D);
+      for (unsigned int k = 0; k < epsilon_EE_rep_h2D.size(); ++k) deleteEpsilonPlot2D(epsilon_EE_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EE_iov_h2D.size(); ++k) delete epsilon_EE_iov_h2D[k];
+      if (fillEtaAlongPi0_) deleteEpsilonPlot2D(epsilon_EE_eta_h2D);
+      for (unsigned int k = 0; k < epsilon_EE_eta_rep_h2D.size(); ++k) deleteEpsilonPlot2D(epsilon_EE_eta_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EE_eta_iov_h2D.size(); ++k) delete epsilon_EE_eta_iov_h2D[k];
+      for (unsigned int g = 0; g < epsilon_EE_extra_h2D.size(); ++g) deleteEpsilonPlot2D(epsilon_EE_extra_h2D[g]);
     }
   }
 
@@ -686,10 +776,14 @@ FillEpsilonPlot::~FillEpsilonPlot()
   }
 
 
-  EndcapTools::freeMemory();
-  //delete geom_;  // if not commented I get seg fault, maybe I should delete it before closing geometry file above
+  if (MakeNtuple4optimization_) {
+    delete Tree_Optim;
+    delete optimFile_;
+  }
   delete ebtopology_;
   delete eetopology_;
+  delete esClusteringAlgo_;
+  delete estopology_;
 
   //JSON
 
@@ -715,8 +809,12 @@ FillEpsilonPlot::~FillEpsilonPlot()
 FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup)
 {
   // std::cout<<"Event: "<<iEvent.id().event()<<" Run "<<iEvent.id().run()<<" LS "<<iEvent.id().luminosityBlock()<<endl;
+  profiler_.count(EcalStageProfiler::kEvents);
   //JSON
-  if ( JSONfile_!="" && !myjson->isGoodLS(iEvent.id().run(),iEvent.id().luminosityBlock()) ) return;
+  if ( JSONfile_!="" ) {
+    EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kTriggerFilter);
+    if ( !myjson->isGoodLS(iEvent.id().run(),iEvent.id().luminosityBlock()) ) return;
+  }
 
   myEvent = iEvent.id().event();
   myLumiBlock = iEvent.id().luminosityBlock();
@@ -785,91 +883,8 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   }
 
 
-  if( !areLabelsSet_ && L1TriggerInfo_ ){
-    
-    edm::Handle< GlobalAlgBlkBxCollection > gtReadoutRecord;
-    iEvent.getByToken( L1GTobjmapToken_, gtReadoutRecord);
- 
-    if (gtReadoutRecord.isValid()) { 
-
-      const GlobalAlgBlkBxCollection *l1results = gtReadoutRecord.product(); 
-      if (l1results->size() == 0) std::cout << "%L1Results -- No trigger name given in TriggerResults of the input " << std::endl;
-
- 	
-      edm::ESHandle<L1TUtmTriggerMenu> menu;
-      iSetup.get<L1TUtmTriggerMenuRcd>().get(menu);
-
-      // get the bit/name association         
-      for (auto const & keyval: menu->getAlgorithmMap()) { 
-	std::string const & trigName  = keyval.second.getName(); 
-	unsigned int iTrigIndex = keyval.second.getIndex(); 
-	std::cerr << "bit: " << iTrigIndex << "\tname: " << trigName << std::endl;                                                         
-	algoBitToName[iTrigIndex] = TString( trigName );
-
-      } // end algo Map
- 
-      int trigCompBin = 1;
-      GlobalAlgBlk const &result = l1results->at(0, 0);
-
-      for (unsigned int itrig = 0; itrig < result.maxPhysicsTriggers; ++itrig) {
-	//      std::cerr << "bit: " << itrig << "\tresult: " << results.getAlgoDecisionFinal(itrig) << std::endl;
-
-	// some indices are empty: name them appropriately
-	if (std::string(algoBitToName[itrig]) == "") algoBitToName[itrig] = Form("EMPTY_%d",itrig);
-
-	//std::string l1triggername = std::string(algoBitToName[itrig]);
-	//L1_nameAndNumb[std::string(algoBitToName[itrig])] = itrig;
-
-	// check if index is valid
-	if ( std::string(algoBitToName[itrig]).find("EMPTY") != std::string::npos ) {
-
-	  // -1 for non valid index
-	  seedIsInStream[itrig] = -1;
-	  l1flag[itrig] = -2; 
-
-	} else {
-
-	  // check if seed is used by the stream: seed expression is "seed1 OR seed2 OR seed3 ... "
-	  // the space at the end is important: see parameters.py
-	  if ( L1SeedsPi0Stream_.find((algoBitToName[itrig]+" ")) != std::string::npos ) { 
-
-	    seedIsInStream[itrig] = 1;
-	    bool myflag = result.getAlgoDecisionFinal(itrig) ; 
-	    if (myflag ) { l1flag[itrig] = 1; }
-	    else {l1flag[itrig] = 0 ; }
-	    // save bit for any seed n the stream in the tree
-	    std::string trigName = std::string(algoBitToName[itrig]);
-	    cout << "trigCompBin = " << trigCompBin << "    Seed name = " << algoBitToName[itrig] << endl;
-	    if (trigCompBin <= triggerComposition->GetNbinsX()) triggerComposition->GetXaxis()->SetBinLabel(trigCompBin,trigName.c_str());
-	    else cout << "Warning: trigCompBin is exceeding the allowed number of bins. Check! " << endl;
-	    trigCompBin++;
-	    if(MakeNtuple4optimization_) Tree_Optim->Branch(trigName.c_str(),l1flag+itrig,(trigName+"/S").c_str());   // l1flag+(int)itrig is the pointer to the itrig-th object of l1flag
-	    //Tree_Optim->Branch((trigName+"_Prescl").c_str(),l1Prescl+(int)itrig,(trigName+"_Prescl/I").c_str());  // not implemented yet
-	  } else {
-
-	    seedIsInStream[itrig] = 0;
-	    l1flag[itrig] = -1;
-
-	  }
-
-	}
-	
-	// std::cout << "L1 TD: "<<itrig<<" "<<algoBitToName[itrig]<<" " 
-	// 	  << l1flag[itrig] <<" " 
-	// 	  << std::endl;           
-	
-
-      }
-
-      if(!areLabelsSet_){
-	areLabelsSet_ = true;
-	cout << "setting labels of triggerComposition histogram" << endl;
-      }
-
-    }
-
-  }
-  // end of --> if (!areLabelsSet_ && L1TriggerInfo_)
+  // bit <--> name association of the L1 seeds, decoded again only when the menu changes
+  if( L1TriggerInfo_ ) updateL1Menu(iSetup);
 
   //MC Photons (they will be associated to the clusters later)
 
@@ -1118,6 +1133,8 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   //For Syst error SystOrNot_=1 or 2, for normal calib is 0
   if(SystOrNot_==1 && int(iEvent.id().event())%2!=0 ) return;
   else if(SystOrNot_==2 && int(iEvent.id().event())%2==0 ) return;
+  statReplicas_.setEvent(iEvent.id().run(), iEvent.id().event());
+  if(iovs_.size() > 0) currentIOV_ = iovs_.find(iEvent.id().run(), iEvent.luminosityBlock());
 
   iEvent.getByToken ( EBRecHitCollectionToken_, ebHandle);
   iEvent.getByToken ( EERecHitCollectionToken_, eeHandle);
@@ -1128,8 +1145,6 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   edm::ESHandle<CaloGeometry> geoHandle;
   iSetup.get<CaloGeometryRecord>().get(geoHandle);
   geometry = geoHandle.product();
-  // estopology_ = new EcalPreshowerTopology(geoHandle);
-  estopology_ = new EcalPreshowerTopology();
   esGeometry_ = (dynamic_cast<const EcalPreshowerGeometry*>( (CaloSubdetectorGeometry*) geometry->getSubdetectorGeometry (DetId::Ecal,EcalPreshower) ));
 
   ///////////////////////
@@ -1156,9 +1171,14 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   // For MC this is not necessary probably (I didn't check)
   // if( HLTResults_ && (!MakeNtuple4optimization_) ){
   if( HLTResults_){
-    EB_HLT = GetHLTResults(iEvent, HLTResultsNameEB_); //Adding * at the end of the sentence make always true the "->Contains" method. So do not use it.
+    EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kTriggerFilter);
+    edm::Handle<edm::TriggerResults> hltTriggerResultHandle;
+    iEvent.getByToken(triggerResultsToken_, hltTriggerResultHandle);
+    updateHLTPathIndices(iEvent, *hltTriggerResultHandle);
+    // False or True depending if it fired, false if the path is not in the menu
+    EB_HLT = hltPathIndexEB_ >= 0 && hltTriggerResultHandle->accept(hltPathIndexEB_); //Adding * at the end of the sentence make always true the "->Contains" method. So do not use it.
     if (Barrel_orEndcap_=="ONLY_BARREL" and not EB_HLT) return;
-    EE_HLT = GetHLTResults(iEvent, HLTResultsNameEE_);
+    EE_HLT = hltPathIndexEE_ >= 0 && hltTriggerResultHandle->accept(hltPathIndexEE_);
     if (Barrel_orEndcap_=="ONLY_ENDCAP" and not EE_HLT) return;
   }
   //std::cout << "EB_HLT,EE_HLT = " << EB_HLT << "," << EE_HLT << endl;
@@ -1166,8 +1186,13 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   //L1 Trigget bit list (and cut if L1_Bit_Sele_ is not empty)
   // this function is not meant to apply the global L1 seed expression to accept or not the event
   // it can reject events if you decide to select one or more specific seeds (this must still be implemented)
-  if( L1TriggerInfo_ ){ if( !getTriggerResult(iEvent, iSetup) ) return; }
+  if( L1TriggerInfo_ ){
+    EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kTriggerFilter);
+    if( !getTriggerResult(iEvent, iSetup) ) return;
+  }
+
 
+  if (eventStore_.isOpen()) writeEventStore(iEvent);
 
   //Vectors
   std::vector< CaloCluster > ebclusters;
@@ -1176,6 +1201,7 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   //vs2s9.clear(); vs2s9.clear(); 
   //vSeedTime.clear();
   vs4s9EE.clear(); Es_1.clear(); Es_2.clear(); 
+  photonSelectionsEB_.clear(); photonSelectionsEE_.clear();
   //vSeedTimeEE.clear();
   //vs2s9EE.clear(); vs2s9EE.clear(); 
   ESratio.clear();
@@ -1185,18 +1211,25 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   Ncristal_EB.clear(); Ncristal_EE.clear();
   //cout << "I'm after Ncristal_EB.clear(); Ncristal_EE.clear(); " << endl;
 
-  //get status from DB
-  edm::ESHandle<EcalChannelStatus> csHandle; 
-  iSetup.get<EcalChannelStatusRcd>().get(csHandle);
-  const EcalChannelStatus &channelStatus = *csHandle; 
-  ////cout << "I'm after const EcalChannelStatus &channelStatus = *csHandle; " << endl;
+  //get status from DB, the bad channel mask is rebuilt only when the IOV changes
+  if( RemoveDead_Flag_ || RemoveSeedsCloseToDeadXtal_ ) {
+    const EcalChannelStatusRcd & csRecord = iSetup.get<EcalChannelStatusRcd>();
+    if( !badChannels_.hasChannelStatus() || csRecord.cacheIdentifier() != channelStatusCacheId_ ) {
+      edm::ESHandle<EcalChannelStatus> csHandle; 
+      csRecord.get(csHandle);
+      badChannels_.setChannelStatus(*csHandle);
+      if( RemoveSeedsCloseToDeadXtal_ ) badChannels_.setNeighbours(ebWindow3x3_, eeWindow3x3_);
+      channelStatusCacheId_ = csRecord.cacheIdentifier();
+    }
+  }
 
   if ( (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) && EB_HLT ) { 
-    fillEBClusters(ebclusters, iEvent, channelStatus);
+    EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kEBClustering);
+    fillEBClusters(ebclusters, iEvent);
   }
-  ////cout << "I'm after fillEBClusters(ebclusters, iEvent, channelStatus) " << endl;
   if ( (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) && EE_HLT ) { 
-    fillEEClusters(eseeclusters, eseeclusters_tot, iEvent, channelStatus);
+    EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kEEClustering);
+    fillEEClusters(eseeclusters, eseeclusters_tot, iEvent);
   }
   // std::cout << "ebclusters.size() = " << ebclusters.size() << std::endl;
   // std::cout << "eseeclusters.size() = " << eseeclusters.size() << std::endl;
@@ -1209,6 +1242,7 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
 
   if(isMC_ && MC_Assoc_) {
 
+    EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kMCTruth);
     // ebclusters_used = MCTruthAssociate(ebclusters,MC_Assoc_DeltaR,true);
     // eeclusters_used = MCTruthAssociate(eseeclusters_tot,MC_Assoc_DeltaR,false);
     int unmergedGenPairs_EB = 0;
@@ -1253,267 +1287,168 @@ FillEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iSetup
   
   }
 
-  delete estopology_;
-
 }
 
 
 /*===============================================================*/
-void FillEpsilonPlot::fillEBClusters(std::vector< CaloCluster > & ebclusters, const edm::Event& iEvent, const EcalChannelStatus &channelStatus)
+std::vector<EcalPi0ClusteringParameters> FillEpsilonPlot::getClusteringParameters(int subDetId)
   /*===============================================================*/
 {
+  EcalPi0ClusteringParameters par;
+  if (subDetId == EcalBarrel) {
+    par.seedEnergy = EB_Seed_E_;
+    par.etaBoundary = 1.;
+    par.T0 = PCparams_.param_T0_barl_;
+  } else {
+    par.useSeedEt = useEE_EtSeed_;
+    par.seedEnergy = EE_Seed_E_;
+    par.seedEt = EE_Seed_Et_;
+    par.etaBoundary = 1.8;
+    par.T0 = PCparams_.param_T0_endc_;
+  }
+  par.removeSeedsCloseToDead = RemoveSeedsCloseToDeadXtal_;
+  par.deadXtalFlags = deadXtalFlags_;
+  par.position = PCparams_;
+
+  // single photon cuts, one parameter set per selection: with FillEtaAlongPi0 each selection
+  // clusters the event as if it were alone (EcalPi0Clustering)
+  const int low = subDetId == EcalBarrel ? 0 : 2;
+  std::vector<EcalPi0ClusteringParameters> pars;
+  for (std::vector<EcalMesonSelection>::const_iterator sel = selections_.begin(); sel != selections_.end(); ++sel) {
+    par.s4s9Low = sel->S4S9Cut[low];
+    par.s4s9High = sel->S4S9Cut[low+1];
+    par.nXtalLow = min(sel->nXtal1Cut[low], sel->nXtal2Cut[low]);
+    par.nXtalHigh = min(sel->nXtal1Cut[low+1], sel->nXtal2Cut[low+1]);
+    par.ptLow = sel->gPtCut[low];
+    par.ptHigh = sel->gPtCut[low+1];
+    pars.push_back(par);
+  }
+  return pars;
+}
 
-  std::vector<EcalRecHit> ebseeds;
-
-  typedef std::set<EBDetId> XtalInUse;
-  XtalInUse isUsed; // map of which xtals have been used
-
-  int dc = 0;
+// cuts by eta region as the FillEpsilonPlot parameters with the same names (Pi0PtCutEB_low, ...)
+EcalMesonSelection FillEpsilonPlot::getMesonSelection(const edm::ParameterSet& cuts, bool isPi0)
+{
+  EcalMesonSelection sel(isPi0);
+
+  const std::string region[4] = { "EB_low", "EB_high", "EE_low", "EE_high" };
+  for (int r = 0; r < 4; ++r) {
+    sel.pi0PtCut.push_back( cuts.getUntrackedParameter<double>("Pi0PtCut" + region[r]) );
+    sel.gPtCut.push_back( cuts.getUntrackedParameter<double>("gPtCut" + region[r]) );
+    sel.S4S9Cut.push_back( cuts.getUntrackedParameter<double>("S4S9_" + region[r]) );
+    sel.isoCut.push_back( cuts.getUntrackedParameter<double>("Pi0IsoCut" + region[r]) );
+    sel.hltIsoCut.push_back( cuts.getUntrackedParameter<double>("Pi0HLTIsoCut" + region[r]) );
+    sel.nXtal1Cut.push_back( cuts.getUntrackedParameter<int>("nXtal_1_" + region[r]) );
+    sel.nXtal2Cut.push_back( cuts.getUntrackedParameter<int>("nXtal_2_" + region[r]) );
+  }
+  return sel;
+}
 
-  // sort by energy and find the seeds
-  for(EBRecHitCollection::const_iterator itb= ebHandle->begin(); itb != ebHandle->end(); ++itb, ++dc) 
-  {
+// file of this stream for the rechit or candidate store: <OutputDir><OutputFile>_<name>_<stream>.root,
+// OutputFile (without .root) makes the names of the batch jobs different
+std::string FillEpsilonPlot::streamFileName(const std::string& fileName) const
+{
+  std::string output = outfilename_;
+  if (output.size() > 5 && output.compare(output.size()-5, 5, ".root") == 0) output.erase(output.size()-5);
+  std::string base = fileName;
+  if (base.size() > 5 && base.compare(base.size()-5, 5, ".root") == 0) base.erase(base.size()-5);
+  return outputDir_ + output + "_" + base + "_" + std::to_string(streamId_) + ".root";
+}
 
-    //cout << "Check EBRecHitCollection in FillEpsilonPlot::fillEBClusters" << endl;
-    EBDetId tmp_id(itb->id());
-    if(itb->energy() > EB_Seed_E_)  ebseeds.push_back( *itb );
+void FillEpsilonPlot::writeEventStore(const edm::Event& iEvent)
+{
+  EcalEventStoreHeader header;
+  header.run = iEvent.id().run();
+  header.lumi = iEvent.id().luminosityBlock();
+  header.event = iEvent.id().event();
+  header.bx = iEvent.bunchCrossing();
+  header.ebHLT = EB_HLT;
+  header.eeHLT = EE_HLT;
+  if( L1TriggerInfo_ ) {
+    for (unsigned int i = 0; i < streamSeedBits_.size(); ++i)
+      if (l1flag[streamSeedBits_[i]] == 1) header.l1Seeds.push_back(streamSeedBits_[i]);
   }
 
-  sort(ebseeds.begin(), ebseeds.end(), ecalRecHitLess());
-  int seed_c = 0;
-  // loop over seeds and make clusters
-  for (std::vector<EcalRecHit>::iterator itseed=ebseeds.begin(); itseed!=ebseeds.end(); itseed++, seed_c++) 
-  {
-    EBDetId seed_id( itseed->id() );
-    //float SeedTime = itseed->time();
-
-    // check if seed already in use. If so go to next seed
-    if(isUsed.count(seed_id)!=0) continue;
+  // missing collections are stored as empty
+  ebHitRecords_.clear(); eeHitRecords_.clear(); esHitRecords_.clear();
+  if (ebHandle.isValid()) fillHitRecords<EBDetId>(*ebHandle, ebHitRecords_);
+  if (eeHandle.isValid()) fillHitRecords<EEDetId>(*eeHandle, eeHitRecords_);
+  if (esHandle.isValid()) fillHitRecords<ESDetId>(*esHandle, esHitRecords_);
+  eventStore_.fill(header, ebHitRecords_, eeHitRecords_, esHitRecords_);
+}
 
-    // find 3x3 matrix of xtals
-    std::vector<DetId> clus_v = ebtopology_->getWindow(seed_id,3,3);       
-    // needed for position calculator
-    //std::vector<std::pair<DetId,float> > clus_used;
+// xtals of a cluster with the uncalibrated energies of its rechits, and its ES energies
+void FillEpsilonPlot::fillCandidatePhoton(const CaloCluster& g, size_t index, int subDetId, EcalPi0CandidatePhoton& photon)
+{
+  const bool isEB = subDetId == EcalBarrel;
+  const std::vector< std::pair<DetId, float> > & hitsAndFrac = g.hitsAndFractions();
+  if (hitsAndFrac.size() > EcalPi0CandidatePhoton::kMaxXtals)
+    throw cms::Exception("CandidateStore") << hitsAndFrac.size() << " xtals in a cluster\n";
+
+  photon.seed = isEB ? EBDetId(g.seed()).hashedIndex() : EEDetId(g.seed()).hashedIndex();
+  photon.nXtal = hitsAndFrac.size();
+  for (unsigned int j = 0; j < hitsAndFrac.size(); ++j) {
+    uint32_t hash = isEB ? EBDetId(hitsAndFrac[j].first).hashedIndex() : EEDetId(hitsAndFrac[j].first).hashedIndex();
+    int32_t hit = isEB ? ebClustering_.hitIndex(hash) : eeClustering_.hitIndex(hash);
+    photon.hash[j] = hash;
+    photon.energy[j] = isEB ? ebHitRecords_[hit].energy : eeHitRecords_[hit].energy;
+  }
 
-    // xtals actually used after removing those already used
-    vector<const EcalRecHit*> RecHitsInWindow;
-    //vector<const EcalRecHit*> RecHitsInWindow5x5;
+  photon.es1 = isEB ? -999. : Es_1[index];
+  photon.es2 = isEB ? -999. : Es_2[index];
+  // matched to the ES: the position of the cluster is the one of the ES clusters
+  bool hasES = photon.es1 > -998.;
+  photon.esX = hasES ? g.x() : 0.;
+  photon.esY = hasES ? g.y() : 0.;
+  photon.esZ = hasES ? g.z() : 0.;
+}
 
-    float simple_energy = 0; 
-    float posTotalEnergy(0.); // need for position calculation
+/*===============================================================*/
+void FillEpsilonPlot::fillEBClusters(std::vector< CaloCluster > & ebclusters, const edm::Event& iEvent)
+  /*===============================================================*/
+{
 
-    // make 3x3  cluster - reject overlaps
-    int i_clus=0;
-    for (std::vector<DetId>::const_iterator det=clus_v.begin(); det!=clus_v.end(); det++, i_clus++) 
-    {
-	EBDetId thisId( *det );
-	// skip this xtal if already used
-	if(isUsed.count(thisId)!=0) continue; //already used
-
-	// find the rec hit
-	EBRecHitCollection::const_iterator ixtal = ebHandle->find( thisId );
-	if( ixtal == ebHandle->end() ) continue; // xtal not found
-
-	RecHitsInWindow.push_back( &(*ixtal) );
-	//clus_used.push_back(std::make_pair(*det,1.));  // it seems it is not used anywhere
-
-	simple_energy +=  ixtal->energy();
-	if(ixtal->energy()>0.) posTotalEnergy += ixtal->energy(); // use only pos energy for position
-    } // loop over xtals in the region
-    ///debug
-    //cout << "seed #" << seed_c << "RecHitsInWindow.size() = " << RecHitsInWindow.size() << endl;
-
-    if(simple_energy <= 0) { 
-	//cout << "skipping cluster with negative energy " << simple_energy << endl; 
-	continue;
-    }
+  fillHitRecords<EBDetId>(*ebHandle, ebHitRecords_);
+  ebClustering_.run(ebHitRecords_.data(), ebHitRecords_.size());
+  profiler_.count(EcalStageProfiler::kSeeds, ebClustering_.nSeeds());
 
-    float s4s9_tmp[4]={0.,0.,0.,0.};
+  const std::vector<EcalPi0Cluster>& clusters = ebClustering_.clusters();
+  const std::vector<std::pair<uint32_t,float> >& clusterHits = ebClustering_.hits();
+  for (std::vector<EcalPi0Cluster>::const_iterator clus = clusters.begin(); clus != clusters.end(); ++clus) 
+  {
+    // (DetId, calibrated energy) of the 3x3 xtals, as fractions
+    std::vector<std::pair<DetId,float> > enFracs;
+    for (unsigned int j = clus->firstHit; j < clus->firstHit + clus->nHits; ++j)
+      enFracs.push_back( std::make_pair( DetId(EBDetId::unhashIndex(clusterHits[j].first)), clusterHits[j].second ) );
+    EBDetId seed_id = EBDetId::unhashIndex(clus->seed);
 
-    int seed_ieta = seed_id.ieta();
-    int seed_iphi = seed_id.iphi();
+    // make calo clusters
+    vs4s9.push_back( clus->s4s9 ); 
+    if (fillEtaAlongPi0_) photonSelectionsEB_.push_back( clus->selections );
+    Ncristal_EB.push_back( clus->nXtal );
+    ebclusters.push_back( CaloCluster( clus->energy, clus->position, CaloID(CaloID::DET_ECAL_BARREL), enFracs, CaloCluster::undefined, seed_id ) );
 
     // following method defined in http://cmslxr.fnal.gov/source/HLTrigger/special/src/HLTRegionalEcalResonanceFilter.cc?v=CMSSW_9_4_1#0903
-    // it is used to use diff_neta_s and diff_nphi_s to get distances between crystals in number of crystals
     // iphi is ported to 0,..,359, and ieta from -85,...,-1,0,1,2,...,84
     // note that ieta and iphi can be 0 and iphi= 360 and ieta = 85 are "lost", so do no tuse them to access histogram content   
+    int seed_ieta = seed_id.ieta();
+    int seed_iphi = seed_id.iphi();
     convxtalid( seed_iphi,seed_ieta);
-
-    // energy of 3x3 cluster
-    float e3x3(0.);
-    std::vector<std::pair<DetId,float> > enFracs;
-
-    // variables for position caculation
-    float xclu(0.), yclu(0.), zclu(0.); // temp var to compute weighted average
-    float total_weight(0.);// to compute position
-
-    // Calculate shower depth
-    float T0 = PCparams_.param_T0_barl_;
-    float maxDepth = PCparams_.param_X0_ * ( T0 + log( posTotalEnergy ) );
-    float maxToFront;
-    if( GeometryFromFile_ ) maxToFront = geom_->getPosition(seed_id).mag(); // to front face
-    else                  {
-      const CaloCellGeometry* cell = geometry->getGeometry( seed_id ).get();
-      GlobalPoint posit = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( 0. );
-      maxToFront = posit.mag();
-    }
-
-    //double EnergyCristals[9] = {0.};
-
-    bool All_rechit_good=true;
-
-    // loop over xtals and compute energy and position
-    for(unsigned int j=0; j<RecHitsInWindow.size();j++)
-    {
-
-	EBDetId det(RecHitsInWindow[j]->id());
-
-	if( RemoveDead_Flag_){
-	  if(!checkStatusOfEcalRecHit(channelStatus, *RecHitsInWindow[j] )  )  {
-	    All_rechit_good = false; 
-	    break;  // exit this loop as soon as one crystal is dead, because at the end of this loop there is a continue if All_rechit_good = false
-	    // at the moment I see the rechits are added in the list of used ones, which is probably wrong if I reject this cluster
-	  }
-	}
-	if( RemoveDead_Map_!="" ){
-	  if( isInDeadMap( true, *RecHitsInWindow[j] ) ) {
-	    All_rechit_good = false;
-	    break;  // exit this loop as soon as one crystal is dead
-	  }
-	}
-
-	int ieta = det.ieta();
-	int iphi = det.iphi();
-	// if (useContainmentCorrectionsFromEoverEtrue_) {
-	//   std::cout << "ieta,iphi,IC,CC1,CC2 " << ieta << "  " << iphi << "  " 
-	// 	    << regionalCalibration_->getCalibMap()->coeff(RecHitsInWindow[j]->id()) << "  "
-	// 	    << hCC_EoverEtrue_g1->GetBinContent(hCC_EoverEtrue_g1->FindFixBin(ieta,iphi)) << "  "
-	// 	    << hCC_EoverEtrue_g2->GetBinContent(hCC_EoverEtrue_g2->FindFixBin(ieta,iphi)) << std::endl;
-	  
-	// }
-
-	// following method defined in http://cmslxr.fnal.gov/source/HLTrigger/special/src/HLTRegionalEcalResonanceFilter.cc?v=CMSSW_9_4_1#0903
-	// it is used to use diff_neta_s and diff_nphi_s to get distances between crystals in number of crystals
-	// iphi is ported to 0,..,359, and ieta from -85,...,-1,0,1,2,...,84
-	// note that ieta and iphi can be 0 and iphi= 360 and ieta = 85 are "lost", so do no tuse them to access histogram content   
-	convxtalid(iphi,ieta);
-
-	// use calibration coeff for energy and position
-	// FIXME: if isEoverEtrue_ is true, then we are not using the pi0 IC, but the photon dependent correction based on E/Etrue
-	// this means we should know which photon we are looking at
-	// at this moment, we are not able to assess which photon will be the first one (we would know it if we could rely on the fact that the clusters 
-	// will always be the same so that the first and second clusters are always the same (therefore we could rely on their DetId).
-	float en = RecHitsInWindow[j]->energy();
-	if (not isEoverEtrue_) {
-	  en *= regionalCalibration_->getCalibMap()->coeff(RecHitsInWindow[j]->id());
-	}
-
-	int dx = diff_neta_s(seed_ieta,ieta);
-	int dy = diff_nphi_s(seed_iphi,iphi);
-	//EnergyCristals[j] = en;
-
-	if(abs(dx)<=1 && abs(dy)<=1) 
-	{
-	  e3x3 += en;
-	  if(dx <= 0 && dy <=0){ s4s9_tmp[0] += en; }
-	  if(dx >= 0 && dy <=0){ s4s9_tmp[1] += en; }
-	  if(dx <= 0 && dy >=0){ s4s9_tmp[2] += en; }
-	  if(dx >= 0 && dy >=0){ s4s9_tmp[3] += en; }
-	  enFracs.push_back( std::make_pair( RecHitsInWindow[j]->id(), en ) );
-	  // Note: I'm using fractions to save rechit energy
-	  // isUsed.insert(RecHitsInWindow[j]->id());  // these crystals should be readded if the matrix is discarded, I add this line later
-
-	}
-
-	// compute position
-	if(en>0.) 
-	{
-	  float weight = std::max( float(0.), PCparams_.param_W0_ + log(en/posTotalEnergy) );
-	  float pos_geo;
-	  if( GeometryFromFile_ ) pos_geo = geom_->getPosition(det).mag(); // to front face
-	  else                  {
-	    const CaloCellGeometry* cell = geometry->getGeometry(det).get();
-	    GlobalPoint posit = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( 0. );
-	    pos_geo = posit.mag();
-	  }
-	  float depth = maxDepth + maxToFront - pos_geo;
-	  GlobalPoint posThis;
-	  if( GeometryFromFile_ ) posThis = geom_->getPosition(det,depth);
-	  else{
-	    const CaloCellGeometry* cell = geometry->getGeometry(det).get();
-	    posThis = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( depth );
-	  }
-
-	  xclu += weight*posThis.x(); 
-	  yclu += weight*posThis.y(); 
-	  zclu += weight*posThis.z(); 
-	  total_weight += weight;
-	}
-
-    } // loop over 3x3 rechits
-
-    if(!All_rechit_good) continue;
-
-    float e2x2 = *max_element( s4s9_tmp,s4s9_tmp+4);
-    float s4s9 = e2x2/e3x3;
-    float inv_total_weight = 1./total_weight;
-    math::XYZPoint clusPos( xclu * inv_total_weight, 
-			    yclu * inv_total_weight,
-			    zclu * inv_total_weight ); 
-
-    //cout << "seed #" << seed_c << " ptClus(before): " << e3x3/cosh(clusPos.eta()) << endl;
-
-    // adding cut on number of crystals
-    if( fabs( clusPos.eta() )<1. ) {
-      if (s4s9<S4S9_cut_low_[EcalBarrel]) continue;
-      if ( RecHitsInWindow.size() < min(nXtal_1_cut_low_[EcalBarrel],nXtal_2_cut_low_[EcalBarrel]) ) continue;
-      // compute pt of gamma and cut
-      float ptClus = e3x3*sin(clusPos.Theta());
-      if( ptClus<gPtCut_low_[EcalBarrel]) continue;
-    } else { 
-      if (s4s9<S4S9_cut_high_[EcalBarrel]) continue;
-      if ( RecHitsInWindow.size() <  min(nXtal_1_cut_high_[EcalBarrel],nXtal_2_cut_high_[EcalBarrel]) ) continue;
-      // compute pt of gamma and cut
-      float ptClus = e3x3*sin(clusPos.Theta());
-      if( ptClus<gPtCut_high_[EcalBarrel]) continue;
-    }
-
-    // reloop on recHits to add them in the set of used recHits
-    for(unsigned int j=0; j<RecHitsInWindow.size();j++)
-    {
-      isUsed.insert(RecHitsInWindow[j]->id());
-    }
-
-    // make calo clusters
-    vs4s9.push_back( s4s9 ); 
-    // vs1s9.push_back( itseed->energy()/e3x3 );
-    // double maxEne = max_array( EnergyCristals, 9 );
-    // for(int i=0; i<9; i++){ if( EnergyCristals[i]==maxEne ) EnergyCristals[i]=0.; }
-    // double maxEne2 = max_array( EnergyCristals, 9);
-    // vs2s9.push_back( (maxEne+maxEne2)/e3x3 );
-    Ncristal_EB.push_back(RecHitsInWindow.size() );
-    ebclusters.push_back( CaloCluster( e3x3, clusPos, CaloID(CaloID::DET_ECAL_BARREL), enFracs, CaloCluster::undefined, seed_id ) );
-    seedEnergyInCluster->Fill(seed_ieta,itseed->energy());
-    //vSeedTime.push_back( SeedTime ); 
-  } //loop over seeds to make EB clusters
-
-  // std::cout << "### FillEpsilonPlot::fillEBClusters():   evt = " << iEvent.id().event() << "   dc = " << dc << "   ebclusters.size() = " << ebclusters.size() << std::endl;
-
+    if (clus->selections & 1) seedEnergyInCluster->Fill(seed_ieta,clus->seedEnergy);
+  } //loop over EB clusters
+  profiler_.count(EcalStageProfiler::kClusters, ebclusters.size());
 
 }
 
 /*===============================================================*/
-void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters, std::vector< CaloCluster > & eseeclusters_tot, const edm::Event& iEvent, const EcalChannelStatus &channelStatus)
+void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters, std::vector< CaloCluster > & eseeclusters_tot, const edm::Event& iEvent)
   /*===============================================================*/
 {
 
-  //cout << "I'm before PreshowerTools esClusteringAlgo(geometry, estopology_, esHandle); " << endl;
-  PreshowerTools esClusteringAlgo(geometry, estopology_, esHandle);
-  ////cout << "I'm after PreshowerTools esClusteringAlgo(geometry, estopology_, esHandle); " << endl;
-
-  std::vector<EcalRecHit> eeseeds;
+  esClusteringAlgo_->setEvent(geometry, *esHandle);
 
   vector <double> eeclusterS4S9; eeclusterS4S9.clear();
+  vector <uint8_t> eeclusterSelections;
   //vector <double> SeedTime_v;    SeedTime_v.clear();
   // vector <double> eeclusterS1S9; eeclusterS1S9.clear();
   // vector <double> eeclusterS2S9; eeclusterS2S9.clear();
@@ -1521,218 +1456,36 @@ void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters,
   std::vector< CaloCluster > eeclusters; // contains the output eeclusters
   eeclusters.clear();
 
-  int dc = 0;
+  fillHitRecords<EEDetId>(*eeHandle, eeHitRecords_);
+  eeClustering_.run(eeHitRecords_.data(), eeHitRecords_.size());
+  profiler_.count(EcalStageProfiler::kSeeds, eeClustering_.nSeeds());
 
-  // sort by energy and find the eeseeds
-  //bool found=false;
-  for(EERecHitCollection::const_iterator ite= eeHandle->begin(); ite != eeHandle->end(); ++ite, ++dc) {
-    EEDetId idXtal( ite->id() );
-    // if(idXtal.zside()<0) Occupancy_EEm->Fill(idXtal.ix(),idXtal.iy()); 
-    // if(idXtal.zside()>0) Occupancy_EEp->Fill(idXtal.ix(),idXtal.iy()); 
-    GlobalPoint posThis;
-    if( GeometryFromFile_ ) posThis = geom_->getPosition(idXtal,0.);
-    else{
-      const CaloCellGeometry* cell = geometry->getGeometry(idXtal).get();
-      posThis = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( 0. );
-    }
-    if (useEE_EtSeed_) { 
-      if (ite->energy()*sin(posThis.theta()) > EE_Seed_Et_ )
-	eeseeds.push_back( *ite ); 
-    } else { 
-      if (ite->energy() > EE_Seed_E_ )              
-	eeseeds.push_back( *ite ); 
-    }
-  } // loop over xtals
-
-  sort(eeseeds.begin(), eeseeds.end(), ecalRecHitLess());
-
-  typedef std::map< EEDetId, bool > EEXtalInUse;
-  EEXtalInUse EEXisUsed;  //map of which eextals have been used
-
-  //loop over seeds to make eeclusters
-  for (std::vector<EcalRecHit>::iterator eeitseed=eeseeds.begin(); eeitseed!=eeseeds.end(); eeitseed++) 
+  const std::vector<EcalPi0Cluster>& clusters = eeClustering_.clusters();
+  const std::vector<std::pair<uint32_t,float> >& clusterHits = eeClustering_.hits();
+  for (std::vector<EcalPi0Cluster>::const_iterator clus = clusters.begin(); clus != clusters.end(); ++clus) 
   {
-    EEDetId eeseed_id( eeitseed->id() );
-    //float SeedTimeEE = eeitseed->time();
-    // check if seed already in use. If so go to next seed
-    EEXtalInUse::const_iterator mapit = EEXisUsed.find( eeseed_id );
-    if( mapit != EEXisUsed.end() ) continue; // seed already in use
-
-    // find 3x3 matrix of xtals
-    int clusEtaSize_(3), clusPhiSize_(3);
-    std::vector<DetId> clus_v = eetopology_->getWindow(eeseed_id,clusEtaSize_,clusPhiSize_); 
-
-    // needed for position calculator
-    //std::vector<std::pair<DetId,float> > clus_used;
-
-    // xtals actually used after removing those already used
-    vector<const EcalRecHit*> RecHitsInWindow;
-    //vector<const EcalRecHit*> RecHitsInWindow5x5;
-
-    float simple_energy = 0.; 
-    float posTotalEnergy(0.); // need for position calculation
-
-    // make 3x3  cluster - reject overlaps
-    int i_clus=0;
-    for (std::vector<DetId>::const_iterator det=clus_v.begin(); det!=clus_v.end(); det++,i_clus++) 
-    {
-	EEDetId thisId( *det );
-	// skip this xtal if already used
-	EEXtalInUse::const_iterator mapit = EEXisUsed.find( thisId );
-	if( mapit != EEXisUsed.end() ) continue; // xtal already used
-
-	// find the rec hit
-	EERecHitCollection::const_iterator ixtal = eeHandle->find( thisId );
-
-	//cout<<"ixtal output: "<< ixtal->energy() <<endl;
-
-	if( ixtal == eeHandle->end() ) continue; // xtal not found
-
-	RecHitsInWindow.push_back( &(*ixtal) );
-	//clus_used.push_back(std::make_pair(*det,1.)); // it seems it is not used anywhereisUsed
-	simple_energy +=  ixtal->energy();
-	if(ixtal->energy()>0.) posTotalEnergy += ixtal->energy(); // use only pos energy for position
-    }  // loop over xtals in the region
-    if(simple_energy <= 0) { 
-	//cout << "skipping cluster with negative energy " << simple_energy << endl; 
-	continue;
-    }
-
-    float s4s9_tmp[4] = {0, 0, 0, 0};
-
-    int seed_ix = eeseed_id.ix(); 
-    int seed_iy = eeseed_id.iy();   
-
-    // energy of 3x3 cluster
-    float e3x3(0.);
-
     std::vector<std::pair<DetId,float> > enFracs;
-
-    // variables for position caculation
-    float xclu(0.), yclu(0.), zclu(0.); // temp var to compute weighted average
-    float total_weight(0.);// to compute position
-
-    // Calculate shower depth
-    float T0 = PCparams_.param_T0_endc_;
-    float maxDepth = PCparams_.param_X0_ * ( T0 + log( posTotalEnergy ) );
-    float maxToFront;
-    if( GeometryFromFile_ ) maxToFront = geom_->getPosition(eeseed_id).mag(); // to front face
-    else                   {
-      const CaloCellGeometry* cell = geometry->getGeometry( eeseed_id ).get();
-      GlobalPoint posit = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( 0. );
-      maxToFront = posit.mag();
-    }
-    //double EnergyCristals[9] = {0.};
-    bool All_rechit_good=true;
-    // loop over xtals and compute energy and position
-    for(unsigned int j=0; j<RecHitsInWindow.size();j++)
-    { 
-	EEDetId det(RecHitsInWindow[j]->id());
-
-	if( RemoveDead_Flag_ ){
-	  if( !checkStatusOfEcalRecHit(channelStatus, *RecHitsInWindow[j] )  ) {
-	    All_rechit_good = false;
-	    break;  // exit this loop as soon as one crystal is dead, because at the end of this loop there is a continue if All_rechit_good = false
-	    // at the moment I see the rechits are added in the list of used ones, which is probably wrong if I reject this cluster
-	  }
-	}
-	if( RemoveDead_Map_!="" ){
-	  if( isInDeadMap( false, *RecHitsInWindow[j] ) ) {
-	    All_rechit_good = false;
-	    break;  // exit this loop as soon as one crystal is dead
-	  }
-	}
-
-	int ix = det.ix();
-	int iy = det.iy();
-
-	// use calibration coeff for energy and position
-	// FIXME: if isEoverEtrue_ is true, then we are not using the pi0 IC, but the photon dependent correction based on E/Etrue
-	// this means we should know which photon we are looking at
-	float en = RecHitsInWindow[j]->energy();
-	if (not isEoverEtrue_) {
-	  en *= regionalCalibration_->getCalibMap()->coeff(RecHitsInWindow[j]->id());
-	} 
-	int dx = seed_ix-ix;
-	int dy = seed_iy-iy;
-	//EnergyCristals[j] = en;
-	if(abs(dx)<=1 && abs(dy)<=1) 
-	{
-	  e3x3 += en;
-	  if(dx <= 0 && dy <=0){ s4s9_tmp[0] += en; }
-	  if(dx >= 0 && dy <=0){ s4s9_tmp[1] += en; }
-	  if(dx <= 0 && dy >=0){ s4s9_tmp[2] += en; }
-	  if(dx >= 0 && dy >=0){ s4s9_tmp[3] += en; }
-	  enFracs.push_back( std::make_pair( RecHitsInWindow[j]->id(), en ) );
-	}
-
-	// compute position
-	if(en>0.) 
-	{
-	  float weight = std::max( float(0.), PCparams_.param_W0_ + log(en/posTotalEnergy) );
-	  float pos_geo;
-	  if( GeometryFromFile_ ) pos_geo = geom_->getPosition(det).mag();
-	  else                   {
-	    const CaloCellGeometry* cell = geometry->getGeometry(det).get();
-	    GlobalPoint posit = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( 0. );
-	    pos_geo = posit.mag();
-	  }
-	  float depth = maxDepth + maxToFront - pos_geo;
-	  GlobalPoint posThis;
-	  if( GeometryFromFile_ ) posThis = geom_->getPosition(det,depth);
-	  else{
-	    const CaloCellGeometry* cell = geometry->getGeometry(det).get();
-	    posThis = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( depth );
-	  }
-	  xclu += weight*posThis.x(); 
-	  yclu += weight*posThis.y(); 
-	  zclu += weight*posThis.z(); 
-	  total_weight += weight;
-	}
-    } // loop over 3x3 eerechits
-
-    if(!All_rechit_good) continue;
-    float e2x2 = *max_element( s4s9_tmp,s4s9_tmp+4);
-    float s4s9 = e2x2/e3x3;
-    float inv_total_weight = 1./total_weight;
-    math::XYZPoint clusPos( xclu * inv_total_weight, yclu * inv_total_weight, zclu * inv_total_weight ); 
-
-    if ( fabs( clusPos.eta() )<1.8 ) { 
-      if (s4s9<S4S9_cut_low_[EcalEndcap]) continue; 
-      if ( RecHitsInWindow.size() < min(nXtal_1_cut_low_[EcalEndcap],nXtal_2_cut_low_[EcalEndcap])) continue;
-      float ptClus = e3x3*sin(clusPos.Theta());
-      if(ptClus<gPtCut_low_[EcalEndcap]) continue;
-    } else { 
-      if (s4s9<S4S9_cut_high_[EcalEndcap]) continue;
-      if ( RecHitsInWindow.size() < min(nXtal_1_cut_high_[EcalEndcap],nXtal_2_cut_high_[EcalEndcap])) continue;
-      float ptClus = e3x3*sin(clusPos.Theta());
-      if(ptClus<gPtCut_high_[EcalEndcap]) continue;
-    }
+    for (unsigned int j = clus->firstHit; j < clus->firstHit + clus->nHits; ++j)
+      enFracs.push_back( std::make_pair( DetId(EEDetId::unhashIndex(clusterHits[j].first)), clusterHits[j].second ) );
+    EEDetId eeseed_id = EEDetId::unhashIndex(clus->seed);
 
     // make calo clusters
-    for(unsigned int j=0; j<RecHitsInWindow.size();j++){
-	EEXisUsed [RecHitsInWindow[j]->id()] = true;
-    }
-    Ncristal_EE.push_back( RecHitsInWindow.size() );
-    eeclusters.push_back( CaloCluster( e3x3, clusPos, CaloID(CaloID::DET_ECAL_ENDCAP),
+    Ncristal_EE.push_back( clus->nXtal );
+    eeclusters.push_back( CaloCluster( clus->energy, clus->position, CaloID(CaloID::DET_ECAL_ENDCAP),
 	    enFracs, CaloCluster::undefined, eeseed_id ) );
+    eeclusterS4S9.push_back(clus->s4s9);
+    if (fillEtaAlongPi0_) eeclusterSelections.push_back( clus->selections );
 
-    eeclusterS4S9.push_back(s4s9);
-    //SeedTime_v.push_back(SeedTimeEE);
-    //eeclusterS1S9.push_back(eeitseed->energy()/e3x3);
-    // double maxEne = max_array( EnergyCristals, 9 );
-    // for(int i=0; i<9; i++){ if( EnergyCristals[i]==maxEne ) EnergyCristals[i]=0.; }
-    // double maxEne2 = max_array( EnergyCristals, 9);
-    // eeclusterS2S9.push_back( (maxEne+maxEne2)/e3x3 );
     int ietaRingSeed = EndcapTools::getRingIndex(eeseed_id); // from 0 to 77 (78 rings, 39 per side)
     // now port ring number to be outside barrel index (which is from -85 to 85 included)
     if (ietaRingSeed > 38) 
       ietaRingSeed = -85 - ietaRingSeed -1; // -1 because otherwise ietaRingSeed=0 overwrite last ieta of EB
     else
       ietaRingSeed = 47 + ietaRingSeed; // 85 + ietaRingSeed - 39 + 1
-    seedEnergyInCluster->Fill(ietaRingSeed,eeitseed->energy());
+    if (clus->selections & 1) seedEnergyInCluster->Fill(ietaRingSeed,clus->seedEnergy);
 
-  } //loop over seeds to make eeclusters
+  } //loop over eeclusters
+  profiler_.count(EcalStageProfiler::kClusters, eeclusters.size());
 
 
   /************************** ENDCAP-PRESHOWER MATCHING ************************/
@@ -1746,6 +1499,8 @@ void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters,
 
   if (eeclusters.size() > 1) {
 
+      EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kESMatching);
+
       for( std::vector<CaloCluster>::const_iterator eeclus_iter  = eeclusters.begin(); eeclus_iter != eeclusters.end(); ++eeclus_iter, ++ind)
       {
 
@@ -1755,8 +1510,8 @@ void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters,
 	    double Z = eeclus_iter->z();
 	    const GlobalPoint point(X,Y,Z);
 
-	    DetId tmp1 = esGeometry_->getClosestCellInPlane(point,1);
-	    DetId tmp2 = esGeometry_->getClosestCellInPlane(point,2);
+	    DetId tmp1 = esStripGrid_.getClosestCellInPlane(point,1);
+	    DetId tmp2 = esStripGrid_.getClosestCellInPlane(point,2);
 
 	    if ((tmp1.rawId()!=0) && (tmp2.rawId()!=0)) 
 	    {
@@ -1767,9 +1522,9 @@ void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters,
 	      // replace the std PreshowerTools::clusterwindowsize_ = 15 with 5, smaller for 3x3 clusters
 	      float es_clusterwindowsize = 5;
 	      //cout << "I'm before 	  PreshowerCluster preshowerclusterp1 = esClusteringAlgo.makeOnePreshowerCluster( es_clusterwindowsize, &tmp1_conversion); " << endl;
-	      PreshowerCluster preshowerclusterp1 = esClusteringAlgo.makeOnePreshowerCluster( es_clusterwindowsize, &tmp1_conversion);
+	      PreshowerCluster preshowerclusterp1 = esClusteringAlgo_->makeOnePreshowerCluster( es_clusterwindowsize, &tmp1_conversion);
 	      ////cout << "I'm after 	  PreshowerCluster preshowerclusterp1 = esClusteringAlgo.makeOnePreshowerCluster( es_clusterwindowsize, &tmp1_conversion); " << endl;
-	      PreshowerCluster preshowerclusterp2 = esClusteringAlgo.makeOnePreshowerCluster( es_clusterwindowsize, &tmp2_conversion);
+	      PreshowerCluster preshowerclusterp2 = esClusteringAlgo_->makeOnePreshowerCluster( es_clusterwindowsize, &tmp2_conversion);
 	      ////cout << "I'm after 	  PreshowerCluster preshowerclusterp2 = esClusteringAlgo.makeOnePreshowerCluster( es_clusterwindowsize, &tmp2_conversion); " << endl;
 
 
@@ -1799,6 +1554,7 @@ void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters,
 		    eseeclusters_tot.push_back( CaloCluster( tempenergy, posit, CaloID(CaloID::DET_ECAL_ENDCAP),  eeclus_iter->hitsAndFractions(), CaloCluster::undefined, eeclus_iter->seed() ) );
 		    Nxtal_tot.push_back(Ncristal_EE[ind]);
 		    vs4s9EE.push_back( eeclusterS4S9[ind] );
+		    if (fillEtaAlongPi0_) photonSelectionsEE_.push_back( eeclusterSelections[ind] );
 		    //vSeedTimeEE.push_back( SeedTime_v[ind] );
 		    Es_1.push_back( e1 ); Es_2.push_back( e2 );
 		}
@@ -1809,6 +1565,7 @@ void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters,
 	    eseeclusters_tot.push_back( CaloCluster( eeclus_iter->energy(), eeclus_iter->position(), CaloID(CaloID::DET_ECAL_ENDCAP),  eeclus_iter->hitsAndFractions(), CaloCluster::undefined, eeclus_iter->seed() ) );
 	    Nxtal_tot.push_back(Ncristal_EE[ind]);
 	    vs4s9EE.push_back( eeclusterS4S9[ind] );
+	    if (fillEtaAlongPi0_) photonSelectionsEE_.push_back( eeclusterSelections[ind] );
 	    //vSeedTimeEE.push_back( SeedTime_v[ind] );
 	    Es_1.push_back( -999. ); Es_2.push_back( -999. );
 	    // vs1s9EE.push_back( eeclusterS1S9[ind] );
@@ -1829,7 +1586,7 @@ void FillEpsilonPlot::fillEEClusters(std::vector< CaloCluster > & eseeclusters,
 }
 
 
-TH2F* FillEpsilonPlot::initializeEpsilonHistograms2D(const char *name, const char *title, int size )
+EcalRegionHistogram* FillEpsilonPlot::initializeEpsilonHistograms2D(const char *name, const char *title, int size, bool arePi0 )
 {
 
   TH1::SetDefaultSumw2(); // all new histograms will automatically activate the storage of the sum of squares of errors (i.e, TH1::Sumw2 is automatically called).
@@ -1847,15 +1604,10 @@ TH2F* FillEpsilonPlot::initializeEpsilonHistograms2D(const char *name, const cha
   } else {
     if(useMassInsteadOfEpsilon_) {
       // let's keep 0.004 GeV/bin
-      if (Are_pi0_) {
-	nbins   = (mass_pi0_high-mass_pi0_low+0.000001)/mass_pi0_bin_width;
-	lowEdge = mass_pi0_low;
-	upEdge  = mass_pi0_high;
-      } else {
-	nbins   = (mass_eta_high-mass_eta_low+0.000001)/mass_eta_bin_width;
-	lowEdge = mass_eta_low;
-	upEdge  = mass_eta_high;
-      }
+      const EcalMesonSelection window(arePi0);
+      lowEdge = window.massLow;
+      upEdge  = window.massHigh;
+      nbins   = (upEdge-lowEdge+0.000001)/(arePi0 ? mass_pi0_bin_width : mass_eta_bin_width);
     } else {
       nbins   = 120;
       lowEdge = -0.5;
@@ -1864,36 +1616,82 @@ TH2F* FillEpsilonPlot::initializeEpsilonHistograms2D(const char *name, const cha
     std::cout << "FillEpsilonPlot::initializeEpsilonHistograms2D::useMassInsteadOfEpsilon_ = " << useMassInsteadOfEpsilon_ << std::endl;
   }
 
-  TH2F *h = new TH2F(name, title, 
-		     nbins, lowEdge, upEdge, 
-		     size, -0.5, ((double) size) - 0.5);
+  // filled as a flat array, the TH2F with the same binning is only built in writeEpsilonPlot2D
+  EcalRegionHistogram *h = new EcalRegionHistogram(name, title, 
+						   nbins, lowEdge, upEdge, 
+						   size, TH1::GetDefaultSumw2());
   if (isEoverEtrue_) {
-    h->GetXaxis()->SetTitle("photon E/E_{true}");
+    h->setAxisTitles("photon E/E_{true}", "crystal index");
   } else {
-    if(useMassInsteadOfEpsilon_) h->GetXaxis()->SetTitle("Mass(#gamma#gamma)");
-    else                         h->GetXaxis()->SetTitle("Epsilon");	
+    if(useMassInsteadOfEpsilon_) h->setAxisTitles("Mass(#gamma#gamma)", "crystal index");
+    else                         h->setAxisTitles("Epsilon", "crystal index");
   }
-  h->GetYaxis()->SetTitle("crystal index");
 
   return h;
 
 }
 
 
-void  FillEpsilonPlot::deleteEpsilonPlot2D(TH2F *h)
+void  FillEpsilonPlot::deleteEpsilonPlot2D(EcalRegionHistogram *h)
+{
+  delete h;
+}
+
+// per-IOV histogram with the binning and titles of the nominal one, its regions are allocated when first filled
+EcalSparseRegionHistogram* FillEpsilonPlot::initializeIOVHistogram2D(const EcalRegionHistogram *nominal, size_t iov)
+{
+  std::string name = nominal->name() + Form("_iov%d", int(iov));
+  std::string title = nominal->title() + ", IOV from " + iovs_.label(iov);
+  EcalSparseRegionHistogram *h = new EcalSparseRegionHistogram(name.c_str(), title.c_str(),
+							       nominal->nBins(), nominal->xMin(), nominal->xMax(),
+							       nominal->nRegions(), nominal->useSumw2());
+  h->setAxisTitles(nominal->xTitle().c_str(), nominal->yTitle().c_str());
+  return h;
+}
+
+// nominal histogram and, with the weight of the event, its replicas, then the histogram of the IOV of the event
+void FillEpsilonPlot::fillEpsilon(EcalRegionHistogram *h, std::vector<EcalRegionHistogram*> &replicas, std::vector<EcalSparseRegionHistogram*> &iovs, float x, uint32_t row, float w)
+{
+  h->fill(x, row, w);
+  for (unsigned int k = 0; k < replicas.size(); ++k)
+    if (statReplicas_.weight(k) != 0.) replicas[k]->fill(x, row, w*statReplicas_.weight(k));
+  if (currentIOV_ >= 0 && !iovs.empty()) iovs[currentIOV_]->fill(x, row, w);
+}
+
+// distributions of selections_[s]: 0 the nominal ones, 1 those of the eta along the pi0
+void FillEpsilonPlot::fillEpsilon(size_t s, int subDetId, float x, uint32_t row, float w)
 {
-  // probably this function is not needed if I only have 1 histogram
-  // but let's keep it for consistency with previous version of the code using TH1
-  //delete h;
-  return;
+  if (subDetId == EcalBarrel) {
+    if (s == 0) fillEpsilon(epsilon_EB_h2D, epsilon_EB_rep_h2D, epsilon_EB_iov_h2D, x, row, w);
+    else        fillEpsilon(epsilon_EB_eta_h2D, epsilon_EB_eta_rep_h2D, epsilon_EB_eta_iov_h2D, x, row, w);
+  } else {
+    if (s == 0) fillEpsilon(epsilon_EE_h2D, epsilon_EE_rep_h2D, epsilon_EE_iov_h2D, x, row, w);
+    else        fillEpsilon(epsilon_EE_eta_h2D, epsilon_EE_eta_rep_h2D, epsilon_EE_eta_iov_h2D, x, row, w);
+  }
 }
 
 
-void  FillEpsilonPlot::writeEpsilonPlot2D(TH2F *h) //, const char *folder)
+void  FillEpsilonPlot::writeEpsilonPlot2D(EcalRegionHistogram *h) //, const char *folder)
 {
+  EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kHistogramWrite);
   //if (not outfile_->GetKey(folder)) outfile_->mkdir(folder);
   //outfile_->cd(folder);
-  h->Write();
+  std::cout << "FillEpsilonPlot::writeEpsilonPlot2D: " << h->name() << " " << h->entries() << " entries, "
+	    << h->memoryBytes()/1048576. << " MB" << std::endl;
+  TH2F *h2D = h->toTH2F();
+  h2D->Write();
+  delete h2D;
+}
+
+void  FillEpsilonPlot::writeEpsilonPlot2D(EcalSparseRegionHistogram *h)
+{
+  EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kHistogramWrite);
+  std::cout << "FillEpsilonPlot::writeEpsilonPlot2D: " << h->name() << " " << h->entries() << " entries, "
+	    << h->nFilledRegions() << "/" << h->nRegions() << " regions filled, "
+	    << h->memoryBytes()/1048576. << " MB" << std::endl;
+  TH2F *h2D = h->toTH2F();
+  h2D->Write();
+  delete h2D;
 }
 
 // std::vector< CaloCluster > FillEpsilonPlot::MCTruthAssociate(std::vector< CaloCluster > & clusters, double deltaR, bool isEB) {
@@ -1945,38 +1743,15 @@ int FillEpsilonPlot::getNumberOverlappingCrystals(std::vector<CaloCluster>::cons
 
   // To count how many crystals overlap between the two 3x3 photon clusters we simply
   // open a geometric 3x3 matrix around the 2 seeds and see how many DetId are in common.
-  // we also check that there is a RecHit in those overlapping crystals, otherwise there is no real overlap
+  // The check on the RecHit in the overlapping crystals used to be always true
+  // (rechit != ebHandle->end() || rechit != eeHandle->end()), so every common crystal is counted
 
   int nOverlapXtals = 0;
-  std::vector<DetId> clus3x3_g1;       
-  std::vector<DetId> clus3x3_g2;       
-  std::set<DetId> DetIdUsed;
 
   if (isEB) {
-  
-    EBDetId  id_g1(g1->seed());
-    EBDetId  id_g2(g2->seed());
-    clus3x3_g1 = ebtopology_->getWindow(id_g1,3,3);       
-    clus3x3_g2 = ebtopology_->getWindow(id_g2,3,3);       
-
+    nOverlapXtals = ebWindow3x3_.overlap(EBDetId(g1->seed()).hashedIndex(), EBDetId(g2->seed()).hashedIndex());
   } else {
-
-    EEDetId  id_g1(g1->seed());
-    EEDetId  id_g2(g2->seed());
-    clus3x3_g1 = eetopology_->getWindow(id_g1,3,3);       
-    clus3x3_g2 = eetopology_->getWindow(id_g2,3,3);       
-
-  }
-
-  for (std::vector<DetId>::const_iterator det = clus3x3_g1.begin(); det != clus3x3_g1.end(); ++det) {
-    DetIdUsed.insert(*det);
-  }
-
-  for (std::vector<DetId>::const_iterator det = clus3x3_g2.begin(); det != clus3x3_g2.end(); ++det) {
-    EcalRecHitCollection::const_iterator rechit = isEB ? ebHandle->find( *det ) : eeHandle->find( *det );
-    if ( (rechit != ebHandle->end()) || (rechit != eeHandle->end()) ) { 
-      if (DetIdUsed.count(*det) != 0) nOverlapXtals++;
-    }
+    nOverlapXtals = eeWindow3x3_.overlap(EEDetId(g1->seed()).hashedIndex(), EEDetId(g2->seed()).hashedIndex());
   }
 
   return nOverlapXtals;
@@ -2008,7 +1783,10 @@ std::vector< CaloCluster > FillEpsilonPlot::MCTruthAssociateMultiPi0(std::vector
 
   // for the moment, if we find the same reco cluster to be closer to both gen photons wrt other clusters, we just skip this event
 
-  std::set<unsigned int> clusterIndexAlreadyUsed;
+  // flat used flags indexed like clusters, and an eta-phi grid so that each gen photon
+  // only looks at the clusters of the cells within deltaR
+  mcMatchUsed_.assign(clusters.size(), false);
+  mcMatchGrid_.fill(clusters);
   std::vector< CaloCluster > ret;
   ret.clear();
 
@@ -2044,19 +1822,13 @@ std::vector< CaloCluster > FillEpsilonPlot::MCTruthAssociateMultiPi0(std::vector
     // std::cout << "ig = " << ig << "   gen eta1,2,phi1,2 " << etaGen1 << "," << etaGen2 << "," << phiGen1 << "," << phiGen2;
     // std::cout << "    DR = " << deltaR_gen << std::endl;
 
-    // loop on reco cluster the first time to match the first gen photon
-    for (unsigned int iclus = 0; iclus < clusters.size(); ++iclus) {
-
-      if (clusterIndexAlreadyUsed.count(iclus) != 0 ) continue;
-      const CaloCluster g = clusters[iclus];
-      float deltaR1 = GetDeltaR(g.eta(), etaGen1, g.phi(), phiGen1);
-      // std::cout << "iclus1 = " << iclus << "     deltaR1 = " << deltaR1 << std::endl;
-      if (deltaR1 < deltaR1_tmp ) {
-	deltaR1_tmp = deltaR1; 
-	n_tmp1 = iclus;
-      }
-  
-    } // loop on reco cluster the first time
+    // closest unused reco cluster to the first gen photon: a cluster farther than deltaR
+    // would leave the pair unmatched anyway, so only the cells within deltaR are searched
+    int nearest1 = mcMatchGrid_.nearestUnused(etaGen1, phiGen1, deltaR, mcMatchUsed_);
+    if (nearest1 >= 0) {
+      n_tmp1 = nearest1;
+      deltaR1_tmp = GetDeltaR(mcMatchGrid_.eta(n_tmp1), etaGen1, mcMatchGrid_.phi(n_tmp1), phiGen1);
+    }
 
     // now, if we find a reco cluster with DR lower than the chosen threshold, we remove the cluster index from the list of available cluster and
     // go on to match the second one
@@ -2065,25 +1837,18 @@ std::vector< CaloCluster > FillEpsilonPlot::MCTruthAssociateMultiPi0(std::vector
     // we also have to order the reco pair based on seed energy to make the flow consistent with pi0 calibration
     
     if(deltaR1_tmp < deltaR) {
-      clusterIndexAlreadyUsed.insert(n_tmp1);
+      mcMatchUsed_[n_tmp1] = true;
     } else {
       numberUnmatchedGenPhotonPairs++;
       continue;
     }
 
-    // loop again on reco clusters to match the second gen photon
-    for (unsigned int iclus = 0; iclus < clusters.size(); ++iclus) {
-
-      if (clusterIndexAlreadyUsed.count(iclus) != 0 ) continue;
-      const CaloCluster g = clusters[iclus];
-      float deltaR2 = GetDeltaR(g.eta(), etaGen2, g.phi(), phiGen2);
-      // std::cout << "iclus2 = " << iclus << "     deltaR2 = " << deltaR2 << std::endl;
-      if( deltaR2 < deltaR2_tmp) {
-	deltaR2_tmp = deltaR2; 
-	n_tmp2 = iclus;
-      }
-
-    } // loop on reco cluster the second time 
+    // same for the second gen photon
+    int nearest2 = mcMatchGrid_.nearestUnused(etaGen2, phiGen2, deltaR, mcMatchUsed_);
+    if (nearest2 >= 0) {
+      n_tmp2 = nearest2;
+      deltaR2_tmp = GetDeltaR(mcMatchGrid_.eta(n_tmp2), etaGen2, mcMatchGrid_.phi(n_tmp2), phiGen2);
+    }
 
     // if we arrived here, it means the first gen photon was matched to a reco cluster within a given DR
     // now, if we cannot matched the second photon, we consider the photon pair to be unmatched and we add back the n_tmp1 cluster index
@@ -2092,7 +1857,7 @@ std::vector< CaloCluster > FillEpsilonPlot::MCTruthAssociateMultiPi0(std::vector
     if(deltaR2_tmp < deltaR) {
 
       bool g1_seed_energy_is_bigger = true;
-      clusterIndexAlreadyUsed.insert(n_tmp2);
+      mcMatchUsed_[n_tmp2] = true;
 
       if(isEB) {
 
@@ -2147,7 +1912,7 @@ std::vector< CaloCluster > FillEpsilonPlot::MCTruthAssociateMultiPi0(std::vector
       }
 
     } else {
-      clusterIndexAlreadyUsed.erase(n_tmp1); 
+      mcMatchUsed_[n_tmp1] = false;
       numberUnmatchedGenPhotonPairs++;
       continue;
     }
@@ -2156,7 +1921,7 @@ std::vector< CaloCluster > FillEpsilonPlot::MCTruthAssociateMultiPi0(std::vector
     // anyway, we do the check and skip the gen pair if the same reco cluster is matched to both gen photons (it can happen if the two are really close to each other)
     // we must also remove the last two elements from the vectors and add the indices back to the set
     if(n_tmp1 == n_tmp2) {
-      clusterIndexAlreadyUsed.erase(n_tmp1); // can erase the element just once because it was the same and a std::set only stores one element with the same value 
+      mcMatchUsed_[n_tmp1] = false;
       if(isEB) {
 	Ncristal_EB_used.pop_back();
 	Ncristal_EB_used.pop_back();
@@ -2212,18 +1977,32 @@ CaloCluster FillEpsilonPlot::getClusterAfterContainmentCorrections(std::vector<C
   // only EB for the moment!
   if (not isEB) return *gam;
 
-  // corrected energy is obtained by correcting energy in each RecHit of photon
   float totalCorrectedClusterEnergy = 0.0;
+  math::XYZPoint clusPos;
+  std::vector< std::pair<DetId, float> > correctedHitsAndFrac; // as hitsAndFrac but with corrections
+  applyContainmentCorrections(*gam, isSecondPhoton, totalCorrectedClusterEnergy, clusPos, &correctedHitsAndFrac);
 
-  if (!hCC_EoverEtrue_g1 || !hCC_EoverEtrue_g2)
-    throw cms::Exception("FillEpsilonPlot::getClusterAfterContainmentCorrections") << "Pointers to histograms with CC are null\n";
-  TH2F* hContainmentCorrection = (isSecondPhoton ? hCC_EoverEtrue_g2 : hCC_EoverEtrue_g1);
+  CaloCluster correctedCaloCluster( totalCorrectedClusterEnergy, clusPos, CaloID(CaloID::DET_ECAL_BARREL), correctedHitsAndFrac, CaloCluster::undefined, EBDetId(gam->seed()) );
+  // cout << "before correction: " << *gam << endl;
+  // cout << "after correction: " << correctedCaloCluster << endl;
+
+  return correctedCaloCluster;
+
+}
 
-  std::vector< std::pair<DetId, float> > hitsAndFrac = gam->hitsAndFractions();
-  std::vector< std::pair<DetId, float> > correctedHitsAndFrac; // as hitsAndFrac but with corrections
-  float correctedEnergy_it = 0;
 
-  //  int ind = 1; // needed for cout below, only for debugging
+void FillEpsilonPlot::applyContainmentCorrections(const CaloCluster& gam, const bool isSecondPhoton, float& totalCorrectedClusterEnergy, math::XYZPoint& clusPos, std::vector< std::pair<DetId, float> >* correctedHitsAndFrac) {
+
+  // EB only: corrected energy is obtained by correcting energy in each RecHit of photon, then the position is recomputed
+  totalCorrectedClusterEnergy = 0.0;
+
+  if (ccEoverEtrueEB_g1_.empty() || ccEoverEtrueEB_g2_.empty())
+    throw cms::Exception("FillEpsilonPlot::applyContainmentCorrections") << "Containment corrections were not loaded\n";
+  const std::vector<float>& containmentCorrection = (isSecondPhoton ? ccEoverEtrueEB_g2_ : ccEoverEtrueEB_g1_);
+
+  const std::vector< std::pair<DetId, float> > & hitsAndFrac = gam.hitsAndFractions();
+  std::vector<float> & correctedEnergy = ccHitEnergyBuffer_;
+  correctedEnergy.resize(hitsAndFrac.size());
 
   // FIXME: hardcoded correction for 2017: CC for 2017 was obtained from V1 MC. We had a V2 MC but statistics was not enough
   // However, since the ratio is nearly flat, we divided CC from V1 MC by the mean of the ratio
@@ -2232,69 +2011,37 @@ CaloCluster FillEpsilonPlot::getClusterAfterContainmentCorrections(std::vector<C
   // float CC_meanRatioV1overV2MC = 1.0;
   float CC_meanRatioV1overV2MC = isSecondPhoton ? scalingEoverEtrueCC_g2_ : scalingEoverEtrueCC_g1_;
 
-  for (std::vector< std::pair<DetId, float> >::const_iterator it  = hitsAndFrac.begin(); it != hitsAndFrac.end(); ++it) {	  
-
-    EBDetId ebId(it->first);
-    correctedEnergy_it = it->second * hContainmentCorrection->GetBinContent(hContainmentCorrection->FindFixBin(ebId.ieta(),ebId.iphi())) / CC_meanRatioV1overV2MC;
-
-    // DEBUG
-    // only for debugging
-    // EBRecHitCollection::const_iterator ixtal = ebHandle->find( ebId );
-    // if( ixtal == ebHandle->end() ) continue; // xtal not found
-    // if (ixtal->energy() < 0) continue; // should not happen
-    // std::cout << ind 
-    // 	      << ":  ieta,iphi = " << ebId.ieta() << "," << ebId.iphi() 
-    // 	      << "   RecHit_energy = " << ixtal->energy()
-    // 	      << "   ChannelStatus = " <<
-    // 	      << "   IC = " << regionalCalibration_->getCalibMap()->coeff(it->first)
-    // 	      << "   RecHit_energy_IC = " << it->second
-    // 	      << "   CC = " << hContainmentCorrection->GetBinContent(hContainmentCorrection->FindFixBin(ebId.ieta(),ebId.iphi()))
-    // 	      << "   RecHit_energy_IC_CC = " << correctedEnergy_it << std::endl;
-
-    totalCorrectedClusterEnergy += correctedEnergy_it;
+  for (unsigned int j = 0; j < hitsAndFrac.size(); ++j) {
+
+    // the table stores the TH2F bin content, promote it to double as GetBinContent() did
+    correctedEnergy[j] = hitsAndFrac[j].second * double(containmentCorrection[EBDetId(hitsAndFrac[j].first).hashedIndex()]) / CC_meanRatioV1overV2MC;
+    totalCorrectedClusterEnergy += correctedEnergy[j];
     // in the rest of the code the fraction was defined as the energy of the RecHit, not the ratio with the total one
-    correctedHitsAndFrac.push_back( std::make_pair(it->first, correctedEnergy_it));  
-    //ind++;
+    if (correctedHitsAndFrac) correctedHitsAndFrac->push_back( std::make_pair(hitsAndFrac[j].first, correctedEnergy[j]) );
 
   }
 
   // variables for position caculation
   float xclu(0.), yclu(0.), zclu(0.); // temp var to compute weighted average
   float total_weight(0.);// to compute position
-  EBDetId seed_id(gam->seed());
+  EBDetId seed_id(gam.seed());
 
   // Calculate shower depth
   float T0 = PCparams_.param_T0_barl_;
   float maxDepth = PCparams_.param_X0_ * ( T0 + log( totalCorrectedClusterEnergy ) ); 
-  float maxToFront;
-  if( GeometryFromFile_ ) maxToFront = geom_->getPosition(seed_id).mag(); // to front face
-  else {
-    const CaloCellGeometry* cell = geometry->getGeometry( seed_id ).get();
-    GlobalPoint posit = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( 0. );
-    maxToFront = posit.mag();
-  }
+  float maxToFront = geomTable_.frontDistance( EcalGeometryTable::index(seed_id) ); // to front face
 
   // loop over xtals (only those with positive energy) and compute energy and position
-  for(unsigned int j = 0; j < correctedHitsAndFrac.size(); ++j) {
+  for(unsigned int j = 0; j < hitsAndFrac.size(); ++j) {
 
-      EBDetId det(correctedHitsAndFrac[j].first);
+      EBDetId det(hitsAndFrac[j].first);
 
       // compute position
-      float weight = std::max( float(0.), PCparams_.param_W0_ + log(correctedHitsAndFrac[j].second/totalCorrectedClusterEnergy) );  // here it requires the fraction Ei/Etot
-      float pos_geo;
-      if( GeometryFromFile_ ) pos_geo = geom_->getPosition(det).mag(); // to front face
-      else                  {
-	const CaloCellGeometry* cell = geometry->getGeometry(det).get();
-	GlobalPoint posit = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( 0. );
-	pos_geo = posit.mag();
-      }
+      float weight = std::max( float(0.), PCparams_.param_W0_ + log(correctedEnergy[j]/totalCorrectedClusterEnergy) );  // here it requires the fraction Ei/Etot
+      uint32_t igeo = EcalGeometryTable::index(det);
+      float pos_geo = geomTable_.frontDistance(igeo); // to front face
       float depth = maxDepth + maxToFront - pos_geo;
-      GlobalPoint posThis;
-      if( GeometryFromFile_ ) posThis = geom_->getPosition(det,depth);
-      else{
-	const CaloCellGeometry* cell = geometry->getGeometry(det).get();
-	posThis = ( dynamic_cast<const TruncatedPyramid*>(cell) )->getPosition( depth );
-      }
+      GlobalPoint posThis = geomTable_.position(igeo, depth);
 
       xclu += weight*posThis.x(); 
       yclu += weight*posThis.y(); 
@@ -2303,15 +2050,27 @@ CaloCluster FillEpsilonPlot::getClusterAfterContainmentCorrections(std::vector<C
 
   } // loop over 3x3 rechits
 
-  math::XYZPoint clusPos( xclu/total_weight, 
-			  yclu/total_weight,
-			  zclu/total_weight ); 
+  clusPos = math::XYZPoint( xclu/total_weight, 
+			    yclu/total_weight,
+			    zclu/total_weight ); 
 
-  CaloCluster correctedCaloCluster( totalCorrectedClusterEnergy, clusPos, CaloID(CaloID::DET_ECAL_BARREL), correctedHitsAndFrac, CaloCluster::undefined, seed_id );
-  // cout << "before correction: " << *gam << endl;
-  // cout << "after correction: " << correctedCaloCluster << endl;
+}
 
-  return correctedCaloCluster;
+
+const FillEpsilonPlot::CorrectedCluster& FillEpsilonPlot::getContainmentCorrectedCluster(const std::vector<CaloCluster>& clusters, const size_t index, const bool isSecondPhoton, const bool isEB) {
+
+  // corrections depend only on the cluster and on the photon flavour, compute them once per event
+  CorrectedCluster & corr = contCorrClusters_[isSecondPhoton ? 1 : 0][index];
+  if (not corr.isSet) {
+    if (isEB) {
+      applyContainmentCorrections(clusters[index], isSecondPhoton, corr.energy, corr.position, 0);
+    } else {
+      corr.energy = clusters[index].energy();
+      corr.position = clusters[index].position();
+    }
+    corr.isSet = true;
+  }
+  return corr;
 
 }
 
@@ -2328,31 +2087,24 @@ void FillEpsilonPlot::computePairProperties(const CaloCluster* g1,
 					    float &eta_pair, 
 					    float &phi_pair) {
 
-  // define photons as math::XYZVector, where the magnitude is scaled to match the energy 
-  // this works because it assumes massless particles (photons), and it is also used in the stream
-  
-  // XYZVector::R() returns sqrt(Mag2()), where Mag2()= fx*fx + fy*fy + fz*fz       
-  // here I'm assuming that the vector initial magnitude is always different from 0
-  // should be ok, the cluster must be some where in the detector, so the distance is greater than 0)
-  //
-  // photon 1
-  tmp_photon1 = g1->position();
-  float energy1 = g1->energy();
-  tmp_photon1 *= (energy1 / tmp_photon1.R());
-  // photon 2
-  tmp_photon2 = g2->position();
-  float energy2 = g2->energy();
-  tmp_photon2 *= (energy2 / tmp_photon2.R());
-
-  math::XYZVector tmp_pi0_3D = tmp_photon1 + tmp_photon2;  
-  float energy_pi0 = energy1 + energy2;
-
-  // M_pi0 = sqrt(E_pi0^2 - |p_pi0|^2)	
-  m_pair = std::sqrt(energy_pi0 * energy_pi0 - tmp_pi0_3D.Mag2());
-  // Rho method is the equivalent of Pt: returns sqrt( fx*fx + fy*fy )
-  pt_pair  = tmp_pi0_3D.Rho();
-  eta_pair = tmp_pi0_3D.Eta();
-  phi_pair = tmp_pi0_3D.Phi();
+  computePairProperties(g1->position(), g1->energy(), g2->position(), g2->energy(),
+			tmp_photon1, tmp_photon2, m_pair, pt_pair, eta_pair, phi_pair);
+
+}
+
+void FillEpsilonPlot::computePairProperties(const math::XYZPoint& position1,
+					    const float energy1,
+					    const math::XYZPoint& position2,
+					    const float energy2,
+					    math::XYZVector &tmp_photon1,
+					    math::XYZVector &tmp_photon2,
+					    float &m_pair,
+					    float &pt_pair,
+					    float &eta_pair, 
+					    float &phi_pair) {
+
+  EcalPi0PairSelection::pairProperties(position1, energy1, position2, energy2,
+				       tmp_photon1, tmp_photon2, m_pair, pt_pair, eta_pair, phi_pair);
 
 }
 
@@ -2361,482 +2113,296 @@ void FillEpsilonPlot::computeEpsilon(std::vector< CaloCluster > & clusters, std:
   if(subDetId!=EcalBarrel && subDetId != EcalEndcap) 
     throw cms::Exception("FillEpsilonPlot::computeEpsilon") << "Subdetector Id not recognized\n";
 
-  //if (isDebug_) cout << "[DEBUG] Beginning cluster loop.. subDetId = " << subDetId << "   clusters.size() = " << clusters.size() << endl;
-
-  float ptMinForIso = (subDetId == EcalBarrel) ? 1.0 : 0.5;
-
-  float hlt_iso_dr = 0.0;
-  float hlt_iso_deta = 0.0;
-  float mass_low_noCorrCut = 0.0;
-  float mass_high_noCorrCut = 0.0;
-  float mass_low_withCorrCut = 0.0;
-  float mass_high_withCorrCut = 0.0;
-  if (Are_pi0_) {
-    hlt_iso_dr = 0.2;
-    hlt_iso_deta = 0.05;
-    mass_low_noCorrCut = mass_pi0_low_noCorrCut;
-    mass_high_noCorrCut = mass_pi0_high_noCorrCut;
-    mass_low_withCorrCut = mass_pi0_low;
-    mass_high_withCorrCut = mass_pi0_high;
-  } else {
-    hlt_iso_dr = 0.3;
-    hlt_iso_deta = 0.1;
-    mass_low_noCorrCut = mass_eta_low_noCorrCut;
-    mass_high_noCorrCut = mass_eta_high_noCorrCut;
-    mass_low_withCorrCut = mass_eta_low;
-    mass_high_withCorrCut = mass_eta_high;
-  }
-  // loop over clusters to make Pi0
-  size_t i=0;
-  for(std::vector<CaloCluster>::const_iterator g1  = clusters.begin(); g1 != clusters.end(); ++g1, ++i) 
-  {
-    size_t j=i+1;
-    for(std::vector<CaloCluster>::const_iterator g2 = g1+1; g2 != clusters.end(); ++g2, ++j ) {
-
-	//float Corr1 = 1., Corr2 = 1.;
-
-	// g1 and g2 are ordered with the energy of the seed, but their respective clusters don't necessarily follow the same order
-	// also, their pTs are not necessarily ordered 
-	// Defining few variables to save photon quantities that are used more than once, to avoid recomputing them every time
-	float g1eta = g1->eta();
-	float g2eta = g2->eta();
-	float g1phi = g1->phi();
-	float g2phi = g2->phi();
-	float DeltaR_g1g2_nocor = GetDeltaR(g1eta, g2eta, g1phi, g2phi);
-	// since: end of Spring 2019
-	// get DR and immediately reject clusters that are too far from each other
-	// w/o this cut, selected pairs would probably be the same due to other cuts, but this should speed up
-	
-	if (DeltaR_g1g2_nocor > 0.4) continue;
-	if( g1eta == g2eta && g1phi == g2phi ) continue;
-
-	// // define photons as math::XYZVector, where the magnitude is scaled to match the energy 
-	// // this works because it assumes massless particles (photons), and it is also used in the stream
-
-	// // XYZVector::R() returns sqrt(Mag2()), where Mag2()= fx*fx + fy*fy + fz*fz       
-	// // here I'm assuming that the vector initial magnitude is always different from 0
-	// // should be ok, the cluster must be some where in the detector, so the distance is greater than 0)
-	// //
-	// // photon 1
-	// math::XYZVector tmp_photon1(g1->position());
-	// float energy1 = g1->energy();
-	// tmp_photon1 *= (energy1 / tmp_photon1.R());
-	// // photon 2
-	// math::XYZVector tmp_photon2(g2->position());
-	// float energy2 = g2->energy();
-	// tmp_photon2 *= (energy2 / tmp_photon2.R());
-
-	// float energy_pi0 = energy1 + energy2;
-	// math::XYZVector tmp_pi0_3D = tmp_photon1 + tmp_photon2; 
-	// // M_pi0 = sqrt(E_pi0^2 - |p_pi0|^2)	
-	// double pi0P4_nocor_mass = std::sqrt(energy_pi0 * energy_pi0 - tmp_pi0_3D.Mag2());
-	// if (pi0P4_nocor_mass < mass_low_noCorrCut || pi0P4_nocor_mass > mass_high_noCorrCut) continue;
-	// // Rho method is the equivalent of Pt: returns sqrt( fx*fx + fy*fy )
-	// double pi0P4_nocor_pt = tmp_pi0_3D.Rho();
-
-	// // Rho method is the equivalent of Pt: it returns sqrt( fx*fx + fy*fy ) 
-	// float g1pt = tmp_photon1.Rho(); 
-	// float g2pt = tmp_photon2.Rho();
-
-	///////
-	float pi0P4_nocor_mass = 0.0;
-	float pi0P4_nocor_pt = 0.0;
-	float pi0P4_nocor_eta = 0.0;
-	float pi0P4_nocor_phi = 0.0;
-	math::XYZVector tmp_photon1;
-	math::XYZVector tmp_photon2;
-	// computePairProperties(g1, g2, 
-	// 		      tmp_photon1, tmp_photon2,
-	// 		      pi0P4_nocor_mass, pi0P4_nocor_pt, pi0P4_nocor_eta, pi0P4_nocor_phi);
-	computePairProperties(&(*g1), &(*g2), 
-			      tmp_photon1, tmp_photon2,
-			      pi0P4_nocor_mass, pi0P4_nocor_pt, pi0P4_nocor_eta, pi0P4_nocor_phi);
-	if (pi0P4_nocor_mass < mass_low_noCorrCut || pi0P4_nocor_mass > mass_high_noCorrCut) continue;
-	float g1pt = tmp_photon1.Rho(); 
-	float g2pt = tmp_photon2.Rho();
-	///////
-
-	// initialize as uncorrected variables
-	math::XYZVector g1_contCorr_tlv(tmp_photon1);
-	math::XYZVector g2_contCorr_tlv(tmp_photon2);
-	float pi0P4_mass = pi0P4_nocor_mass;
-	float pi0P4_pt = pi0P4_nocor_pt;
-	float pi0P4_eta = pi0P4_nocor_eta;
-	float pi0P4_phi = pi0P4_nocor_phi;
-
-	// apply containment corrections
-	if (useContainmentCorrectionsFromEoverEtrue_) {
-
-	  CaloCluster g1_contCorr_clus(getClusterAfterContainmentCorrections(g1,false,subDetId==EcalBarrel));
-	  CaloCluster g2_contCorr_clus(getClusterAfterContainmentCorrections(g2,true,subDetId==EcalBarrel));
-	  computePairProperties(&g1_contCorr_clus, &g2_contCorr_clus, 
-				g1_contCorr_tlv, g2_contCorr_tlv,
-				pi0P4_mass, pi0P4_pt, pi0P4_eta, pi0P4_phi);
-	} 
+  EcalStageProfiler::Scope pairSearchTimer(profiler_, EcalStageProfiler::kPairSearch);
 
-	if (pi0P4_mass < mass_low_withCorrCut || pi0P4_mass > mass_high_withCorrCut) continue;
-
-	// define array inded based on eta region, to access the proper cut value
-	int etaRegionID = 0;
-	// for Nxtal cuts
-	int Nxtal_g1 = 0;
-	int Nxtal_g2 = 0;
-	int Nxtal_EnergGamma = 0;
-	int Nxtal_EnergGamma2 = 0;
-	float fabs_pi0P4_eta = fabs(pi0P4_eta);
-	// set some stuff based on eta region
-	if (subDetId == EcalBarrel) {
-
-	  Nxtal_g1 = Ncristal_EB_used[i];
-	  Nxtal_g2 = Ncristal_EB_used[j];
-	  if(g1->energy() > g2->energy()) {  
-	    Nxtal_EnergGamma = Ncristal_EB_used[i]; 
-	    Nxtal_EnergGamma2 = Ncristal_EB_used[j]; 
-	  } else {  
-	    Nxtal_EnergGamma = Ncristal_EB_used[j]; 
-	    Nxtal_EnergGamma2 = Ncristal_EB_used[i]; 
-	  }
+  // reset the containment corrected clusters of the previous call
+  if (useContainmentCorrectionsFromEoverEtrue_) {
+    contCorrClusters_[0].assign(clusters.size(), CorrectedCluster());
+    contCorrClusters_[1].assign(clusters.size(), CorrectedCluster());
+  }
 
-	  if (fabs_pi0P4_eta < 1.0) 
-	    etaRegionID = 0;
-	  else if (fabs_pi0P4_eta < 1.479) 
-	    etaRegionID = 1;
-	  whichRegionEcalStreamPi0 = etaRegionID;
+  // pair search and cuts are in EcalPi0PairSelection, the pairs come back to the hooks below
+  pairClusters_ = &clusters;
+  pairMatchedGen_ = &clusters_matchedGenPhoton;
+  pairSubDetId_ = subDetId;
+  const std::vector<uint8_t>* photonSelections = 0;
+  if (fillEtaAlongPi0_) photonSelections = subDetId==EcalBarrel ? &photonSelectionsEB_ : &photonSelectionsEE_;
+  pairSelection_.run(clusters, subDetId==EcalBarrel ? Ncristal_EB_used : Ncristal_EE_used, photonSelections,
+                     subDetId==EcalBarrel, *this, profiler_);
 
-	} else {
+  if(MakeNtuple4optimization_){
+    if (isDebug_) cout << "[DEBUG] Filling Tree" << endl; 
+    //for(unsigned int i=0; i<NL1SEED; i++) Op_L1Seed[i] = L1BitCollection_[i];
+    //for(unsigned int i=0; i<NL1SEED; i++) Op_L1Seed[i] = l1flag[i];
+    Op_NPi0 = nPi0; 
+    if(nPi0>0) Tree_Optim->Fill();
+  }
+ 
+}
 
-	  Nxtal_g1 = Ncristal_EE_used[i];
-	  Nxtal_g2 = Ncristal_EE_used[j];
-	  if(g1->energy() > g2->energy()) {  
-	    Nxtal_EnergGamma = Ncristal_EE_used[i]; 
-	    Nxtal_EnergGamma2 = Ncristal_EE_used[j]; 
-	  } else {  
-	    Nxtal_EnergGamma = Ncristal_EE_used[j]; 
-	    Nxtal_EnergGamma2 = Ncristal_EE_used[i]; 
-	  }
+// preselected pair for the candidate store, the following cuts are redone when it is replayed
+void FillEpsilonPlot::preselected(const EcalPi0Pair& pair)
+{
+  if (!candidateStore_.isOpen()) return;
+  const EcalClusterGrid& grid = pairSelection_.grid();
+  EcalPi0Candidate candidate;
+  candidate.run = myRun;
+  candidate.lumi = myLumiBlock;
+  candidate.event = myEvent;
+  candidate.ebHLT = EB_HLT;
+  candidate.eeHLT = EE_HLT;
+  candidate.isEB = pairSubDetId_==EcalBarrel;
+  candidate.nextClu = min(grid.nearestDeltaR(pair.g1eta, pair.g1phi, pair.i, pair.j), grid.nearestDeltaR(pair.g2eta, pair.g2phi, pair.i, pair.j));
+  candidate.isoPtSum = grid.etaBandPtSum(pair.etaNoCorr, pair.phiNoCorr, selections_[0].hltIsoDEta, selections_[0].hltIsoDR,
+                                         EcalPi0PairSelection::ptMinForIso(candidate.isEB), pair.i, pair.j);
+  fillCandidatePhoton((*pairClusters_)[pair.i], pair.i, pairSubDetId_, candidate.g1);
+  fillCandidatePhoton((*pairClusters_)[pair.j], pair.j, pairSubDetId_, candidate.g2);
+  candidateStore_.fill(candidate);
+}
 
-	  if (fabs_pi0P4_eta < 1.8) {
-	    etaRegionID = 2;
-	    whichRegionEcalStreamPi0 = etaRegionID;
-	  } else if (fabs_pi0P4_eta < 2.0) {                       
-	    etaRegionID = 3;
-	    whichRegionEcalStreamPi0 = etaRegionID;
-	  } else {
-	    etaRegionID = 3; // same as above for calibration cuts
-	    whichRegionEcalStreamPi0 = 4; // this is a different region for the stream
-	  }
+void FillEpsilonPlot::correct(EcalPi0Pair& pair)
+{
+  if (!useContainmentCorrectionsFromEoverEtrue_) return;
+  // computed once per event for each cluster as first (g1) or second (g2) photon
+  const CorrectedCluster& g1_contCorr_clus = getContainmentCorrectedCluster(*pairClusters_, pair.i, false, pairSubDetId_==EcalBarrel);
+  const CorrectedCluster& g2_contCorr_clus = getContainmentCorrectedCluster(*pairClusters_, pair.j, true, pairSubDetId_==EcalBarrel);
+  computePairProperties(g1_contCorr_clus.position, g1_contCorr_clus.energy,
+			g2_contCorr_clus.position, g2_contCorr_clus.energy,
+			pair.g1Corr, pair.g2Corr,
+			pair.mass, pair.pt, pair.eta, pair.phi);
+}
 
-	}
+// mass ranges of Are_pi0
+void FillEpsilonPlot::passedKinematics(const EcalPi0Pair& pair, size_t s)
+{
+  if (pairSubDetId_ == EcalBarrel && s == 0) {
+    double pi0_ieta = fabs(pair.eta)/0.0174;
+    pi0MassVsIetaEB->Fill( pi0_ieta, pair.mass);
+    pi0MassVsETEB->Fill(pair.pt, pair.mass);
+    photonDeltaRVsIetaEB->Fill( pi0_ieta, pair.deltaR);
+  }
+}
 
-	//std::cout << "pio mass: w/o corr, w/ corr --> " << pi0P4_nocor_mass << "," << pi0P4_mass << endl;  
-	
-	// pi0/eta pT cut
-	//if (pi0P4_nocor_pt < pi0PtCut_[etaRegionID]) continue;
-	if (pi0P4_pt < pi0PtCut_[etaRegionID]) continue;
-	if(Nxtal_EnergGamma  < nXtal_1_cut_[etaRegionID] ) continue; 
-	if(Nxtal_EnergGamma2 < nXtal_2_cut_[etaRegionID] ) continue;
+// pair passing all the cuts of selections_[s]: kinematic histograms, ntuple and region fills
+void FillEpsilonPlot::selected(const EcalPi0Pair& pair, size_t s)
+{
+  const int subDetId = pairSubDetId_;
+  std::vector<TLorentzVector*>& clusters_matchedGenPhoton = *pairMatchedGen_;
+  const size_t i = pair.i;
+  const size_t j = pair.j;
+  std::vector<CaloCluster>::const_iterator g1 = pairClusters_->begin() + i;
+  std::vector<CaloCluster>::const_iterator g2 = pairClusters_->begin() + j;
+  const EcalMesonSelection& sel = selections_[s];
+  whichRegionEcalStreamPi0 = pair.streamRegion;
+
+  const float g1eta = pair.g1eta, g1phi = pair.g1phi, g2eta = pair.g2eta, g2phi = pair.g2phi;
+  const float g1pt = pair.g1.Rho();
+  const float g2pt = pair.g2.Rho();
+  const float DeltaR_g1g2_nocor = pair.deltaR;
+  const float pi0P4_nocor_mass = pair.massNoCorr, pi0P4_nocor_pt = pair.ptNoCorr;
+  const float pi0P4_nocor_eta = pair.etaNoCorr, pi0P4_nocor_phi = pair.phiNoCorr;
+  const math::XYZVector& g1_contCorr_tlv = pair.g1Corr;
+  const math::XYZVector& g2_contCorr_tlv = pair.g2Corr;
+  const float pi0P4_mass = pair.mass, pi0P4_pt = pair.pt, pi0P4_eta = pair.eta, pi0P4_phi = pair.phi;
+  const int Nxtal_g1 = pair.nXtal1;
+  const int Nxtal_g2 = pair.nXtal2;
+  const float nextClu = pair.nextClu;
+  const float hlt_iso = pair.hltIso;
+
+
+
+
+  if (fillKinematicVariables_ && s == 0) {
+
+    // here the cut on mass was not applied yet, this apparently means that when subDetId==EcalEndcap, I can have photons one in EE+ and the other in EE-
+    // indeed, it looks like these distributions for abs(eta_pi0) < 1.479 have some events with Nxtal = 6, which is the cut for EE (it is 7 for EB)
+    // so, I should actually require explicitely whether I am looking at EB or EE
+    // also, I should add the mass cut
+    // once I have the mass cut, I can have pairs of photons whose pi0 falls in EB (|eta| < 1.479), but the selections on photons is correctly the one for EE
+
+    pi0pt_afterCuts->Fill(whichRegionEcalStreamPi0, pi0P4_nocor_pt);
+    g1pt_afterCuts->Fill(whichRegionEcalStreamPi0, g1pt);
+    g2pt_afterCuts->Fill(whichRegionEcalStreamPi0, g2pt);
+    g1Nxtal_afterCuts->Fill(whichRegionEcalStreamPi0,Nxtal_g1);
+    g2Nxtal_afterCuts->Fill(whichRegionEcalStreamPi0,Nxtal_g2);
+    pi0PhotonsNoverlappingXtals_afterCuts->Fill(whichRegionEcalStreamPi0,getNumberOverlappingCrystals(g1,g2,subDetId==EcalBarrel));
+    g1g2DR_afterCuts->Fill(whichRegionEcalStreamPi0,DeltaR_g1g2_nocor);
+    if (isMC_) {
+      pi0MassVsPU[whichRegionEcalStreamPi0]->Fill(pi0P4_nocor_mass,nPUobs_BX0_);
+    }	   
 
+  }
 
-	if (subDetId == EcalBarrel) {
-	  double pi0_ieta = fabs(pi0P4_eta)/0.0174;
-	  pi0MassVsIetaEB->Fill( pi0_ieta, pi0P4_mass);
-	  pi0MassVsETEB->Fill(pi0P4_pt, pi0P4_mass);
-	  photonDeltaRVsIetaEB->Fill( pi0_ieta, DeltaR_g1g2_nocor);
-	}
-	//////////////////////////////////////////////////////////////////////////////////////////////////
-
-	//////////////////
-	// pi0/eta isolation cut (distance to other clusters)
-	// computed with the HLT isolation in one go
-	//////////////////
-	// Implementation of HLT Filter Isolation - Eta Band Isolation 
-	// implemented in HLT: CMSSW_7_1_0/src/HLTrigger/special/src/HLTEcalResonanceFilter.cc
-	// see Yong Yang's  Thesis: http://thesis.library.caltech.edu/7345/
-	//////////////////
-	float nextClu = 999.;
-	if (pi0IsoCut_[etaRegionID] > 0.0) {
-	  float Drtmp = 999.;
-	  float deltaR1 = 0.0, deltaR2 = 0.0;
-	  for (std::vector<CaloCluster>::const_iterator Gtmp  = clusters.begin(); Gtmp != clusters.end(); ++Gtmp) {
-	    if (Gtmp != g1 and Gtmp != g2) {
-	      // pi0 iso
-	      deltaR1 = GetDeltaR(Gtmp->eta(),g1eta,Gtmp->phi(),g1phi);
-	      deltaR2 = GetDeltaR(Gtmp->eta(),g2eta,Gtmp->phi(),g2phi);
-	      if(deltaR1 < Drtmp || deltaR2 < Drtmp) {
-		nextClu = min(deltaR1, deltaR2);
-		Drtmp = nextClu;
-	      }
-	    }
-	  }
-	  if (nextClu < pi0IsoCut_[etaRegionID]) continue;
-	}
 
-	double deltaR0 = 0.0, deta = 0.0, gPtTmp = 0.0;
-	float hlt_iso = 0.0;
-	for (std::vector<CaloCluster>::const_iterator Gtmp  = clusters.begin(); Gtmp != clusters.end(); ++Gtmp) {
-	  if (Gtmp != g1 and Gtmp != g2) {
-	    // HLT iso part
-	    // cluster must be inside of an eta strip 
-	    deta = fabs(Gtmp->eta() - pi0P4_eta); 
-	    if (deta > hlt_iso_deta) continue;
-	    // now dR
-	    deltaR0 = GetDeltaR(Gtmp->eta(), pi0P4_eta, Gtmp->phi(), pi0P4_phi);
-	    if (deltaR0  > hlt_iso_dr) continue;
-	    // now pt
-	    gPtTmp = Gtmp->energy()*sin(Gtmp->position().Theta());
-	    if (gPtTmp < ptMinForIso) continue; 
-	    hlt_iso += gPtTmp;
-	  }
-	}
-	hlt_iso /= pi0P4_pt;
+  //Fill Optimization
+  if( MakeNtuple4optimization_) {
+
+    //FIXME: check how the tree is filled when using E/Etrue corrections (evaluate to save both corrected and uncorrected photons, because also position is changed)
+    // add in case a flag saying which corrections are used
+    if( nPi0>NPI0MAX-2 ) { 
+      cout<<"nPi0::TOO MANY PI0: ("<<nPi0<<")!!!"<<endl; 
+    } else{
+      Op_Pi0recIsEB.push_back(  (subDetId==EcalBarrel)? 1:0);
+      Op_ClusIsoPi0.push_back(  nextClu);  
+      Op_HLTIsoPi0.push_back(   hlt_iso);
+      Op_nCrisG1.push_back(     Nxtal_g1); 
+      Op_nCrisG2.push_back(     Nxtal_g2);
+      Op_enG1_cor.push_back(    g1_contCorr_tlv.Rho());
+      Op_enG2_cor.push_back(    g2_contCorr_tlv.Rho());
+      Op_etaG1_cor.push_back(   g1_contCorr_tlv.Eta());
+      Op_etaG2_cor.push_back(   g2_contCorr_tlv.Eta());
+      Op_phiG1_cor.push_back(   g1_contCorr_tlv.Phi());
+      Op_phiG2_cor.push_back(   g2_contCorr_tlv.Phi());
+      Op_mPi0_cor.push_back(    pi0P4_mass);
+      Op_phiPi0_cor.push_back(  pi0P4_phi);
+      Op_etaPi0_cor.push_back(  pi0P4_eta);
+      Op_ptPi0_cor.push_back(   pi0P4_pt);
+      Op_DeltaRG1G2.push_back(  DeltaR_g1g2_nocor);
+      Op_ptPi0_nocor.push_back( pi0P4_nocor_pt);
+      Op_mPi0_nocor.push_back(  pi0P4_nocor_mass);
+      Op_etaPi0_nocor.push_back(  pi0P4_nocor_eta);
+      Op_phiPi0_nocor.push_back(  pi0P4_nocor_phi);
+      Op_Es_e1_1.push_back(     (subDetId==EcalBarrel) ? 0. : Es_1[i]);
+      Op_Es_e1_2.push_back(     (subDetId==EcalBarrel) ? 0. : Es_1[j]);
+      Op_Es_e2_1.push_back(     (subDetId==EcalBarrel) ? 0. : Es_2[i]);
+      Op_Es_e2_2.push_back(     (subDetId==EcalBarrel) ? 0. : Es_2[j]);
+      Op_S4S9_1.push_back(      (subDetId==EcalBarrel) ? vs4s9[i] : vs4s9EE[i]);
+      Op_S4S9_2.push_back(      (subDetId==EcalBarrel) ? vs4s9[j] : vs4s9EE[j]);
+      // Op_S2S9_1.push_back(      (subDetId==EcalBarrel) ? vs2s9[i] : vs2s9EE[i]);
+      // Op_S2S9_2.push_back(      (subDetId==EcalBarrel) ? vs2s9[j] : vs2s9EE[j]);
+      // Op_S1S9_1.push_back(      (subDetId==EcalBarrel) ? vs1s9[i] : vs1s9EE[i]);
+      // Op_S1S9_2.push_back(      (subDetId==EcalBarrel) ? vs1s9[j] : vs1s9EE[j]);
+      Op_enG1_nocor.push_back(  g1->energy()); // g1P4_nocor.E();
+      Op_enG2_nocor.push_back(  g2->energy()); // g2P4_nocor.E();
+      Op_etaG1_nocor.push_back( g1eta);
+      Op_etaG2_nocor.push_back( g2eta);
+      Op_phiG1_nocor.push_back( g1phi);
+      Op_phiG2_nocor.push_back( g2phi);
+      //Op_Time_1.push_back(      (subDetId==EcalBarrel) ? vSeedTime[i] : vSeedTimeEE[i]);
+      //Op_Time_2.push_back(      (subDetId==EcalBarrel) ? vSeedTime[j] : vSeedTimeEE[j]);
+      if( isMC_ && MC_Assoc_ ) {
+	Op_enG1_true.push_back(   clusters_matchedGenPhoton[i]->Energy());
+	Op_enG2_true.push_back(   clusters_matchedGenPhoton[j]->Energy());
+	Op_DeltaR_1.push_back(    GetDeltaR(g1eta, clusters_matchedGenPhoton[i]->Eta(), g1phi, clusters_matchedGenPhoton[i]->Phi()));
+	Op_DeltaR_2.push_back(    GetDeltaR(g2eta, clusters_matchedGenPhoton[j]->Eta(), g2phi, clusters_matchedGenPhoton[j]->Phi()));
+      }
 
-	if (hlt_iso > pi0HLTIsoCut_[etaRegionID]) continue;
+      if( (g1->seed().subdetId()==1) && (g2->seed().subdetId()==1) ) {
+
+	EBDetId  id_1(g1->seed()); int iEta1 = id_1.ieta(); int iPhi1 = id_1.iphi();
+	EBDetId  id_2(g2->seed()); int iEta2 = id_2.ieta(); int iPhi2 = id_2.iphi();
+
+	Op_iEtaiX_1.push_back(   iEta1);
+	Op_iEtaiX_2.push_back(   iEta2);
+	Op_iPhiiY_1.push_back(   iPhi1);
+	Op_iPhiiY_2.push_back(   iPhi2);
+	Op_iEta_1on5.push_back(  iEta1%5);
+	Op_iEta_2on5.push_back(  iEta2%5);
+	Op_iPhi_1on2.push_back(  iPhi1%2);
+	Op_iPhi_2on2.push_back(  iPhi2%2);
+	Op_iEta_1on2520.push_back( (TMath::Abs(iEta1)<=25)*(iEta1%25) + (TMath::Abs(iEta1)>25)*((iEta1-25*TMath::Abs(iEta1)/iEta1)%20)); //Distance in xtal from module boundaries
+	Op_iEta_2on2520.push_back((TMath::Abs(iEta2)<=25)*(iEta2%25) + (TMath::Abs(iEta2)>25)*((iEta2-25*TMath::Abs(iEta2)/iEta2)%20));
+	Op_iPhi_1on20.push_back(  iPhi1%20);
+	Op_iPhi_2on20.push_back(  iPhi2%20);
+
+      } else if( (g1->seed().subdetId()==2) && (g2->seed().subdetId()==2) ) {
+              
+	EEDetId  id_1(g1->seed()); int iX1 = id_1.ix(); int iY1 = id_1.iy();
+	EEDetId  id_2(g2->seed()); int iX2 = id_2.ix(); int iY2 = id_2.iy();
+
+	Op_iEtaiX_1.push_back(      (iX1 < 50) ? iX1 : 100-iX1);
+	Op_iEtaiX_2.push_back(      (iX2 < 50) ? iX2 : 100-iX2);
+	Op_iPhiiY_1.push_back(      (iY1 < 50) ? iY1 : 100-iY1);
+	Op_iPhiiY_2.push_back(      (iY2 < 50) ? iY2 : 100-iY2);
+	Op_iEta_1on5.push_back(     999);
+	Op_iEta_2on5.push_back(     999);
+	Op_iPhi_1on2.push_back(     999);
+	Op_iPhi_2on2.push_back(     999);
+	Op_iEta_1on2520.push_back(  999);
+	Op_iEta_2on2520.push_back(  999);
+	Op_iPhi_1on20.push_back(    999);
+	Op_iPhi_2on20.push_back(    999);
+              
+      } else {
+	Op_iEtaiX_1.push_back(      -999);
+	Op_iEtaiX_2.push_back(      -999);
+	Op_iPhiiY_1.push_back(      -999);
+	Op_iPhiiY_2.push_back(      -999);
+	Op_iEta_1on5.push_back(     -999);
+	Op_iEta_2on5.push_back(     -999);
+	Op_iPhi_1on2.push_back(     -999);
+	Op_iPhi_2on2.push_back(     -999);
+	Op_iEta_1on2520.push_back(  -999);
+	Op_iEta_2on2520.push_back(  -999);
+	Op_iPhi_1on20.push_back(    -999);
+	Op_iPhi_2on20.push_back(    -999);
+      }
+      nPi0++;
+    }
 
+  }
 
-	if (fillKinematicVariables_) {
+  //if (isDebug_) cout << "[DEBUG] End Accessing Optmization Variables..." << endl;
 
-	  // here the cut on mass was not applied yet, this apparently means that when subDetId==EcalEndcap, I can have photons one in EE+ and the other in EE-
-	  // indeed, it looks like these distributions for abs(eta_pi0) < 1.479 have some events with Nxtal = 6, which is the cut for EE (it is 7 for EB)
-	  // so, I should actually require explicitely whether I am looking at EB or EE
-	  // also, I should add the mass cut
-	  // once I have the mass cut, I can have pairs of photons whose pi0 falls in EB (|eta| < 1.479), but the selections on photons is correctly the one for EE
+  if (!MakeNtuple4optimization_) {
 
-	  pi0pt_afterCuts->Fill(whichRegionEcalStreamPi0, pi0P4_nocor_pt);
-	  g1pt_afterCuts->Fill(whichRegionEcalStreamPi0, g1pt);
-	  g2pt_afterCuts->Fill(whichRegionEcalStreamPi0, g2pt);
-	  g1Nxtal_afterCuts->Fill(whichRegionEcalStreamPi0,Nxtal_g1);
-	  g2Nxtal_afterCuts->Fill(whichRegionEcalStreamPi0,Nxtal_g2);
-	  pi0PhotonsNoverlappingXtals_afterCuts->Fill(whichRegionEcalStreamPi0,getNumberOverlappingCrystals(g1,g2,subDetId==EcalBarrel));
-	  g1g2DR_afterCuts->Fill(whichRegionEcalStreamPi0,DeltaR_g1g2_nocor);
-	  if (isMC_) {
-	    pi0MassVsPU[whichRegionEcalStreamPi0]->Fill(pi0P4_nocor_mass,nPUobs_BX0_);
-	  }	   
+    //if (isDebug_) cout << "[DEBUG] computing region weights" << endl; 
 
+    // compute region weights
+    RegionWeightVector w1;
+    {
+      EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kRegionWeights);
+      // region weights W_j^k for clu1 and clu2, in CalibType and in the ExtraCalibTypes granularities
+      EcalRegionalCalibrationBase::getWeights( weightCalibrations_, &(*g1), subDetId, weights1_ );
+      EcalRegionalCalibrationBase::getWeights( weightCalibrations_, &(*g2), subDetId, weights2_ );
+
+      // append w2 to w1
+      w1 = weights1_[0];
+      w1.insert( w1.end(), weights2_[0].begin(), weights2_[0].end() );
+    }
+    EcalStageProfiler::Scope fillTimer(profiler_, EcalStageProfiler::kHistogramFill);
+    profiler_.count(EcalStageProfiler::kFills, w1.size());
+
+    float r2 = pi0P4_mass/sel.referenceMass;
+    r2 = r2*r2;
+    //average <eps> for cand k
+    float eps_k = 0.5 * ( r2 - 1. );
+    // compute quantities needed for <eps>_j in each region j
+    for(RegionWeightVector::const_iterator it = w1.begin(); it != w1.end(); ++it) {
+      const uint32_t& iR = (*it).iRegion;
+      const float& w = (*it).value;
+
+      if(subDetId==EcalBarrel){
+	if( !EtaRingCalibEB_ && !SMCalibEB_ ) 
+	  fillEpsilon( s, EcalBarrel, useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, iR, w );
+	//If Low Statistic fill all the Eta Ring and/or the SM
+	else if( iR+1 < regionRowsBeginEB_.size() ){
+	  for(uint32_t iRow=regionRowsBeginEB_[iR]; iRow<regionRowsBeginEB_[iR+1]; iRow++)
+	    fillEpsilon( s, EcalBarrel, useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, regionRowsEB_[iRow], w );
 	}
-
-
-	//Fill Optimization
-	if( MakeNtuple4optimization_) {
-
-	  //FIXME: check how the tree is filled when using E/Etrue corrections (evaluate to save both corrected and uncorrected photons, because also position is changed)
-	  // add in case a flag saying which corrections are used
-	  if( nPi0>NPI0MAX-2 ) { 
-	    cout<<"nPi0::TOO MANY PI0: ("<<nPi0<<")!!!"<<endl; 
-	  } else{
-	    Op_Pi0recIsEB.push_back(  (subDetId==EcalBarrel)? 1:0);
-	    Op_ClusIsoPi0.push_back(  nextClu);  
-	    Op_HLTIsoPi0.push_back(   hlt_iso);
-	    Op_nCrisG1.push_back(     Nxtal_g1); 
-	    Op_nCrisG2.push_back(     Nxtal_g2);
-	    Op_enG1_cor.push_back(    g1_contCorr_tlv.Rho());
-	    Op_enG2_cor.push_back(    g2_contCorr_tlv.Rho());
-	    Op_etaG1_cor.push_back(   g1_contCorr_tlv.Eta());
-	    Op_etaG2_cor.push_back(   g2_contCorr_tlv.Eta());
-	    Op_phiG1_cor.push_back(   g1_contCorr_tlv.Phi());
-	    Op_phiG2_cor.push_back(   g2_contCorr_tlv.Phi());
-	    Op_mPi0_cor.push_back(    pi0P4_mass);
-	    Op_phiPi0_cor.push_back(  pi0P4_phi);
-	    Op_etaPi0_cor.push_back(  pi0P4_eta);
-	    Op_ptPi0_cor.push_back(   pi0P4_pt);
-	    Op_DeltaRG1G2.push_back(  DeltaR_g1g2_nocor);
-	    Op_ptPi0_nocor.push_back( pi0P4_nocor_pt);
-	    Op_mPi0_nocor.push_back(  pi0P4_nocor_mass);
-	    Op_etaPi0_nocor.push_back(  pi0P4_nocor_eta);
-	    Op_phiPi0_nocor.push_back(  pi0P4_nocor_phi);
-	    Op_Es_e1_1.push_back(     (subDetId==EcalBarrel) ? 0. : Es_1[i]);
-	    Op_Es_e1_2.push_back(     (subDetId==EcalBarrel) ? 0. : Es_1[j]);
-	    Op_Es_e2_1.push_back(     (subDetId==EcalBarrel) ? 0. : Es_2[i]);
-	    Op_Es_e2_2.push_back(     (subDetId==EcalBarrel) ? 0. : Es_2[j]);
-	    Op_S4S9_1.push_back(      (subDetId==EcalBarrel) ? vs4s9[i] : vs4s9EE[i]);
-	    Op_S4S9_2.push_back(      (subDetId==EcalBarrel) ? vs4s9[j] : vs4s9EE[j]);
-	    // Op_S2S9_1.push_back(      (subDetId==EcalBarrel) ? vs2s9[i] : vs2s9EE[i]);
-	    // Op_S2S9_2.push_back(      (subDetId==EcalBarrel) ? vs2s9[j] : vs2s9EE[j]);
-	    // Op_S1S9_1.push_back(      (subDetId==EcalBarrel) ? vs1s9[i] : vs1s9EE[i]);
-	    // Op_S1S9_2.push_back(      (subDetId==EcalBarrel) ? vs1s9[j] : vs1s9EE[j]);
-	    Op_enG1_nocor.push_back(  g1->energy()); // g1P4_nocor.E();
-	    Op_enG2_nocor.push_back(  g2->energy()); // g2P4_nocor.E();
-	    Op_etaG1_nocor.push_back( g1eta);
-            Op_etaG2_nocor.push_back( g2eta);
-	    Op_phiG1_nocor.push_back( g1phi);
-            Op_phiG2_nocor.push_back( g2phi);
-	    //Op_Time_1.push_back(      (subDetId==EcalBarrel) ? vSeedTime[i] : vSeedTimeEE[i]);
-	    //Op_Time_2.push_back(      (subDetId==EcalBarrel) ? vSeedTime[j] : vSeedTimeEE[j]);
-	    if( isMC_ && MC_Assoc_ ) {
-	      Op_enG1_true.push_back(   clusters_matchedGenPhoton[i]->Energy());
-	      Op_enG2_true.push_back(   clusters_matchedGenPhoton[j]->Energy());
-	      Op_DeltaR_1.push_back(    GetDeltaR(g1eta, clusters_matchedGenPhoton[i]->Eta(), g1phi, clusters_matchedGenPhoton[i]->Phi()));
-	      Op_DeltaR_2.push_back(    GetDeltaR(g2eta, clusters_matchedGenPhoton[j]->Eta(), g2phi, clusters_matchedGenPhoton[j]->Phi()));
-	    }
-
-            if( (g1->seed().subdetId()==1) && (g2->seed().subdetId()==1) ) {
-
-              EBDetId  id_1(g1->seed()); int iEta1 = id_1.ieta(); int iPhi1 = id_1.iphi();
-              EBDetId  id_2(g2->seed()); int iEta2 = id_2.ieta(); int iPhi2 = id_2.iphi();
-
-              Op_iEtaiX_1.push_back(   iEta1);
-              Op_iEtaiX_2.push_back(   iEta2);
-              Op_iPhiiY_1.push_back(   iPhi1);
-              Op_iPhiiY_2.push_back(   iPhi2);
-              Op_iEta_1on5.push_back(  iEta1%5);
-              Op_iEta_2on5.push_back(  iEta2%5);
-              Op_iPhi_1on2.push_back(  iPhi1%2);
-              Op_iPhi_2on2.push_back(  iPhi2%2);
-              Op_iEta_1on2520.push_back( (TMath::Abs(iEta1)<=25)*(iEta1%25) + (TMath::Abs(iEta1)>25)*((iEta1-25*TMath::Abs(iEta1)/iEta1)%20)); //Distance in xtal from module boundaries
-              Op_iEta_2on2520.push_back((TMath::Abs(iEta2)<=25)*(iEta2%25) + (TMath::Abs(iEta2)>25)*((iEta2-25*TMath::Abs(iEta2)/iEta2)%20));
-              Op_iPhi_1on20.push_back(  iPhi1%20);
-              Op_iPhi_2on20.push_back(  iPhi2%20);
-
-            } else if( (g1->seed().subdetId()==2) && (g2->seed().subdetId()==2) ) {
-              
-              EEDetId  id_1(g1->seed()); int iX1 = id_1.ix(); int iY1 = id_1.iy();
-              EEDetId  id_2(g2->seed()); int iX2 = id_2.ix(); int iY2 = id_2.iy();
-
-              Op_iEtaiX_1.push_back(      (iX1 < 50) ? iX1 : 100-iX1);
-              Op_iEtaiX_2.push_back(      (iX2 < 50) ? iX2 : 100-iX2);
-              Op_iPhiiY_1.push_back(      (iY1 < 50) ? iY1 : 100-iY1);
-              Op_iPhiiY_2.push_back(      (iY2 < 50) ? iY2 : 100-iY2);
-              Op_iEta_1on5.push_back(     999);
-              Op_iEta_2on5.push_back(     999);
-              Op_iPhi_1on2.push_back(     999);
-              Op_iPhi_2on2.push_back(     999);
-              Op_iEta_1on2520.push_back(  999);
-              Op_iEta_2on2520.push_back(  999);
-              Op_iPhi_1on20.push_back(    999);
-              Op_iPhi_2on20.push_back(    999);
-              
-            } else {
-              Op_iEtaiX_1.push_back(      -999);
-              Op_iEtaiX_2.push_back(      -999);
-              Op_iPhiiY_1.push_back(      -999);
-              Op_iPhiiY_2.push_back(      -999);
-              Op_iEta_1on5.push_back(     -999);
-              Op_iEta_2on5.push_back(     -999);
-              Op_iPhi_1on2.push_back(     -999);
-              Op_iPhi_2on2.push_back(     -999);
-              Op_iEta_1on2520.push_back(  -999);
-              Op_iEta_2on2520.push_back(  -999);
-              Op_iPhi_1on20.push_back(    -999);
-              Op_iPhi_2on20.push_back(    -999);
-            }
-	    nPi0++;
-	  }
-
+      }
+      else {
+	if( !EtaRingCalibEE_ && !SMCalibEE_ ) 
+	  fillEpsilon( s, EcalEndcap, useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, iR, w );
+	//If Low Statistic fill all the Eta Ring and/or the quadrant
+	else if( iR+1 < regionRowsBeginEE_.size() ){
+	  for(uint32_t iRow=regionRowsBeginEE_[iR]; iRow<regionRowsBeginEE_[iR+1]; iRow++)
+	    fillEpsilon( s, EcalEndcap, useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, regionRowsEE_[iRow], w );
 	}
-	
-	//if (isDebug_) cout << "[DEBUG] End Accessing Optmization Variables..." << endl;
-
-	if (!MakeNtuple4optimization_) {
-
-	  //if (isDebug_) cout << "[DEBUG] computing region weights" << endl; 
-
-	  // compute region weights
-	  RegionWeightVector w1 = regionalCalibration_->getWeights( &(*g1), subDetId ); // region weights W_j^k for clu1
-	  RegionWeightVector w2 = regionalCalibration_->getWeights( &(*g2), subDetId ); // region weights W_j^k for clu2
-
-	  // append w2 to w1
-	  w1.insert( w1.end(), w2.begin(), w2.end() );
-
-	  float r2 = pi0P4_mass/PI0MASS;
-	  r2 = r2*r2;
-	  //average <eps> for cand k
-	  float eps_k = 0.5 * ( r2 - 1. );
-	  // compute quantities needed for <eps>_j in each region j
-	  for(RegionWeightVector::const_iterator it = w1.begin(); it != w1.end(); ++it) {
-	    const uint32_t& iR = (*it).iRegion;
-	    const float& w = (*it).value;
-
-	    if(subDetId==EcalBarrel){
-	      if( !EtaRingCalibEB_ && !SMCalibEB_ ) 
-		epsilon_EB_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iR, w );
-	      std::vector<DetId> mioId(regionalCalibration_->allDetIdsInEERegion(iR));
-	      std::map<int,vector<int>>::iterator it; 
-	      int iEta = List_IR_EtaPhi.find(iR)->second[0]; 
-	      int iSM = List_IR_EtaPhi.find(iR)->second[2];
-	      //If Low Statistic fill all the Eta Ring
-	      if( EtaRingCalibEB_ ){
-		for(auto const &iterator : ListEtaFix_xtalEB){
-		  if( iterator.first == iEta ){ 
-		    for(unsigned int iRtmp=0; iRtmp<iterator.second.size(); iRtmp++){ 
-		      epsilon_EB_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iterator.second[iRtmp], w); 
-		    }
-		  }
-		}
-	      }
-	      if( SMCalibEB_ ){
-		for(auto const &iterator : ListSMFix_xtalEB){
-		  if( iterator.first == iSM ){ 
-		    for(unsigned int iRtmp=0; iRtmp<iterator.second.size(); iRtmp++){ 
-		      epsilon_EB_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iterator.second[iRtmp], w); 
-		    }
-		  }
-		}		
-	      }
-	    }
-	    else {
-	      if( !EtaRingCalibEE_ && !SMCalibEE_ ) epsilon_EE_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iR, w );
-	      std::vector<DetId> mioId(regionalCalibration_->allDetIdsInEERegion(iR));
-	      std::map<int,vector<int>>::iterator it; 
-	      int iX = List_IR_XYZ.find(iR)->second[0]; 
-	      int iY = List_IR_XYZ.find(iR)->second[1]; 
-	      int iZ = List_IR_XYZ.find(iR)->second[2]; int Quad = List_IR_XYZ.find(iR)->second[3];
-	      if( iZ==-1 ){
-		//If Low Statistic fill all the Eta Ring
-		if( EtaRingCalibEE_ ){
-		  for(auto const &iterator : ListEtaFix_xtalEEm){
-		    if( iterator.first == GetRing( iX, iY, VectRing,false) ){ 
-		      for(unsigned int iRtmp=0; iRtmp<iterator.second.size(); iRtmp++){ 
-			epsilon_EE_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iterator.second[iRtmp], w ); 
-		      }
-		    }
-		  }
-		}
-		if( SMCalibEE_ ){
-		  for(auto const &iterator : ListQuadFix_xtalEEm){
-		    if( iterator.first == Quad ){ 
-		      for(unsigned int iRtmp=0; iRtmp<iterator.second.size(); iRtmp++){ 
-			epsilon_EE_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iterator.second[iRtmp], w ); 
-		      }
-		    }
-		  }
-		}
-	      }
-	      else{
-		//If Low Statistic fill all the Eta Ring
-		if( EtaRingCalibEE_ ){
-		  for(auto const &iterator : ListEtaFix_xtalEEp){
-		    if( iterator.first == GetRing( iX, iY, VectRing,false) ){
-		      for(unsigned int iRtmp=0; iRtmp<iterator.second.size(); iRtmp++){ 
-			epsilon_EE_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iterator.second[iRtmp], w ); 
-		      }
-		    }
-		  }
-		}
-		if( SMCalibEE_ ){
-		  for(auto const &iterator : ListQuadFix_xtalEEp){
-		    if( iterator.first == Quad ){ 
-		      for(unsigned int iRtmp=0; iRtmp<iterator.second.size(); iRtmp++){ 
-			epsilon_EE_h2D->Fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, (double) iterator.second[iRtmp], w ); 
-		      }
-		    }
-		  }
-		}
-	      }
-	    }
-	  }
-	} // end filling histograms with mass
-
-	// if (isDebug_) cout << "[DEBUG] End of Cluster Loop" << endl;
-    } // loop over clusters (g2)
-  } // loop over clusters to make pi0 
+      }
+    }
 
-  if(MakeNtuple4optimization_){
-    if (isDebug_) cout << "[DEBUG] Filling Tree" << endl; 
-    //for(unsigned int i=0; i<NL1SEED; i++) Op_L1Seed[i] = L1BitCollection_[i];
-    //for(unsigned int i=0; i<NL1SEED; i++) Op_L1Seed[i] = l1flag[i];
-    Op_NPi0 = nPi0; 
-    if(nPi0>0) Tree_Optim->Fill();
-  }
- 
+    // nominal distributions in the other granularities, without EtaRing/SM filling
+    std::vector<EcalRegionHistogram*> &extra = subDetId==EcalBarrel ? epsilon_EB_extra_h2D : epsilon_EE_extra_h2D;
+    if (s == 0) {
+      for (size_t g = 1; g <= extra.size(); ++g) {
+	for(RegionWeightVector::const_iterator it = weights1_[g].begin(); it != weights1_[g].end(); ++it)
+	  extra[g-1]->fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, it->iRegion, it->value );
+	for(RegionWeightVector::const_iterator it = weights2_[g].begin(); it != weights2_[g].end(); ++it)
+	  extra[g-1]->fill( useMassInsteadOfEpsilon_? pi0P4_mass : eps_k, it->iRegion, it->value );
+      }
+    }
+  } // end filling histograms with mass
 }
 
 
@@ -2846,6 +2412,8 @@ void FillEpsilonPlot::computeEpsilon(std::vector< CaloCluster > & clusters, std:
 void FillEpsilonPlot::computeEoverEtrue(std::vector< CaloCluster > & clusters, std::vector<TLorentzVector*>& clusters_matchedGenPhoton, int subDetId ) 
 {
 
+  EcalStageProfiler::Scope pairSearchTimer(profiler_, EcalStageProfiler::kPairSearch);
+
   // this method is meant to be used with MC using MC truth
   // the cluster vector is such that two consecutive clusters belong to the same gen pi0
   // therefore, we loop on the vector using a step of 2, and assign g2 = g1+1
@@ -3181,7 +2749,7 @@ void FillEpsilonPlot::computeEoverEtrue(std::vector< CaloCluster > & clusters, s
 	  if ( not applySelectionForEoverEtrue || (pi0P4_mass>((Are_pi0_)?0.03:0.35) && pi0P4_mass<((Are_pi0_)?0.23:0.7)) ) {
 
 	    //EoverEtrue_g1_EB_h[iR]->Fill( EoverEtrue_g1, w );
-	    EoverEtrue_g1_EB_h2D->Fill( EoverEtrue_g1, (double) iR, w );
+	    EoverEtrue_g1_EB_h2D->fill( EoverEtrue_g1, iR, w );
 	    //allEoverEtrue_g1_EB->Fill( EoverEtrue_g1, w );
 	    // int iEta = List_IR_EtaPhi.find(iR)->second[0]; 
 	    //int iPhi = List_IR_EtaPhi.find(iR)->second[1]; 
@@ -3195,7 +2763,7 @@ void FillEpsilonPlot::computeEoverEtrue(std::vector< CaloCluster > & clusters, s
 	  if (  not applySelectionForEoverEtrue || (pi0P4_mass>((Are_pi0_)?0.03:0.35) && pi0P4_mass<((Are_pi0_)?0.28:0.75)) ) {
 
 	    //EoverEtrue_g1_EE_h[iR]->Fill( EoverEtrue_g1, w );
-	    EoverEtrue_g1_EE_h2D->Fill( EoverEtrue_g1, (double) iR, w );
+	    EoverEtrue_g1_EE_h2D->fill( EoverEtrue_g1, iR, w );
 	    //allEoverEtrue_g1_EE->Fill( EoverEtrue_g1, w );
 	    // int iX = List_IR_XYZ.find(iR)->second[0]; 
 	    // int iY = List_IR_XYZ.find(iR)->second[1]; 
@@ -3262,35 +2830,24 @@ void FillEpsilonPlot::computeEoverEtrue(std::vector< CaloCluster > & clusters, s
 ///////======================================
 
 
-// ------------ method called once each job just before starting event loop  ------------
+// ------------ method called once each stream just before starting event loop  ------------
   void 
-FillEpsilonPlot::beginJob()
+FillEpsilonPlot::beginStream(edm::StreamID streamId)
 {
 
-  if (isDebug_) cout << "[DEBUG] beginJob" << endl;
+  if (isDebug_) cout << "[DEBUG] beginStream " << streamId.value() << endl;
+  streamId_ = streamId.value();
 
-  /// testing the EE eta ring
-  TH2F eep("eep","EE+",102,0.5,101.5,102,-0.5,101.5);
-  TH2F eem("eem","EE-",102,0.5,101.5,102,-0.5,101.5);
-
-  for(int etaring=0; etaring < EndcapTools::N_RING_ENDCAP; ++etaring)
-  {
-
-    float fillValue = (etaring%2)==0 ? 1. : 2.;
-    std::vector<DetId> allDetIds = EcalCalibType::EtaRing::allDetIdsInEERegion(etaring);
-    for(int ixtal=0; ixtal<int(allDetIds.size()); ixtal++)
-    {
-	EEDetId eeid(allDetIds.at(ixtal));
-	if(eeid.zside()==-1)
-	  eem.SetBinContent(eeid.ix(),eeid.iy(),fillValue);
-	else
-	  eep.SetBinContent(eeid.ix(),eeid.iy(),fillValue);
+  if (eventStoreOutput_!="") eventStore_.open(streamFileName(eventStoreOutput_));
+  if (candidateStoreOutput_!="") candidateStore_.open(streamFileName(candidateStoreOutput_));
 
-    }
+  if (MakeNtuple4optimization_) {
+    // the baskets of the tree go to the file of the stream as it is filled
+    optimFileName_ = streamFileName("Tree_Optim");
+    optimFile_ = TFile::Open(optimFileName_.c_str(), "RECREATE");
+    if(!optimFile_ or not optimFile_->IsOpen()) throw cms::Exception("WritingOutputFile") << "It was no possible to create output file " << optimFileName_ << "\n";
+    Tree_Optim->SetDirectory(optimFile_);
   }
-  outfile_->cd();
-  eep.Write();
-  eem.Write();
 
   ifstream file;
   file.open( edm::FileInPath ( Endc_x_y_.c_str() ).fullPath().c_str(), ifstream::in);
@@ -3306,6 +2863,7 @@ FillEpsilonPlot::beginJob()
     strcpy (cstr, Line.c_str());
     p=strtok (cstr," ");
     int i(0);
+    iXiYtoRing GiveRing;
     while (p!=NULL){
 	if(i==0)  GiveRing.iX = atoi(p);
 	if(i==1)  GiveRing.iY = atoi(p);
@@ -3319,6 +2877,12 @@ FillEpsilonPlot::beginJob()
     }
     delete[] cstr;
   }
+  // (ix,iy) -> ring lookup, the first entry of the file wins
+  EERingTable_.assign(kEERingTableSize*kEERingTableSize, -1);
+  for(std::vector<iXiYtoRing>::const_reverse_iterator it = VectRing.rbegin(); it != VectRing.rend(); ++it){
+    if( it->iX<0 || it->iX>=kEERingTableSize || it->iY<0 || it->iY>=kEERingTableSize ) continue;
+    EERingTable_[it->iX*kEERingTableSize+it->iY] = it->Ring;
+  }
   //Initialize Map iR vs Eta
   if( (SMCalibEB_ && EtaRingCalibEB_) || (SMCalibEE_ && EtaRingCalibEE_) ) cout<<"WARNING: Intercalibrating with EtaRing and SM!!!"<<endl; 
   std::vector<int> InitV; InitV.clear();
@@ -3355,14 +2919,68 @@ FillEpsilonPlot::beginJob()
   nentries = calibMap_EE->GetEntriesFast();
   for(Long64_t iEntry=0; iEntry<nentries; iEntry++){
     calibMap_EE->GetEntry(iEntry);
-    if(zside_<0.) ListEtaFix_xtalEEm[ GetRing( ix_,iy_, VectRing, false) ].push_back( hashedIndexEE_ );
-    if(zside_>0.) ListEtaFix_xtalEEp[ GetRing( ix_,iy_, VectRing, false) ].push_back( hashedIndexEE_ );
+    if(zside_<0.) ListEtaFix_xtalEEm[ getEERing( ix_,iy_ ) ].push_back( hashedIndexEE_ );
+    if(zside_>0.) ListEtaFix_xtalEEp[ getEERing( ix_,iy_ ) ].push_back( hashedIndexEE_ );
     if(zside_<0.) ListQuadFix_xtalEEm[ iquadrant_ ].push_back( hashedIndexEE_ );
     if(zside_>0.) ListQuadFix_xtalEEp[ iquadrant_ ].push_back( hashedIndexEE_ );
     std::vector<int> iXYZ; iXYZ.clear(); iXYZ.push_back( ix_ ); iXYZ.push_back( iy_ ); iXYZ.push_back( zside_ ); iXYZ.push_back( iquadrant_ );
     List_IR_XYZ[hashedIndexEE_] = iXYZ;
   }
 
+  fillRegionExpansionTables();
+
+}
+
+
+// ring of the EE crystal (ix,iy) from Endc_x_y_, -1 if not found
+int FillEpsilonPlot::getEERing(int ix, int iy) const
+{
+  if( ix<0 || ix>=kEERingTableSize || iy<0 || iy>=kEERingTableSize ) return -1;
+  return EERingTable_[ix*kEERingTableSize+iy];
+}
+
+static void appendRegionRows(const std::map<int,vector<int>>& list, int key, std::vector<int>& rows)
+{
+  std::map<int,vector<int>>::const_iterator it = list.find(key);
+  if( it != list.end() ) rows.insert( rows.end(), it->second.begin(), it->second.end() );
+}
+
+// For each region iR the rows of epsilon_EB_h2D/epsilon_EE_h2D to be filled when
+// calibrating by eta ring and/or SM (quadrant in EE): rows of region iR are
+// regionRowsEB_[ regionRowsBeginEB_[iR] ... regionRowsBeginEB_[iR+1] )
+void FillEpsilonPlot::fillRegionExpansionTables()
+{
+  int nRegionsEB = List_IR_EtaPhi.empty() ? 0 : List_IR_EtaPhi.rbegin()->first + 1;
+  regionRowsBeginEB_.assign(nRegionsEB+1, 0);
+  regionRowsEB_.clear();
+  for(int iR=0; iR<nRegionsEB; ++iR){
+    regionRowsBeginEB_[iR] = regionRowsEB_.size();
+    std::map<int,vector<int>>::const_iterator reg = List_IR_EtaPhi.find(iR);
+    if( reg == List_IR_EtaPhi.end() ) continue;
+    int iEta = reg->second[0];
+    int iSM = reg->second[2];
+    if( EtaRingCalibEB_ ) appendRegionRows(ListEtaFix_xtalEB, iEta, regionRowsEB_);
+    if( SMCalibEB_ )      appendRegionRows(ListSMFix_xtalEB, iSM, regionRowsEB_);
+  }
+  regionRowsBeginEB_[nRegionsEB] = regionRowsEB_.size();
+
+  int nRegionsEE = List_IR_XYZ.empty() ? 0 : List_IR_XYZ.rbegin()->first + 1;
+  regionRowsBeginEE_.assign(nRegionsEE+1, 0);
+  regionRowsEE_.clear();
+  for(int iR=0; iR<nRegionsEE; ++iR){
+    regionRowsBeginEE_[iR] = regionRowsEE_.size();
+    std::map<int,vector<int>>::const_iterator reg = List_IR_XYZ.find(iR);
+    if( reg == List_IR_XYZ.end() ) continue;
+    int iX = reg->second[0];
+    int iY = reg->second[1];
+    int iZ = reg->second[2];
+    int Quad = reg->second[3];
+    if( EtaRingCalibEE_ ) appendRegionRows( iZ==-1 ? ListEtaFix_xtalEEm : ListEtaFix_xtalEEp, getEERing(iX,iY), regionRowsEE_);
+    if( SMCalibEE_ )      appendRegionRows( iZ==-1 ? ListQuadFix_xtalEEm : ListQuadFix_xtalEEp, Quad, regionRowsEE_);
+  }
+  regionRowsBeginEE_[nRegionsEE] = regionRowsEE_.size();
+
+  if (isDebug_) cout << "[DEBUG] region expansion tables: " << regionRowsEB_.size() << " EB rows, " << regionRowsEE_.size() << " EE rows" << endl;
 }
 
 
@@ -3370,8 +2988,8 @@ FillEpsilonPlot::beginJob()
 float 
 FillEpsilonPlot::GetDeltaR(float eta1, float eta2, float phi1, float phi2){
 
-  return sqrt( (eta1-eta2)*(eta1-eta2) 
-	+ DeltaPhi(phi1, phi2)*DeltaPhi(phi1, phi2) );
+  // same function used by the cluster grid, see EcalClusterGrid.h
+  return EcalClusterGrid::deltaR(eta1, eta2, phi1, phi2);
 
 }
 
@@ -3383,36 +3001,33 @@ FillEpsilonPlot::DeltaPhi(float phi1, float phi2){
   // while (diff >acos(-1)) diff -= 2*acos(-1);
   // while (diff <= -acos(-1)) diff += 2*acos(-1);
 
-  float diff = phi2 - phi1;
-  while (diff > TMath::Pi()) diff -= 2.*TMath::Pi();
-  while (diff <= -TMath::Pi()) diff += 2.*TMath::Pi();
-
-  return diff;
+  return EcalClusterGrid::deltaPhi(phi1, phi2);
 
 }
 
-bool FillEpsilonPlot::GetHLTResults(const edm::Event& iEvent, std::string s){
+void FillEpsilonPlot::updateHLTPathIndices(const edm::Event& iEvent, const edm::TriggerResults& hltResults){
 
-  edm::Handle<edm::TriggerResults> hltTriggerResultHandle;
-  iEvent.getByToken(triggerResultsToken_, hltTriggerResultHandle);
+  // the path indices depend only on the trigger names, so they are looked up again only when these change
+  const edm::TriggerNames & HLTNames = iEvent.triggerNames(hltResults);
+  if (nHLTPathResolutions_ > 0 && HLTNames.parameterSetID() == hltNamesID_) return;
 
-  edm::TriggerNames HLTNames;
+  hltNamesID_ = HLTNames.parameterSetID();
+  hltPathIndexEB_ = findHLTPath(HLTNames, HLTResultsNameEB_);
+  hltPathIndexEE_ = findHLTPath(HLTNames, HLTResultsNameEE_);
+  nHLTPathResolutions_++;
 
-  HLTNames = iEvent.triggerNames(*hltTriggerResultHandle);
-  std::string tempnames;
-  int hltCount = hltTriggerResultHandle->size();
+}
+
+int FillEpsilonPlot::findHLTPath(const edm::TriggerNames& HLTNames, std::string s){
+
+  int hltCount = HLTNames.size();
   TRegexp reg(TString( s.c_str()) );
-  //std::cout << "hlCount = " << hltCount << std::endl;
   for (int i = 0 ; i != hltCount; ++i) {
     TString hltName_tstr(HLTNames.triggerName(i));
-    //std::cout << "hltName_tstr is: " << hltName_tstr << " and reg is: " << s << std::endl;
-    if ( hltName_tstr.Contains(reg) ){          // If reg contains * ir will say always True. So you ask for ->accept(i) to the first HLTName always.
-      //std::cout << "hltName_tstr.Contains(reg) give: " << hltName_tstr << " --> " << hltTriggerResultHandle->accept(i) << std::endl;
-      return hltTriggerResultHandle->accept(i); // False or True depending if it fired.
-    }
+    if ( hltName_tstr.Contains(reg) ) return i; // If reg contains * ir will say always True. So you would get the first HLTName always.
   }
-  return false;
-} // HLT isValid
+  return -1;
+}
 
 // not used anymore
 // bool FillEpsilonPlot::getTriggerByName( std::string s ) {
@@ -3434,46 +3049,27 @@ bool FillEpsilonPlot::getTriggerResult(const edm::Event& iEvent, const edm::Even
 
     const GlobalAlgBlkBxCollection *l1results = gtReadoutRecord.product(); 
 
-    ////////////////////
-    ////////////////////
-    // here we redo the association bit number <--> bit name
-    // the reason is that this is not a constant 
-    //e.g. during data taking in 2017 I noticed the number associated to a name changed, for instance SingleJet16 was 130 and then it became 131)
-    edm::ESHandle<L1TUtmTriggerMenu> menu;
-    iSetup.get<L1TUtmTriggerMenuRcd>().get(menu);
-    // get the bit/name association         
-    for (auto const & keyval: menu->getAlgorithmMap()) { 
-      std::string const & trigName  = keyval.second.getName(); 
-      unsigned int iTrigIndex = keyval.second.getIndex(); 
-      algoBitToName[iTrigIndex] = TString( trigName );  
-    } // end algo Map
-    ////////////////////
-    ////////////////////
-
     GlobalAlgBlk const &result = l1results->at(0, 0);
 
-    for (unsigned int itrig = 0; itrig < result.maxPhysicsTriggers; ++itrig) {
-      //      std::cerr << "bit: " << itrig << "\tresult: " << results.getAlgoDecisionFinal(itrig) << std::endl;
+    // only the seeds used by the stream, with the bits and bins found in updateL1Menu
+    for (unsigned int i = 0; i < streamSeedBits_.size(); ++i) {
 
       // L1 decision below is 1 if seed fired, 0 if it didn't. 
-      // seedIsInStream[itrig] = -1 if index is not valid, = 0 if index is valid but the seed is not used by the stream
-      if (seedIsInStream[itrig] > 0) { 
-    
-	bool myflag = result.getAlgoDecisionFinal(itrig) ; 
-	if (myflag ) { 
-	  l1flag[itrig] = 1; 
-	  triggerComposition->Fill(algoBitToName[itrig], l1flag[itrig]); 
-	  if (EB_HLT) triggerComposition_EB->Fill(algoBitToName[itrig], l1flag[itrig]); 
-	  if (EE_HLT) triggerComposition_EE->Fill(algoBitToName[itrig], l1flag[itrig]); 
-	  // cout << " itrig = " << itrig << "    ";
-	  // cout << " l1flag[itrig] = " << l1flag[itrig] << "    ";
-	  // cout << " algoBitToName[itrig] = " << algoBitToName[itrig] << endl;	  
-	} else {
-	  l1flag[itrig] = 0 ; 
+      unsigned int itrig = streamSeedBits_[i];
+      bool myflag = result.getAlgoDecisionFinal(itrig) ; 
+      if (streamSeedBins_[i] > 0) seedFlagByBin_[streamSeedBins_[i]-1] = myflag ? 1 : 0;
+      if (myflag ) { 
+	l1flag[itrig] = 1; 
+	if (streamSeedBins_[i] > 0) {
+	  double x = triggerComposition->GetXaxis()->GetBinCenter(streamSeedBins_[i]);
+	  triggerComposition->Fill(x, l1flag[itrig]); 
+	  if (EB_HLT) triggerComposition_EB->Fill(x, l1flag[itrig]); 
+	  if (EE_HLT) triggerComposition_EE->Fill(x, l1flag[itrig]); 
 	}
+      } else {
+	l1flag[itrig] = 0 ; 
+      }
 
-      } 
- 
     }
 
   }
@@ -3482,11 +3078,249 @@ bool FillEpsilonPlot::getTriggerResult(const edm::Event& iEvent, const edm::Even
   return true;
 }
 
-void FillEpsilonPlot::endJob(){
+void FillEpsilonPlot::updateL1Menu(const edm::EventSetup& iSetup) {
+
+  // here we redo the association bit number <--> bit name when the menu changes
+  // the reason is that this is not a constant 
+  //e.g. during data taking in 2017 I noticed the number associated to a name changed, for instance SingleJet16 was 130 and then it became 131)
+  const L1TUtmTriggerMenuRcd & menuRecord = iSetup.get<L1TUtmTriggerMenuRcd>();
+  if( areLabelsSet_ && menuRecord.cacheIdentifier() == l1MenuCacheId_ ) return;
+  l1MenuCacheId_ = menuRecord.cacheIdentifier();
+
+  edm::ESHandle<L1TUtmTriggerMenu> menu;
+  menuRecord.get(menu);
+
+  // get the bit/name association         
+  for (unsigned int itrig = 0; itrig < GlobalAlgBlk::maxPhysicsTriggers; ++itrig) algoBitToName[itrig] = "";
+  for (auto const & keyval: menu->getAlgorithmMap()) { 
+    std::string const & trigName  = keyval.second.getName(); 
+    unsigned int iTrigIndex = keyval.second.getIndex(); 
+    algoBitToName[iTrigIndex] = TString( trigName );
+  } // end algo Map
+
+  streamSeedBits_.clear();
+  streamSeedBins_.clear();
+  // -1 for the seeds of the tree that are not in this menu
+  seedFlagByBin_.assign(seedFlagByBin_.size(), -1);
+  for (unsigned int itrig = 0; itrig < GlobalAlgBlk::maxPhysicsTriggers; ++itrig) {
+
+    // some indices are empty: name them appropriately
+    if (std::string(algoBitToName[itrig]) == "") algoBitToName[itrig] = Form("EMPTY_%d",itrig);
+
+    // check if index is valid
+    if ( std::string(algoBitToName[itrig]).find("EMPTY") != std::string::npos ) {
+
+      // -1 for non valid index
+      seedIsInStream[itrig] = -1;
+      l1flag[itrig] = -2; 
+
+    } else if ( L1SeedsPi0Stream_.find((algoBitToName[itrig]+" ")) != std::string::npos ) { 
+
+      // check if seed is used by the stream: seed expression is "seed1 OR seed2 OR seed3 ... "
+      // the space at the end is important: see parameters.py
+      seedIsInStream[itrig] = 1;
+      l1flag[itrig] = 0;
+      std::string trigName = std::string(algoBitToName[itrig]);
+
+      // bin of the seed in the triggerComposition histograms: a seed seen for the first time takes the next free bin
+      int bin = triggerComposition->GetXaxis()->FindFixBin(trigName.c_str());
+      if (bin <= 0) {
+	cout << "trigCompBin = " << trigCompBin_ << "    Seed name = " << algoBitToName[itrig] << endl;
+	if (trigCompBin_ <= triggerComposition->GetNbinsX()) {
+	  bin = trigCompBin_;
+	  triggerComposition->GetXaxis()->SetBinLabel(bin,trigName.c_str());
+	  triggerComposition_EB->GetXaxis()->SetBinLabel(bin,trigName.c_str());
+	  triggerComposition_EE->GetXaxis()->SetBinLabel(bin,trigName.c_str());
+	}
+	else {
+	  cout << "Warning: trigCompBin is exceeding the allowed number of bins. Check! " << endl;
+	  bin = 0;
+	}
+	trigCompBin_++;
+      }
+      streamSeedBits_.push_back(itrig);
+      streamSeedBins_.push_back(bin);
+      if (bin > 0) seedFlagByBin_[bin-1] = 0;
+
+      // save bit for any seed n the stream in the tree (branches can only be booked with the first menu);
+      // a branch follows the seed name, its bit may change with the menu
+      if(MakeNtuple4optimization_ && !areLabelsSet_ && bin > 0) Tree_Optim->Branch(trigName.c_str(),&seedFlagByBin_[bin-1],(trigName+"/S").c_str());
+      //Tree_Optim->Branch((trigName+"_Prescl").c_str(),l1Prescl+(int)itrig,(trigName+"_Prescl/I").c_str());  // not implemented yet
+
+    } else {
+
+      seedIsInStream[itrig] = 0;
+      l1flag[itrig] = -1;
+
+    }
 
+  }
+
+  if(!areLabelsSet_){
+    areLabelsSet_ = true;
+    cout << "setting labels of triggerComposition histogram" << endl;
+  }
+
+}
+
+// ------------ method called once each stream just after ending the event loop  ------------
+void FillEpsilonPlot::endStream(){
+
+  eventStore_.close();
+  candidateStore_.close();
+
+  if (MakeNtuple4optimization_ && optimFile_) {
+    // the file deletes the tree
+    optimFile_->cd();
+    Tree_Optim->Write();
+    optimFile_->Close();
+    delete optimFile_;
+    optimFile_ = 0;
+    Tree_Optim = 0;
+  }
+
+  // the output is written once for all the streams, in globalEndJob
+  std::lock_guard<std::mutex> guard(globalCache()->streamsMutex_);
+  if (globalCache()->streams_.size() <= streamId_) globalCache()->streams_.resize(streamId_+1, 0);
+  globalCache()->streams_[streamId_] = this;
+
+}
+
+void FillEpsilonPlot::globalEndJob(const FillEpsilonPlotGlobalCache* globalCache){
+
+  // streams are merged in order of stream id, so that the result does not depend on which one ended first
+  std::vector<FillEpsilonPlot*> streams;
+  for (uint32_t i = 0; i < globalCache->streams_.size(); ++i)
+    if (globalCache->streams_[i]) streams.push_back(globalCache->streams_[i]);
+  if (streams.empty()) return;
+
+  for (uint32_t i = 1; i < streams.size(); ++i) streams[0]->mergeStream(*streams[i]);
+  streams[0]->writeOutput(streams);
+
+}
+
+static void mergeHistogram(TH1 *h, TH1 *other)
+{
+  // TH1::Merge also takes care of the alphanumeric bins of triggerComposition
+  TList list;
+  list.Add(other);
+  h->Merge(&list);
+}
+
+void FillEpsilonPlot::mergeStream(FillEpsilonPlot &other){
+
+  EcalStageProfiler::Scope timer(profiler_, EcalStageProfiler::kHistogramMerge);
+  if( !MakeNtuple4optimization_ &&(Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) ) {
+    if (isEoverEtrue_) {
+      EoverEtrue_g1_EB_h2D->add(*other.EoverEtrue_g1_EB_h2D);
+      EoverEtrue_g2_EB_h2D->add(*other.EoverEtrue_g2_EB_h2D);
+    } else {
+      epsilon_EB_h2D->add(*other.epsilon_EB_h2D);
+      for (unsigned int k = 0; k < epsilon_EB_rep_h2D.size(); ++k) epsilon_EB_rep_h2D[k]->add(*other.epsilon_EB_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EB_iov_h2D.size(); ++k) epsilon_EB_iov_h2D[k]->add(*other.epsilon_EB_iov_h2D[k]);
+      if (fillEtaAlongPi0_) epsilon_EB_eta_h2D->add(*other.epsilon_EB_eta_h2D);
+      for (unsigned int k = 0; k < epsilon_EB_eta_rep_h2D.size(); ++k) epsilon_EB_eta_rep_h2D[k]->add(*other.epsilon_EB_eta_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EB_eta_iov_h2D.size(); ++k) epsilon_EB_eta_iov_h2D[k]->add(*other.epsilon_EB_eta_iov_h2D[k]);
+      for (unsigned int g = 0; g < epsilon_EB_extra_h2D.size(); ++g) epsilon_EB_extra_h2D[g]->add(*other.epsilon_EB_extra_h2D[g]);
+    }
+  }
+
+  if( !MakeNtuple4optimization_ && (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) ) {
+    if (isEoverEtrue_) {
+      EoverEtrue_g1_EE_h2D->add(*other.EoverEtrue_g1_EE_h2D);
+      EoverEtrue_g2_EE_h2D->add(*other.EoverEtrue_g2_EE_h2D);
+    } else {
+      epsilon_EE_h2D->add(*other.epsilon_EE_h2D);
+      for (unsigned int k = 0; k < epsilon_EE_rep_h2D.size(); ++k) epsilon_EE_rep_h2D[k]->add(*other.epsilon_EE_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EE_iov_h2D.size(); ++k) epsilon_EE_iov_h2D[k]->add(*other.epsilon_EE_iov_h2D[k]);
+      if (fillEtaAlongPi0_) epsilon_EE_eta_h2D->add(*other.epsilon_EE_eta_h2D);
+      for (unsigned int k = 0; k < epsilon_EE_eta_rep_h2D.size(); ++k) epsilon_EE_eta_rep_h2D[k]->add(*other.epsilon_EE_eta_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EE_eta_iov_h2D.size(); ++k) epsilon_EE_eta_iov_h2D[k]->add(*other.epsilon_EE_eta_iov_h2D[k]);
+      for (unsigned int g = 0; g < epsilon_EE_extra_h2D.size(); ++g) epsilon_EE_extra_h2D[g]->add(*other.epsilon_EE_extra_h2D[g]);
+    }
+  }
+
+  mergeHistogram(pi0MassVsIetaEB, other.pi0MassVsIetaEB);
+  mergeHistogram(pi0MassVsETEB, other.pi0MassVsETEB);
+  mergeHistogram(photonDeltaRVsIetaEB, other.photonDeltaRVsIetaEB);
+  if (L1TriggerInfo_) {
+    mergeHistogram(triggerComposition, other.triggerComposition);
+    mergeHistogram(triggerComposition_EB, other.triggerComposition_EB);
+    mergeHistogram(triggerComposition_EE, other.triggerComposition_EE);
+  }
+  if (isMC_ and MC_Assoc_) {
+    mergeHistogram(h_numberUnmergedGenPhotonPairs_EB, other.h_numberUnmergedGenPhotonPairs_EB);
+    mergeHistogram(h_numberMatchedGenPhotonPairs_EB, other.h_numberMatchedGenPhotonPairs_EB);
+    mergeHistogram(h_numberUnmergedGenPhotonPairs_EE, other.h_numberUnmergedGenPhotonPairs_EE);
+    mergeHistogram(h_numberMatchedGenPhotonPairs_EE, other.h_numberMatchedGenPhotonPairs_EE);
+    mergeHistogram(h_numberUnmergedGenPhotonPairs, other.h_numberUnmergedGenPhotonPairs);
+    mergeHistogram(h_numberMatchedGenPhotonPairs, other.h_numberMatchedGenPhotonPairs);
+    mergeHistogram(g1RecoGenDR_EB, other.g1RecoGenDR_EB);
+    mergeHistogram(g2RecoGenDR_EB, other.g2RecoGenDR_EB);
+    mergeHistogram(diff_g2Recog1GenDR_g2RecoGenDR_EB, other.diff_g2Recog1GenDR_g2RecoGenDR_EB);
+  }
+
+  if (fillKinematicVariables_) {
+    mergeHistogram(seedEnergyInCluster, other.seedEnergyInCluster);
+    mergeHistogram(pi0pt_afterCuts, other.pi0pt_afterCuts);
+    mergeHistogram(g1pt_afterCuts, other.g1pt_afterCuts);
+    mergeHistogram(g2pt_afterCuts, other.g2pt_afterCuts);
+    mergeHistogram(g1Nxtal_afterCuts, other.g1Nxtal_afterCuts);
+    mergeHistogram(g2Nxtal_afterCuts, other.g2Nxtal_afterCuts);
+    mergeHistogram(pi0PhotonsNoverlappingXtals_afterCuts, other.pi0PhotonsNoverlappingXtals_afterCuts);
+    mergeHistogram(g1g2DR_afterCuts, other.g1g2DR_afterCuts);
+    for (uint32_t i = 0; i < pi0MassVsPU.size(); ++i) mergeHistogram(pi0MassVsPU[i], other.pi0MassVsPU[i]);
+  }
+
+  pairSelection_.addCounts(other.pairSelection_);
+  nHLTPathResolutions_ += other.nHLTPathResolutions_;
+  profiler_.merge(other.profiler_);
+
+}
+
+void FillEpsilonPlot::writeOutput(const std::vector<FillEpsilonPlot*> &streams){
+
+  // output file
+  string fileName = "";
+  fileName = outputDir_ + outfilename_;
+  outfile_ = TFile::Open(fileName.c_str(),"RECREATE");
+  if(!outfile_ or not outfile_->IsOpen()) throw cms::Exception("WritingOutputFile") << "It was no possible to create output file " << fileName << "\n";
+
+  /// testing the EE eta ring
+  TH2F eep("eep","EE+",102,0.5,101.5,102,-0.5,101.5);
+  TH2F eem("eem","EE-",102,0.5,101.5,102,-0.5,101.5);
+  eep.SetDirectory(0);
+  eem.SetDirectory(0);
+
+  for(int etaring=0; etaring < EndcapTools::N_RING_ENDCAP; ++etaring)
+  {
+
+    float fillValue = (etaring%2)==0 ? 1. : 2.;
+    std::vector<DetId> allDetIds = EcalCalibType::EtaRing::allDetIdsInEERegion(etaring);
+    for(int ixtal=0; ixtal<int(allDetIds.size()); ixtal++)
+    {
+	EEDetId eeid(allDetIds.at(ixtal));
+	if(eeid.zside()==-1)
+	  eem.SetBinContent(eeid.ix(),eeid.iy(),fillValue);
+	else
+	  eep.SetBinContent(eeid.ix(),eeid.iy(),fillValue);
+
+    }
+  }
   outfile_->cd();
+  eep.Write();
+  eem.Write();
+
   if(MakeNtuple4optimization_){
-    Tree_Optim->Write();
+    // entries of the streams one after the other, in order of stream id: the baskets are copied from the
+    // files of the streams (without unzipping them), which are then removed
+    TChain chain("Tree_Optim");
+    for (uint32_t i = 0; i < streams.size(); ++i) chain.Add(streams[i]->optimFileName_.c_str());
+    outfile_->cd();
+    TTree *tree = chain.CloneTree(-1, "fast");
+    tree->Write();
+    delete tree;
+    for (uint32_t i = 0; i < streams.size(); ++i) gSystem->Unlink(streams[i]->optimFileName_.c_str());
   }
 
   pi0MassVsIetaEB->Write();
@@ -3535,6 +3369,12 @@ void FillEpsilonPlot::endJob(){
       writeEpsilonPlot2D(EoverEtrue_g2_EB_h2D);
     } else {
       writeEpsilonPlot2D(epsilon_EB_h2D);
+      for (unsigned int k = 0; k < epsilon_EB_rep_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EB_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EB_iov_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EB_iov_h2D[k]);
+      if (fillEtaAlongPi0_) writeEpsilonPlot2D(epsilon_EB_eta_h2D);
+      for (unsigned int k = 0; k < epsilon_EB_eta_rep_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EB_eta_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EB_eta_iov_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EB_eta_iov_h2D[k]);
+      for (unsigned int g = 0; g < epsilon_EB_extra_h2D.size(); ++g) writeEpsilonPlot2D(epsilon_EB_extra_h2D[g]);
     }
   }
 
@@ -3544,10 +3384,76 @@ void FillEpsilonPlot::endJob(){
       writeEpsilonPlot2D(EoverEtrue_g2_EE_h2D);
     } else {
       writeEpsilonPlot2D(epsilon_EE_h2D);
+      for (unsigned int k = 0; k < epsilon_EE_rep_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EE_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EE_iov_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EE_iov_h2D[k]);
+      if (fillEtaAlongPi0_) writeEpsilonPlot2D(epsilon_EE_eta_h2D);
+      for (unsigned int k = 0; k < epsilon_EE_eta_rep_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EE_eta_rep_h2D[k]);
+      for (unsigned int k = 0; k < epsilon_EE_eta_iov_h2D.size(); ++k) writeEpsilonPlot2D(epsilon_EE_eta_iov_h2D[k]);
+      for (unsigned int g = 0; g < epsilon_EE_extra_h2D.size(); ++g) writeEpsilonPlot2D(epsilon_EE_extra_h2D[g]);
+    }
+  }
+
+  std::cout << "### FillEpsilonPlot::endJob() (" << streams.size() << " streams)" << std::endl;
+  std::cout << "pi0 pairs: tested " << pairSelection_.nTested() << ", skipped by the eta-phi grid " << pairSelection_.nSkipped() << std::endl;
+  // once per stream, more if the HLT menu changed
+  if( HLTResults_ ) {
+    std::cout << "HLT path indices resolved " << nHLTPathResolutions_ << " times" << std::endl;
+    // also in the output, summed by the hadd of the jobs
+    outfile_->cd();
+    TH1D hltPathResolutions("hltPathResolutions", "HLT path index lookups", 1, 0, 1);
+    hltPathResolutions.SetBinContent(1, nHLTPathResolutions_);
+    hltPathResolutions.Write();
+  }
+
+  if( profiler_.enabled() ) {
+    outfile_->cd();
+    TH1D* h = profiler_.timeHistogram("profileStageTime");     h->Write(); delete h;
+    h = profiler_.callsHistogram("profileStageCalls");          h->Write(); delete h;
+    h = profiler_.counterHistogram("profileCounters");          h->Write(); delete h;
+    profiler_.print();
+  }
+
+  outfile_->Write(); // is this needed? I usually Write() each single object individually
+  std::string outname = outfile_->GetName();
+  outfile_->Close();
+
+  if( profiler_.enabled() ) {
+    // report next to the output file, written once the output is closed: a failure only loses the report
+    std::string reportName = fileName;
+    if (reportName.size() > 5 && reportName.compare(reportName.size()-5, 5, ".root") == 0) reportName.erase(reportName.size()-5);
+    reportName += "_profile.json";
+    try {
+      profiler_.writeJSON(reportName, streams.size());
+      std::cout << "profile report written in " << reportName << std::endl;
+    } catch (cms::Exception& e) {
+      std::cout << "[FillEpsilonPlot] WARNING: profile report not written: " << e.what() << std::endl;
     }
   }
 
-  std::cout << "### FillEpsilonPlot::endJob()" << std::endl;
+  // check goodness of file inside this job
+  std::cout << "After writing: check goodness of file" << std::endl;
+  std::cout << "file name: " << outname << std::endl;
+  bool isGood = true;
+  TFile * fcheck = TFile::Open(outname.c_str(),"READ");
+  if (not fcheck or fcheck->IsZombie()) {
+    isGood = false;
+  } else {
+    if (fcheck->GetSize() < 1048576) isGood = false; // set limit at 1 MB, file is actually larger
+    //if (fcheck->GetSize() < 500000) isGood = false; // set limit at 500 kB, file is actually larger
+    else if (fcheck->TestBit(TFile::kRecovered)) isGood = false;
+    fcheck->Close();    
+  }
+
+  if (isGood) {
+    std::cout << ">>>> File looks good" << std::endl;
+  } else {
+    std::cout << "#### File is bad or non existing. Will be deleted if existing" << std::endl;
+    if (not gSystem->AccessPathName(outname.c_str())) {
+      // file exists, let's delete it
+      //gSystem->Exec(Form("rm %s",outname.c_str()));
+      gSystem->Unlink(outname.c_str()); // this works also for non-Unix systems, just in case
+    }
+  }
 
 }
 
@@ -3559,8 +3465,8 @@ void FillEpsilonPlot::loadEoverEtrueContainmentCorrections(const std::string& fi
 
   cout << "FillEpsilonPlot:: loading E/Etrue containment corrections from " << fileName << endl;
 
-  hCC_EoverEtrue_g1 = new TH2F("hCC_EoverEtrue_g1","",171,-85.5,85.5,360,0.5,360.5);
-  hCC_EoverEtrue_g2 = new TH2F("hCC_EoverEtrue_g2","",171,-85.5,85.5,360,0.5,360.5);
+  hCC_EoverEtrue_g1 = detached(new TH2F("hCC_EoverEtrue_g1","",171,-85.5,85.5,360,0.5,360.5));
+  hCC_EoverEtrue_g2 = detached(new TH2F("hCC_EoverEtrue_g2","",171,-85.5,85.5,360,0.5,360.5));
 
   TH2F* hCC_tmp1 = nullptr;
   TH2F* hCC_tmp2 = nullptr;
@@ -3597,8 +3503,19 @@ void FillEpsilonPlot::loadEoverEtrueContainmentCorrections(const std::string& fi
     }
   }
 
+  delete hCC_tmp1;
+  delete hCC_tmp2;
   f->Close();
 
+  // flat copy of the corrections indexed by EB hashed index, used when correcting the clusters
+  ccEoverEtrueEB_g1_.assign(EBDetId::kSizeForDenseIndexing, 0.);
+  ccEoverEtrueEB_g2_.assign(EBDetId::kSizeForDenseIndexing, 0.);
+  for (int hash = 0; hash < EBDetId::kSizeForDenseIndexing; ++hash) {
+    EBDetId ebId = EBDetId::unhashIndex(hash);
+    ccEoverEtrueEB_g1_[hash] = hCC_EoverEtrue_g1->GetBinContent(hCC_EoverEtrue_g1->FindFixBin(ebId.ieta(),ebId.iphi()));
+    ccEoverEtrueEB_g2_[hash] = hCC_EoverEtrue_g2->GetBinContent(hCC_EoverEtrue_g2->FindFixBin(ebId.ieta(),ebId.iphi()));
+  }
+
 }
 
 
@@ -3606,6 +3523,34 @@ void FillEpsilonPlot::loadEoverEtrueContainmentCorrections(const std::string& fi
 // ------------ method called when starting to processes a run  ------------
 void FillEpsilonPlot::beginRun(edm::Run const&, edm::EventSetup const& iSetup) {
 
+  // flat per-xtal geometry used by the position calculation in the clustering
+  if( GeometryFromFile_ ) {
+    if( !geomTable_.isFilled() ) geomTable_.fill(geom_);
+  } else {
+    const CaloGeometryRecord & geoRecord = iSetup.get<CaloGeometryRecord>();
+    if( !geomTable_.isFilled() || geoRecord.cacheIdentifier() != geometryCacheId_ ) {
+      edm::ESHandle<CaloGeometry> geoHandle;
+      geoRecord.get(geoHandle);
+      geomTable_.fill(geoHandle.product());
+      geometryCacheId_ = geoRecord.cacheIdentifier();
+    }
+  }
+
+  // closest ES strip grid, used for the EE-ES matching (the preshower geometry always comes from the EventSetup)
+  const CaloGeometryRecord & esGeoRecord = iSetup.get<CaloGeometryRecord>();
+  if( !esStripGrid_.isFilled() || esGeoRecord.cacheIdentifier() != esGeometryCacheId_ ) {
+    edm::ESHandle<CaloGeometry> geoHandle;
+    esGeoRecord.get(geoHandle);
+    esStripGrid_.fill(dynamic_cast<const EcalPreshowerGeometry*>( geoHandle->getSubdetectorGeometry(DetId::Ecal,EcalPreshower) ));
+    esGeometryCacheId_ = esGeoRecord.cacheIdentifier();
+    if( !esStripGrid_.isEnabled() ) cout << "[FillEpsilonPlot] WARNING: getClosestCellInPlane does not depend only on the projected point, ES strip grid disabled" << endl;
+    if( validateESStripGrid_ && esStripGrid_.isEnabled() ) {
+      int nMismatch = esStripGrid_.validate(10000);
+      cout << "[FillEpsilonPlot] ES strip grid validation: " << nMismatch << " mismatches with getClosestCellInPlane over 4x10000 points" << endl;
+      if( nMismatch > 0 ) esStripGrid_.disable();
+    }
+  }
+
   //    edm::ESHandle<L1GtTriggerMenu> menuRcd;
   //    iSetup.get<L1GtTriggerMenuRcd>().get(menuRcd) ;
   //    const L1GtTriggerMenu* menu = menuRcd.product();
@@ -3639,35 +3584,6 @@ void FillEpsilonPlot::beginRun(edm::Run const&, edm::EventSetup const& iSetup) {
   //    }
 }
 
-bool FillEpsilonPlot::checkStatusOfEcalRecHit(const EcalChannelStatus &channelStatus,const EcalRecHit &rh){
-  int status =  int(channelStatus[rh.id().rawId()].getStatusCode()); 
-  if ( status > 0/*statusLevelRecHitsToUsea_*/ ) return false; 
-  return true; 
-}
-
-bool FillEpsilonPlot::isInDeadMap( bool isEB, const EcalRecHit &rh ){
-  bool isBad=false;
-  if(isEB){
-    EBDetId det(rh.id());
-    int ieta = det.ieta();
-    int iphi = det.iphi();
-    if( EBMap_DeadXtal->GetBinContent( iphi+1, ieta+86 ) == 1 ) isBad=true;
-  }
-  else{
-    EEDetId det(rh.id());
-    int ix = det.ix();
-    int iy = det.iy();
-    int iz = det.zside();
-    if( iz==-1 ){
-	if( EEmMap_DeadXtal->GetBinContent( ix+1, iy+1 ) == 1 ) isBad=true;
-    }
-    else{
-	if( EEpMap_DeadXtal->GetBinContent( ix+1, iy+1 ) == 1 ) isBad=true;
-    }
-  }
-  return isBad;
-}
-
 // ------------ method called when ending the processing of a run  ------------
   void 
 FillEpsilonPlot::endRun(edm::Run const&, edm::EventSetup const&)
@@ -3712,18 +3628,5 @@ double max (double x, double y){
   else      return y;
 }
 
-int GetRing(int x, int y, vector<iXiYtoRing> VectRing, bool debug3){
-  int index(0);
-  bool found = false;
-  if(debug3) cout<<"--> Looking for "<<x<<" "<<y<<endl;
-  for( size_t i=0; i<VectRing.size(); i++){
-    if(  VectRing[i].iX != x || VectRing[i].iY != y ){index++;    if(debug3){cout<<"Is not "<<VectRing[i].iX<<" and "<<VectRing[i].iY<<" index is: "<<index<<endl;}}
-    if(  VectRing[i].iX == x && VectRing[i].iY == y ){found=true; if(debug3){cout<<"FOUND! "<<VectRing[i].iX<<" "<<VectRing[i].iY<<endl;}                   break;}
-  }
-  if(found){ if(debug3){cout<<"Returning: "<<VectRing[index].iX<<" "<<VectRing[index].iY<<" "<<VectRing[index].Ring<<endl;} return VectRing[index].Ring;}
-  else{      if(debug3){cout<<"NOT found: "<<x<<" "<<y<<endl;}             return -1;}
-}
-
-
 //define this as a plug-in
 DEFINE_FWK_MODULE(FillEpsilonPlot);
@@ -3,6 +3,10 @@
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
+#include <climits>
 using std::cout;
 using std::endl;
 using std::vector;
@@ -11,14 +15,77 @@ using std::pair;
 using std::stringstream;
 using std::runtime_error;
 
-#include "CalibCode/json/reader.h"
-#include "CalibCode/json/elements.h"
+namespace {
+  // runs with at least this number of LS ranges get a bitmap, if their last LS is small enough
+  const unsigned int kMinSegmentsForBitmap = 8;
+  const int kMaxLSForBitmap = 1<<16;
 
-JSON::JSON(const char* json) {
+  // minimal parser for the certification JSON format
+  class LumiMaskParser {
+  public:
+    LumiMaskParser(const std::string& text) : text_(text), pos_(0) {}
 
-  goodLS_ = LSRange();
-  goodLSCache_ = goodLS_.end();
+    void skipSpaces() { while (pos_ < text_.size() && isspace(text_[pos_])) pos_++; }
 
+    bool accept(char c) {
+      skipSpaces();
+      if (pos_ < text_.size() && text_[pos_] == c) { pos_++; return true; }
+      return false;
+    }
+
+    void expect(char c) {
+      if (!accept(c)) {
+        stringstream err;
+        err << "JSON: expected '" << c << "' at position " << pos_;
+        throw runtime_error(err.str());
+      }
+    }
+
+    int number() {
+      skipSpaces();
+      size_t start = pos_;
+      if (pos_ < text_.size() && (text_[pos_] == '-' || text_[pos_] == '+')) pos_++;
+      while (pos_ < text_.size() && isdigit(text_[pos_])) pos_++;
+      if (start == pos_) {
+        stringstream err;
+        err << "JSON: expected a number at position " << pos_;
+        throw runtime_error(err.str());
+      }
+      return atoi(text_.substr(start, pos_-start).c_str());
+    }
+
+    // run numbers are quoted
+    int runNumber() {
+      expect('"');
+      int run = number();
+      expect('"');
+      return run;
+    }
+
+    bool atEnd() { skipSpaces(); return pos_ >= text_.size(); }
+
+  private:
+    const std::string& text_;
+    size_t pos_;
+  };
+}
+
+JSON::JSON(const char* json) : oldRun(-1), oldRunIndex_(-1) {
+
+  ReadJSONFile(json);
+
+}
+
+//========================
+void JSON::ReadJSONFile(const char* json) {
+  //========================
+  runs_.clear();
+  segmentsBegin_.assign(1, 0);
+  segments_.clear();
+  bitmapBegin_.clear();
+  bitmap_.clear();
+  oldRun = -1;
+  oldRunIndex_ = -1;
 
   std::ifstream jsonFileStream;
   jsonFileStream.open(json);
@@ -27,34 +94,75 @@ JSON::JSON(const char* json) {
     std::cout << "Unable to open file " << json << std::endl;
     return;
   }
+  stringstream buffer;
+  buffer << jsonFileStream.rdbuf();
+  const std::string text = buffer.str();
 
-  json::Object elemRootFile;
-  json::Reader::Read(elemRootFile, jsonFileStream);
+  // read everything first: the runs are not necessarily sorted in the file
+  LSRange goodLS;
+  LumiMaskParser parser(text);
+  parser.expect('{');
+  if (!parser.accept('}')) {
+    do {
+      int run = parser.runNumber();
+      parser.expect(':');
+      parser.expect('[');
+      GoodLSVector& thisRunSegments = goodLS[run];
+      if (!parser.accept(']')) {
+        do {
+          parser.expect('[');
+          int lsStart = parser.number();
+          parser.expect(',');
+          int lsEnd = parser.number();
+          parser.expect(']');
+          thisRunSegments.push_back(std::make_pair(lsStart, lsEnd));
+        } while (parser.accept(','));
+        parser.expect(']');
+      }
+    } while (parser.accept(','));
+    parser.expect('}');
+  }
+  if (!parser.atEnd()) throw runtime_error(std::string("JSON: unexpected characters after the end of ") + json);
 
-  for (json::Object::const_iterator itRun=elemRootFile.Begin();itRun!=elemRootFile.End();++itRun)
-  {
-    const json::Array& lsSegment = (*itRun).element;
-    GoodLSVector thisRunSegments;
-    for (json::Array::const_iterator lsIterator=lsSegment.Begin();lsIterator!=lsSegment.End();++lsIterator)
-    {
-	json::Array lsSegment=(*lsIterator);
-	json::Number lsStart=lsSegment[0];
-	json::Number lsEnd=lsSegment[1];
-	aLSSegment thisSegment=std::make_pair<int,int>(lsStart.Value(),lsEnd.Value());
-	thisRunSegments.push_back(thisSegment);
-    }
-    goodLS_[atoi((*itRun).name.c_str())]=thisRunSegments;
+  for (LSRange::iterator itR = goodLS.begin(); itR != goodLS.end(); ++itR) addRun(itR->first, itR->second);
+
+  std::cout << "[GoodRunLSMap]::Good Run LS map filled with " << runs_.size() << " runs, " << segments_.size() << " LS ranges, " << nLS() << " LS" << std::endl;
+}
+
+//========================
+void JSON::addRun(int run, GoodLSVector& segments) {
+  //========================
+  // sort and merge overlapping or contiguous ranges
+  std::sort(segments.begin(), segments.end());
+  unsigned int first = segments_.size();
+  for (GoodLSVector::const_iterator iSeg = segments.begin(); iSeg != segments.end(); ++iSeg) {
+    if (iSeg->first > iSeg->second) continue;
+    if (segments_.size() > first && iSeg->first <= segments_.back().second + 1)
+      segments_.back().second = std::max(segments_.back().second, iSeg->second);
+    else
+      segments_.push_back(*iSeg);
   }
+  runs_.push_back(run);
+  segmentsBegin_.push_back(segments_.size());
 
+  unsigned int nSegments = segments_.size() - first;
+  if (nSegments >= kMinSegmentsForBitmap && segments_.back().second < kMaxLSForBitmap && segments_[first].first >= 0) {
+    bitmapBegin_.push_back(bitmap_.size());
+    bitmap_.resize(bitmap_.size() + segments_.back().second/64 + 1, 0);
+    uint64_t* bits = &bitmap_[bitmapBegin_.back()];
+    for (unsigned int i = first; i < segments_.size(); ++i)
+      for (int ls = segments_[i].first; ls <= segments_[i].second; ++ls) bits[ls/64] |= uint64_t(1) << (ls%64);
+  } else {
+    bitmapBegin_.push_back(-1);
+  }
+}
 
-  std::cout << "[GoodRunLSMap]::Good Run LS map filled with " << goodLS_.size() << " runs" << std::endl;
-  for (LSRange::const_iterator itR=goodLS_.begin(); itR!=goodLS_.end(); ++itR)
-  {
-    std::cout << "[GoodRunLSMap]::Run " << (*itR).first <<  " LS ranges are: ";
-    for (GoodLSVector::const_iterator iSeg=(*itR).second.begin();iSeg!=(*itR).second.end();++iSeg)
-	std::cout << "[" << (*iSeg).first << "," << (*iSeg).second << "] ";
-    std::cout << std::endl;
-  }  
+//========================
+unsigned int JSON::nLS() const {
+  //========================
+  unsigned int n = 0;
+  for (GoodLSVector::const_iterator iSeg = segments_.begin(); iSeg != segments_.end(); ++iSeg) n += iSeg->second - iSeg->first + 1;
+  return n;
 }
 
 //========================
@@ -62,19 +170,22 @@ bool JSON::isGoodLS(int run, int lumi) {
   //========================
   if( oldRun != run ) {
     oldRun = run;
-    goodLSCache_ = goodLS_.find( run );
+    std::vector<int>::const_iterator itR = std::lower_bound(runs_.begin(), runs_.end(), run);
+    oldRunIndex_ = (itR != runs_.end() && *itR == run) ? itR - runs_.begin() : -1;
   }
   // check whether this run is part of the good runs. else retrun false
-  if( goodLSCache_ != goodLS_.end() ) {
-    // get list of LS intervals
-    const GoodLSVector& lsvector =   goodLSCache_->second; 
-    // loop over good LS intervals and return as soon as one interval contains this event
-    for(GoodLSVector::const_iterator iLS = lsvector.begin(); iLS != lsvector.end(); iLS++) {
-	if(lumi >= iLS->first && lumi <= iLS->second ) {
-	  //cout << "Accepting run: " << Run << " LS: " << LumiSection << endl; 
-	  return true;
-	} // check current LS being in the interval
-    } // loop over good LS for this run
-  }
-  return false;
+  if( oldRunIndex_ < 0 ) return false;
+
+  const unsigned int first = segmentsBegin_[oldRunIndex_], last = segmentsBegin_[oldRunIndex_+1];
+  if( first == last || lumi < segments_[first].first || lumi > segments_[last-1].second ) return false;
+
+  if( bitmapBegin_[oldRunIndex_] >= 0 )
+    return (bitmap_[bitmapBegin_[oldRunIndex_] + lumi/64] >> (lumi%64)) & 1;
+
+  // last range starting at or before lumi
+  GoodLSVector::const_iterator begin = segments_.begin() + first;
+  GoodLSVector::const_iterator end = segments_.begin() + last;
+  GoodLSVector::const_iterator iLS = std::upper_bound(begin, end, std::make_pair(lumi, INT_MAX));
+  --iLS;
+  return lumi <= iLS->second;
 }
@@ -24,8 +24,23 @@
 
 enum calibGranularity{ xtal, tt, etaring };
 
+class RooPlot;
+
 struct Pi0FitResult {
   RooFitResult* res;
+  RooPlot* frame;  // mass fit: data and model, deleted by saveMassPeakFit
+  int niter;       // mass fit: attempt of the result
+  float mean;
+  float meanErr;
+  float sigma;
+  float sigmaErr;
+  float Nsig;
+  float NsigErr;
+  float normSig;   // signal and background fractions in 3 sigma
+  float normBkg;
+  float b[4];      // first background parameters
+  int nBkgParam;
+  float chi2red;   // from the frame
   float S;     // signal in 3 sigma region
   float Serr;
   float B;     // bkg in 3 sigma region
@@ -101,6 +116,7 @@ class FitEpsilonPlot : public edm::EDAnalyzer {
       void loadEoverEtruePlot(const std::string& filename, const int whichPhoton);
       void loadEoverEtruePlotFoldedInSM(const int whichPhoton);
       void loadEpsilonPlotFoldedInSM();
+      void loadStatReplicas();
       void saveCoefficients();
       void saveCoefficientsEoverEtrue(const bool isSecondGenPhoton);
       void saveCoefficientsEoverEtrueRooFit(const bool isSecondGenPhoton);
@@ -111,7 +127,14 @@ class FitEpsilonPlot : public edm::EDAnalyzer {
 
       int getArrayIndexOfFoldedSMfromIetaIphi(const int, const int);
       int getArrayIndexOfFoldedSMfromDenseIndex(const int, const bool);  
-      Pi0FitResult FitMassPeakRooFit(TH1F* h,double xlo, double xhi, uint32_t HistoIndex, int ngaus=1, FitMode mode=Pi0EB, int niter=0, bool isNot_2010_=true);
+      Pi0FitResult FitMassPeakRooFit(TH1F* h,double xlo, double xhi, uint32_t HistoIndex, int ngaus=1, FitMode mode=Pi0EB, int niter=0, bool isNot_2010_=true, bool storeResult=true);
+      Pi0FitResult fitMassPeak(TH1F* h, double xlo, double xhi, uint32_t HistoIndex, int ngaus, FitMode mode, int niter, bool isNot_2010_, std::vector<Pi0FitResult>& attempts);
+      void saveMassPeakFit(std::vector<Pi0FitResult>& attempts, uint32_t HistoIndex, FitMode mode, bool storeResult);
+      void fitRegionMass(int iR, bool isEB);
+      void sendRegionMassFit(int iR, bool isEB, std::string& bytes);
+      void receiveRegionMassFit(int iR, const std::string& bytes);
+      bool fitReplicaEpsilon(TH1F* h, uint32_t HistoIndex, FitMode mode, float& epsilon);
+      float replicaStatError(std::vector<TH1F**>& replicas, uint32_t HistoIndex, FitMode mode);
       TFitResultPtr FitEoverEtruePeak(TH1F* h1, Bool_t isSecondGenPhoton, uint32_t HistoIndex, FitMode mode, Bool_t noDrawStatBox);
       Pi0FitResult FitEoverEtruePeakRooFit(TH1F* h1, Bool_t isSecondGenPhoton, uint32_t HistoIndex, FitMode mode);
 
@@ -147,6 +170,16 @@ class FitEpsilonPlot : public edm::EDAnalyzer {
       int finRangeFit_; 
       bool useMassInsteadOfEpsilon_;
       bool foldInSuperModule_;
+      // mass fits of the regions, made here or by nFitWorkers worker processes, their results in
+      // regionFits_[iR-inRangeFit_] until analyze takes them in region order
+      struct RegionMassFit {
+        bool fitted;
+        std::vector<Pi0FitResult> attempts;  // of the mass fit, the result is the last one
+        float mean;     // epsilon, 0 if not fitted or the peak is on the upper bound
+        float statErr;
+      };
+      unsigned int nFitWorkers_;
+      std::vector<RegionMassFit> regionFits_;
       bool fitEoverEtrueWithRooFit_;
       bool readFoldedHistogramFromFile_;
       bool makeFoldedHistograms_;  // this flag makes sense with foldInSuperModule_, but to use folded histograms we first need to make them (makeFoldedHistograms_ = true)
@@ -160,6 +193,16 @@ class FitEpsilonPlot : public edm::EDAnalyzer {
       //TH2F *epsilon_EB_h2D;  // epsilon distribution by region (mass vs crystal index)
       //TH2F *epsilon_EE_h2D;  // epsilon distribution in EE (mass vs crystal index)
 
+      // statistical replicas of the mass distributions (StatReplicas of FillEpsilonPlot), one array per replica
+      std::string statReplicas_;
+      int iov_;  // IOV of the distributions to fit (epsilon_EB_iR_iov<k>), -1 for the whole dataset
+      std::string epsilonPlotPrefix_;  // "eta_" for the eta distributions filled along the pi0 ones, "<CalibType>_" for an ExtraCalibTypes granularity
+      bool startFromUnitMap_;  // calibMapPath not loaded: the output map holds only the correction factors (ExtraCalibTypes fits)
+      std::vector<TH1F**> epsilon_EB_rep_h;
+      std::vector<TH1F**> epsilon_EE_rep_h;
+      std::map<int,float> EBmap_statErr;  // relative statistical error of the coefficient, by region
+      std::map<int,float> EEmap_statErr;
+
       // for E/Etrue with MC 
       bool isEoverEtrue_;
       TH1F **EoverEtrue_g1_EB_h;
@@ -21,6 +21,8 @@ Implementation:
 #include <memory>
 #include <iostream>
 #include <string>
+#include <functional>
+#include <algorithm>
 
 #include "TF1.h"
 #include "TH1F.h"
@@ -36,6 +38,7 @@ Implementation:
 #include "TROOT.h"
 #include "TDirectory.h"
 #include "TStyle.h"
+#include "TBufferFile.h"
 
 // user include files
 #include "FWCore/Framework/interface/Frameworkfwd.h"
@@ -69,6 +72,7 @@ Implementation:
 #include "RooAbsCategory.h" 
 
 #include "CalibCode/FitEpsilonPlot/interface/FitEpsilonPlot.h"
+#include "CalibCode/CalibTools/interface/EcalForkedTaskPool.h"
 
 using std::cout;
 using std::endl;
@@ -117,6 +121,27 @@ FitEpsilonPlot::FitEpsilonPlot(const edm::ParameterSet& iConfig)
     useFit_RooMinuit_ = iConfig.getUntrackedParameter<bool>("useFit_RooMinuit",false);
     foldInSuperModule_ = iConfig.getUntrackedParameter<bool>("foldInSuperModule",false);
     makeFoldedHistograms_ = iConfig.getUntrackedParameter<bool>("makeFoldedHistograms",false);
+    statReplicas_ = iConfig.getUntrackedParameter<std::string>("StatReplicas","");
+    if(statReplicas_ != "" && statReplicas_ != "evenOdd" && statReplicas_ != "bootstrap")
+      throw cms::Exception("StatReplicas") << "Unknown StatReplicas mode " << statReplicas_ << "\n";
+    if(statReplicas_ != "" && (isEoverEtrue_ || foldInSuperModule_ || !useMassInsteadOfEpsilon_))
+      throw cms::Exception("StatReplicas") << "Statistical replicas are only fitted for the mass distributions, without folding in SM\n";
+    iov_ = iConfig.getUntrackedParameter<int>("IOV",-1);
+    if(iov_ >= 0 && (isEoverEtrue_ || foldInSuperModule_ || statReplicas_ != ""))
+      throw cms::Exception("IOV") << "The distributions of an IOV cannot be fitted with E/Etrue, SM folding or statistical replicas\n";
+    epsilonPlotPrefix_ = iConfig.getUntrackedParameter<std::string>("EpsilonPlotPrefix","");
+    // the mass fits of the regions can run in worker processes (RooFit does not fit in threads), 1 fits them here
+    int nFitWorkers = iConfig.getUntrackedParameter<int>("nFitWorkers",1);
+    if(nFitWorkers < 1)
+      throw cms::Exception("nFitWorkers") << "nFitWorkers must be at least 1\n";
+    nFitWorkers_ = nFitWorkers;
+    if(epsilonPlotPrefix_ != "" && (isEoverEtrue_ || foldInSuperModule_))
+      throw cms::Exception("EpsilonPlotPrefix") << "EpsilonPlotPrefix cannot be used with E/Etrue or SM folding\n";
+    // cross-check fits of a granularity coarser than the IC map (ExtraCalibTypes): a region cannot take the IC of its
+    // crystals, so the map starts from 1 and the output calibMap holds only the correction factors of the regions
+    startFromUnitMap_ = iConfig.getUntrackedParameter<bool>("StartFromUnitMap",false);
+    if(startFromUnitMap_ && isEoverEtrue_)
+      throw cms::Exception("StartFromUnitMap") << "StartFromUnitMap cannot be used with E/Etrue\n";
 
     // apparently for E/Etrue the fits are much better (I tried RooCMSShape + double-Crystal-Ball)
     // some tuning might be required, though
@@ -164,6 +189,8 @@ FitEpsilonPlot::FitEpsilonPlot(const edm::ParameterSet& iConfig)
     // therefore, the case with extension is included below
     std::string stringToMatch = "iter_-1";  // used below: this string should not match to trigger true condition 
     if(currentIteration_ < 0) throw cms::Exception("IterationNumber") << "Invalid negative iteration number\n";
+    else if(startFromUnitMap_)
+      cout << "FIT_EPSILON: " << calibMapPath_ << " not loaded, the output map holds the correction factors of the " << calibTypeString_ << " regions" << endl;
     else if(currentIteration_ > 0 || (currentIteration_ == 0 && calibMapPath_.find(stringToMatch)==std::string::npos))
     {
       regionalCalibration_->getCalibMap()->loadCalibMapFromFile(calibMapPath_.c_str(),false);
@@ -247,6 +274,7 @@ FitEpsilonPlot::FitEpsilonPlot(const edm::ParameterSet& iConfig)
       cout << "FIT_EPSILON: FitEpsilonPlot:: loading epsilon plots from file: " << epsilonPlotFileName_ << endl;
       //loadEpsilonPlot(epsilonPlotFileName_);
       loadEpsilonPlot2D(epsilonPlotFileName_);
+      if (statReplicas_ != "") loadStatReplicas();
 
       if (foldInSuperModule_ && EEoEB_ == "Barrel" && (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE")) {
 
@@ -315,6 +343,10 @@ FitEpsilonPlot::~FitEpsilonPlot()
       }
     } else {
       deleteEpsilonPlot(epsilon_EB_h, regionalCalibration_->getCalibMap()->getNRegionsEB() );
+      for (unsigned int k = 0; k < epsilon_EB_rep_h.size(); ++k) {
+	deleteEpsilonPlot(epsilon_EB_rep_h[k], regionalCalibration_->getCalibMap()->getNRegionsEB() );
+	delete [] epsilon_EB_rep_h[k];
+      }
       if (foldInSuperModule_) {
 	for (unsigned int i = 0; i < epsilon_EB_SM_hvec.size(); ++i) {
 	  delete epsilon_EB_SM_hvec[i];
@@ -338,6 +370,10 @@ FitEpsilonPlot::~FitEpsilonPlot()
       // delete EoverEtrue_g2_EE_h;
     } else {
       deleteEpsilonPlot(epsilon_EE_h, regionalCalibration_->getCalibMap()->getNRegionsEE() );
+      for (unsigned int k = 0; k < epsilon_EE_rep_h.size(); ++k) {
+	deleteEpsilonPlot(epsilon_EE_rep_h[k], regionalCalibration_->getCalibMap()->getNRegionsEE() );
+	delete [] epsilon_EE_rep_h[k];
+      }
       // delete epsilon_EE_h;
     }
 
@@ -689,10 +725,11 @@ void FitEpsilonPlot::loadEpsilonPlot2D(const std::string& filename)
 
   if( EEoEB_ == "Barrel" && (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) ){
 
-    line = "epsilon_EB_iR";
+    line = epsilonPlotPrefix_ + (iov_ < 0 ? "epsilon_EB_iR" : Form("epsilon_EB_iR_iov%d",iov_));
     TH2F* h2_tmp_epsilon = (TH2F*)inputEpsilonFile_->Get(line.c_str());
     if(!h2_tmp_epsilon)
       throw cms::Exception("loadEpsilonPlot2D") << "Cannot load histogram " << line << "\n";    
+    if(iov_ >= 0) cout << "FIT_EPSILON: fitting " << h2_tmp_epsilon->GetTitle() << endl;
 
     for(int iR=inRangeFit_; iR <= finRangeFit_ && iR < regionalCalibration_->getCalibMap()->getNRegionsEB(); iR++)
       {
@@ -714,10 +751,11 @@ void FitEpsilonPlot::loadEpsilonPlot2D(const std::string& filename)
   }
   else if( EEoEB_ == "Endcap" && (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) ){
 
-    line = Form("epsilon_EE_iR");
+    line = epsilonPlotPrefix_ + (iov_ < 0 ? "epsilon_EE_iR" : Form("epsilon_EE_iR_iov%d",iov_));
     TH2F* h2_tmp_epsilon = (TH2F*)inputEpsilonFile_->Get(line.c_str());
     if(!h2_tmp_epsilon)
       throw cms::Exception("loadEpsilonPlot2D") << "Cannot load histogram " << line << "\n";
+    if(iov_ >= 0) cout << "FIT_EPSILON: fitting " << h2_tmp_epsilon->GetTitle() << endl;
 
     for(int jR=inRangeFit_; jR <= finRangeFit_ && jR<EEDetId::kSizeForDenseIndexing; jR++)
       {
@@ -734,6 +772,36 @@ void FitEpsilonPlot::loadEpsilonPlot2D(const std::string& filename)
 
 
 
+// replicas epsilon_EB_iR_rep0, epsilon_EB_iR_rep1, ... in the same file and for the same regions as the nominal distributions
+void FitEpsilonPlot::loadStatReplicas()
+{
+  const bool isEB = EEoEB_ == "Barrel";
+  if( isEB && !(Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE") ) return;
+  if( !isEB && !(Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE") ) return;
+
+  const int nRegions = isEB ? regionalCalibration_->getCalibMap()->getNRegionsEB() : regionalCalibration_->getCalibMap()->getNRegionsEE();
+  std::vector<TH1F**>& replicas = isEB ? epsilon_EB_rep_h : epsilon_EE_rep_h;
+
+  for(int k = 0; ; ++k)
+    {
+      std::string line = epsilonPlotPrefix_ + Form(isEB ? "epsilon_EB_iR_rep%d" : "epsilon_EE_iR_rep%d", k);
+      TH2F* h2_tmp_epsilon = (TH2F*)inputEpsilonFile_->Get(line.c_str());
+      if(!h2_tmp_epsilon) break;
+
+      TH1F** h = new TH1F*[nRegions]();
+      for(int iR=inRangeFit_; iR <= finRangeFit_ && iR < nRegions; iR++)
+	{
+	  h[iR] = (TH1F*) (h2_tmp_epsilon->ProjectionX(Form("proj_%s_h%d",line.c_str(),iR),iR+1,iR+1,"e"))->Clone(Form("%s_h%d",line.c_str(),iR));
+	  h[iR]->SetDirectory(0);
+	}
+      replicas.push_back(h);
+    }
+
+  if(replicas.size() < 2)
+    throw cms::Exception("loadStatReplicas") << "Found " << replicas.size() << " statistical replicas in " << epsilonPlotFileName_ << ", need at least 2\n";
+  cout << "FIT_EPSILON: " << replicas.size() << " statistical replicas loaded (" << statReplicas_ << ")" << endl;
+}
+
 void  FitEpsilonPlot::deleteEpsilonPlot(TH1F **h, int size)
 {
     for(int jR=0; jR<size; jR++)
@@ -816,6 +884,41 @@ void FitEpsilonPlot::saveCoefficients()
   hmap_EEm->SetStats(false);
   hmap_EEm->Write();
 
+  // statistical errors from the replicas, same binning as the calib maps
+  if(statReplicas_ != "") {
+    TH2F* hstat_EB = (TH2F*)hmap_EB->Clone("statErr_EB");
+    TH2F* hstat_EEp = (TH2F*)hmap_EEp->Clone("statErr_EEp");
+    TH2F* hstat_EEm = (TH2F*)hmap_EEm->Clone("statErr_EEm");
+    hstat_EB->Reset();
+    hstat_EEp->Reset();
+    hstat_EEm->Reset();
+    hstat_EB->SetTitle(Form("EB statistical error of the coefficients (%s)",statReplicas_.c_str()));
+    hstat_EEp->SetTitle(Form("EE+ statistical error of the coefficients (%s)",statReplicas_.c_str()));
+    hstat_EEm->SetTitle(Form("EE- statistical error of the coefficients (%s)",statReplicas_.c_str()));
+    hstat_EB->SetMinimum(0.);
+    hstat_EEp->SetMinimum(0.);
+    hstat_EEm->SetMinimum(0.);
+
+    for(std::map<int,float>::const_iterator it = EBmap_statErr.begin(); it != EBmap_statErr.end(); ++it) {
+      std::vector<DetId> ids = regionalCalibration_->allDetIdsInEBRegion(it->first);
+      for(std::vector<DetId>::const_iterator iid = ids.begin(); iid != ids.end(); ++iid) {
+	EBDetId ebid(*iid);
+	hstat_EB->SetBinContent( ebid.ieta()+EBDetId::MAX_IETA+1, ebid.iphi(), it->second * regionalCalibration_->getCalibMap()->coeff(*iid) );
+      }
+    }
+    for(std::map<int,float>::const_iterator it = EEmap_statErr.begin(); it != EEmap_statErr.end(); ++it) {
+      std::vector<DetId> ids = regionalCalibration_->allDetIdsInEERegion(it->first);
+      for(std::vector<DetId>::const_iterator iid = ids.begin(); iid != ids.end(); ++iid) {
+	EEDetId eeid(*iid);
+	TH2F* hstat = eeid.positiveZ() ? hstat_EEp : hstat_EEm;
+	hstat->SetBinContent( eeid.ix(), eeid.iy(), it->second * regionalCalibration_->getCalibMap()->coeff(*iid) );
+      }
+    }
+    hstat_EB->Write();
+    hstat_EEp->Write();
+    hstat_EEm->Write();
+  }
+
   /*------------- TTREE --------------*/
 
   uint32_t   rawId;
@@ -842,6 +945,7 @@ void FitEpsilonPlot::saveCoefficients()
   float      fit_b2;    
   float      fit_b3;    
   float      fit_Bnorm; 
+  float      coeffStatErr;
   /// endcap variables
   int ix;
   int iy;
@@ -880,6 +984,7 @@ void FitEpsilonPlot::saveCoefficients()
   treeEB->Branch("fit_b2",&fit_b2,"fit_b2/F");
   treeEB->Branch("fit_b3",&fit_b3,"fit_b3/F");
   treeEB->Branch("fit_Bnorm",&fit_Bnorm,"fit_Bnorm/F");
+  if(statReplicas_ != "") treeEB->Branch("coeffStatErr",&coeffStatErr,"coeffStatErr/F");
 
   /// endcap
   treeEE->Branch("ix",&ix,"ix/I");
@@ -905,6 +1010,7 @@ void FitEpsilonPlot::saveCoefficients()
   treeEE->Branch("fit_b2",&fit_b2,"fit_b2/F");
   treeEE->Branch("fit_b3",&fit_b3,"fit_b3/F");
   treeEE->Branch("fit_Bnorm",&fit_Bnorm,"fit_Bnorm/F");
+  if(statReplicas_ != "") treeEE->Branch("coeffStatErr",&coeffStatErr,"coeffStatErr/F");
 
 
   for(int iR=0; iR < regionalCalibration_->getCalibMap()->getNRegionsEB(); ++iR)  {
@@ -934,6 +1040,7 @@ void FitEpsilonPlot::saveCoefficients()
       fit_Bnorm  = EBmap_Bnorm[ebid.hashedIndex()];
 
       regCoeff = regionalCalibration_->getCalibMap()->coeff(*iid);
+      coeffStatErr = EBmap_statErr.count(iR) ? EBmap_statErr[iR] * regCoeff : 0.;
 
       treeEB->Fill();
     } // loop over DetId in regions
@@ -967,6 +1074,7 @@ void FitEpsilonPlot::saveCoefficients()
 	  fit_b2     = EEmap_b2[eeid.hashedIndex()];
 	  fit_b3     = EEmap_b3[eeid.hashedIndex()];
 	  fit_Bnorm  = EEmap_Bnorm[eeid.hashedIndex()];
+	  coeffStatErr = EEmap_statErr.count(jR) ? EEmap_statErr[jR] * regCoeff : 0.;
 
 	  treeEE->Fill();
 	}
@@ -1613,6 +1721,13 @@ void FitEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iS
     /// compute average weight, eps, and update calib constant
     if( (EEoEB_ == "Barrel") && (Barrel_orEndcap_=="ONLY_BARREL" || Barrel_orEndcap_=="ALL_PLEASE" ) ){
 
+      // the mass fits are made in this loop or, with nFitWorkers > 1, by worker processes running ahead of it
+      int endFitEB = std::min(finRangeFit_+1, regionalCalibration_->getCalibMap()->getNRegionsEB());
+      regionFits_.assign(std::max(endFitEB-inRangeFit_, 0), RegionMassFit());
+      std::unique_ptr<EcalForkedTaskPool> fitWorkers;
+      if(nFitWorkers_ > 1 && useMassInsteadOfEpsilon_ && !isEoverEtrue_)
+	fitWorkers.reset(new EcalForkedTaskPool(inRangeFit_, endFitEB, nFitWorkers_, std::bind(&FitEpsilonPlot::sendRegionMassFit, this, std::placeholders::_1, true, std::placeholders::_2)));
+
       for(uint32_t j= (uint32_t)inRangeFit_; j <= (uint32_t)finRangeFit_ && j < (uint32_t)regionalCalibration_->getCalibMap()->getNRegionsEB(); ++j)  
 	{
 	  cout<<"FIT_EPSILON: Fitting EB Cristal--> "<<j<<endl;
@@ -1730,36 +1845,18 @@ void FitEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iS
 	      }
 	    else if(useMassInsteadOfEpsilon_)
 	      {
-
-		int crystalIndexInSM = getArrayIndexOfFoldedSMfromDenseIndex(j);
-		TH1F* histoToFit = (foldInSuperModule_ ? epsilon_EB_SM_hvec[crystalIndexInSM] : epsilon_EB_h[j]);
-
-		int iMin = histoToFit->GetXaxis()->FindFixBin(Are_pi0_? 0.08:0.4 ); 
-		int iMax = histoToFit->GetXaxis()->FindFixBin(Are_pi0_? 0.18:0.65 );
-		double integral = histoToFit->Integral(iMin, iMax);  
-
-		if(integral>60.) {
-
-		  Pi0FitResult fitres = FitMassPeakRooFit( histoToFit, 
-							   Are_pi0_? fitRange_low_pi0:fitRange_low_eta, 
-							   Are_pi0_? fitRange_high_pi0:fitRange_high_eta, 
-							   j, 1, Pi0EB, 0, isNot_2010_); //0.05-0.3
-		  RooRealVar* mean_fitresult = (RooRealVar*)(((fitres.res)->floatParsFinal()).find("mean"));
-		  mean = mean_fitresult->getVal();
-
-		  float r2 = mean/(Are_pi0_? PI0MASS:ETAMASS);
-		  r2 = r2*r2;
-		  //cout<<"EBMEAN::"<<j<<":"<<mean<<" Saved if: "<<fitres.SoB<<">(isNot_2010_ ? 0.04:0.1) "<<(fitres.chi2/fitres.dof)<<" < 0.2 "<<fabs(mean-0.15)<<" >0.0000001) "<<endl;
-		  //if( fitres.SoB>(isNot_2010_ ? 0.04:0.1) && (fitres.chi2/fitres.dof)< 0.5 && fabs(mean-0.15)>0.0000001) mean = 0.5 * ( r2 - 1. );
-		  //if( fitres.chi2 < 5 && fabs(mean-(Are_pi0_? upper_bound_pi0mass_EB:upper_bound_etamass_EB))>0.0000001) mean = 0.5 * ( r2 - 1. );
-		  if( fabs(mean-(Are_pi0_? upper_bound_pi0mass_EB:upper_bound_etamass_EB)) > 0.0000001 )
-		    mean = 0.5 * ( r2 - 1. );
-		  else 
-		    mean = 0.;
-		}
-		else{
-		  mean = 0.;
+		if(fitWorkers) {
+		  std::string bytes;
+		  fitWorkers->read(j, bytes);
+		  receiveRegionMassFit(j, bytes);
 		}
+		else fitRegionMass(j, true);
+
+		RegionMassFit& fit = regionFits_[j-inRangeFit_];
+		if(fit.fitted) saveMassPeakFit(fit.attempts, j, Pi0EB, true);
+		mean = fit.mean;
+
+		if(!epsilon_EB_rep_h.empty()) EBmap_statErr[j] = fit.statErr;
 	      }
 
 	  }
@@ -1810,6 +1907,12 @@ void FitEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iS
     /// loop over EE crystals
     if( (EEoEB_ == "Endcap") && (Barrel_orEndcap_=="ONLY_ENDCAP" || Barrel_orEndcap_=="ALL_PLEASE" ) ){
 
+      int endFitEE = std::min(finRangeFit_+1, regionalCalibration_->getCalibMap()->getNRegionsEE());
+      regionFits_.assign(std::max(endFitEE-inRangeFit_, 0), RegionMassFit());
+      std::unique_ptr<EcalForkedTaskPool> fitWorkers;
+      if(nFitWorkers_ > 1 && useMassInsteadOfEpsilon_ && !isEoverEtrue_)
+	fitWorkers.reset(new EcalForkedTaskPool(inRangeFit_, endFitEE, nFitWorkers_, std::bind(&FitEpsilonPlot::sendRegionMassFit, this, std::placeholders::_1, false, std::placeholders::_2)));
+
       for(int jR = inRangeFit_; jR <=finRangeFit_ && jR < regionalCalibration_->getCalibMap()->getNRegionsEE(); jR++)
 	{
 	  cout << "FIT_EPSILON: Fitting EE Cristal--> " << jR << endl;
@@ -1924,35 +2027,18 @@ void FitEpsilonPlot::analyze(const edm::Event& iEvent, const edm::EventSetup& iS
 	      }
 	    else if(useMassInsteadOfEpsilon_)
 	      {
-		int iMin = epsilon_EE_h[jR]->GetXaxis()->FindFixBin(Are_pi0_? 0.08:0.4 ); 
-		int iMax = epsilon_EE_h[jR]->GetXaxis()->FindFixBin(Are_pi0_? 0.18:0.65 );
-		double integral = epsilon_EE_h[jR]->Integral(iMin, iMax);  
-
-		if(integral>70.)
-		  {
-		    Pi0FitResult fitres = FitMassPeakRooFit( epsilon_EE_h[jR], 
-							     Are_pi0_? fitRange_low_pi0:fitRange_low_etaEE, 
-							     Are_pi0_? fitRange_high_pi0:fitRange_high_eta, 
-							     jR, 1, Pi0EE, 0, isNot_2010_);//0.05-0.3
-		    RooRealVar* mean_fitresult = (RooRealVar*)(((fitres.res)->floatParsFinal()).find("mean"));
-		    mean = mean_fitresult->getVal();
-		    float r2 = mean/(Are_pi0_? PI0MASS:ETAMASS);
-		    r2 = r2*r2;
-		    //cout<<"EEMEAN::"<<jR<<":"<<mean<<" Saved if: "<<fitres.SoB<<">0.3 "<<(fitres.chi2/fitres.dof)<<" < (isNot_2010_? 0.07:0.35) "<<fabs(mean-0.14)<<" >0.0000001) "<<endl;
-		    //if( (fitres.chi2/fitres.dof)<0.3 && fitres.SoB>(isNot_2010_? 0.07:0.35) && fabs(mean-0.14)>0.0000001 ) mean = 0.5 * ( r2 - 1. );
-		    //if( fitres.chi2 < 5 && fabs(mean-(Are_pi0_? upper_bound_pi0mass_EE:upper_bound_etamass_EE))>0.0000001 ) mean = 0.5 * ( r2 - 1. );
-		    // do not use Chi2 for goodness of fit. If I have many events, then the chi2 will be huge because the model will not pass through all data points
-		    // on the oter hand, if I have few events, the statistical uncertainty is large and the Chi2 tends to be little
-		    // better not to use Chi2
-		    if(fabs(mean-(Are_pi0_? upper_bound_pi0mass_EE:upper_bound_etamass_EE))>0.0000001 ) 
-		      mean = 0.5 * ( r2 - 1. );
-		    else
-		      mean = 0.;
-		  }
-		else
-		  {
-		    mean = 0.; 
-		  }
+		if(fitWorkers) {
+		  std::string bytes;
+		  fitWorkers->read(jR, bytes);
+		  receiveRegionMassFit(jR, bytes);
+		}
+		else fitRegionMass(jR, false);
+
+		RegionMassFit& fit = regionFits_[jR-inRangeFit_];
+		if(fit.fitted) saveMassPeakFit(fit.attempts, jR, Pi0EE, true);
+		mean = fit.mean;
+
+		if(!epsilon_EE_rep_h.empty()) EEmap_statErr[jR] = fit.statErr;
 	      }
 
 	  }
@@ -2017,7 +2103,10 @@ void FitEpsilonPlot::IterativeFit(TH1F* h, TF1 & ffit)
 
 //-----------------------------------------------------------------------------------
 
-Pi0FitResult FitEpsilonPlot::FitMassPeakRooFit(TH1F* h, double xlo, double xhi,  uint32_t HistoIndex, int ngaus, FitMode mode, int niter, bool isNot_2010_) 
+// mass fit of one distribution, retried with more background terms while the peak is on the upper bound
+// of the mean: every attempt is appended to attempts and the last one is returned.
+// Nothing is drawn, stored or written here (see saveMassPeakFit), so that it can run in the fit workers
+Pi0FitResult FitEpsilonPlot::fitMassPeak(TH1F* h, double xlo, double xhi,  uint32_t HistoIndex, int ngaus, FitMode mode, int niter, bool isNot_2010_, std::vector<Pi0FitResult>& attempts) 
 {
     //-----------------------------------------------------------------------------------
 
@@ -2025,15 +2114,6 @@ Pi0FitResult FitEpsilonPlot::FitMassPeakRooFit(TH1F* h, double xlo, double xhi,
     ind << (int) HistoIndex;
     TString nameHistofit = "Fit_n_" + ind.str() + Form("_attempt%d",niter);
 
-    // add canvas to save rooplot on top (will save this in the file)
-    TCanvas* canvas = new TCanvas((nameHistofit+Form("_c")).Data(),"",700,700);
-    canvas->cd();
-    canvas->SetTickx(1);
-    canvas->SetTicky(1);
-    canvas->cd();
-    canvas->SetRightMargin(0.06);
-    canvas->SetLeftMargin(0.15);
-
     Double_t upMassBoundaryEB = Are_pi0_? upper_bound_pi0mass_EB:upper_bound_etamass_EB; 
     Double_t upMassBoundaryEE = Are_pi0_? upper_bound_pi0mass_EB:upper_bound_etamass_EE; 
     Double_t upMassBoundary = (mode==Pi0EB) ? upMassBoundaryEB : upMassBoundaryEE;
@@ -2258,108 +2338,277 @@ Pi0FitResult FitEpsilonPlot::FitMassPeakRooFit(TH1F* h, double xlo, double xhi,
     pi0res.chi2 = xframe->chiSquare("model","data",pi0res.nFitParam) * pi0res.dof;
     pi0res.probchi2 = TMath::Prob(pi0res.chi2, ndof);
 
-    xframe->Draw();
+    pi0res.niter = niter;
+    pi0res.mean = mean.getVal();
+    pi0res.meanErr = mean.getError();
+    pi0res.sigma = sigma.getVal();
+    pi0res.sigmaErr = sigma.getError();
+    pi0res.Nsig = Nsig.getVal();
+    pi0res.NsigErr = Nsig.getError();
+    pi0res.normSig = normSig;
+    pi0res.normBkg = normBkg;
+    pi0res.b[0] = cb0.getVal();
+    pi0res.b[1] = cb1.getVal();
+    pi0res.b[2] = cb2.getVal();
+    pi0res.b[3] = cb3.getVal();
+    pi0res.nBkgParam = cbpars.getSize();
+    pi0res.chi2red = xframe->chiSquare();
+    pi0res.frame = xframe;
+    attempts.push_back(pi0res);
+
+    //xframe->chiSquare() is the chi2 reduced, i.e., that whose expected value is 1
+    // E[X^2]=v; Var[X^2]=2v --> fit is bad if |X^2-v|>5*sqrt(2v) 
 
-    cout << "FIT_EPSILON: Nsig: " << Nsig.getVal() 
-	 << " nsig 3sig: " << normSig*Nsig.getVal()
-	 << " nbkg 3sig: " << normBkg*Nbkg.getVal()
-	 << " S/B: " << pi0res.SoB << " +/- " << pi0res.SoBerr
-	 << " chi2: " << pi0res.chi2
-	 << " chi2 reduced: " << pi0res.chi2 / pi0res.dof
-	 << " DOF: " << pi0res.dof
-	 << " N(fit.param.): " << pi0res.nFitParam
-	 << " prob(chi2): " << pi0res.probchi2
-	 << endl;
+    //if(mode==Pi0EB && ( xframe->chiSquare()/pi0res.dof>0.35 || pi0res.SoB<0.6 || fabs(mean.getVal()-(Are_pi0_? 0.150:0.62))<0.0000001 ) ){
+    //bool badChi2 = fabs(xframe->chiSquare() - pi0res.dof) > 5.0 * sqrt(2. * pi0res.dof);
 
-    if(mode==Pi0EB){
-	  EBmap_Signal[HistoIndex]=pi0res.S;
-	  EBmap_Backgr[HistoIndex]=pi0res.B;
-	  EBmap_Chisqu[HistoIndex]=xframe->chiSquare();
-	  EBmap_ndof[HistoIndex]=ndof;
-	  EBmap_mean[HistoIndex]=mean.getVal();
-	  EBmap_mean_err[HistoIndex]=mean.getError();
-	  EBmap_sigma[HistoIndex]=sigma.getVal();
-	  EBmap_Snorm[HistoIndex]=normSig;
-	  EBmap_b0[HistoIndex]=cb0.getVal();
-	  EBmap_b1[HistoIndex]=cb1.getVal();
-	  EBmap_b2[HistoIndex]=cb2.getVal();
-	  EBmap_b3[HistoIndex]=cb3.getVal();
-	  EBmap_Bnorm[HistoIndex]=normBkg;
+    if((mode==Pi0EB || mode==Pi0EE) && niter < 3 && ( fabs(mean.getVal()-maxMassForGaussianMean)<0.0000001 ) ){
+	  return fitMassPeak( h, xlo, xhi, HistoIndex, ngaus, mode, niter+1, isNot_2010_, attempts);
     }
-    if(mode==Pi0EE){
-	  EEmap_Signal[HistoIndex]=pi0res.S;
-	  EEmap_Backgr[HistoIndex]=pi0res.B;
-	  EEmap_Chisqu[HistoIndex]=xframe->chiSquare();
-	  EEmap_ndof[HistoIndex]=ndof;
-	  EEmap_mean[HistoIndex]=mean.getVal();
-	  EEmap_mean_err[HistoIndex]=mean.getError();
-	  EEmap_sigma[HistoIndex]=sigma.getVal();
-	  EEmap_Snorm[HistoIndex]=normSig;
-	  EEmap_b0[HistoIndex]=cb0.getVal();
-	  EEmap_b1[HistoIndex]=cb1.getVal();
-	  EEmap_b2[HistoIndex]=cb2.getVal();
-	  EEmap_b3[HistoIndex]=cb3.getVal();
-	  EEmap_Bnorm[HistoIndex]=normBkg;
+
+    return pi0res;
+}
+
+
+// prints the attempts of fitMassPeak and, with storeResult, keeps the parameters of the last one for the output tree
+// and writes the plots of all of them with StoreForTest, the last attempt first (as the recursive fit did)
+void FitEpsilonPlot::saveMassPeakFit(std::vector<Pi0FitResult>& attempts, uint32_t HistoIndex, FitMode mode, bool storeResult)
+{
+    for(std::vector<Pi0FitResult>::const_iterator fitres = attempts.begin(); fitres != attempts.end(); ++fitres) {
+      cout << "FIT_EPSILON: Nsig: " << fitres->Nsig 
+	   << " nsig 3sig: " << fitres->S
+	   << " nbkg 3sig: " << fitres->B
+	   << " S/B: " << fitres->SoB << " +/- " << fitres->SoBerr
+	   << " chi2: " << fitres->chi2
+	   << " chi2 reduced: " << fitres->chi2 / fitres->dof
+	   << " DOF: " << fitres->dof
+	   << " N(fit.param.): " << fitres->nFitParam
+	   << " prob(chi2): " << fitres->probchi2
+	   << endl;
+
+      if(mode==Pi0EB && storeResult){
+	    EBmap_Signal[HistoIndex]=fitres->S;
+	    EBmap_Backgr[HistoIndex]=fitres->B;
+	    EBmap_Chisqu[HistoIndex]=fitres->chi2red;
+	    EBmap_ndof[HistoIndex]=fitres->dof;
+	    EBmap_mean[HistoIndex]=fitres->mean;
+	    EBmap_mean_err[HistoIndex]=fitres->meanErr;
+	    EBmap_sigma[HistoIndex]=fitres->sigma;
+	    EBmap_Snorm[HistoIndex]=fitres->normSig;
+	    EBmap_b0[HistoIndex]=fitres->b[0];
+	    EBmap_b1[HistoIndex]=fitres->b[1];
+	    EBmap_b2[HistoIndex]=fitres->b[2];
+	    EBmap_b3[HistoIndex]=fitres->b[3];
+	    EBmap_Bnorm[HistoIndex]=fitres->normBkg;
+      }
+      if(mode==Pi0EE && storeResult){
+	    EEmap_Signal[HistoIndex]=fitres->S;
+	    EEmap_Backgr[HistoIndex]=fitres->B;
+	    EEmap_Chisqu[HistoIndex]=fitres->chi2red;
+	    EEmap_ndof[HistoIndex]=fitres->dof;
+	    EEmap_mean[HistoIndex]=fitres->mean;
+	    EEmap_mean_err[HistoIndex]=fitres->meanErr;
+	    EEmap_sigma[HistoIndex]=fitres->sigma;
+	    EEmap_Snorm[HistoIndex]=fitres->normSig;
+	    EEmap_b0[HistoIndex]=fitres->b[0];
+	    EEmap_b1[HistoIndex]=fitres->b[1];
+	    EEmap_b2[HistoIndex]=fitres->b[2];
+	    EEmap_b3[HistoIndex]=fitres->b[3];
+	    EEmap_Bnorm[HistoIndex]=fitres->normBkg;
+      }
     }
 
-    TLatex lat;
-    std::string line = "";
-    lat.SetNDC();
-    lat.SetTextSize(0.040);
-    lat.SetTextColor(1);
+    // save all the attempts, the last one first
+    if(StoreForTest_ && storeResult){
+      for(std::vector<Pi0FitResult>::const_reverse_iterator fitres = attempts.rbegin(); fitres != attempts.rend(); ++fitres) {
 
-    float xmin(0.2), yhi(0.80), ypass(0.05);
-    if(mode==EtaEB) yhi=0.30;
-    if(mode==Pi0EE) yhi=0.5;
-    line = Form("Yield: %.0f #pm %.0f", Nsig.getVal(), Nsig.getError() );
-    lat.DrawLatex(xmin,yhi, line.c_str());
+        // add canvas to save rooplot on top (will save this in the file)
+        TCanvas* canvas = new TCanvas(Form("Fit_n_%d_attempt%d_c", (int) HistoIndex, fitres->niter),"",700,700);
+        canvas->cd();
+        canvas->SetTickx(1);
+        canvas->SetTicky(1);
+        canvas->cd();
+        canvas->SetRightMargin(0.06);
+        canvas->SetLeftMargin(0.15);
 
-    line = Form("m_{#gamma#gamma}: %.2f #pm %.2f", mean.getVal()*1000., mean.getError()*1000. );
-    lat.DrawLatex(xmin,yhi-ypass, line.c_str());
+        fitres->frame->Draw();
 
-    line = Form("#sigma: %.2f #pm %.2f (%.2f%s)", sigma.getVal()*1000., sigma.getError()*1000., sigma.getVal()*100./mean.getVal(), "%" );
-    lat.DrawLatex(xmin,yhi-2.*ypass, line.c_str());
+        TLatex lat;
+        std::string line = "";
+        lat.SetNDC();
+        lat.SetTextSize(0.040);
+        lat.SetTextColor(1);
 
-    //sprintf(line,"S/B(3#sigma): %.2f #pm %.2f", pi0res.SoB, pi0res.SoBerr );
-    line = Form("S/B(3#sigma): %.2f", pi0res.SoB );
-    lat.DrawLatex(xmin,yhi-3.*ypass, line.c_str());
+        float xmin(0.2), yhi(0.80), ypass(0.05);
+        if(mode==EtaEB) yhi=0.30;
+        if(mode==Pi0EE) yhi=0.5;
+        line = Form("Yield: %.0f #pm %.0f", fitres->Nsig, fitres->NsigErr );
+        lat.DrawLatex(xmin,yhi, line.c_str());
 
-    line = Form("#Chi^{2}: %.2f (%d dof)", pi0res.chi2, pi0res.dof );
-    lat.DrawLatex(xmin,yhi-4.*ypass, line.c_str());
+        line = Form("m_{#gamma#gamma}: %.2f #pm %.2f", fitres->mean*1000., fitres->meanErr*1000. );
+        lat.DrawLatex(xmin,yhi-ypass, line.c_str());
 
-    line = Form("B param. %d", cbpars.getSize() );
-    lat.DrawLatex(xmin,yhi-5.*ypass, line.c_str());
+        line = Form("#sigma: %.2f #pm %.2f (%.2f%s)", fitres->sigma*1000., fitres->sigmaErr*1000., fitres->sigma*100./fitres->mean, "%" );
+        lat.DrawLatex(xmin,yhi-2.*ypass, line.c_str());
 
-    canvas->RedrawAxis("sameaxis");
+        //sprintf(line,"S/B(3#sigma): %.2f #pm %.2f", fitres->SoB, fitres->SoBerr );
+        line = Form("S/B(3#sigma): %.2f", fitres->SoB );
+        lat.DrawLatex(xmin,yhi-3.*ypass, line.c_str());
 
-    Pi0FitResult fitres = pi0res;
-    //xframe->chiSquare() is the chi2 reduced, i.e., that whose expected value is 1
-    // E[X^2]=v; Var[X^2]=2v --> fit is bad if |X^2-v|>5*sqrt(2v) 
+        line = Form("#Chi^{2}: %.2f (%d dof)", fitres->chi2, fitres->dof );
+        lat.DrawLatex(xmin,yhi-4.*ypass, line.c_str());
 
-    //if(mode==Pi0EB && ( xframe->chiSquare()/pi0res.dof>0.35 || pi0res.SoB<0.6 || fabs(mean.getVal()-(Are_pi0_? 0.150:0.62))<0.0000001 ) ){
-    //bool badChi2 = fabs(xframe->chiSquare() - pi0res.dof) > 5.0 * sqrt(2. * pi0res.dof);
+        line = Form("B param. %d", fitres->nBkgParam );
+        lat.DrawLatex(xmin,yhi-5.*ypass, line.c_str());
 
-    if(mode==Pi0EB && ( fabs(mean.getVal()-maxMassForGaussianMean)<0.0000001 ) ){
-	  if(niter==0) fitres = FitMassPeakRooFit( h, xlo, xhi, HistoIndex, ngaus, mode, 1, isNot_2010_);
-	  if(niter==1) fitres = FitMassPeakRooFit( h, xlo, xhi, HistoIndex, ngaus, mode, 2, isNot_2010_);
-	  if(niter==2) fitres = FitMassPeakRooFit( h, xlo, xhi, HistoIndex, ngaus, mode, 3, isNot_2010_);
+        canvas->RedrawAxis("sameaxis");
+
+        outfileTEST_->cd();
+        fitres->frame->Write();
+        canvas->Write();
+        delete canvas;
+      }
     }
-    if(mode==Pi0EE && ( fabs(mean.getVal()-maxMassForGaussianMean)<0.0000001 ) ){
-	  if(niter==0) fitres = FitMassPeakRooFit( h, xlo, xhi, HistoIndex, ngaus, mode, 1, isNot_2010_);
-	  if(niter==1) fitres = FitMassPeakRooFit( h, xlo, xhi, HistoIndex, ngaus, mode, 2, isNot_2010_);
-	  if(niter==2) fitres = FitMassPeakRooFit( h, xlo, xhi, HistoIndex, ngaus, mode, 3, isNot_2010_);
+
+    for(std::vector<Pi0FitResult>::iterator fitres = attempts.begin(); fitres != attempts.end(); ++fitres) {
+      delete fitres->frame;
+      fitres->frame = 0;
     }
+}
 
-    // save last version of fit made
-    // if(StoreForTest_ && niter==0){
-    if(StoreForTest_){
-      outfileTEST_->cd();
-      xframe->Write();
-      canvas->Write();
+
+Pi0FitResult FitEpsilonPlot::FitMassPeakRooFit(TH1F* h, double xlo, double xhi,  uint32_t HistoIndex, int ngaus, FitMode mode, int niter, bool isNot_2010_, bool storeResult) 
+{
+    std::vector<Pi0FitResult> attempts;
+    fitMassPeak( h, xlo, xhi, HistoIndex, ngaus, mode, niter, isNot_2010_, attempts);
+    saveMassPeakFit(attempts, HistoIndex, mode, storeResult);
+    return attempts.back();
+}
+
+
+// mass fit of region iR into regionFits_[iR-inRangeFit_]: epsilon if the peak is not on the upper bound,
+// and the statistical error from the replicas
+void FitEpsilonPlot::fitRegionMass(int iR, bool isEB)
+{
+    RegionMassFit& fit = regionFits_[iR-inRangeFit_];
+    fit.fitted = false;
+    fit.attempts.clear();
+    fit.mean = 0.;
+    fit.statErr = 0.;
+    FitMode mode = isEB ? Pi0EB : Pi0EE;
+
+    TH1F* histoToFit = epsilon_EE_h[iR];
+    if(isEB) histoToFit = foldInSuperModule_ ? epsilon_EB_SM_hvec[getArrayIndexOfFoldedSMfromDenseIndex(iR)] : epsilon_EB_h[iR];
+
+    int iMin = histoToFit->GetXaxis()->FindFixBin(Are_pi0_? 0.08:0.4 ); 
+    int iMax = histoToFit->GetXaxis()->FindFixBin(Are_pi0_? 0.18:0.65 );
+    double integral = histoToFit->Integral(iMin, iMax);  
+
+    if(integral > (isEB ? 60. : 70.)) {
+
+      Pi0FitResult fitres = fitMassPeak( histoToFit, 
+				Are_pi0_? fitRange_low_pi0 : (isEB ? fitRange_low_eta : fitRange_low_etaEE), 
+				Are_pi0_? fitRange_high_pi0:fitRange_high_eta, 
+				iR, 1, mode, 0, isNot_2010_, fit.attempts); //0.05-0.3
+      fit.fitted = true;
+      float mean = fitres.mean;
+      float r2 = mean/(Are_pi0_? PI0MASS:ETAMASS);
+      r2 = r2*r2;
+      // do not use Chi2 for goodness of fit. If I have many events, then the chi2 will be huge because the model will not pass through all data points
+      // on the oter hand, if I have few events, the statistical uncertainty is large and the Chi2 tends to be little
+      // better not to use Chi2
+      float upperBound = isEB ? (Are_pi0_? upper_bound_pi0mass_EB:upper_bound_etamass_EB) : (Are_pi0_? upper_bound_pi0mass_EE:upper_bound_etamass_EE);
+      if( fabs(mean-upperBound) > 0.0000001 )
+	fit.mean = 0.5 * ( r2 - 1. );
+    }
+
+    std::vector<TH1F**>& replicas = isEB ? epsilon_EB_rep_h : epsilon_EE_rep_h;
+    if(!replicas.empty()) fit.statErr = replicaStatError(replicas, iR, mode);
+}
+
+// task of a fit worker: the result of fitRegionMass for analyze, with the plots of the attempts if they are stored
+void FitEpsilonPlot::sendRegionMassFit(int iR, bool isEB, std::string& bytes)
+{
+    fitRegionMass(iR, isEB);
+    RegionMassFit& fit = regionFits_[iR-inRangeFit_];
+
+    TBufferFile buffer(TBuffer::kWrite);
+    buffer << fit.fitted << fit.mean << fit.statErr;
+    buffer << (int) fit.attempts.size();
+    for(std::vector<Pi0FitResult>::iterator r = fit.attempts.begin(); r != fit.attempts.end(); ++r) {
+      buffer << r->niter << r->mean << r->meanErr << r->sigma << r->sigmaErr << r->Nsig << r->NsigErr << r->normSig << r->normBkg;
+      buffer.WriteFastArray(r->b, 4);
+      buffer << r->nBkgParam << r->chi2red << r->S << r->Serr << r->B << r->Berr << r->SoB << r->SoBerr << r->chi2 << r->dof << r->nFitParam << r->probchi2;
+      buffer.WriteObject(StoreForTest_ ? (TObject*) r->frame : (TObject*) 0);
+      delete r->frame;
+      r->frame = 0;
+    }
+    bytes.assign(buffer.Buffer(), buffer.Length());
+}
+
+void FitEpsilonPlot::receiveRegionMassFit(int iR, const std::string& bytes)
+{
+    RegionMassFit& fit = regionFits_[iR-inRangeFit_];
+
+    TBufferFile buffer(TBuffer::kRead, bytes.size(), const_cast<char*>(bytes.data()), kFALSE);
+    buffer >> fit.fitted >> fit.mean >> fit.statErr;
+    int nAttempts = 0;
+    buffer >> nAttempts;
+    fit.attempts.resize(nAttempts);
+    for(std::vector<Pi0FitResult>::iterator r = fit.attempts.begin(); r != fit.attempts.end(); ++r) {
+      r->res = 0;  // stays in the worker
+      buffer >> r->niter >> r->mean >> r->meanErr >> r->sigma >> r->sigmaErr >> r->Nsig >> r->NsigErr >> r->normSig >> r->normBkg;
+      buffer.ReadFastArray(r->b, 4);
+      buffer >> r->nBkgParam >> r->chi2red >> r->S >> r->Serr >> r->B >> r->Berr >> r->SoB >> r->SoBerr >> r->chi2 >> r->dof >> r->nFitParam >> r->probchi2;
+      r->frame = (RooPlot*) buffer.ReadObject(RooPlot::Class());
+    }
+}
+
+// epsilon of a replica with the selection of the nominal fit, false if it was not fitted or the peak ended on the upper bound
+bool FitEpsilonPlot::fitReplicaEpsilon(TH1F* h, uint32_t HistoIndex, FitMode mode, float& epsilon)
+{
+    int iMin = h->GetXaxis()->FindFixBin(Are_pi0_? 0.08:0.4 ); 
+    int iMax = h->GetXaxis()->FindFixBin(Are_pi0_? 0.18:0.65 );
+    if(h->Integral(iMin, iMax) <= (mode==Pi0EB ? 60. : 70.)) return false;
+
+    double xlo = Are_pi0_? fitRange_low_pi0 : (mode==Pi0EB ? fitRange_low_eta : fitRange_low_etaEE);
+    double xhi = Are_pi0_? fitRange_high_pi0 : fitRange_high_eta;
+    Pi0FitResult fitres = FitMassPeakRooFit( h, xlo, xhi, HistoIndex, 1, mode, 0, isNot_2010_, false);
+    float mean = ((RooRealVar*)(((fitres.res)->floatParsFinal()).find("mean")))->getVal();
+
+    float upperBound = (mode==Pi0EB) ? (Are_pi0_? upper_bound_pi0mass_EB:upper_bound_etamass_EB) : (Are_pi0_? upper_bound_pi0mass_EE:upper_bound_etamass_EE);
+    if(fabs(mean-upperBound) <= 0.0000001) return false;
+
+    float r2 = mean/(Are_pi0_? PI0MASS:ETAMASS);
+    r2 = r2*r2;
+    epsilon = 0.5 * ( r2 - 1. );
+    return true;
+}
+
+// relative statistical error of the coefficient update 1/(1+epsilon) from the replicas of region HistoIndex:
+// half the even-odd difference, or the RMS of the bootstrap replicas; 0 if too few replicas could be fitted
+float FitEpsilonPlot::replicaStatError(std::vector<TH1F**>& replicas, uint32_t HistoIndex, FitMode mode)
+{
+    std::vector<float> factors;
+    for(unsigned int k = 0; k < replicas.size(); ++k) {
+      float epsilon = 0.;
+      if(fitReplicaEpsilon(replicas[k][HistoIndex], HistoIndex, mode, epsilon)) factors.push_back(1./(1.+epsilon));
     }
 
-    delete canvas;
-    return fitres;
+    if(statReplicas_ == "evenOdd") {
+      if(factors.size() < 2) return 0.;
+      return fabs(factors[0]-factors[1]) / (factors[0]+factors[1]);
+    }
+
+    if(factors.size() < 2) return 0.;
+    double sum = 0., sum2 = 0.;
+    for(unsigned int k = 0; k < factors.size(); ++k) {
+      sum += factors[k];
+      sum2 += factors[k]*factors[k];
+    }
+    double average = sum/factors.size();
+    double variance = sum2/factors.size() - average*average;
+    return variance > 0. ? sqrt(variance)/average : 0.;
 }
 
 
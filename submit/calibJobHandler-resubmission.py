@@ -305,6 +305,7 @@ for iters in range(Iter_toResub, nIterations):
        Double_t fit_b2_;\
        Double_t fit_b3_;\
        Double_t fit_Bnorm_;\
+       Float_t coeffStatErr_;\
      };")
    gROOT.ProcessLine(\
      "struct EEStruct{\
@@ -330,6 +331,7 @@ for iters in range(Iter_toResub, nIterations):
        Double_t fit_b2_;\
        Double_t fit_b3_;\
        Double_t fit_Bnorm_;\
+       Float_t coeffStatErr_;\
      };")
    s = EBStruct()
    t = EEStruct()
@@ -359,6 +361,7 @@ for iters in range(Iter_toResub, nIterations):
        Double_t fit_b2;\
        Double_t fit_b3;\
        Double_t fit_Bnorm;\
+       Float_t coeffStatErr;\
      };")
    gROOT.ProcessLine(\
      "struct EE1Struct{\
@@ -384,6 +387,7 @@ for iters in range(Iter_toResub, nIterations):
        Double_t fit_b2;\
        Double_t fit_b3;\
        Double_t fit_Bnorm;\
+       Float_t coeffStatErr;\
      };")
    s1 = EB1Struct()
    t1 = EE1Struct()
@@ -392,6 +396,13 @@ for iters in range(Iter_toResub, nIterations):
    calibMap_EEm = TH2F("calibMap_EEm", "EE- calib coefficients", 100,0.5,100.5,100,0.5,100.5)
    calibMap_EEp = TH2F("calibMap_EEp", "EE+ calib coefficients", 100,0.5,100.5,100,0.5,100.5)
    TreeEB = TTree("calibEB", "Tree of EB Inter-calibration constants")
+   # statistical errors of the ICs, saved by the fit of the last iteration with statReplicas
+   withStatErr = statReplicas != '' and iters == nIterations-1
+   if withStatErr:
+       statErr_EB = TH2F("statErr_EB", "EB IC statistical errors: #eta on x, #phi on y", 171,-85.5,85.5 , 360,0.5,360.5)
+       statErr_EEm = TH2F("statErr_EEm", "EE- IC statistical errors", 100,0.5,100.5,100,0.5,100.5)
+       statErr_EEp = TH2F("statErr_EEp", "EE+ IC statistical errors", 100,0.5,100.5,100,0.5,100.5)
+
    TreeEB.Branch('rawId_'      , AddressOf(s,'rawId_'),'rawId_/I')
    TreeEB.Branch('hashedIndex_', AddressOf(s,'hashedIndex_'),'hashedIndex_/I')
    TreeEB.Branch('ieta_'       , AddressOf(s,'ieta_'),'ieta_/I')
@@ -409,6 +420,8 @@ for iters in range(Iter_toResub, nIterations):
    TreeEB.Branch('Ndof_'       , AddressOf(s,'Ndof_'),'Ndof_/F')
    TreeEB.Branch('fit_mean_'   , AddressOf(s,'fit_mean_'),'fit_mean_/F')
    TreeEB.Branch('fit_sigma_'  , AddressOf(s,'fit_sigma_'),'fit_sigma_/F')
+   if withStatErr:
+       TreeEB.Branch('coeffStatErr_', AddressOf(s,'coeffStatErr_'),'coeffStatErr_/F')
    TreeEB.Branch('fit_Snorm_'  , AddressOf(s,'fit_Snorm_'),'fit_Snorm_/F')
    TreeEB.Branch('fit_b0_'     , AddressOf(s,'fit_b0_'),'fit_b0_/F')
    TreeEB.Branch('fit_b1_'     , AddressOf(s,'fit_b1_'),'fit_b1_/F')
@@ -433,6 +446,8 @@ for iters in range(Iter_toResub, nIterations):
    TreeEE.Branch('Ndof_'       , AddressOf(t,'Ndof_'),'Ndof_/F')
    TreeEE.Branch('fit_mean_'   , AddressOf(t,'fit_mean_'),'fit_mean_/F')
    TreeEE.Branch('fit_sigma_'  , AddressOf(t,'fit_sigma_'),'fit_sigma_/F')
+   if withStatErr:
+       TreeEE.Branch('coeffStatErr_', AddressOf(t,'coeffStatErr_'),'coeffStatErr_/F')
    TreeEE.Branch('fit_Snorm_'  , AddressOf(t,'fit_Snorm_'),'fit_Snorm_/F')
    TreeEE.Branch('fit_b0_'     , AddressOf(t,'fit_b0_'),'fit_b0_/F')
    TreeEE.Branch('fit_b1_'     , AddressOf(t,'fit_b1_'),'fit_b1_/F')
@@ -470,6 +485,9 @@ for iters in range(Iter_toResub, nIterations):
           thisTree.SetBranchAddress( 'Ndof',AddressOf(s1,'Ndof'));
           thisTree.SetBranchAddress( 'fit_mean',AddressOf(s1,'fit_mean'));
           thisTree.SetBranchAddress( 'fit_sigma',AddressOf(s1,'fit_sigma'));
+          hasStatErr = withStatErr and bool(thisTree.GetBranch('coeffStatErr'))
+          if hasStatErr:
+              thisTree.SetBranchAddress( 'coeffStatErr',AddressOf(s1,'coeffStatErr'));
           thisTree.SetBranchAddress( 'fit_Snorm',AddressOf(s1,'fit_Snorm'));
           thisTree.SetBranchAddress( 'fit_b0',AddressOf(s1,'fit_b0'));
           thisTree.SetBranchAddress( 'fit_b1',AddressOf(s1,'fit_b1'));
@@ -496,6 +514,7 @@ for iters in range(Iter_toResub, nIterations):
                   s.Ndof_ = s1.Ndof
                   s.fit_mean_ = s1.fit_mean
                   s.fit_sigma_ = s1.fit_sigma
+                  s.coeffStatErr_ = s1.coeffStatErr if hasStatErr else 0.
                   s.fit_Snorm_ = s1.fit_Snorm
                   s.fit_b0_ = s1.fit_b0
                   s.fit_b1_ = s1.fit_b1
@@ -521,6 +540,9 @@ for iters in range(Iter_toResub, nIterations):
           thisTree.SetBranchAddress( 'Ndof',AddressOf(t1,'Ndof'));
           thisTree.SetBranchAddress( 'fit_mean',AddressOf(t1,'fit_mean'));
           thisTree.SetBranchAddress( 'fit_sigma',AddressOf(t1,'fit_sigma'));
+          hasStatErr = withStatErr and bool(thisTree.GetBranch('coeffStatErr'))
+          if hasStatErr:
+              thisTree.SetBranchAddress( 'coeffStatErr',AddressOf(t1,'coeffStatErr'));
           thisTree.SetBranchAddress( 'fit_Snorm',AddressOf(t1,'fit_Snorm'));
           thisTree.SetBranchAddress( 'fit_b0',AddressOf(t1,'fit_b0'));
           thisTree.SetBranchAddress( 'fit_b1',AddressOf(t1,'fit_b1'));
@@ -546,6 +568,7 @@ for iters in range(Iter_toResub, nIterations):
                   t.Ndof_ = t1.Ndof
                   t.fit_mean_ = t1.fit_mean
                   t.fit_sigma_ = t1.fit_sigma
+                  t.coeffStatErr_ = t1.coeffStatErr if hasStatErr else 0.
                   t.fit_Snorm_ = t1.fit_Snorm
                   t.fit_b0_ = t1.fit_b0
                   t.fit_b1_ = t1.fit_b1
@@ -557,6 +580,10 @@ for iters in range(Iter_toResub, nIterations):
        thisHistoEB = thisfile_f.Get("calibMap_EB")
        thisHistoEEm = thisfile_f.Get("calibMap_EEm")
        thisHistoEEp = thisfile_f.Get("calibMap_EEp")
+       if withStatErr:
+           thisStatErrEB = thisfile_f.Get("statErr_EB")
+           thisStatErrEEm = thisfile_f.Get("statErr_EEm")
+           thisStatErrEEp = thisfile_f.Get("statErr_EEp")
        if EEoEB == 0:
           MaxEta = 85
           Init = int(init)
@@ -568,6 +595,8 @@ for iters in range(Iter_toResub, nIterations):
                  bin_y = myRechit.iphi()
                  value = thisHistoEB.GetBinContent(bin_x,bin_y)
                  calibMap_EB.SetBinContent(bin_x,bin_y,value)
+                 if withStatErr and thisStatErrEB:
+                     statErr_EB.SetBinContent(bin_x,bin_y,thisStatErrEB.GetBinContent(bin_x,bin_y))
        else :
           Init1 = int(init)
           Fin1 = int(finit+1)
@@ -577,9 +606,13 @@ for iters in range(Iter_toResub, nIterations):
                  if myRechitE.zside() < 0 :
                     value = thisHistoEEm.GetBinContent(myRechitE.ix(),myRechitE.iy())
                     calibMap_EEm.SetBinContent(myRechitE.ix(),myRechitE.iy(),value)
+                    if withStatErr and thisStatErrEEm:
+                        statErr_EEm.SetBinContent(myRechitE.ix(),myRechitE.iy(),thisStatErrEEm.GetBinContent(myRechitE.ix(),myRechitE.iy()))
                  if myRechitE.zside() > 0 :
                     value = thisHistoEEp.GetBinContent(myRechitE.ix(),myRechitE.iy())
                     calibMap_EEp.SetBinContent(myRechitE.ix(),myRechitE.iy(),value)
+                    if withStatErr and thisStatErrEEp:
+                        statErr_EEp.SetBinContent(myRechitE.ix(),myRechitE.iy(),thisStatErrEEp.GetBinContent(myRechitE.ix(),myRechitE.iy()))
 
        thisfile_f.Close()
    f.cd()
@@ -406,6 +406,15 @@ If this is not the case, modify FillEpsilonPlot.cc
             output = submitJobs.communicate()
             print output
 
+    # fits of the eta and extraCalibTypes distributions, their maps are not merged
+    if (not ONLYMERGEFIT ):
+        for job in extraFitJobs():
+            submit_s = "bsub -q " + queue + " -o /dev/null -e /dev/null " + extraFitSrcName(srcPath, job[0], iters)
+            print submit_s
+            submitJobs = subprocess.Popen([submit_s], stdout=subprocess.PIPE, shell=True);
+            output = submitJobs.communicate()
+            print output
+
     if (not ONLYMERGEFIT ):
 
         # checking number of running/pending jobs
@@ -499,6 +508,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2_;\
                    Double_t fit_b3_;\
                    Double_t fit_Bnorm_;\
+                   Float_t coeffStatErr_;\
                  };")
                gROOT.ProcessLine(\
                  "struct EB1Struct{\
@@ -526,6 +536,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2;\
                    Double_t fit_b3;\
                    Double_t fit_Bnorm;\
+                   Float_t coeffStatErr;\
                  };")
 
             if(Barrel_or_Endcap=='ONLY_ENDCAP' or Barrel_or_Endcap=='ALL_PLEASE'):
@@ -554,6 +565,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2_;\
                    Double_t fit_b3_;\
                    Double_t fit_Bnorm_;\
+                   Float_t coeffStatErr_;\
                  };")
                gROOT.ProcessLine(\
                  "struct EE1Struct{\
@@ -580,6 +592,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2;\
                    Double_t fit_b3;\
                    Double_t fit_Bnorm;\
+                   Float_t coeffStatErr;\
                  };")
                
         if(Barrel_or_Endcap=='ONLY_BARREL' or Barrel_or_Endcap=='ALL_PLEASE'):
@@ -608,6 +621,14 @@ If this is not the case, modify FillEpsilonPlot.cc
             TreeEB = TTree("calibEB", "Tree of EB Inter-calibration constants")
             TreeEE = TTree("calibEE", "Tree of EE Inter-calibration constants")
 
+        # statistical errors of the ICs, saved by the fit of the last iteration with statReplicas
+        withStatErr = statReplicas != '' and iters == nIterations-1
+        withStatErrMaps = withStatErr and not (isEoverEtrue and n_repeat == 1)
+        if withStatErrMaps:
+            statErr_EB = TH2F("statErr_EB", "EB IC statistical errors: #eta on x, #phi on y", 171,-85.5,85.5 , 360,0.5,360.5)
+            statErr_EEm = TH2F("statErr_EEm", "EE- IC statistical errors", 100,0.5,100.5,100,0.5,100.5)
+            statErr_EEp = TH2F("statErr_EEp", "EE+ IC statistical errors", 100,0.5,100.5,100,0.5,100.5)
+
         if(Barrel_or_Endcap=='ONLY_BARREL' or Barrel_or_Endcap=='ALL_PLEASE'):
            TreeEB.Branch('rawId_'      , AddressOf(s,'rawId_'),'rawId_/I')
            TreeEB.Branch('hashedIndex_', AddressOf(s,'hashedIndex_'),'hashedIndex_/I')
@@ -625,6 +646,8 @@ If this is not the case, modify FillEpsilonPlot.cc
            TreeEB.Branch('fit_mean_'   , AddressOf(s,'fit_mean_'),'fit_mean_/F')
            TreeEB.Branch('fit_mean_err_'   , AddressOf(s,'fit_mean_err_'),'fit_mean_err_/F')
            TreeEB.Branch('fit_sigma_'  , AddressOf(s,'fit_sigma_'),'fit_sigma_/F')
+           if withStatErr:
+               TreeEB.Branch('coeffStatErr_', AddressOf(s,'coeffStatErr_'),'coeffStatErr_/F')
            if not isEoverEtrue:
                TreeEB.Branch('Signal_'     , AddressOf(s,'Signal_'),'Signal_/F')
                TreeEB.Branch('Backgr_'     , AddressOf(s,'Backgr_'),'Backgr_/F')
@@ -652,6 +675,8 @@ If this is not the case, modify FillEpsilonPlot.cc
            TreeEE.Branch('fit_mean_'   , AddressOf(t,'fit_mean_'),'fit_mean_/F')
            TreeEE.Branch('fit_mean_err_'   , AddressOf(t,'fit_mean_err_'),'fit_mean_err_/F')
            TreeEE.Branch('fit_sigma_'  , AddressOf(t,'fit_sigma_'),'fit_sigma_/F')
+           if withStatErr:
+               TreeEE.Branch('coeffStatErr_', AddressOf(t,'coeffStatErr_'),'coeffStatErr_/F')
            if not isEoverEtrue:
                TreeEE.Branch('Signal_'     , AddressOf(t,'Signal_'),'Signal_/F')
                TreeEE.Branch('Backgr_'     , AddressOf(t,'Backgr_'),'Backgr_/F')
@@ -703,6 +728,9 @@ If this is not the case, modify FillEpsilonPlot.cc
                thisTree.SetBranchAddress( 'fit_mean',AddressOf(s1,'fit_mean'));
                thisTree.SetBranchAddress( 'fit_mean_err',AddressOf(s1,'fit_mean_err'));
                thisTree.SetBranchAddress( 'fit_sigma',AddressOf(s1,'fit_sigma'));
+               hasStatErr = withStatErr and bool(thisTree.GetBranch('coeffStatErr'))
+               if hasStatErr:
+                   thisTree.SetBranchAddress( 'coeffStatErr',AddressOf(s1,'coeffStatErr'));
                if not isEoverEtrue:
                    thisTree.SetBranchAddress( 'Signal',AddressOf(s1,'Signal'));
                    thisTree.SetBranchAddress( 'Backgr',AddressOf(s1,'Backgr'));
@@ -731,6 +759,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                        s.fit_mean_ = s1.fit_mean
                        s.fit_mean_err_ = s1.fit_mean_err
                        s.fit_sigma_ = s1.fit_sigma
+                       s.coeffStatErr_ = s1.coeffStatErr if hasStatErr else 0.
                        if not isEoverEtrue:
                            s.Signal_ = s1.Signal
                            s.Backgr_ = s1.Backgr
@@ -761,6 +790,9 @@ If this is not the case, modify FillEpsilonPlot.cc
                thisTree.SetBranchAddress( 'fit_mean',AddressOf(t1,'fit_mean'));
                thisTree.SetBranchAddress( 'fit_mean_err',AddressOf(t1,'fit_mean_err'));
                thisTree.SetBranchAddress( 'fit_sigma',AddressOf(t1,'fit_sigma'));
+               hasStatErr = withStatErr and bool(thisTree.GetBranch('coeffStatErr'))
+               if hasStatErr:
+                   thisTree.SetBranchAddress( 'coeffStatErr',AddressOf(t1,'coeffStatErr'));
                if not isEoverEtrue:
                    thisTree.SetBranchAddress( 'Signal',AddressOf(t1,'Signal'));
                    thisTree.SetBranchAddress( 'Backgr',AddressOf(t1,'Backgr'));
@@ -788,6 +820,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                        t.fit_mean_ = t1.fit_mean
                        t.fit_mean_err_ = t1.fit_mean_err
                        t.fit_sigma_ = t1.fit_sigma
+                       t.coeffStatErr_ = t1.coeffStatErr if hasStatErr else 0.
                        if not isEoverEtrue:
                            t.Signal_ = t1.Signal
                            t.Backgr_ = t1.Backgr
@@ -807,6 +840,10 @@ If this is not the case, modify FillEpsilonPlot.cc
                 thisHistoEB = thisfile_f.Get("calibMap_EB")
                 thisHistoEEm = thisfile_f.Get("calibMap_EEm")
                 thisHistoEEp = thisfile_f.Get("calibMap_EEp")
+            if withStatErrMaps:
+                thisStatErrEB = thisfile_f.Get("statErr_EB")
+                thisStatErrEEm = thisfile_f.Get("statErr_EEm")
+                thisStatErrEEp = thisfile_f.Get("statErr_EEp")
             if EEoEB == 0:
                MaxEta = 85
                Init = int(init)
@@ -818,6 +855,8 @@ If this is not the case, modify FillEpsilonPlot.cc
                       bin_y = myRechit.iphi()
                       value = thisHistoEB.GetBinContent(bin_x,bin_y)
                       calibMap_EB.SetBinContent(bin_x,bin_y,value)
+                      if withStatErrMaps and thisStatErrEB:
+                          statErr_EB.SetBinContent(bin_x,bin_y,thisStatErrEB.GetBinContent(bin_x,bin_y))
             else :
                Init1 = int(init)
                Fin1 = int(finit+1)
@@ -827,9 +866,13 @@ If this is not the case, modify FillEpsilonPlot.cc
                       if myRechitE.zside() < 0 :
                          value = thisHistoEEm.GetBinContent(myRechitE.ix(),myRechitE.iy())
                          calibMap_EEm.SetBinContent(myRechitE.ix(),myRechitE.iy(),value)
+                         if withStatErrMaps and thisStatErrEEm:
+                             statErr_EEm.SetBinContent(myRechitE.ix(),myRechitE.iy(),thisStatErrEEm.GetBinContent(myRechitE.ix(),myRechitE.iy()))
                       if myRechitE.zside() > 0 :
                          value = thisHistoEEp.GetBinContent(myRechitE.ix(),myRechitE.iy())
                          calibMap_EEp.SetBinContent(myRechitE.ix(),myRechitE.iy(),value)
+                         if withStatErrMaps and thisStatErrEEp:
+                             statErr_EEp.SetBinContent(myRechitE.ix(),myRechitE.iy(),thisStatErrEEp.GetBinContent(myRechitE.ix(),myRechitE.iy()))
 
             thisfile_f.Close()
 
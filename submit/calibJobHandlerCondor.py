@@ -51,7 +51,7 @@ def checkNjobsCondor(grepArg="ecalpro"):
 
 
 # helper function to save some lines, the file is not opened not closed here, this must be handled outside
-def writeCondorSubmitBase(condor_file="", dummy_exec_name="", logdir="", jobBatchName="undefined", memory=2000, maxtime=86400):    
+def writeCondorSubmitBase(condor_file="", dummy_exec_name="", logdir="", jobBatchName="undefined", memory=2000, maxtime=86400, cpus=1):    
     condor_file.write('''Universe = vanilla
 Executable = {de}
 use_x509userproxy = True
@@ -61,10 +61,11 @@ Error      = {ld}/$(ProcId).error
 getenv      = True
 environment = "LS_SUBCWD={here}"
 request_memory = {mem}
+request_cpus = {cpus}
 periodic_remove = (JobStatus == 2) && (time() - EnteredCurrentStatus) > (48 * 3600) # remove jobs running for more than 48 hours
 +MaxRuntime = {time}
 +JobBatchName = "{jbn}"
-'''.format(de=os.path.abspath(dummy_exec_name), ld=os.path.abspath(logdir), here=os.environ['PWD'], jbn=jobBatchName, mem=memory, time=maxtime ) )
+'''.format(de=os.path.abspath(dummy_exec_name), ld=os.path.abspath(logdir), here=os.environ['PWD'], jbn=jobBatchName, mem=memory, time=maxtime, cpus=cpus ) )
     if os.environ['USER'] in ['mciprian']:
         condor_file.write('+AccountingGroup = "group_u_CMS.CAF.ALCA"\n\n')
     else:
@@ -85,7 +86,7 @@ parser.add_option("-s", "--syst", dest="syst",  type="int",     default=0,   hel
 
 pwd         = os.getcwd()
 
-if not options.njobs
+if not options.njobs:
         print "Must specify number of jobs with option -n. Abort"
         sys.exit(1)
 
@@ -588,7 +589,8 @@ If this is not the case, modify FillEpsilonPlot.cc
     if not os.path.exists(logdir): os.makedirs(logdir)
     condor_file_name = condordir+'/condor_submit_fit.condor'
     condor_file = open(condor_file_name,'w')
-    writeCondorSubmitBase(condor_file, dummy_exec.name, logdir, "ecalpro_Fit", memory=2000, maxtime=86400) # this does not close the file
+    # each fit worker is a copy of the fit job
+    writeCondorSubmitBase(condor_file, dummy_exec.name, logdir, "ecalpro_Fit", memory=2000*nFitWorkers, maxtime=86400, cpus=nFitWorkers) # this does not close the file
 
     # preparing submission of fit tasks (EB)
     if (not ONLYMERGEFIT): print 'Submitting ' + str(nEB) + ' jobs to fit the Barrel'
@@ -610,6 +612,11 @@ If this is not the case, modify FillEpsilonPlot.cc
             print eosPath + '/' + dirname + '/iter_' + str(iters) + '/' + Add_path + '/' + NameTag + 'Endcap_'+str(inte) + '_' + calibMapName
             condor_file.write('arguments = {sf} \nqueue 1 \n\n'.format(sf=os.path.abspath(fit_src_n)))
 
+    # fits of the eta and extraCalibTypes distributions, their maps are not merged
+    if (not ONLYMERGEFIT):
+        for job in extraFitJobs():
+            condor_file.write('arguments = {sf} \nqueue 1 \n\n'.format(sf=os.path.abspath(extraFitSrcName(srcPath, job[0], iters))))
+
     condor_file.close()
             
     if (not ONLYMERGEFIT ):
@@ -663,7 +670,7 @@ If this is not the case, modify FillEpsilonPlot.cc
         if not os.path.exists(logdir): os.makedirs(logdir)
         condor_file_name = condordir+'/condor_submit_fit_recovery.condor'
         condor_file = open(condor_file_name,'w')
-        writeCondorSubmitBase(condor_file, dummy_exec.name, logdir, "ecalpro_Fit_recovery", memory=2000, maxtime=86400) # this does not close the file
+        writeCondorSubmitBase(condor_file, dummy_exec.name, logdir, "ecalpro_Fit_recovery", memory=2000*nFitWorkers, maxtime=86400, cpus=nFitWorkers) # this does not close the file
         for fit in fit_src_toResub:
             condor_file.write('arguments = {sf} \nqueue 1 \n\n'.format(sf=os.path.abspath(fit)))               
         condor_file.close()
@@ -755,6 +762,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2_;\
                    Double_t fit_b3_;\
                    Double_t fit_Bnorm_;\
+                   Float_t coeffStatErr_;\
                  };")
                gROOT.ProcessLine(\
                  "struct EB1Struct{\
@@ -782,6 +790,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2;\
                    Double_t fit_b3;\
                    Double_t fit_Bnorm;\
+                   Float_t coeffStatErr;\
                  };")
 
             if(Barrel_or_Endcap=='ONLY_ENDCAP' or Barrel_or_Endcap=='ALL_PLEASE'):
@@ -810,6 +819,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2_;\
                    Double_t fit_b3_;\
                    Double_t fit_Bnorm_;\
+                   Float_t coeffStatErr_;\
                  };")
                gROOT.ProcessLine(\
                  "struct EE1Struct{\
@@ -836,6 +846,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                    Double_t fit_b2;\
                    Double_t fit_b3;\
                    Double_t fit_Bnorm;\
+                   Float_t coeffStatErr;\
                  };")
                
         if(Barrel_or_Endcap=='ONLY_BARREL' or Barrel_or_Endcap=='ALL_PLEASE'):
@@ -864,6 +875,14 @@ If this is not the case, modify FillEpsilonPlot.cc
             TreeEB = TTree("calibEB", "Tree of EB Inter-calibration constants")
             TreeEE = TTree("calibEE", "Tree of EE Inter-calibration constants")
 
+        # statistical errors of the ICs, saved by the fit of the last iteration with statReplicas
+        withStatErr = statReplicas != '' and iters == nIterations-1
+        withStatErrMaps = withStatErr and not (isEoverEtrue and n_repeat == 1)
+        if withStatErrMaps:
+            statErr_EB = TH2F("statErr_EB", "EB IC statistical errors: #eta on x, #phi on y", 171,-85.5,85.5 , 360,0.5,360.5)
+            statErr_EEm = TH2F("statErr_EEm", "EE- IC statistical errors", 100,0.5,100.5,100,0.5,100.5)
+            statErr_EEp = TH2F("statErr_EEp", "EE+ IC statistical errors", 100,0.5,100.5,100,0.5,100.5)
+
         if(Barrel_or_Endcap=='ONLY_BARREL' or Barrel_or_Endcap=='ALL_PLEASE'):
            TreeEB.Branch('rawId_'      , AddressOf(s,'rawId_'),'rawId_/I')
            TreeEB.Branch('hashedIndex_', AddressOf(s,'hashedIndex_'),'hashedIndex_/I')
@@ -881,6 +900,8 @@ If this is not the case, modify FillEpsilonPlot.cc
            TreeEB.Branch('fit_mean_'   , AddressOf(s,'fit_mean_'),'fit_mean_/F')
            TreeEB.Branch('fit_mean_err_'   , AddressOf(s,'fit_mean_err_'),'fit_mean_err_/F')
            TreeEB.Branch('fit_sigma_'  , AddressOf(s,'fit_sigma_'),'fit_sigma_/F')
+           if withStatErr:
+               TreeEB.Branch('coeffStatErr_', AddressOf(s,'coeffStatErr_'),'coeffStatErr_/F')
            if not isEoverEtrue:
                TreeEB.Branch('Signal_'     , AddressOf(s,'Signal_'),'Signal_/F')
                TreeEB.Branch('Backgr_'     , AddressOf(s,'Backgr_'),'Backgr_/F')
@@ -908,6 +929,8 @@ If this is not the case, modify FillEpsilonPlot.cc
            TreeEE.Branch('fit_mean_'   , AddressOf(t,'fit_mean_'),'fit_mean_/F')
            TreeEE.Branch('fit_mean_err_'   , AddressOf(t,'fit_mean_err_'),'fit_mean_err_/F')
            TreeEE.Branch('fit_sigma_'  , AddressOf(t,'fit_sigma_'),'fit_sigma_/F')
+           if withStatErr:
+               TreeEE.Branch('coeffStatErr_', AddressOf(t,'coeffStatErr_'),'coeffStatErr_/F')
            if not isEoverEtrue:
                TreeEE.Branch('Signal_'     , AddressOf(t,'Signal_'),'Signal_/F')
                TreeEE.Branch('Backgr_'     , AddressOf(t,'Backgr_'),'Backgr_/F')
@@ -963,6 +986,9 @@ If this is not the case, modify FillEpsilonPlot.cc
                thisTree.SetBranchAddress( 'fit_mean',AddressOf(s1,'fit_mean'));
                thisTree.SetBranchAddress( 'fit_mean_err',AddressOf(s1,'fit_mean_err'));
                thisTree.SetBranchAddress( 'fit_sigma',AddressOf(s1,'fit_sigma'));
+               hasStatErr = withStatErr and bool(thisTree.GetBranch('coeffStatErr'))
+               if hasStatErr:
+                   thisTree.SetBranchAddress( 'coeffStatErr',AddressOf(s1,'coeffStatErr'));
                if not isEoverEtrue:
                    thisTree.SetBranchAddress( 'Signal',AddressOf(s1,'Signal'));
                    thisTree.SetBranchAddress( 'Backgr',AddressOf(s1,'Backgr'));
@@ -991,6 +1017,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                        s.fit_mean_ = s1.fit_mean
                        s.fit_mean_err_ = s1.fit_mean_err
                        s.fit_sigma_ = s1.fit_sigma
+                       s.coeffStatErr_ = s1.coeffStatErr if hasStatErr else 0.
                        if not isEoverEtrue:
                            s.Signal_ = s1.Signal
                            s.Backgr_ = s1.Backgr
@@ -1021,6 +1048,9 @@ If this is not the case, modify FillEpsilonPlot.cc
                thisTree.SetBranchAddress( 'fit_mean',AddressOf(t1,'fit_mean'));
                thisTree.SetBranchAddress( 'fit_mean_err',AddressOf(t1,'fit_mean_err'));
                thisTree.SetBranchAddress( 'fit_sigma',AddressOf(t1,'fit_sigma'));
+               hasStatErr = withStatErr and bool(thisTree.GetBranch('coeffStatErr'))
+               if hasStatErr:
+                   thisTree.SetBranchAddress( 'coeffStatErr',AddressOf(t1,'coeffStatErr'));
                if not isEoverEtrue:
                    thisTree.SetBranchAddress( 'Signal',AddressOf(t1,'Signal'));
                    thisTree.SetBranchAddress( 'Backgr',AddressOf(t1,'Backgr'));
@@ -1048,6 +1078,7 @@ If this is not the case, modify FillEpsilonPlot.cc
                        t.fit_mean_ = t1.fit_mean
                        t.fit_mean_err_ = t1.fit_mean_err
                        t.fit_sigma_ = t1.fit_sigma
+                       t.coeffStatErr_ = t1.coeffStatErr if hasStatErr else 0.
                        if not isEoverEtrue:
                            t.Signal_ = t1.Signal
                            t.Backgr_ = t1.Backgr
@@ -1067,6 +1098,10 @@ If this is not the case, modify FillEpsilonPlot.cc
                 thisHistoEB = thisfile_f.Get("calibMap_EB")
                 thisHistoEEm = thisfile_f.Get("calibMap_EEm")
                 thisHistoEEp = thisfile_f.Get("calibMap_EEp")
+            if withStatErrMaps:
+                thisStatErrEB = thisfile_f.Get("statErr_EB")
+                thisStatErrEEm = thisfile_f.Get("statErr_EEm")
+                thisStatErrEEp = thisfile_f.Get("statErr_EEp")
             if EEoEB == 0:
                MaxEta = 85
                Init = int(init)
@@ -1082,6 +1117,8 @@ If this is not the case, modify FillEpsilonPlot.cc
                                bin_y = myRechit.iphi()
                                value = thisHistoEB.GetBinContent(bin_x,bin_y)
                                calibMap_EB.SetBinContent(bin_x,bin_y,value)
+                               if withStatErrMaps and thisStatErrEB:
+                                   statErr_EB.SetBinContent(bin_x,bin_y,thisStatErrEB.GetBinContent(bin_x,bin_y))
                    else:
                        if nFitB < 61200:
                            myRechit = EBDetId( EBDetId.detIdFromDenseIndex(nFitB) )
@@ -1089,6 +1126,8 @@ If this is not the case, modify FillEpsilonPlot.cc
                            bin_y = myRechit.iphi()
                            value = thisHistoEB.GetBinContent(bin_x,bin_y)
                            calibMap_EB.SetBinContent(bin_x,bin_y,value)
+                           if withStatErrMaps and thisStatErrEB:
+                               statErr_EB.SetBinContent(bin_x,bin_y,thisStatErrEB.GetBinContent(bin_x,bin_y))
             else :
                Init1 = int(init)
                Fin1 = int(finit+1)
@@ -1098,9 +1137,13 @@ If this is not the case, modify FillEpsilonPlot.cc
                       if myRechitE.zside() < 0 :
                          value = thisHistoEEm.GetBinContent(myRechitE.ix(),myRechitE.iy())
                          calibMap_EEm.SetBinContent(myRechitE.ix(),myRechitE.iy(),value)
+                         if withStatErrMaps and thisStatErrEEm:
+                             statErr_EEm.SetBinContent(myRechitE.ix(),myRechitE.iy(),thisStatErrEEm.GetBinContent(myRechitE.ix(),myRechitE.iy()))
                       if myRechitE.zside() > 0 :
                          value = thisHistoEEp.GetBinContent(myRechitE.ix(),myRechitE.iy())
                          calibMap_EEp.SetBinContent(myRechitE.ix(),myRechitE.iy(),value)
+                         if withStatErrMaps and thisStatErrEEp:
+                             statErr_EEp.SetBinContent(myRechitE.ix(),myRechitE.iy(),thisStatErrEEp.GetBinContent(myRechitE.ix(),myRechitE.iy()))
 
             thisfile_f.Close()
 
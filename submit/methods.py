@@ -15,14 +15,6 @@ def printFillCfg1( outputfile ):
     outputfile.write('process.load("FWCore.MessageService.MessageLogger_cfi")\n\n')
     outputfile.write('process.load("Configuration.Geometry.GeometryIdeal_cff")\n')
 
-    # if (nThread > 1 ):
-    #     outputfile.write("\n")
-    #     outputfile.write("process.options = cms.untracked.PSet(\n")
-    #     outputfile.write("    numberOfThreads = cms.untracked.uint32( 4 ),\n")
-    #     outputfile.write("    numberOfStreams = cms.untracked.uint32( 0 ),\n")
-    #     outputfile.write("    sizeOfStackForThreadsInKB = cms.untracked.uint32( 10*1024 )\n")
-    #     outputfile.write(")\n\n")
-
 
     outputfile.write('process.load("Configuration.StandardSequences.FrontierConditions_GlobalTag_condDBv2_cff")\n')
     #outputfile.write('process.load("Configuration.StandardSequences.FrontierConditions_GlobalTag_cff")\n')
@@ -194,6 +186,10 @@ def printFillCfg1( outputfile ):
     # outputfile.write(")\n")
     outputfile.write("process.options = cms.untracked.PSet(\n")
     outputfile.write("   wantSummary = cms.untracked.bool(True),\n")
+    if (nThread > 1 ):
+        outputfile.write("   numberOfThreads = cms.untracked.uint32( " + str(nThread) + " ),\n")
+        outputfile.write("   numberOfStreams = cms.untracked.uint32( 0 ),\n")
+        outputfile.write("   sizeOfStackForThreadsInKB = cms.untracked.uint32( 10*1024 ),\n")
     outputfile.write(")\n")
     outputfile.write("process.source = cms.Source('PoolSource',\n")
     #outputfile.write("                            inputCommands = cms.untracked.vstring( #type_Module_instance_process\n")
@@ -331,7 +327,19 @@ def printFillCfg2( outputfile, pwd , iteration, outputDir, ijob ):
             outputfile.write("process.analyzerFillEpsilon.fileEoverEtrueContainmentCorrections = cms.untracked.string(\"\")\n")
 
 
-        outputfile.write("process.analyzerFillEpsilon.useOnlyEEClusterMatchedWithES = cms.untracked.bool(" + useOnlyEEClusterMatchedWithES + ")\n\n")
+        outputfile.write("process.analyzerFillEpsilon.useOnlyEEClusterMatchedWithES = cms.untracked.bool(" + useOnlyEEClusterMatchedWithES + ")\n")
+        if profileFillStages:
+            outputfile.write("process.analyzerFillEpsilon.profileStages = cms.untracked.bool(True)\n")
+        if eventStoreOutput != '':
+            outputfile.write("process.analyzerFillEpsilon.EventStoreOutput = cms.untracked.string('" + eventStoreOutput + "')\n")
+        if candidateStoreOutput != '':
+            outputfile.write("process.analyzerFillEpsilon.CandidateStoreOutput = cms.untracked.string('" + candidateStoreOutput + "')\n")
+        if statReplicas != '' and iteration == nIterations-1:
+            outputfile.write("process.analyzerFillEpsilon.StatReplicas = cms.untracked.string('" + statReplicas + "')\n")
+            outputfile.write("process.analyzerFillEpsilon.nStatReplicas = cms.untracked.int32(" + str(nStatReplicas) + ")\n")
+        if len(iovBoundaries) > 0 and iteration == nIterations-1:
+            outputfile.write("process.analyzerFillEpsilon.IOVBoundaries = cms.untracked.vstring(" + ", ".join("'" + b + "'" for b in iovBoundaries) + ")\n")
+        outputfile.write("\n")
 
         outputfile.write("### choosing proper input tag (recalibration module changes the collection names)\n")
         outputfile.write("if correctHits:\n")
@@ -345,6 +353,8 @@ def printFillCfg2( outputfile, pwd , iteration, outputDir, ijob ):
         outputfile.write("process.analyzerFillEpsilon.triggerTag   = cms.untracked." + triggerTag + "\n")
         outputfile.write("process.analyzerFillEpsilon.L1GTobjmapTag   = cms.untracked." + L1GTobjmapTag + "\n")
         outputfile.write("process.analyzerFillEpsilon.CalibType    = cms.untracked.string('" + CalibType + "')\n")
+        if extraCalibTypes:
+            outputfile.write("process.analyzerFillEpsilon.ExtraCalibTypes = cms.untracked.vstring(" + ", ".join("'" + t + "'" for t in extraCalibTypes) + ")\n")
         outputfile.write("process.analyzerFillEpsilon.CurrentIteration = cms.untracked.int32(" + str(iteration) + ")\n")
         if( EB_Seed_E!='' ):
             outputfile.write("process.analyzerFillEpsilon.EB_Seed_E = cms.untracked.double(" + EB_Seed_E + ")\n")
@@ -384,6 +394,13 @@ def printFillCfg2( outputfile, pwd , iteration, outputDir, ijob ):
         outputfile.write("process.analyzerFillEpsilon.S4S9_EE_low = cms.untracked.double(" + S4S9_EE_low + ")\n")
         outputfile.write("process.analyzerFillEpsilon.S4S9_EE_high = cms.untracked.double(" + S4S9_EE_high + ")\n")
         outputfile.write("process.analyzerFillEpsilon.Barrel_orEndcap = cms.untracked.string('" + Barrel_or_Endcap + "')\n")
+        if fillEtaAlongPi0 and Are_pi0:
+            outputfile.write("process.analyzerFillEpsilon.FillEtaAlongPi0 = cms.untracked.bool(True)\n")
+            outputfile.write("process.analyzerFillEpsilon.EtaSelection = cms.untracked.PSet(\n")
+            for name in sorted(etaSelection):
+                kind = "int32" if name.startswith("nXtal") else "double"
+                outputfile.write("    " + name + " = cms.untracked." + kind + "(" + etaSelection[name] + "),\n")
+            outputfile.write(")\n")
         if(useJsonFilterInCpp and len(json_file)>0):
            if json_file.startswith('/afs/cern.ch/'): 
                outputfile.write("process.analyzerFillEpsilon.JSONfile = cms.untracked.string('" + json_file + "')\n")
@@ -452,7 +469,7 @@ def printFillCfg2( outputfile, pwd , iteration, outputDir, ijob ):
     else:
         outputfile.write("process.endp = cms.EndPath()\n")
 
-def printFitCfg( outputfile, iteration, outputDir, nIn, nFin, EBorEE, nFit, justDoHistogramFolding=False ):
+def printFitCfg( outputfile, iteration, outputDir, nIn, nFin, EBorEE, nFit, justDoHistogramFolding=False, iov=-1, eta=False, calibType=None ):
     if isEoverEtrue and localFolderToWriteFits:
         outputDir = outputDir.replace("/tmp",localFolderToWriteFits)
     outputfile.write("import FWCore.ParameterSet.Config as cms\n")
@@ -461,15 +478,34 @@ def printFitCfg( outputfile, iteration, outputDir, nIn, nFin, EBorEE, nFit, just
     outputfile.write("process.maxEvents = cms.untracked.PSet( input = cms.untracked.int32(1) )\n")
     outputfile.write("process.source =   cms.Source('EmptySource')\n")
     outputfile.write("process.fitEpsilon = cms.EDAnalyzer('FitEpsilonPlot')\n")
-    outputfile.write("process.fitEpsilon.OutputFile = cms.untracked.string('" + NameTag + EBorEE + "_" + str(nFit) + "_" + calibMapName + "')\n")
-    outputfile.write("process.fitEpsilon.CalibType = cms.untracked.string('" + CalibType + "')\n")
+    # eta distributions filled along the pi0 ones (fillEtaAlongPi0)
+    etaTag = "_eta" if eta else ""
+    # or one of the extraCalibTypes granularities filled along CalibType (only for the Are_pi0 selection)
+    if calibType and calibType != CalibType:
+        if eta:
+            raise ValueError("printFitCfg: the extraCalibTypes granularities are not filled for the eta selection, eta=True cannot be used with calibType='" + calibType + "'")
+        etaTag += "_" + calibType
+    if iov >= 0:
+        outputfile.write("process.fitEpsilon.OutputFile = cms.untracked.string('" + NameTag + EBorEE + "_" + str(nFit) + etaTag + "_iov" + str(iov) + "_" + calibMapName + "')\n")
+        outputfile.write("process.fitEpsilon.IOV = cms.untracked.int32(" + str(iov) + ")\n")
+    else:
+        outputfile.write("process.fitEpsilon.OutputFile = cms.untracked.string('" + NameTag + EBorEE + "_" + str(nFit) + etaTag + "_" + calibMapName + "')\n")
+    if eta:
+        outputfile.write("process.fitEpsilon.EpsilonPlotPrefix = cms.untracked.string('eta_')\n")
+    if calibType and calibType != CalibType:
+        outputfile.write("process.fitEpsilon.EpsilonPlotPrefix = cms.untracked.string('" + calibType + "_')\n")
+        outputfile.write("process.fitEpsilon.CalibType = cms.untracked.string('" + calibType + "')\n")
+        # the IC map of the iteration is per crystal: the output map of this fit holds only the correction factors of the regions
+        outputfile.write("process.fitEpsilon.StartFromUnitMap = cms.untracked.bool(True)\n")
+    else:
+        outputfile.write("process.fitEpsilon.CalibType = cms.untracked.string('" + CalibType + "')\n")
     outputfile.write("process.fitEpsilon.OutputDir = cms.untracked.string('" +  outputDir + "')\n")
     outputfile.write("process.fitEpsilon.CurrentIteration = cms.untracked.int32(" + str(iteration) + ")\n")
     outputfile.write("process.fitEpsilon.NInFit = cms.untracked.int32(" + str(nIn) + ")\n")
     outputfile.write("process.fitEpsilon.NFinFit = cms.untracked.int32(" + str(nFin) + ")\n")
     outputfile.write("process.fitEpsilon.EEorEB = cms.untracked.string('" + EBorEE + "')\n")
     outputfile.write("process.fitEpsilon.isNot_2010 = cms.untracked.bool(" + isNot_2010 + ")\n")
-    if(Are_pi0):
+    if(Are_pi0 and not eta):
         outputfile.write("process.fitEpsilon.Are_pi0 = cms.untracked.bool( True )\n")
     else:
         outputfile.write("process.fitEpsilon.Are_pi0 = cms.untracked.bool( False )\n")
@@ -491,12 +527,17 @@ def printFitCfg( outputfile, iteration, outputDir, nIn, nFin, EBorEE, nFit, just
     else:
         outputfile.write("process.fitEpsilon.isEoverEtrue = cms.untracked.bool(False)\n")
     outputfile.write("process.fitEpsilon.StoreForTest = cms.untracked.bool( True )\n")
+    if nFitWorkers > 1:
+        outputfile.write("process.fitEpsilon.nFitWorkers = cms.untracked.int32(" + str(nFitWorkers) + ")\n")
     if foldInSuperModule:
         outputfile.write("process.fitEpsilon.foldInSuperModule = cms.untracked.bool(True)\n")
     else:
         outputfile.write("process.fitEpsilon.foldInSuperModule = cms.untracked.bool(False)\n")
     if useFit_RooMinuit:
         outputfile.write("process.fitEpsilon.useFit_RooMinuit = cms.untracked.bool( True )\n")        
+    # no replicas are filled for the extraCalibTypes granularities
+    if statReplicas != '' and iteration == nIterations-1 and not (calibType and calibType != CalibType):
+        outputfile.write("process.fitEpsilon.StatReplicas = cms.untracked.string('" + statReplicas + "')\n")
     outputfile.write("process.fitEpsilon.Barrel_orEndcap = cms.untracked.string('" + Barrel_or_Endcap + "')\n")
     if not(isCRAB): #If CRAB you have to put the correct path, and you do it on calibJobHandler.py, not on ./submitCalibration.py
         outputfile.write("process.fitEpsilon.EpsilonPlotFileName = cms.untracked.string('" + eosPath + "/" + dirname + "/iter_" + str(iteration) + "/" + NameTag + "epsilonPlots.root')\n")
@@ -545,6 +586,73 @@ def printSubmitFitSrc(outputfile, cfgName, source, destination, pwd, logpath, ju
         outputfile.write("echo 'rm -f " + sourcerooplot + "' >> " + logpath + " \n")
         outputfile.write("rm -f " + sourcerooplot + " >> " + logpath + " 2>&1 \n")
 
+# fits of the distributions filled along the nominal ones, as (eta, calibType, tag of their files): the eta
+# selection with fillEtaAlongPi0 and the extraCalibTypes granularities. Their maps are not merged in the
+# calibMap of the iteration, each fit job copies its own to the iteration directory
+def extraFits():
+    fits = []
+    if Are_pi0 and fillEtaAlongPi0:
+        fits.append((True, CalibType, "_eta"))
+    for calibType in extraCalibTypes:
+        if calibType != CalibType:
+            fits.append((False, calibType, "_" + calibType))
+    return fits
+
+# regions in EB and EE of each granularity (CalibTools/interface/EcalCalibTypes.h)
+nRegionsOfCalibType = { 'xtal' : (61200, 14648), 'tt' : (2448, 1), 'etaring' : (170, 78) }
+
+# first and last region of the fit jobs of EBorEE ('Barrel' or 'Endcap') for a granularity, nFit regions per job
+def fitJobRanges(EBorEE, calibType):
+    if Barrel_or_Endcap == ("ONLY_ENDCAP" if EBorEE == "Barrel" else "ONLY_BARREL"):
+        return []
+    nRegions = nRegionsOfCalibType[calibType][0 if EBorEE == "Barrel" else 1]
+    if EBorEE == "Barrel" and calibType == 'xtal' and foldInSuperModule:
+        nRegions = 1700
+    return [(first, min(first + nFit, nRegions) - 1) for first in range(0, nRegions, nFit)]
+
+# fit jobs of extraFits() as (name, EBorEE, index, first region, last region, eta, calibType, tag);
+# the source file of a job is srcPath/Fit/submit_<name>_iter_<iteration>.sh
+def extraFitJobs():
+    jobs = []
+    for eta, calibType, tag in extraFits():
+        for EBorEE in ["Barrel", "Endcap"]:
+            for k, (nIn, nFin) in enumerate(fitJobRanges(EBorEE, calibType)):
+                name = ("EB_" if EBorEE == "Barrel" else "EE_") + str(k) + tag
+                jobs.append((name, EBorEE, k, nIn, nFin, eta, calibType, tag))
+    return jobs
+
+def extraFitSrcName(srcPath, name, iteration):
+    return srcPath + "/Fit/submit_" + name + "_iter_" + str(iteration) + ".sh"
+
+def printExtraFitJobs(iteration, cfgFitPath, srcPath, pwd):
+    for name, EBorEE, k, nIn, nFin, eta, calibType, tag in extraFitJobs():
+        fit_cfg_n = cfgFitPath + "/fitEpsilonPlot_" + name + "_iter_" + str(iteration) + ".py"
+        fit_cfg_f = open(fit_cfg_n, 'w')
+        printFitCfg(fit_cfg_f, iteration, "/tmp", nIn, nFin, EBorEE, k, eta=eta, calibType=calibType)
+        fit_cfg_f.close()
+        # as the OutputFile of printFitCfg
+        mapName = NameTag + EBorEE + "_" + str(k) + tag + "_" + calibMapName
+        fitSrc_n = extraFitSrcName(srcPath, name, iteration)
+        fitSrc_f = open(fitSrc_n, 'w')
+        logpath = pwd + "/" + dirname + "/log/fitEpsilonPlot_" + name + "_iter_" + str(iteration) + ".log"
+        printSubmitFitSrc(fitSrc_f, fit_cfg_n, "/tmp/" + mapName, eosPath + '/' + dirname + '/iter_' + str(iteration) + "/" + mapName, pwd, logpath)
+        fitSrc_f.close()
+        os.chmod(fitSrc_n, 0777)
+
+def printStoreCopy(outputfile, source, destination, redirect):
+    # rechit and candidate stores of the job, one file per stream named after its output (see FillEpsilonPlot::streamFileName)
+    for store in [eventStoreOutput, candidateStoreOutput]:
+        if store == '':
+            continue
+        storeFiles = source.replace(".root", "") + "_" + store.replace(".root", "") + "_*.root"
+        destinationDir = destination[:destination.rfind('/')]
+        outputfile.write("for f in " + storeFiles + "; do\n")
+        outputfile.write("    test -f ${f} || continue\n")
+        outputfile.write("    echo \"eos cp ${f} " + destinationDir + "/\"" + redirect + "\n")
+        outputfile.write("    eos cp ${f} " + destinationDir + "/" + redirect + "\n")
+        outputfile.write("    rm -f ${f}\n")
+        outputfile.write("done\n")
+
 def printSubmitSrc(outputfile, cfgName, source, destination, pwd, logpath):
     outputfile.write("#!/bin/bash\n")
     outputfile.write("export XRD_NETWORKSTACK=IPv4\n")
@@ -581,6 +689,7 @@ def printSubmitSrc(outputfile, cfgName, source, destination, pwd, logpath):
         outputfile.write("else\n")
         outputfile.write("    echo 'file did not exist in /tmp/ (probably it was bad and deleted already'\n")
         outputfile.write("fi\n")
+        printStoreCopy(outputfile, source, destination, "")
     else:
         outputfile.write("echo 'cmsRun " + cfgName + " 2>&1 | awk {quote}/FILL_COUT:/{quote}' > " + logpath  + "\n")
         outputfile.write("cmsRun " + cfgName + " 2>&1 | awk '/FILL_COUT:/' >> " + logpath  + "\n")
@@ -590,6 +699,7 @@ def printSubmitSrc(outputfile, cfgName, source, destination, pwd, logpath):
         outputfile.write("eos cp " + source + " " + destination + " >> " + logpath + " 2>&1 \n")
         outputfile.write("echo 'rm -f " + source + "' >> " + logpath + " \n")
         outputfile.write("rm -f " + source + " >> " + logpath + " 2>&1 \n")
+        printStoreCopy(outputfile, source, destination, " >> " + logpath + " 2>&1")
     if len(copiedCCfile):
         outputfile.write("echo 'rm -f " + copiedCCfile + "'\n")
         outputfile.write("rm -f " + copiedCCfile + "\n")        
@@ -68,11 +68,17 @@ if justCreateRecHits:
    nIterations = 1
 if MakeNtuple4optimization:
    nIterations = 1
-#nThread          = 4 # if bigger than 1, enable multithreading, but I'm not sure if ECALpro supports it (see methods.py searching nThread)
+nThread          = 1 # threads of each fill job: if bigger than 1, FillEpsilonPlot runs with one stream per thread and merges them at the end
+profileFillStages = False # time the stages of FillEpsilonPlot, summary in the output file and in a _profile.json next to it
+eventStoreOutput = '' # if not empty, each fill job also writes its selected rechits to <output file>_<name>_<stream>.root, copied to eos next to the output, to be replayed with replayFillEpsilon --eventStore
+candidateStoreOutput = '' # if not empty, each fill job also writes its preselected photon pairs to <output file>_<name>_<stream>.root, copied to eos next to the output, to be refilled with a new IC map by replayCandidates
 
 SubmitFurtherIterationsFromExisting = False
 # maybe I don't need the root://eoscms/ prefix if eos is mounted
 startingCalibMap = 'root://eoscms//eos/cms/store/group/dpg_ecal/alca_ecalcalib/piZero_Run2/mciprian/AlCaEta_2018_tagAsPi0ForULcalibration_v2/iter_4/AlCaEta_2018_tagAsPi0ForULcalibration_v2_calibMap.root' # used  only if SubmitFurtherIterationsFromExisting is True
+statReplicas = '' # 'evenOdd' or 'bootstrap': the last iteration also fills replicas of the mass distributions in the same pass and the fit saves the statistical error of the ICs (replaces resubmitting it with SystOrNot = 1 and 2)
+nStatReplicas = 10 # number of bootstrap replicas (evenOdd has always 2)
+iovBoundaries = [] # e.g. ['315252', '316000:120']: the last iteration also fills the mass distributions of each IOV (from a boundary to the next one), fitted with printFitCfg(..., iov=k)
 SystOrNot = 0 # can be 0, 1 or 2 to run on all (default), even or odd events. It works only if you submit this new iteration from an existing one, therefore SubmitFurtherIterationsFromExisting must be set true. Tipically 0 is the default and has no real effect, it is like submitting usual iterations.  
 
 #N files
@@ -80,7 +86,7 @@ ijobmax          = 2 if isMC==False else 1  # 5 number of files per job, 1 for M
 if justCreateRecHits:
    ijobmax = 1 # when recreating rechits from digis, keep same correspondance of files 
 nHadd            = 35 #35                    # 35 number of files per hadd
-nFit             = 2000 if isMC==False else 10                 # number of fits done in parallel
+nFit             = 2000 if isMC==False else 10                 # number of fits done in parallel (per worker, see nFitWorkers)
 useFit_RooMinuit = False if isEoverEtrue else True # if True the fit is done with RooMinuit, otherwise with RooMinimizer. The former is obsolete, but the latter can lead to a CMSSW error which makes the job fail, creating large white strips in the map. This happens often because the fit sees a negative PDF at the border of the fit range, RooFit will try to adjust the fit range to avoid the unphysical region, but after few trials CMSSW throws an error: without CMSSW the fit should actually be able to try several thousands of times before failing
 # However, at least from CMSSW_10_2_X, for EoverEtrue with fits using RooCMSshape+double-Crystal-Ball the fits are much better, so let's use RooMinimizer in that case
 Barrel_or_Endcap = 'ALL_PLEASE'          # Option: 'ONLY_BARREL','ONLY_ENDCAP','ALL_PLEASE'
@@ -350,6 +356,33 @@ else:
          nXtal_2_EE_high = '0'
          S4S9_EE_high = '0.9'
 
+# with Are_pi0, the eta selection is also evaluated in the same jobs (each selection on its own clusters,
+# the pi0 results are those of a pi0-only job) and fills eta_epsilon_EB_iR and eta_epsilon_EE_iR,
+# fitted with printFitCfg(..., eta=True); the cuts are those of the eta calibration above (also the --eta defaults
+# of replayCandidates, EcalReplaySetup::defaultCuts)
+fillEtaAlongPi0 = False
+etaSelection = {
+   'Pi0PtCutEB_low' : '3.0', 'gPtCutEB_low' : '1.0', 'Pi0IsoCutEB_low' : '0.0', 'Pi0HLTIsoCutEB_low' : '0.5',
+   'nXtal_1_EB_low' : '7', 'nXtal_2_EB_low' : '6', 'S4S9_EB_low' : '0.85',
+   'Pi0PtCutEB_high' : '3.0', 'gPtCutEB_high' : '1.0', 'Pi0IsoCutEB_high' : '0.0', 'Pi0HLTIsoCutEB_high' : '0.5',
+   'nXtal_1_EB_high' : '7', 'nXtal_2_EB_high' : '6', 'S4S9_EB_high' : '0.85',
+   'Pi0PtCutEE_low' : '3.0', 'gPtCutEE_low' : '0.7', 'Pi0IsoCutEE_low' : '0.0', 'Pi0HLTIsoCutEE_low' : '0.5',
+   'nXtal_1_EE_low' : '7', 'nXtal_2_EE_low' : '6', 'S4S9_EE_low' : '0.85',
+   'Pi0PtCutEE_high' : '3.0', 'gPtCutEE_high' : '0.6', 'Pi0IsoCutEE_high' : '0.0', 'Pi0HLTIsoCutEE_high' : '0.5',
+   'nXtal_1_EE_high' : '7', 'nXtal_2_EE_high' : '6', 'S4S9_EE_high' : '0.85',
+}
+
+# granularities ('xtal', 'tt', 'etaring') filled by the same fill jobs next to CalibType, as <type>_epsilon_EB_iR and
+# <type>_epsilon_EE_iR (nominal distributions only, pi0 selection); fitted with printFitCfg(..., calibType='tt'),
+# whose output map holds the correction factors of the regions instead of ICs
+extraCalibTypes = []
+
+# worker processes making the mass fits of the regions of a fit job (1: fitted one after the other in the job);
+# each worker is a copy of the fit job, the condor fit jobs ask for as many cpus and 2000 MB each
+nFitWorkers = 1
+# a fit job with workers takes nFit regions per worker, so there are nFitWorkers times fewer fit jobs
+nFit = nFit*nFitWorkers
+
 #containment corrections (these are set below)
 useContainmentCorrectionsFromEoverEtrue = False
 fileEoverEtrueContainmentCorrections = ""
@@ -208,11 +208,11 @@ finListB = list()
 inListE = list()
 finListE = list()
 for tmp in range(nEB):
-    inListB.append( 2000*tmp )
-    finListB.append( 2000*tmp+1999 )
+    inListB.append( nFit*tmp )
+    finListB.append( nFit*tmp+(nFit-1) )
 for tmp in range(nEE):
-    inListE.append( 2000*tmp )
-    finListE.append( 2000*tmp+1999 )
+    inListE.append( nFit*tmp )
+    finListE.append( nFit*tmp+(nFit-1) )
     # cfg
 for it in range(nIterations):
     print "[calib]  '-- Fit::Iteration " + str(it)
@@ -265,6 +265,9 @@ for it in range(nIterations):
         changePermission = subprocess.Popen(['chmod 777 ' + fitSrc_n], stdout=subprocess.PIPE, shell=True);
         debugout = changePermission.communicate()
 
+    # fits of the eta and extraCalibTypes distributions, split over the regions of their granularity
+    printExtraFitJobs(it, cfgFitPath, srcPath, pwd)
+
 ### setting environment
 env_script_n = workdir + "/submit.sh"
 env_script_f = open(env_script_n, 'w')
@@ -302,6 +302,9 @@ for it in range(nIterations):
         changePermission = subprocess.Popen(['chmod 777 ' + fitSrc_n], stdout=subprocess.PIPE, shell=True);
         debugout = changePermission.communicate()
 
+    # fits of the eta and extraCalibTypes distributions, split over the regions of their granularity
+    printExtraFitJobs(it, cfgFitPath, srcPath, pwd)
+
 #build command with options and arguments
 calibCMD = "python " + pwd + "/calibJobHandlerCondor.py -n " + str(njobs)
 if options.recoverFill: calibCMD += " --recover-fill "